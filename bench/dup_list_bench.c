@@ -0,0 +1,204 @@
+// Microbenchmark of the duplicate packet detection structure (-D), see dup_list.h
+// The sliding window bitmap of dup_list.c is compared with the previous dupStoreList implementation (a copy of which is
+// kept below, as legacyDupSL_*), over the same sequence of (reconstructed) sequence numbers, with gaps (lost packets) and
+// reordered repetitions (duplicated packets)
+// For each structure, the average time per insert/check, the distribution of the time taken by each block of BENCH_BLOCK
+// consecutive operations (to highlight the latency spikes) and the number of detected duplicates (against the exact number)
+// are printed
+// Build with 'make bench' and run as: bench/dup_list_bench [number of sequence numbers]
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dup_list.h"
+
+// Same window used by reportStructureInit() (SEQUENCE_NUMBERS_RESET_THRESHOLD)
+#define BENCH_WINDOW 10000
+#define BENCH_DEF_SEQ_NUMBERS 50000000
+#define BENCH_BLOCK 64
+// Probability (in %) of a gap (i.e. of a lost packet) and of a repetition of one of the last BENCH_MAX_REORDER sequence numbers
+#define BENCH_GAP_PERC 2
+#define BENCH_DUP_PERC 1
+#define BENCH_MAX_REORDER 100
+
+// Previous dupStoreList implementation (array of 2*size {seqNo, occupied} nodes, with a current and a past half)
+struct legacyDupStoreListNode {
+	unsigned int seqNo;
+	unsigned int occupied;
+	struct legacyDupStoreListNode *next;
+};
+
+struct legacyDupStoreList {
+	struct legacyDupStoreListNode *array;
+	int size;
+	int8_t past_list_pos;
+};
+
+static void legacyDupSL_reset(struct legacyDupStoreList *DSL) {
+	int start_i = DSL->past_list_pos==0 ? 0 : DSL->size;
+	int stop_i = DSL->past_list_pos==0 ? DSL->size : DSL->size*2;
+
+	for(int i=start_i;i<stop_i;i++) {
+		DSL->array[i].occupied=0;
+	}
+
+	DSL->past_list_pos=DSL->past_list_pos==0 ? 1 : 0;
+}
+
+static int legacyDupSL_insertandcheck(struct legacyDupStoreList *DSL, unsigned int seqNo) {
+	unsigned int seqNoHash=seqNo % DSL->size;
+	unsigned int pastSeqNoHash;
+
+	if(DSL->past_list_pos!=-1) {
+		pastSeqNoHash=DSL->past_list_pos==1 ? seqNoHash+DSL->size : seqNoHash;
+
+		if(DSL->array[pastSeqNoHash].occupied==1 && seqNo==DSL->array[pastSeqNoHash].seqNo) {
+			return DSL_FOUND;
+		}
+	}
+
+	if(DSL->past_list_pos==0) {
+		seqNoHash+=DSL->size;
+	}
+
+	if(DSL->array[seqNoHash].occupied==0) {
+		DSL->array[seqNoHash].occupied=1;
+		DSL->array[seqNoHash].seqNo=seqNo;
+		return DSL_NOTFOUND;
+	}
+
+	if(seqNo==DSL->array[seqNoHash].seqNo) {
+		return DSL_FOUND;
+	} else {
+		int newSeqNoHash = DSL->past_list_pos==0 ? seqNoHash-DSL->size : seqNoHash+DSL->size;
+
+		legacyDupSL_reset(DSL);
+
+		if(DSL->array[newSeqNoHash].occupied==0) {
+			DSL->array[newSeqNoHash].occupied=1;
+			DSL->array[newSeqNoHash].seqNo=seqNo;
+			return DSL_NOTFOUND;
+		}
+
+		return DSL_POSCONFLICT;
+	}
+}
+
+static inline uint64_t nowNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+
+	return (uint64_t) ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+static int bitmapInsertAndCheck(void *DSL, uint64_t seqNo) {
+	return dupSL_insertandcheck((dupStoreList) DSL,seqNo);
+}
+
+static int legacyInsertAndCheck(void *DSL, uint64_t seqNo) {
+	return legacyDupSL_insertandcheck((struct legacyDupStoreList *) DSL,(unsigned int) seqNo);
+}
+
+static int compareU64(const void *a, const void *b) {
+	uint64_t va=*(const uint64_t *) a;
+	uint64_t vb=*(const uint64_t *) b;
+
+	return (va>vb)-(va<vb);
+}
+
+// Insert all the 'n' sequence numbers of 'seq', timing each block of BENCH_BLOCK operations, and print the results
+static void benchRun(const char *name, int (*insertandcheck)(void *, uint64_t), void *DSL, uint64_t *seq, uint64_t n, uint64_t expected, uint64_t *blocks) {
+	uint64_t nblocks=n/BENCH_BLOCK;
+	uint64_t found=0;
+	uint64_t start, blockStart, now;
+
+	start=blockStart=nowNs();
+	for(uint64_t i=0;i<n;i++) {
+		found+=insertandcheck(DSL,seq[i])==DSL_FOUND;
+
+		if((i+1)%BENCH_BLOCK==0) {
+			now=nowNs();
+			blocks[i/BENCH_BLOCK]=now-blockStart;
+			blockStart=now;
+		}
+	}
+	now=nowNs();
+
+	qsort(blocks,nblocks,sizeof(uint64_t),compareU64);
+
+	fprintf(stdout,"%-14s %6.2f ns/op   %d-op block p50/p99/p99.9/max: %6.2f/%6.2f/%6.2f/%8.2f us   duplicates: %" PRIu64 "/%" PRIu64 "\n",
+		name,(double) (now-start)/n,BENCH_BLOCK,
+		(double) blocks[nblocks/2]/1000,(double) blocks[nblocks*99/100]/1000,(double) blocks[nblocks*999/1000]/1000,(double) blocks[nblocks-1]/1000,
+		found,expected);
+}
+
+int main(int argc, char **argv) {
+	uint64_t n=argc>1 ? strtoull(argv[1],NULL,10) : BENCH_DEF_SEQ_NUMBERS;
+	uint64_t *seq;
+	uint64_t *blocks;
+	uint8_t *seen;
+	uint64_t next=0;
+	uint64_t expected=0;
+	dupStoreList DSL;
+	struct legacyDupStoreList legacy;
+
+	if(n<BENCH_BLOCK*1000) {
+		fprintf(stderr,"Error: at least %d sequence numbers are required.\n",BENCH_BLOCK*1000);
+		return 1;
+	}
+
+	seq=malloc(n*sizeof(uint64_t));
+	blocks=malloc((n/BENCH_BLOCK)*sizeof(uint64_t));
+	seen=calloc(n+n/BENCH_GAP_PERC+1,sizeof(uint8_t));
+	if(!seq || !blocks || !seen) {
+		fprintf(stderr,"Error: cannot allocate memory.\n");
+		return 1;
+	}
+
+	// Generate the sequence numbers, and count the exact number of duplicates
+	srand(1);
+	for(uint64_t i=0;i<n;i++) {
+		if(i>BENCH_MAX_REORDER && rand()%100<BENCH_DUP_PERC) {
+			seq[i]=next-1-rand()%BENCH_MAX_REORDER;
+		} else {
+			if(rand()%100<BENCH_GAP_PERC) {
+				next++;
+			}
+			seq[i]=next++;
+		}
+
+		if(seen[seq[i]]) {
+			expected++;
+		}
+		seen[seq[i]]=1;
+	}
+
+	DSL=dupSL_init(BENCH_WINDOW);
+	legacy.size=BENCH_WINDOW;
+	legacy.past_list_pos=-1;
+	legacy.array=calloc(legacy.size*2,sizeof(struct legacyDupStoreListNode));
+	if(CHECK_DSL_NULL(DSL) || !legacy.array) {
+		fprintf(stderr,"Error: cannot allocate the duplicate detection structures.\n");
+		return 1;
+	}
+
+	// Run each structure twice, in alternate order, so that both of them run once with warm caches
+	for(int run=0;run<2;run++) {
+		fprintf(stdout,"Run %d:\n",run+1);
+		dupSL_reset(DSL);
+		benchRun("bitmap window",bitmapInsertAndCheck,DSL,seq,n,expected,blocks);
+		memset(legacy.array,0,legacy.size*2*sizeof(struct legacyDupStoreListNode));
+		legacy.past_list_pos=-1;
+		benchRun("legacy list",legacyInsertAndCheck,&legacy,seq,n,expected,blocks);
+	}
+
+	dupSL_free(DSL);
+	free(legacy.array);
+	free(seq);
+	free(blocks);
+	free(seen);
+
+	return 0;
+}
@@ -0,0 +1,145 @@
+// Microbenchmark of the locale-independent number formatting used on the per-packet output paths (-W, -w) and by -g,
+// see fixed_point_fmt.h
+// fpfmtFixed() is compared with the snprintf("%.*f") call it replaced, over the same set of latency values (in us, written
+// in ms, as done by formatPerPacketFields()), for each number of decimal digits in [0,BENCH_MAX_DECIMAL_DIGITS]; fpfmtU64()
+// is compared with snprintf("%" PRIu64) over the same sequence numbers too
+// For each formatter, the average time per value is printed, together with the number of values which were not formatted
+// exactly as snprintf() did (always 0 is expected when the number of decimal digits is greater than or equal to 3, i.e. when
+// no rounding is involved)
+// Build with 'make bench' and run as: bench/fpfmt_bench [number of values]
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fixed_point_fmt.h"
+
+#define BENCH_DEF_VALUES 5000000
+#define BENCH_MAX_DECIMAL_DIGITS 6
+// Latencies are generated between 0 and BENCH_MAX_LATENCY us (with a few negative ones, as for unsynchronized clocks in -u mode)
+#define BENCH_MAX_LATENCY 2000000
+#define BENCH_NEG_PERC 1
+
+static inline uint64_t nowNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+
+	return (uint64_t) ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+// The result of each formatter is accumulated in a checksum, so that the compiler cannot discard the formatting
+static uint64_t checksum;
+
+static void benchFixed(int64_t *values, uint64_t n, int decimal_digits) {
+	char buf[FPFMT_MAX_LEN];
+	char ref[FPFMT_MAX_LEN+1];
+	uint64_t start, t_fpfmt, t_snprintf;
+	uint64_t mismatches=0;
+	size_t len;
+	int reflen;
+
+	start=nowNs();
+	for(uint64_t i=0;i<n;i++) {
+		len=fpfmtFixed(buf,values[i],3,decimal_digits);
+		checksum+=len+buf[len-1];
+	}
+	t_fpfmt=nowNs()-start;
+
+	start=nowNs();
+	for(uint64_t i=0;i<n;i++) {
+		reflen=snprintf(ref,sizeof(ref),"%.*f",decimal_digits,(double) values[i]/1000);
+		checksum+=reflen+ref[reflen-1];
+	}
+	t_snprintf=nowNs()-start;
+
+	// Check the results outside the timed loops
+	for(uint64_t i=0;i<n;i++) {
+		len=fpfmtFixed(buf,values[i],3,decimal_digits);
+		reflen=snprintf(ref,sizeof(ref),"%.*f",decimal_digits,(double) values[i]/1000);
+
+		if(len!=(size_t) reflen || memcmp(buf,ref,len)!=0) {
+			mismatches++;
+		}
+	}
+
+	fprintf(stdout,"%%.%df   fpfmtFixed: %6.2f ns/value   snprintf: %6.2f ns/value   speedup: %5.2fx   mismatches: %" PRIu64 "/%" PRIu64 "\n",
+		decimal_digits,(double) t_fpfmt/n,(double) t_snprintf/n,(double) t_snprintf/t_fpfmt,mismatches,n);
+}
+
+static void benchU64(uint64_t *values, uint64_t n) {
+	char buf[FPFMT_MAX_LEN];
+	char ref[FPFMT_MAX_LEN+1];
+	uint64_t start, t_fpfmt, t_snprintf;
+	uint64_t mismatches=0;
+	size_t len;
+	int reflen;
+
+	start=nowNs();
+	for(uint64_t i=0;i<n;i++) {
+		len=fpfmtU64(buf,values[i]);
+		checksum+=len+buf[len-1];
+	}
+	t_fpfmt=nowNs()-start;
+
+	start=nowNs();
+	for(uint64_t i=0;i<n;i++) {
+		reflen=snprintf(ref,sizeof(ref),"%" PRIu64,values[i]);
+		checksum+=reflen+ref[reflen-1];
+	}
+	t_snprintf=nowNs()-start;
+
+	for(uint64_t i=0;i<n;i++) {
+		len=fpfmtU64(buf,values[i]);
+		reflen=snprintf(ref,sizeof(ref),"%" PRIu64,values[i]);
+
+		if(len!=(size_t) reflen || memcmp(buf,ref,len)!=0) {
+			mismatches++;
+		}
+	}
+
+	fprintf(stdout,"%%" PRIu64 "   fpfmtU64:   %6.2f ns/value   snprintf: %6.2f ns/value   speedup: %5.2fx   mismatches: %" PRIu64 "/%" PRIu64 "\n",
+		(double) t_fpfmt/n,(double) t_snprintf/n,(double) t_snprintf/t_fpfmt,mismatches,n);
+}
+
+int main(int argc, char **argv) {
+	uint64_t n=argc>1 ? strtoull(argv[1],NULL,10) : BENCH_DEF_VALUES;
+	int64_t *latencies;
+	uint64_t *seqnos;
+
+	if(n==0) {
+		fprintf(stderr,"Error: at least one value is required.\n");
+		return 1;
+	}
+
+	latencies=malloc(n*sizeof(int64_t));
+	seqnos=malloc(n*sizeof(uint64_t));
+	if(!latencies || !seqnos) {
+		fprintf(stderr,"Error: cannot allocate memory.\n");
+		return 1;
+	}
+
+	srand(1);
+	for(uint64_t i=0;i<n;i++) {
+		latencies[i]=rand()%BENCH_MAX_LATENCY;
+		if(rand()%100<BENCH_NEG_PERC) {
+			latencies[i]=-latencies[i];
+		}
+
+		seqnos[i]=i;
+	}
+
+	for(int decimal_digits=0;decimal_digits<=BENCH_MAX_DECIMAL_DIGITS;decimal_digits++) {
+		benchFixed(latencies,n,decimal_digits);
+	}
+
+	benchU64(seqnos,n);
+
+	// Print the checksum too, so that it is actually used
+	fprintf(stdout,"(checksum: %" PRIu64 ")\n",checksum);
+
+	free(latencies);
+	free(seqnos);
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+#! /usr/bin/python3
+import sys,struct
+
+# Constants, as defined in include/tfile_binary.h
+TFILE_BIN_TAG_HEADER=0x80
+TFILE_BIN_TAG_ERROR=0x01
+TFILE_BIN_MAGIC=0x4C544254
+TFILE_BIN_VERSION=1
+TFILE_BIN_HDR_SIZE=18
+
+# Bits of the -X extra data mask, as defined in include/options.h (CHAR_P, CHAR_R, CHAR_M, CHAR_N)
+CHAR_P=1
+CHAR_R=2
+CHAR_M=3
+CHAR_N=4
+
+# CSV header lines, as written by openTfile() (see report_manager.h)
+PERPACKET_COMMON_FILE_HEADER_NO_FOLLOWUP="Sequence Number,RTT/Latency,Tx_Timestamp_s_us,Error"
+PERPACKET_COMMON_FILE_HEADER_FOLLOWUP="Sequence Number,RTT/Latency,Est server processing time,Tx_Timestamp_s_us,Error"
+
+class TraceFormatError(Exception):
+	pass
+
+def extra_bit_set(mask,char_macro):
+	return ((mask >> char_macro) & 1) == 1
+
+def read_varint(data,pos):
+	value=0
+	shift=0
+
+	while True:
+		if pos>=len(data):
+			raise TraceFormatError("truncated varint at offset "+str(pos))
+
+		byte=data[pos]
+		pos+=1
+		value|=(byte & 0x7F) << shift
+
+		if byte & 0x80 == 0:
+			return value,pos
+
+		shift+=7
+
+		if shift>=70:
+			raise TraceFormatError("invalid varint at offset "+str(pos))
+
+def read_signed_varint(data,pos):
+	value,pos=read_varint(data,pos)
+
+	# Zigzag decoding
+	return (value >> 1) ^ -(value & 1),pos
+
+def csv_header_line(followup,extra_mask):
+	line=PERPACKET_COMMON_FILE_HEADER_FOLLOWUP if followup else PERPACKET_COMMON_FILE_HEADER_NO_FOLLOWUP
+
+	# Same order used by openTfile()
+	if extra_bit_set(extra_mask,CHAR_P):
+		line+=",PER till now"
+	if extra_bit_set(extra_mask,CHAR_R):
+		line+=",Reconstructed Sequence Number"
+	if extra_bit_set(extra_mask,CHAR_M):
+		line+=",Current minimum"
+	if extra_bit_set(extra_mask,CHAR_N):
+		line+=",Current maximum"
+
+	return line
+
+# Convert a full binary trace to a list of CSV lines, exactly as they would have been written by LaTe without
+# --report-perpacket-binary (a new CSV header line is written for each section of the trace, as it happens when
+# LaTe is appending to an already existing CSV file)
+def convert_trace(data,outfile):
+	pos=0
+	header=None
+	sections=0
+
+	while pos<len(data):
+		tag=data[pos]
+
+		if tag & TFILE_BIN_TAG_HEADER:
+			if pos+TFILE_BIN_HDR_SIZE>len(data):
+				raise TraceFormatError("truncated header record at offset "+str(pos))
+
+			magic,version,lamp_id,latency_type,followup,extra_mask,side,decimal_digits,time_unit_ns=struct.unpack_from(">IBHBBHBBI",data,pos+1)
+
+			if magic!=TFILE_BIN_MAGIC:
+				raise TraceFormatError("invalid magic at offset "+str(pos)+": this is not a LaTe binary trace")
+			if version!=TFILE_BIN_VERSION:
+				raise TraceFormatError("unsupported trace version: "+str(version))
+
+			header={"lamp_id": lamp_id, "followup": followup, "extra_mask": extra_mask, "side": side,
+				"decimal_digits": decimal_digits, "time_unit_ns": time_unit_ns}
+			prev_seq=0
+			prev_tx_time=0
+			sections+=1
+
+			print("Section "+str(sections)+": LaMP ID "+str(lamp_id)+", written by the "+("server" if side==1 else "client"),file=sys.stderr)
+
+			outfile.write(csv_header_line(followup,extra_mask)+"\n")
+			pos+=TFILE_BIN_HDR_SIZE
+			continue
+
+		if header is None:
+			raise TraceFormatError("packet record found before any header record")
+
+		# All times are converted to us (the time unit used by the CSV files)
+		unit_us=header["time_unit_ns"]/1000
+		digits=header["decimal_digits"]
+		pos+=1
+
+		seq_delta,pos=read_signed_varint(data,pos)
+		seq=prev_seq+seq_delta
+		prev_seq=seq
+
+		latency,pos=read_signed_varint(data,pos)
+		latency=int(latency*unit_us)
+
+		if header["followup"]:
+			proc_time,pos=read_varint(data,pos)
+			proc_time=int(proc_time*unit_us)
+
+		tx_delta,pos=read_signed_varint(data,pos)
+		tx_time=prev_tx_time+tx_delta
+		prev_tx_time=tx_time
+		tx_time_us=int(tx_time*unit_us)
+
+		line=str(seq)+","+"%.*f" % (digits,latency/1000)
+		if header["followup"]:
+			line+=","+"%.*f" % (digits,proc_time/1000)
+		line+=",%d.%06d" % (tx_time_us//1000000,tx_time_us%1000000)
+		line+=","+str(tag & TFILE_BIN_TAG_ERROR)
+
+		if extra_bit_set(header["extra_mask"],CHAR_P):
+			if pos+8>len(data):
+				raise TraceFormatError("truncated packet record at offset "+str(pos))
+			per_till_now,=struct.unpack_from(">d",data,pos)
+			pos+=8
+			line+=",%.2f" % per_till_now
+
+		if extra_bit_set(header["extra_mask"],CHAR_R):
+			full_seq,pos=read_varint(data,pos)
+			line+=","+str(full_seq)
+
+		for char_macro in (CHAR_M,CHAR_N):
+			if extra_bit_set(header["extra_mask"],char_macro):
+				value,pos=read_signed_varint(data,pos)
+				line+=","+"%.*f" % (digits,int(value*unit_us)/1000)
+
+		outfile.write(line+"\n")
+
+	return sections
+
+def print_usage():
+	print("Usage: "+sys.argv[0]+" <binary trace (.ltb) file> [<output CSV file>]")
+	print("If no output file is specified, the CSV data is written to the standard output.")
+
+def main(argv):
+	if len(argv)<1 or len(argv)>2:
+		print_usage()
+		sys.exit(1)
+
+	try:
+		with open(argv[0],"rb") as infile:
+			data=infile.read()
+	except OSError as e:
+		print("Error: cannot read "+argv[0]+": "+str(e),file=sys.stderr)
+		sys.exit(1)
+
+	try:
+		if len(argv)==2:
+			with open(argv[1],"w") as outfile:
+				convert_trace(data,outfile)
+		else:
+			convert_trace(data,sys.stdout)
+	except TraceFormatError as e:
+		print("Error: malformed trace: "+str(e),file=sys.stderr)
+		sys.exit(1)
+
+if __name__ == "__main__":
+	main(sys.argv[1:])
@@ -1,7 +1,7 @@
 #! /usr/bin/python3
 from threading import Thread, Lock
 from dataclasses import dataclass
-import sys,getopt,os,time,socket
+import sys,getopt,os,time,socket,struct
 
 # Data class to store the options read from command line (i.e. IPv4 and port to bind the UDP and TCP sockets to)
 @dataclass
@@ -12,40 +12,117 @@ class struct_options:
 mutex_exitflag=Lock()
 exitflag=0
 
+# Binary framing (--report-socket-binary): datagram header format and magic value, as defined in include/report_sock_binary.h,
+# and 'struct' formats of the types which can be found in the 'binlayout=' field of 'LaTeINIT' (all little-endian)
+BIN_HEADER_FORMAT="<IBBHQHH"
+BIN_MAGIC=0x5742544C
+BIN_LAYOUT_TYPES={"u8": "B", "u16": "H", "u32": "I", "u64": "Q", "i64": "q", "f64": "d"}
+
+# Parse the 'binlayout=' field value received in 'LaTeINIT' ('<name>:<type>;<name>:<type>;...'), returning the field names
+# and the 'struct' format of each binary record
+def parse_binlayout(binlayout):
+	names=[]
+	record_format="<"
+
+	for field in binlayout.split(";"):
+		name,fieldtype=field.split(":")
+		names.append(name)
+		record_format+=BIN_LAYOUT_TYPES[fieldtype]
+
+	return names,record_format
+
+# Decode a binary datagram, returning its datagram sequence number and the list of records contained inside (each record is
+# a list of strings, one for each field, as in the text mode), or None,None if the datagram should be discarded
+def decode_binary_datagram(data,accepted_id,record_format):
+	header_size=struct.calcsize(BIN_HEADER_FORMAT)
+
+	if len(data)<header_size:
+		print("Warning: data ignored. Received a truncated binary datagram")
+		return None,None
+
+	magic,version,reserved,lamp_id,dgram_seq,nrecords,record_size=struct.unpack_from(BIN_HEADER_FORMAT,data,0)
+
+	if magic != BIN_MAGIC:
+		print("Warning: data ignored. Expected a LaTe binary datagram")
+		return None,None
+
+	if str(lamp_id) != accepted_id:
+		print("Warning: data ignored. Expected test ID",accepted_id,"but received",lamp_id)
+		return None,None
+
+	if record_size != struct.calcsize(record_format) or len(data)<header_size+nrecords*record_size:
+		print("Warning: data ignored. The binary records do not match the layout received in LaTeINIT")
+		return None,None
+
+	records=[]
+	for i in range(nrecords):
+		records.append([str(value) for value in struct.unpack_from(record_format,data,header_size+i*record_size)])
+
+	return dgram_seq,records
+
 # Thread function to manage the reception of the UDP packets, containing the per-packet data from LaTe
 # This is also the function used to process the per-packet data, for each packet (in this example, we are 
 # just printing each reported metric and its value)
-def udp_rx_loop(udp_descriptor,accepted_id,late_fields):
+def udp_rx_loop(udp_descriptor,accepted_id,late_fields,bin_record_format):
+	# Next expected datagram sequence number, when the per-packet data is packed into multi-record datagrams (--report-socket-batch)
+	# or when the binary framing is used (--report-socket-binary)
+	expected_dgram_seq=0
+
 	while True:
 		data,addr=udp_descriptor.recvfrom(2048)
 
-		# Convert bytes to string
-		decoded_data=data.decode("utf-8").split(",")
+		# Binary framing (--report-socket-binary): decode the datagram using the record layout received in 'LaTeINIT'
+		if bin_record_format != None and not data.startswith(b"terminate,"):
+			dgram_seq,records=decode_binary_datagram(data,accepted_id,bin_record_format)
 
-		# This is just done to correctly terminate the loop (see the terminate_udp_rx_loop() function, starting from line 71)
-		if decoded_data[0] == "terminate":
-			if decoded_data[1] == accepted_id:
-				print("UDP rx loop termination requested")
-				break
-			else:
+			if records == None:
 				continue
+		else:
+			# Convert bytes to string
+			# Multi-record datagrams contain one header line, followed by one line for each record
+			decoded_lines=data.decode("utf-8").split("\n")
+			decoded_data=decoded_lines[0].split(",")
+
+			# This is just done to correctly terminate the loop (see the terminate_udp_rx_loop() function, starting from line 71)
+			if decoded_data[0] == "terminate":
+				if decoded_data[1] == accepted_id:
+					print("UDP rx loop termination requested")
+					break
+				else:
+					continue
+
+			# Discard all the UDP packets which are not starting with 'LaTe' and the correct ID, as received in 'LaTeINIT' (point (a.2) in ./LaTe -h)
+			# The correct ID is passed to this thread function by means of its 'accepted_id' argument
+			if decoded_data[0] != "LaTe" and decoded_data[0] != "LaTeB":
+				print("Warning: data ignored. Expected a LaTe packet, but received",decoded_data[0])
+				continue;
+
+			if decoded_data[1] != accepted_id:
+				print("Warning: data ignored. Expected test ID",accepted_id,"but received",decoded_data[1])
+				continue;
+
+			if decoded_data[0] == "LaTeB":
+				# Multi-record datagram: 'LaTeB,<LaMP ID>,<datagram seq>,<n>', followed by <n> records
+				dgram_seq=int(decoded_data[2])
+				records=[line.split(",") for line in decoded_lines[1:int(decoded_data[3])+1]]
+			else:
+				# Single record datagram: 'LaTe,<LaMP ID>,<f1>,<f2>,...,<fn>'
+				dgram_seq=None
+				records=[decoded_data[2:]]
 
-		# Discard all the UDP packets which are not starting with 'LaTe' and the correct ID, as received in 'LaTeINIT' (point (a.2) in ./LaTe -h)
-		# The correct ID is passed to this thread function by means of its 'accepted_id' argument
-		if decoded_data[0] != "LaTe":
-			print("Warning: data ignored. Expected a LaTe packet, but received",decoded_data[0])
-			continue;
-
-		if decoded_data[1] != accepted_id:
-			print("Warning: data ignored. Expected test ID",accepted_id,"but received",decoded_data[1])
-			continue;
+		# The datagram sequence number is increased by one for each datagram, thus any gap means that some datagrams were lost
+		if dgram_seq != None:
+			if dgram_seq > expected_dgram_seq:
+				print("Warning:",dgram_seq-expected_dgram_seq,"datagram(s) containing per-packet data were lost")
+			expected_dgram_seq=dgram_seq+1
 
 		# When a UDP packet is received, parse/process the data contained inside using the fields received in 'LateINIT' (point (a.3) in ./LaTe -h)
 		# The fields received in 'LaTeINIT' are passed to this thread function by means of its 'late_fields' argument
 		# .... process here the data related to each packet ....
-		print("UDP | received data:")
-		for i in range(len(late_fields)):
-			print("\t",late_fields[i],":",decoded_data[i+2])
+		for record in records:
+			print("UDP | received data:")
+			for i in range(len(late_fields)):
+				print("\t",late_fields[i],":",record[i])
 
 		mutex_exitflag.acquire()
 		if exitflag == 1:
@@ -159,12 +236,18 @@ def main (argv):
 		# Gather the field names from the first TCP packet (i.e. 'LaTeINIT')
 		for field in decoded_data[2].split("=")[1].split(";"):
 			late_fields.append(field)
+
+		# When the binary framing is used (--report-socket-binary), the fields of each record are described by 'binlayout='
+		bin_record_format=None
+		for couple in decoded_data[3:]:
+			if couple.split("=")[0] == "binlayout":
+				late_fields,bin_record_format=parse_binlayout(couple.split("=")[1])
 		
 		print("Current ID:",lamp_session_id)
 
 		# Start waiting for and receiving UDP packets, in a separate thread (point (a.1) ./LaTe -h)
 		# udp_rx_loop() will take into account the points (a.2) and (a.3) in ./LaTe -h
-		t=Thread(target=udp_rx_loop,args=(udp_descriptor,lamp_session_id,late_fields))
+		t=Thread(target=udp_rx_loop,args=(udp_descriptor,lamp_session_id,late_fields,bin_record_format))
 		try:
 			t.start()
 		except:
@@ -0,0 +1,36 @@
+#ifndef LATENCYTEST_ADMISSIONCTRL_H_INCLUDED
+#define LATENCYTEST_ADMISSIONCTRL_H_INCLUDED
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include "options.h"
+
+// Server admission control: per-client rate limit (--rate-limit) and maximum number of concurrent sessions (--max-sessions)
+// Each client IP address gets a token bucket of opts->rate_limit_burst packets, refilled at opts->rate_limit packets/s:
+// admissionCtrlPacket() should be called for each received packet, before doing anything else with it, and the packet
+// should be discarded if AC_LIMITED is returned (the INIT packets are checked in the same way)
+// The buckets are stored in a fixed size table, where each client can only be placed in AC_PROBE_WINDOW slots: a bucket
+// which has been full for a while is the same as a new one, so its slot is reused by the next client, while the clients
+// which do not find any free slot share a single bucket (thus, the memory and the cost of each check are always bounded)
+// All the functions can be called by more than one thread at the same time (e.g. by the --server-threads threads): the buckets
+// are updated with atomic compare-and-swap operations, thus admissionCtrlPacket() never takes a lock
+
+#define CHECK_AC_NULL(AC) (AC==NULL)
+
+// Number of slots of the table of the token buckets (2^AC_TABLE_BITS) and number of slots a client can be placed in
+#define AC_TABLE_BITS 12
+#define AC_PROBE_WINDOW 8
+
+// admissionCtrlPacket() and admissionCtrlSessionStart() return values
+#define AC_ACCEPT	0
+#define AC_LIMITED	1
+
+typedef struct _admissionCtrl *admissionCtrl;
+
+admissionCtrl admissionCtrlInit(struct options *opts);
+int admissionCtrlPacket(admissionCtrl AC, in_addr_t ip);
+int admissionCtrlSessionStart(admissionCtrl AC);
+void admissionCtrlSessionEnd(admissionCtrl AC);
+void admissionCtrlFree(admissionCtrl AC);
+
+#endif
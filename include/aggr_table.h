@@ -0,0 +1,25 @@
+#ifndef LATENCYTEST_AGGRTABLE_H_INCLUDED
+#define LATENCYTEST_AGGRTABLE_H_INCLUDED
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include "options.h"
+#include "report_data_structs.h"
+
+// Running statistics aggregated over all the sessions served in continuous daemon mode (--aggregate-stats)
+// The aggrTable stores a global aggregate and one aggregate for each client IP address, up to opts->aggr_max_clients
+// clients (any further client is aggregated in a single "other" entry), so that its memory is bounded
+// At the end of each session, its report structure and latency histogram are merged with aggrTableAddSession(), whose
+// cost does not depend on the number of packets of the session; a separate thread exports the aggregates every
+// opts->aggr_interval seconds to Carbon (if -g is specified) and to the -f CSV file (if specified)
+// aggrTableAddSession() can be called by more than one thread at the same time (e.g. by the --server-threads threads)
+
+#define CHECK_AT_NULL(AT) (AT==NULL)
+
+typedef struct _aggrTable *aggrTable;
+
+aggrTable aggrTableInit(struct options *opts);
+int aggrTableAddSession(aggrTable AT, struct in_addr ip, modeub_t mode, reportStructure *report, latencyHist *hist, uint8_t timedout);
+void aggrTableFree(aggrTable AT);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef LATENCYTEST_CARBONDUPLIST_H_INCLUDED
 #define LATENCYTEST_CARBONDUPLIST_H_INCLUDED
 
+#include <stdint.h>
+
 #define CHECK_CDSL_NULL(SL) (SL==NULL)
 
 // carbonDupStoreList errors
@@ -13,7 +15,7 @@
 
 typedef struct _carbonDupStoreList *carbonDupStoreList;
 carbonDupStoreList carbonDupSL_init(int size);
-int carbonDupSL_insertandcheck(carbonDupStoreList CDSL, unsigned int seqNo);
+int carbonDupSL_insertandcheck(carbonDupStoreList CDSL, uint64_t seqNo);
 void carbonDupSL_reset(carbonDupStoreList CDSL);
 void carbonDupSL_free(carbonDupStoreList CDSL);
 
@@ -4,12 +4,16 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "report_data_structs.h"
+#include "carbon_sink.h"
 
 void carbonReportStructureInit(carbonReportStructure *report,struct options *opts);
 // The 'add_one' argument can be used to add '1' to the timestamp in seconds which is sent
 // It is used to avoid losing data when the last metrics are flushed
 int carbonReportStructureFlush(carbonReportStructure *report,struct options *opts,int decimal_digits,uint8_t add_one);
+int carbonReportStructureFlushMulti(carbonReportStructure **reports,const char **metric_paths,int nreports,carbonSink sink,struct options *opts,int decimal_digits,uint8_t add_one);
+int carbonAggrStatsFlush(aggrStatsStructure **stats,int nstats,carbonSink sink,struct options *opts,unsigned int interval,int decimal_digits);
 void carbonReportStructureUpdate(carbonReportStructure *report,uint64_t tripTime,int32_t seqNo,uint8_t dup_detect_enabled);
+void carbonReportStructureUpdateExt(carbonReportStructure *report,uint64_t tripTime,uint64_t seqNo,uint8_t dup_detect_enabled);
 void carbonReportStructureFree(carbonReportStructure *report,struct options *opts);
 
 int openCarbonReportSocket(carbonReportStructure *report,struct options *opts);
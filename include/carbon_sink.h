@@ -0,0 +1,43 @@
+#ifndef LATENCYTEST_CARBONSINK_H_INCLUDED
+#define LATENCYTEST_CARBONSINK_H_INCLUDED
+
+#include <stddef.h>
+#include "options.h"
+
+// Non-blocking sink for the metrics sent to Carbon/Graphite ('-g')
+// Each flush of the metrics produces one or more batches (see carbon_report_manager.c), which are copied by
+// carbonSinkEnqueue() inside a bounded in-memory queue, without performing any system call: a separate thread then
+// sends the queued batches to Carbon, so that a stalled or lost connection never blocks the flush thread (and,
+// consequently, the receive loop, which shares a mutex with it)
+// When the connection to Carbon cannot be established, or it is lost, the sink thread tries to reconnect in background,
+// with an exponential backoff; in the meanwhile, the queued batches are moved to an on-disk spool file (if specified
+// with --report-graphite-spool), which is sent, before any newer batch, as soon as Carbon is reachable again
+// As the timestamps are written inside the batches when the metrics are flushed, the spooled metrics are backfilled
+// with their original timestamps; a spool file which is not empty when LaTe is started is sent as well
+
+// Maximum size of each batch (a UDP batch is never larger than MAX_g_SOCK_BUF_SIZE bytes)
+#define CARBON_TCP_BATCH_SIZE 8192
+
+// Number of batches which can be stored inside the in-memory queue (when the queue is full, the new batches are dropped)
+#define CARBON_SINK_QUEUE_SIZE 16
+// Interval (in ms) after which the sink thread checks for new batches
+#define CARBON_SINK_POLL_INTERVAL 100
+// Minimum and maximum interval (in s) between two reconnection attempts
+#define CARBON_SINK_BACKOFF_MIN 1
+#define CARBON_SINK_BACKOFF_MAX 60
+// Time (in s) after which a connection which does not accept any data is considered lost
+#define CARBON_SINK_STALL_TIMEOUT 30
+// Maximum time (in ms) spent sending the pending batches when the sink is terminated
+#define CARBON_SINK_CLOSE_TIMEOUT 2000
+// Maximum size (in MiB) of the spool file (when this size is reached, the new batches are dropped)
+#define CARBON_SINK_SPOOL_MAX_SIZE_MIB 64
+
+#define CHECK_CS_NULL(CS) (CS==NULL)
+
+typedef struct _carbonSink *carbonSink;
+
+carbonSink carbonSinkInit(struct options *opts);
+int carbonSinkEnqueue(carbonSink CS,const char *buf,size_t len);
+void carbonSinkFree(carbonSink CS);
+
+#endif
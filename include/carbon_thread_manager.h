@@ -9,7 +9,6 @@
 
 typedef struct _carbon_pthread_data {
 	pthread_t tid;
-	pthread_mutex_t mutex;
 
 	// Pipe descriptors for a pipe used to unblock the thread when caling stopCarbonTimedThread(), in order to properly
 	// terminate it
@@ -23,9 +22,6 @@ struct flush_callback_args {
 	carbon_pthread_data_t *ctd;
 };
 
-#define carbon_pthread_mutex_lock(ctd) pthread_mutex_lock(&(ctd.mutex))
-#define carbon_pthread_mutex_unlock(ctd) pthread_mutex_unlock(&(ctd.mutex))
-
 int startCarbonTimedThread(carbon_pthread_data_t *ctd,carbonReportStructure *reportPtr,struct options *opts);
 void stopCarbonTimedThread(carbon_pthread_data_t *ctd);
 
@@ -50,6 +50,9 @@ struct lampsock_data {
 	char devname[IFNAMSIZ];
 	int ifindex;
 	struct timeval rx_timeout;
+	struct timeval session_end; // Continuous daemon mode (server): time at which the previous session ended (zero before the first session)
+	struct _aggrTable *aggr_table; // Continuous daemon mode (server): statistics aggregated over all the sessions (NULL if --aggregate-stats is not specified, see aggr_table.h)
+	struct _admissionCtrl *admission_ctrl; // Server: per-client rate limit and maximum number of sessions (NULL if neither --rate-limit nor --max-sessions is specified, see admission_ctrl.h)
 
 	// UDP socket parameters for the -w reporting option
  	report_sock_data_t sock_w_data;
@@ -79,7 +82,10 @@ struct src_addrs {
 int socketCreator(protocol_t protocol);
 int socketOpen(protocol_t protocol,struct lampsock_data *sData,struct options *opts,struct src_addrs *addressesptr);
 int socketDataSetup(protocol_t protocol,struct lampsock_data *sData,struct options *opts,struct src_addrs *addressesptr);
+int socketOpenShard(struct lampsock_data *sData,struct options *opts);
+int socketAttachReuseportCBPF(int sFd,unsigned int shards);
 int socketSetTimestamping(struct lampsock_data sData, int mode);
+int socketResetTimestamping(struct lampsock_data sData);
 int pollErrqueueWait(int sFd,uint64_t timeout_ms);
 int connectWithTimeout(int sockfd, const struct sockaddr *addr,socklen_t addrlen,int timeout_ms);
 char *connectWithTimeoutStrError(int retval);
@@ -4,6 +4,7 @@
 #include <pthread.h>
 #include "common_thread.h"
 #include "rawsock_lamp.h"
+#include "lamp_ext.h"
 
 #define LO_ADDR_HEX 0x0100007f
 #define CHECK_IP_ADDR_DST(ip) (headerptrs.ipHeader->daddr!=ip)
@@ -14,6 +15,7 @@ struct controlRCVstruct {
 	struct in_addr ip;
 	in_port_t port;
 	uint16_t type_idx;
+	uint16_t ext_flags; // LaMP extensions requested (INIT) or accepted (ACK) by the other peer (LAMP_EXT_FLAG_*, see lamp_ext.h)
 	uint8_t mac[ETHER_ADDR_LEN];
 };
 
@@ -22,11 +24,13 @@ typedef union _controlRCVdata {
 	struct controlRCVstruct controlRCV;
 } controlRCVdata;
 
-int controlSenderUDP(arg_struct_udp *args, uint16_t session_id, int max_attempts, lamptype_t type, uint16_t followup_type, time_t interval_ms, uint8_t *termination_flag, pthread_mutex_t *termination_flag_mutex);
-int controlSenderUDP_RAW(arg_struct *args, controlRCVdata *rcvData, uint16_t session_id, int max_attempts, lamptype_t type, uint16_t followup_type, time_t interval_ms, uint8_t *termination_flag, pthread_mutex_t *termination_flag_mutex);
+int controlSenderUDP(arg_struct_udp *args, uint16_t session_id, int max_attempts, lamptype_t type, uint16_t ctrl_param, time_t interval_ms, uint8_t *termination_flag, pthread_mutex_t *termination_flag_mutex);
+int controlSenderUDP_RAW(arg_struct *args, controlRCVdata *rcvData, uint16_t session_id, int max_attempts, lamptype_t type, uint16_t ctrl_param, time_t interval_ms, uint8_t *termination_flag, pthread_mutex_t *termination_flag_mutex);
 int controlReceiverUDP(int sFd, controlRCVdata *rcvData, lamptype_t type, uint8_t *termination_flag, pthread_mutex_t *termination_flag_mutex);
 int controlReceiverUDP_RAW(int sFd, in_port_t port, in_addr_t ip, controlRCVdata *rcvData, lamptype_t type, uint8_t *termination_flag, pthread_mutex_t *termination_flag_mutex);
+void printInterSessionGap(struct timeval *session_end);
 int sendFollowUpData(struct lampsock_data sData,uint16_t id,uint16_t seq,struct timeval tDiff);
 int sendFollowUpData_RAW(arg_struct *args,controlRCVdata *rcvData,uint16_t id,uint16_t ip_id,uint16_t seq,struct timeval tDiff);
+uint16_t rawUDPChecksum(struct iphdr *ipHeader, struct udphdr *udpHeader, size_t udplen);
 
 #endif
\ No newline at end of file
@@ -1,9 +1,12 @@
 #ifndef LATENCYTEST_DUPLIST_H_INCLUDED
 #define LATENCYTEST_DUPLIST_H_INCLUDED
 
+#include <stdint.h>
+
 #define CHECK_DSL_NULL(SL) (SL==NULL)
 
 // dupStoreList errors
+#define DSL_OUTOFWINDOW		5
 #define DSL_ZEROSIZE    	4
 #define DSL_NOTFOUND		3
 #define DSL_EMPTY 			2
@@ -13,7 +16,7 @@
 
 typedef struct _dupStoreList *dupStoreList;
 dupStoreList dupSL_init(int size);
-int dupSL_insertandcheck(dupStoreList DSL, unsigned int seqNo);
+int dupSL_insertandcheck(dupStoreList DSL, uint64_t seqNo);
 void dupSL_reset(dupStoreList DSL);
 void dupSL_free(dupStoreList DSL);
 
@@ -0,0 +1,22 @@
+#ifndef LATENCYTEST_FIXEDPOINTFMT_H_INCLUDED
+#define LATENCYTEST_FIXEDPOINTFMT_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Locale-independent integer to decimal formatting, used on the per-packet output paths (-W, -w) and by -g, instead of
+// the printf-family functions
+// All the functions write the characters directly inside the caller buffer, without any terminating '\0', and return
+// the number of characters which were written; the caller buffer should be at least FPFMT_MAX_LEN characters long
+
+// Maximum number of decimal digits supported by fpfmtFixed() (higher values are reduced to this one)
+#define FPFMT_MAX_DECIMAL_DIGITS 18
+// Maximum length of a formatted number (sign + 20 integer digits + decimal point + decimal digits)
+#define FPFMT_MAX_LEN (1+20+1+FPFMT_MAX_DECIMAL_DIGITS)
+
+size_t fpfmtU64(char *buf,uint64_t val);
+size_t fpfmtI64(char *buf,int64_t val);
+size_t fpfmtU64Pad(char *buf,uint64_t val,unsigned int width);
+size_t fpfmtFixed(char *buf,int64_t val,unsigned int scale_digits,unsigned int decimal_digits);
+
+#endif
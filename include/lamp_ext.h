@@ -0,0 +1,92 @@
+#ifndef LATENCYTEST_LAMPEXT_H_INCLUDED
+#define LATENCYTEST_LAMPEXT_H_INCLUDED
+
+#include <endian.h>
+#include <stdint.h>
+#include <string.h>
+
+/* LaMP extensions, negotiated during the INIT procedure
+
+   The client appends LAMP_EXT_SIZE bytes after the LaMP header of the INIT packet, containing LAMP_EXT_MAGIC and the
+   flags of the requested extensions; the server replies with an ACK carrying the same bytes, with the flags of the
+   extensions which were accepted. The payload length field of INIT/ACK packets is left untouched, as it is already
+   used to carry the connection type, and the extension block is detected by looking at the UDP payload size.
+   An older server simply ignores the extension block and replies with a plain ACK, i.e. no extension is accepted,
+   while an older client never sends it.
+
+   +-------+-------+
+   | magic | flags |
+   | (16)  | (16)  |
+   +-------+-------+ */
+
+#define LAMP_EXT_MAGIC 0x4C45 // 'LE'
+#define LAMP_EXT_SIZE 4
+
+// Extension flags
+#define LAMP_EXT_FLAG_NONE 0x0000
+#define LAMP_EXT_FLAG_EXTSEQ 0x0001 // Extended (64 bit) sequence numbers
+
+// Extensions which can be accepted by this version of LaTe
+#define LAMP_EXT_SUPPORTED_FLAGS (LAMP_EXT_FLAG_EXTSEQ)
+
+// Extended sequence number: when LAMP_EXT_FLAG_EXTSEQ has been accepted, every data packet carries a 64 bit,
+// never wrapping, sequence number in network byte order, as the first LAMP_EXTSEQ_SIZE bytes of the LaMP payload
+// The 16 bit sequence number of the LaMP header is still set as usual, and it is always equal to the 16 least
+// significant bits of the extended one
+#define LAMP_EXTSEQ_SIZE 8
+
+static inline void lampExtWrite(uint8_t *buf, uint16_t flags) {
+	uint16_t magic=htobe16(LAMP_EXT_MAGIC);
+
+	flags=htobe16(flags);
+	memcpy(buf,&magic,sizeof(magic));
+	memcpy(buf+2,&flags,sizeof(flags));
+}
+
+// Get the extension flags from a buffer containing 'len' bytes after the LaMP header
+// LAMP_EXT_FLAG_NONE is returned if no (valid) extension block is present
+static inline uint16_t lampExtRead(const uint8_t *buf, size_t len) {
+	uint16_t magic, flags;
+
+	if(len<LAMP_EXT_SIZE) {
+		return LAMP_EXT_FLAG_NONE;
+	}
+
+	memcpy(&magic,buf,sizeof(magic));
+	if(be16toh(magic)!=LAMP_EXT_MAGIC) {
+		return LAMP_EXT_FLAG_NONE;
+	}
+
+	memcpy(&flags,buf+2,sizeof(flags));
+
+	return be16toh(flags);
+}
+
+static inline void lampExtSeqWrite(uint8_t *payload, uint64_t seq) {
+	seq=htobe64(seq);
+	memcpy(payload,&seq,sizeof(seq));
+}
+
+static inline uint64_t lampExtSeqRead(const uint8_t *payload) {
+	uint64_t seq;
+
+	memcpy(&seq,payload,sizeof(seq));
+
+	return be64toh(seq);
+}
+
+// Expand a 16 bit LaMP sequence number to the full width sequence number which is closest to 'ref' (i.e. to a recently
+// received extended sequence number); it can be used for packets which do not carry any payload (e.g. follow-up data)
+static inline uint64_t lampExtSeqExpand(uint64_t ref, uint16_t seq) {
+	uint64_t expanded=(ref & ~((uint64_t) UINT16_MAX)) | seq;
+
+	if(expanded>ref && expanded-ref>UINT16_MAX/2 && expanded>UINT16_MAX) {
+		expanded-=(uint64_t) UINT16_MAX+1;
+	} else if(expanded<ref && ref-expanded>UINT16_MAX/2) {
+		expanded+=(uint64_t) UINT16_MAX+1;
+	}
+
+	return expanded;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef LATENCYTEST_LATENCYHIST_H_INCLUDED
+#define LATENCYTEST_LATENCYHIST_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Log-linear latency histogram (in us), used to compute the percentiles and the bucket counts of each Carbon flush interval
+// Each power of 2 range [2^e,2^(e+1)) is split into 2^LATENCY_HIST_SUB_BITS linear sub-buckets, so that the relative
+// error of any percentile is always lower than 1/2^LATENCY_HIST_SUB_BITS (i.e. about 3%), while the values lower than
+// 2^LATENCY_HIST_SUB_BITS us are stored exactly
+#define LATENCY_HIST_SUB_BITS 5
+#define LATENCY_HIST_SUB_BUCKETS (1<<LATENCY_HIST_SUB_BITS)
+// Highest power of 2 (in us) which can be stored: any higher value (i.e. >71 minutes) is counted in the last bucket
+#define LATENCY_HIST_MAX_EXP 32
+#define LATENCY_HIST_BUCKETS ((LATENCY_HIST_MAX_EXP-LATENCY_HIST_SUB_BITS+1)*LATENCY_HIST_SUB_BUCKETS)
+
+// Coarse groups, used to export the bucket counts (e.g. for a heatmap): group 0 contains the values in [0,2^LATENCY_HIST_SUB_BITS) us,
+// while group g>0 contains the values in [2^(g+LATENCY_HIST_SUB_BITS-1),2^(g+LATENCY_HIST_SUB_BITS)) us
+#define LATENCY_HIST_GROUPS (LATENCY_HIST_MAX_EXP-LATENCY_HIST_SUB_BITS+1)
+
+typedef struct latencyHist {
+	uint64_t counts[LATENCY_HIST_BUCKETS];	// # - number of latency values in each bucket
+	uint64_t count;							// # - total number of latency values
+
+	// Internal members
+	// Don't touch these variables, as they are managed internally by latencyHistUpdate()
+	unsigned int _usedBuckets;	// # - highest non-empty bucket plus one (only the first '_usedBuckets' buckets are cleared when resetting)
+} latencyHist;
+
+void latencyHistInit(latencyHist *lh);
+void latencyHistReset(latencyHist *lh);
+void latencyHistUpdate(latencyHist *lh, uint64_t value);
+void latencyHistMerge(latencyHist *dst, latencyHist *src);
+uint64_t latencyHistPercentile(latencyHist *lh, double percentile);
+unsigned int latencyHistUsedGroups(latencyHist *lh);
+uint64_t latencyHistGroupCount(latencyHist *lh, unsigned int group);
+uint64_t latencyHistGroupUpperBound(unsigned int group);
+
+#endif
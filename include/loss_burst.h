@@ -0,0 +1,55 @@
+#ifndef LATENCYTEST_LOSSBURST_H_INCLUDED
+#define LATENCYTEST_LOSSBURST_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of buckets for the burst and gap length distributions
+// Bucket i (i>0) counts the runs with a length in (2^(i-1),2^i], bucket 0 counts the runs of length 1
+// The last bucket counts all the runs longer than 2^(LOSS_BURST_HIST_BUCKETS-2)
+#define LOSS_BURST_HIST_BUCKETS 12
+
+// Minimum number of consecutively received packets which should be observed to consider a loss burst as terminated,
+// for the Gilbert-Elliott model estimation (i.e. two losses separated by less than GE_GMIN received packets belong to
+// the same "bad state" period) - same meaning and default value as "Gmin" in RFC 3611
+#define GE_GMIN 16
+
+typedef struct lossBurstStats {
+	uint64_t burstHist[LOSS_BURST_HIST_BUCKETS];	// # - distribution of the number of consecutively lost packets
+	uint64_t gapHist[LOSS_BURST_HIST_BUCKETS];		// # - distribution of the number of consecutively received packets between two loss bursts
+	uint64_t burstCount;							// # - total number of loss bursts
+	uint64_t maxBurst;								// # - longest loss burst
+
+	// Internal members
+	// Don't touch these variables, as they are managed internally by lossBurstUpdate()
+	uint64_t _currGap;		// # - packets received since the last loss burst
+	uint8_t _lossSeen;		// [0,1] - = 1 if at least one loss burst has been detected so far
+
+	// Gilbert-Elliott model state and counters
+	uint8_t _geInBurst;		// [0,1] - = 1 if the model is currently in the "bad" state
+	uint64_t _geBurstPkts;	// # - packets (lost+received) belonging to the current "bad" period
+	uint64_t _geBurstLost;	// # - lost packets in the current "bad" period
+	uint64_t _gePendingRx;	// # - packets received after the last loss of the current "bad" period
+	uint64_t _geGoodPkts;	// # - packets observed in the "good" state
+	uint64_t _geGoodLost;	// # - isolated losses, observed in the "good" state
+	uint64_t _geBadPkts;	// # - packets observed in the "bad" state
+	uint64_t _geBadLost;	// # - lost packets in the "bad" state
+	uint64_t _geTransitions;// # - number of good->bad transitions
+} lossBurstStats;
+
+// Estimated Gilbert-Elliott model parameters
+typedef struct geParams {
+	double p;			// P(good->bad)
+	double r;			// P(bad->good)
+	double h;			// Loss density in the bad state (1-h is the probability of a correct reception when in the bad state)
+	double k;			// Loss density in the good state (isolated losses)
+} geParams_t;
+
+void lossBurstInit(lossBurstStats *lb);
+void lossBurstUpdate(lossBurstStats *lb, uint64_t lostBefore);
+void lossBurstFinalize(lossBurstStats *lb);
+void lossBurstGetGE(lossBurstStats *lb, geParams_t *ge);
+void lossBurstMerge(lossBurstStats *dst, lossBurstStats *src);
+void lossBurstSerializeHist(uint64_t *hist, char *buf, size_t bufsize);
+
+#endif
@@ -91,6 +91,42 @@
 // Maximum supported length for a metric path specified by the user, when the -g option (to send data to Carbon/Graphite) is used
 #define MAX_g_METRIC_PATH_LEN 255
 
+// Maximum number of latency percentiles which can be sent to Carbon/Graphite for each flush interval (-g)
+#define MAX_g_PERCENTILES 8
+
+// Maximum number of threads serving the sessions of a multi-session server (--server-threads)
+#define MAX_SERVER_THREADS 64
+
+// Maximum number of requests reflected with a single sendmmsg() by the batched ping-like reflector (--reflector-batch),
+// equal to the maximum number of messages accepted by sendmmsg() (UIO_MAXIOV)
+#define MAX_REFLECTOR_BATCH 1024
+// Maximum value of the batch latency of the reflector (--reflector-batch-latency), in us
+#define MAX_REFLECTOR_BATCH_LATENCY 1000000
+
+// Maximum RX queue index which can be selected for the AF_XDP socket (--xdp-queue)
+#define MAX_XDP_QUEUE 1023
+
+// Default and maximum block retire timeout, in ms, of the TPACKET_V3 receive ring (--rx-ring-timeout)
+#define RX_RING_DEF_TIMEOUT 1
+#define MAX_RX_RING_TIMEOUT 1000
+// Maximum number of frames handed to the kernel with a single kick of the PACKET_TX_RING (--tx-ring-batch)
+#define MAX_TX_RING_BATCH 128
+
+// Maximum interval, in s, between two exports of the aggregated statistics (--aggregate-stats)
+#define MAX_AGGR_INTERVAL 86400
+// Default and maximum number of clients for which separate aggregated statistics are kept (--aggregate-max-clients)
+// Each client needs about 8 kB of memory, mostly for its latency histogram
+#define AGGR_DEF_MAX_CLIENTS 256
+#define MAX_AGGR_CLIENTS 4096
+
+// Maximum per-client rate limit, in packets/s, and maximum size of each token bucket, in packets (--rate-limit, --rate-limit-burst)
+#define MAX_RATE_LIMIT 10000000
+#define MAX_RATE_LIMIT_BURST 1000000
+// Default size of the token buckets, as the number of packets received in RATE_LIMIT_DEF_BURST_MS ms at the rate limit
+#define RATE_LIMIT_DEF_BURST_MS 100
+// Maximum value which can be specified with --max-sessions
+#define MAX_MAX_SESSIONS 1000000
+
 // -w TCP socket timeout (in ms)
 #define TCP_w_SOCKET_CONNECT_TIMEOUT 5000
 
@@ -101,9 +137,12 @@
 // Change this only if you really know what you are doing!
 #define INITIAL_SEQ_NO 0
 
-// This constant defines the default size of the carbonDupStoreList data structure, when an optimal size cannot be inferred
-// from the reporting interval (specified with -g) and from the periodicity (specified with -t) (e.g. on a server)
+// This constant defines the minimum size of the carbonDupStoreList data structure, which is otherwise inferred
+// from the reporting interval (specified with -g) and from the periodicity (specified with -t, or CLIENT_DEF_INTERVAL on a server)
 #define CARBON_REPORT_DEFAULT_FLUSH_STRUCT_SIZE 10
+// Expected number of packets in each reporting interval, given the -g interval (in s) and the periodicity (in ms)
+#define CARBON_DUP_STRUCT_SIZE(carbon_interval,interval) ((int) ((carbon_interval)*1000/(interval))>CARBON_REPORT_DEFAULT_FLUSH_STRUCT_SIZE ? \
+	(int) ((carbon_interval)*1000/(interval)) : CARBON_REPORT_DEFAULT_FLUSH_STRUCT_SIZE)
 
 // Char <-> shift mapping for SET_REPORT_EXTRA_DATA_BIT
 // To use SET_REPORT_EXTRA_DATA_BIT() you should specify the report_extra_data variable and one of these macros
@@ -161,7 +200,8 @@ typedef enum {
 
 typedef enum {
 	G_TCP,
-	G_UDP
+	G_UDP,
+	G_TCP_PICKLE // TCP socket, using the Carbon pickle protocol instead of the plaintext one
 } graphite_sock_t;
 
 struct sock_params {
@@ -196,6 +236,12 @@ struct options {
 	uint8_t refuseFollowup; // Server only. =1 if the server should deny any follow-up request coming the client, =0 otherwise (default: 0)
 	uint8_t verboseFlag; // =1 if verbose mode is on, =0 otherwise (default: 0, i.e. no -V specified)
 	char *Wfilename; // Filename for the -W mode
+	uint8_t W_binary; // =1 if the -W per-packet data should be written using the binary trace format (--report-perpacket-binary), =0 to write a CSV file (default: 0)
+	uint8_t w_batch; // =1 if the -w per-packet data should be packed into multi-record datagrams (--report-socket-batch), =0 to send one datagram per packet (default: 0)
+	uint8_t w_binary; // =1 if the -w per-packet data should be sent using the binary framing (--report-socket-binary), =0 to send it as text (default: 0)
+	uint64_t W_rotate_size; // Maximum size (in bytes) of each -W file segment (--report-perpacket-rotate-size), =0 to disable size-based rotation (default: 0)
+	uint32_t W_rotate_interval; // Interval (in s) after which a new -W file segment is started (--report-perpacket-rotate-interval), =0 to disable time-based rotation (default: 0)
+	char *W_rotate_hook; // Command executed on each closed -W file segment (--report-perpacket-rotate-hook), NULL if not specified (default: NULL)
 	uint8_t printAfter; // Server only. =0 if the server should print that a packet was received before sending the reply, =1 to print after sending the reply (default: 0)
 	uint8_t initial_timeout_server;
 	uint8_t log_init_failures;
@@ -236,7 +282,11 @@ struct options {
 
 	// -g UDP/TCP socket parameters and type
 	struct sock_params carbon_sock_params;
-	graphite_sock_t carbon_sock_type; // It should be equal to G_TCP if a TCP socket should be used (default), or to G_UDP if a UDP socket should be used
+	graphite_sock_t carbon_sock_type; // It should be equal to G_TCP if a TCP socket should be used (default), to G_UDP if a UDP socket should be used, or to G_TCP_PICKLE if a TCP socket with the pickle protocol should be used
+	char *carbon_spool_filename; // File in which the -g metrics are stored while Carbon is not reachable (--report-graphite-spool), NULL if not specified (default: NULL)
+	double carbon_percentiles[MAX_g_PERCENTILES]; // Latency percentiles, in (0,100], sent to Carbon for each flush interval (--report-graphite-percentiles) (default: 50, 90, 99, 99.9)
+	uint8_t carbon_percentiles_num; // Number of percentiles inside carbon_percentiles (0 if no percentile should be sent)
+	uint8_t carbon_histogram; // = 1 if the latency histogram bucket counts should be sent to Carbon (--report-graphite-histogram), = 0 otherwise (default: 0)
 	
 	uint8_t dup_detect_enabled; // = 1 if duplicate packet detection is enabled, = 0 otherwise
 
@@ -247,6 +297,31 @@ struct options {
 
 	int udp_forced_src_port; // '-1' means that the option has not been specified, i.e. let the OS choose a client UDP source port
 	int udp_forced_dst_port; // '-1' means that the option has not been specified, i.e. let the server use as UDP destination port the one received as UDP source port from the client
+
+	uint8_t multi_session; // Server only. = 1 if multiple concurrent sessions should be served (--multi-session), = 0 otherwise (default: 0)
+	uint16_t server_threads; // Server only. Number of threads (each one with its own SO_REUSEPORT socket) serving the sessions with --multi-session (default: 1)
+	uint8_t reuseport_cbpf; // Server only. = 1 if the packets should be steered to the threads depending on their LaMP id (--reuseport-cbpf), = 0 otherwise (default: 0)
+	uint16_t reflector_batch; // Server only. Maximum number of ping-like requests reflected together, with recvmmsg()/sendmmsg(), when no follow-up is requested (--reflector-batch) (default: 1, i.e. no batching)
+	uint32_t reflector_batch_latency; // Server only. Maximum time, in us, the reflector waits for more requests after the first one of each batch (--reflector-batch-latency) (default: 0)
+
+	uint8_t xdp_enabled; // = 1 if the raw LaMP data packets should be sent and received through an AF_XDP socket (--xdp), = 0 otherwise (default: 0)
+	uint32_t xdp_queue; // RX queue the AF_XDP socket is bound to (--xdp-queue) (default: 0)
+	uint8_t xdp_reflector; // Server only. = 1 if the ping-like requests should be reflected in the kernel by an XDP program (--xdp-reflector), = 0 otherwise (default: 0)
+	uint8_t xdp_generic; // = 1 if the XDP programs should always be attached in generic mode (--xdp-generic), = 0 to try the native mode first (default: 0)
+	uint8_t rx_ring; // = 1 if the raw LaMP data packets should be received through a TPACKET_V3 ring (--rx-ring), = 0 otherwise (default: 0)
+	uint32_t rx_ring_timeout; // Block retire timeout, in ms, of the TPACKET_V3 ring (--rx-ring-timeout) (default: RX_RING_DEF_TIMEOUT)
+	uint8_t tx_ring; // Client only. = 1 if the raw LaMP data packets should be sent through a PACKET_TX_RING (--tx-ring), = 0 otherwise (default: 0)
+	uint32_t tx_ring_batch; // Client only. Number of frames handed to the kernel with a single send() on the PACKET_TX_RING (--tx-ring-batch) (default: 1)
+	uint8_t qdisc_bypass; // Client only. = 1 if the PACKET_TX_RING socket should bypass the qdisc layer (--qdisc-bypass), = 0 otherwise (default: 0)
+
+	uint32_t aggr_interval; // Server only. Interval, in s, between two exports of the statistics aggregated over all the sessions (--aggregate-stats) (default: 0, i.e. no aggregation)
+	uint32_t aggr_max_clients; // Server only. Maximum number of clients with their own aggregated statistics (--aggregate-max-clients) (default: AGGR_DEF_MAX_CLIENTS)
+
+	uint32_t rate_limit; // Server only. Maximum rate, in packets/s, of the packets accepted from each client IP address (--rate-limit) (default: 0, i.e. no limit)
+	uint32_t rate_limit_burst; // Server only. Size, in packets, of the token bucket of each client (--rate-limit-burst) (default: RATE_LIMIT_DEF_BURST_MS ms of packets at the rate limit)
+	uint32_t max_sessions; // Server only. Maximum number of concurrent sessions with --multi-session (--max-sessions) (default: 0, i.e. no limit)
+
+	uint8_t ext_seq_enabled; // Client only. = 1 if extended (64 bit) sequence numbers should be requested to the server during the INIT procedure, = 0 otherwise (default: 0)
 };
 
 void options_initialize(struct options *options);
@@ -4,8 +4,18 @@
 // options.h already includes <netinet/in.h>, needed for "struct sockaddr_in"
 #include "carbon_dup_list.h"
 #include "dup_list.h"
+#include "latency_hist.h"
+#include "loss_burst.h"
 #include "options.h"
 
+#if (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__))
+	#include <stdatomic.h>
+	#define CARBON_ATOMICS_SUPPORTED 1
+#else
+	#include <pthread.h>
+	#define CARBON_ATOMICS_SUPPORTED 0
+#endif
+
 // Expected negative gap to detect a reset in the cyclical sequence numbers
 // Expected positive gap to detect out of order packets after a cyclical sequence number reset
 // This parameter is a key parameter for the sequence number reconstruction and for the out of order 
@@ -21,6 +31,16 @@ typedef struct report_sock_data {
 	int descriptor_udp;
 	int descriptor_tcp;
 	struct sockaddr_in addrto;
+
+	// Batched '-w' mode (--report-socket-batch): when 'batched' is = 1, the per-packet data is sent by the writer
+	// defined in tfile_writer.h, which is started at the beginning of each test by writeToReportSocket()
+	uint8_t batched;
+	struct _tfileWriter *batch_writer;
+
+	// Binary '-w' framing (--report-socket-binary, see report_sock_binary.h): when 'binary' is = 1, 'dgram_seq' is the
+	// sequence number of the next datagram sent without batching
+	uint8_t binary;
+	uint64_t dgram_seq;
 } report_sock_data_t;
 
 typedef struct reportStructure {
@@ -56,6 +76,8 @@ typedef struct reportStructure {
 	uint64_t dupCount; 			// # - updated only if -D is not specified - transmitted/printed
 	uint8_t dupCountEnabled;	// [0,1] - = 0 if the dupCount value shall not be taken into account, = 1 otherwise - transmitted/not printed
 	dupStoreList dupCountList;	// Data struct - allocated and updated only if -D is not specified - not transmitted/not printed
+
+	lossBurstStats lossBursts;	// Data struct - loss burst/gap distributions and Gilbert-Elliott model counters - transmitted/printed
 } reportStructure;
 
 // Structure containing the per-packet data which can be written to a CSV file for each packet
@@ -69,7 +91,17 @@ typedef struct perPackerDataStructure {
 	reportStructure *reportDataPointer;
 } perPackerDataStructure;
 
-typedef struct carbonReportStructure {
+// Snapshot of the extra (-X) per-packet data, taken when each packet is received (it is computed starting from the
+// current values inside the report structure, which may change before the data is actually written)
+typedef struct perPacketExtraData {
+	double perTillNow;
+	uint64_t reconstructedSeqNo;
+	int64_t minLatency; // us (-1 ms, i.e. -1000 us, when not available)
+	int64_t maxLatency; // us (-1 ms, i.e. -1000 us, when not available)
+} perPacketExtraData;
+
+// Metrics accumulated by the receive thread during a single flush interval, which are sent to Carbon/Graphite
+typedef struct carbonIntervalData {
 	uint64_t minLatency;		// us
 	double averageLatency;		// us
 	uint64_t maxLatency;		// us
@@ -79,18 +111,62 @@ typedef struct carbonReportStructure {
 	double _welfordM2;					// us - not transmitted (used for the variance/stdev computation)
 	double _welfordAverageLatencyOld;	// us - not transmitted (used for the variance/stdev computation)
 
-	int _maxSeqNumber;				// # - not sent to Graphite (used for the current flush interval packet loss estimation)
-	int _precMaxSeqNumber;			// # - not sent to Graphite (used for the current flush interval packet loss estimation)
-	uint8_t _detectedSeqNoReset; 	// [0,1] - = 0 if no sequence number cyclical reset has been detected in the current flush interval, = 1 otherwise
-
 	uint64_t outOfOrderCount;	// #
 	uint64_t lossCount;			// #
 	int64_t netlossCount; 		// # - taking into account also out of order packets which were considered lost in previous intervals and have been now received (i.e. "recovered")
 
-	uint64_t dupCount; 					// # - updated only if -D is not specified
+	uint64_t dupCount; 			// # - updated only if -D is not specified
+
+	lossBurstStats lossBursts;	// Data struct - loss bursts detected in the current flush interval
+
+	latencyHist latencyHist;	// Data struct - histogram of the latency values (used to compute the percentiles)
+} carbonIntervalData;
+
+typedef struct carbonReportStructure {
+	// Double buffered interval data: the receive thread only updates intervals[epoch & 1], while the flush thread reads and
+	// then resets the other buffer, which it has retired by increasing 'epoch' at the end of the flush interval
+	// No lock is taken on the per-packet path (see carbonReportStructureSwap() in carbon_report_manager.c); if C11 atomic
+	// variables are not supported, 'epoch' is protected by a mutex instead, which is however never held while formatting
+	// or sending the metrics
+	carbonIntervalData intervals[2];
+	#if CARBON_ATOMICS_SUPPORTED
+		_Atomic uint32_t epoch;		// written only by the flush thread
+		_Atomic uint8_t _writing;	// [0,1] - = 1 while the receive thread is updating the interval data
+	#else
+		uint32_t epoch;
+		pthread_mutex_t _epoch_mut;
+	#endif
+
+	// Sequence number tracking state, which spans over consecutive flush intervals: it is read and written only by the
+	// receive thread, which rolls it over to the next interval as soon as it detects a new epoch
+	uint32_t _rxEpoch;				// # - epoch of the interval data updated by the last received packet
+	int64_t _maxSeqNumber;			// # - not sent to Graphite (used for the current flush interval packet loss estimation)
+	int64_t _precMaxSeqNumber;		// # - not sent to Graphite (used for the current flush interval packet loss estimation)
+	uint8_t _detectedSeqNoReset; 	// [0,1] - = 0 if no sequence number cyclical reset has been detected in the current flush interval, = 1 otherwise
+
 	carbonDupStoreList dupCountList;	// Data struct - allocated and updated only if -D is not specified
 
-	int socketDescriptor;		// written only once when opening the socket to Carbon/Graphite with openCarbonReportSocket() in carbon_report_manager.h/.c
+	struct _carbonSink *sink;	// written only once when opening the socket to Carbon/Graphite with openCarbonReportSocket() in carbon_report_manager.h/.c (see carbon_sink.h)
 } carbonReportStructure;
 
+// Running aggregate of all the sessions served in continuous daemon mode by (or from) the same client, or by all the
+// clients (--aggregate-stats, see aggr_table.h), updated, at the end of each session, by merging its report structure
+// Names of the aggregate of all the clients and of the aggregate of the clients which do not fit in the table
+#define AGGR_GLOBAL_NAME "global"
+#define AGGR_OTHER_NAME "other"
+
+typedef struct aggrStatsStructure {
+	char name[INET_ADDRSTRLEN];	// Client IP address, AGGR_GLOBAL_NAME or AGGR_OTHER_NAME
+	uint8_t isClient;			// [0,1] - = 1 if 'name' is the IP address of a single client, = 0 otherwise
+
+	uint64_t sessions;			// # - total number of sessions
+	uint64_t sessionsUnidir;	// # - unidirectional sessions
+	uint64_t sessionsPinglike;	// # - ping-like sessions
+	uint64_t sessionsTimedout;	// # - sessions terminated by the server timeout
+	uint64_t sessionsInterval;	// # - sessions ended since the last export (used to compute the session rate)
+
+	reportStructure report;		// Data struct - merged report of the unidirectional sessions (see reportStructureMerge())
+	latencyHist latencyHist;	// Data struct - merged latency histogram of the unidirectional sessions
+} aggrStatsStructure;
+
 #endif // LATENCYTEST_REPORTDATASTRUCTS_H_INCLUDED
\ No newline at end of file
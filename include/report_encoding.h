@@ -0,0 +1,80 @@
+#ifndef LATENCYTEST_REPORTENCODING_H_INCLUDED
+#define LATENCYTEST_REPORTENCODING_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include "report_data_structs.h"
+
+/* Binary encoding of the end-of-test report (sent by the server, inside CTRL_UNIDIR_REPORT packets)
+
+   Every multi-byte field is stored in network byte order (big endian); doubles are carried as their
+   IEEE 754 binary64 representation, so that no precision is lost (as it happened with the old "%.5lf" text encoding).
+
+   Encoded report layout:
+   +-------+-----------+---------+-------+-------------+----------+---------------+-----+-------+
+   | magic | version   | flags   | fixed | total       | fixed    | TLV section 1 | ... | CRC32 |
+   | (16)  | (8)       | (8)     | len   | length (32) | section  | (optional)    |     | (32)  |
+   |       |           |         | (16)  |             |          |               |     |       |
+   +-------+-----------+---------+-------+-------------+----------+---------------+-----+-------+
+   'fixed len' is the length of the fixed section: a newer peer can append fields to it, which will be
+   skipped by older decoders. The CRC32 (IEEE 802.3 polynomial) covers every byte preceding it.
+
+   TLV sections: type (16) - length of the value (16) - value
+   Unknown TLV sections are always skipped by the decoder.
+
+   When the encoded report does not fit inside a single LaMP packet, it is split into fragments,
+   each one starting with:
+   +-------+----------+----------+---------------+
+   | magic | fragment | fragment | total encoded |
+   | (16)  | idx (8)  | num (8)  | length (32)   |
+   +-------+----------+----------+---------------+ */
+
+#define REPORT_ENC_MAGIC 0x4C52 // 'LR'
+#define REPORT_ENC_VERSION 1
+#define REPORT_ENC_HDR_SIZE 10
+#define REPORT_ENC_FIXED_SIZE 80
+#define REPORT_ENC_TLV_HDR_SIZE 4
+#define REPORT_ENC_CRC_SIZE 4
+
+#define REPORT_FRAG_MAGIC 0x4C46 // 'LF'
+#define REPORT_FRAG_HDR_SIZE 8
+// Maximum amount of encoded report bytes carried by each fragment: together with the fragment header,
+// it should always fit inside a single LaMP packet (see MAX_PAYLOAD_SIZE_UDP_LAMP in options.h)
+#define REPORT_FRAG_MAX_PAYLOAD 1024
+#define REPORT_FRAG_MAX_SIZE (REPORT_FRAG_HDR_SIZE+REPORT_FRAG_MAX_PAYLOAD)
+#define REPORT_FRAG_MAX_NUM 64
+#define REPORT_ENC_MAX_SIZE (REPORT_FRAG_MAX_PAYLOAD*REPORT_FRAG_MAX_NUM)
+
+// TLV section types (0 is reserved)
+#define REPORT_TLV_RESERVED 0x0000
+#define REPORT_TLV_LOSS_BURST 0x0001
+
+// reportDecode() and reportReasm_*() return values
+#define REPORT_ENC_NOERR 0
+#define REPORT_REASM_COMPLETE 0
+#define REPORT_REASM_INCOMPLETE 1
+#define REPORT_ENC_ERR_SHORT -1
+#define REPORT_ENC_ERR_MAGIC -2
+#define REPORT_ENC_ERR_VERSION -3
+#define REPORT_ENC_ERR_CHECKSUM -4
+#define REPORT_ENC_ERR_MALFORMED -5
+#define REPORT_ENC_ERR_NOMEM -6
+
+#define CHECK_REASM_NULL(RR) (RR==NULL)
+
+typedef struct _reportReasm *reportReasm;
+
+uint8_t *reportEncode(reportStructure *report, size_t *encodedLen);
+int reportDecode(reportStructure *report, const uint8_t *buf, size_t len);
+unsigned int reportFragmentsNumber(size_t encodedLen);
+size_t reportFragmentPrepare(uint8_t *fragBuf, const uint8_t *encoded, size_t encodedLen, unsigned int fragIdx);
+
+reportReasm reportReasm_init(void);
+int reportReasm_add(reportReasm RR, const uint8_t *frag, size_t fragLen);
+int reportReasm_decode(reportReasm RR, reportStructure *report);
+void reportReasm_reset(reportReasm RR);
+void reportReasm_free(reportReasm RR);
+
+const char *reportEncErrStr(int err);
+
+#endif
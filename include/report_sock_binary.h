@@ -0,0 +1,40 @@
+#ifndef LATENCYTEST_REPORTSOCKBINARY_H_INCLUDED
+#define LATENCYTEST_REPORTSOCKBINARY_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include "report_data_structs.h"
+
+/* Binary framing for the '-w' per-packet UDP feed (--report-socket-binary)
+
+   Each UDP datagram contains a header, followed by one or more fixed-size records (more than one only when
+   --report-socket-batch is specified too). All the multi-byte fields are in little-endian byte order.
+
+   Datagram header:
+   +--------+---------+----------+-------+---------------+-----------+-------------+
+   | magic  | version | reserved | LaMP  | datagram seq  | number of | record size |
+   | 'LTBW' | (8)     | (8)      | ID    | (64)          | records   | [B] (16)    |
+   | (32)   |         |          | (16)  |               | (16)      |             |
+   +--------+---------+----------+-------+---------------+-----------+-------------+
+
+   Record (the fields in brackets are present only in follow-up mode, or when the corresponding -X field is enabled):
+   +-----+------------+-----------------+--------------+-------+--------------+---------+-------------+-------------+
+   | seq | latency    | [est. proc.     | tx timestamp | error | [PER till    | [full   | [curr. min  | [curr. max  |
+   | u64 | [ns] i64   |  time [ns] u64] | [ns] i64     | u8    |  now f64]    | seq u64]| [ns] i64]   | [ns] i64]   |
+   +-----+------------+-----------------+--------------+-------+--------------+---------+-------------+-------------+
+   The same layout is also described in 'LaTeINIT', through the 'binlayout=' field, as a ';'-separated list of
+   '<field name>:<type>' elements, e.g. 'binlayout=seq:u64;latency_ns:i64;tx_timestamp_ns:i64;error:u8'.
+   The tx timestamp is expressed in ns since the epoch. */
+
+#define REPORT_SOCK_BIN_MAGIC 0x5742544C // 'LTBW', when written in little-endian byte order
+#define REPORT_SOCK_BIN_VERSION 1
+#define REPORT_SOCK_BIN_HDR_SIZE 20
+// Maximum size of a record (all the optional fields included)
+#define REPORT_SOCK_BIN_MAX_RECORD_SIZE (4*8+1+4*8)
+
+size_t reportSockBinaryRecordSize(int followup_on_flag,uint16_t enabled_extra_data);
+int reportSockBinaryLayoutPrint(char *buf,size_t bufsize,int followup_on_flag,uint16_t enabled_extra_data);
+size_t reportSockBinaryHeaderEncode(uint8_t *buf,uint16_t test_id,uint64_t dgram_seq,uint16_t nrecords,uint16_t record_size);
+size_t reportSockBinaryRecordEncode(uint8_t *buf,perPackerDataStructure *perPktData,perPacketExtraData *extraData);
+
+#endif
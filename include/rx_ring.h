@@ -0,0 +1,46 @@
+#ifndef LATENCYTEST_RXRING_H_INCLUDED
+#define LATENCYTEST_RXRING_H_INCLUDED
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include "rawsock.h"
+#include "rawsock_lamp.h"
+
+// TPACKET_V3 mmap'd receive ring for the raw client and server (--rx-ring)
+// A second AF_PACKET socket, bound to the interface used for the test, receives the LaMP data packets (selected by their
+// control field, with the same masks used by the AF_XDP socket, see xdp_sock.h) into a ring shared with the kernel, without
+// any copy and without any system call as long as there are packets ready: the kernel fills one block of frames at a time,
+// and hands it to userspace when it is full, or when the retire timeout (--rx-ring-timeout) expires
+// A classic BPF filter selects the packets on the ring socket, while the complementary filter is attached to the companion
+// socket used for the control packets (INIT, ACK, REPORT, ...), so that each packet is received by only one of them
+// Each frame carries the kernel timestamp of the packet (the hardware one, when requested and available): the timestamp
+// is taken when the packet is received, thus it does not depend on when the block is handed to userspace
+
+// Size and number of the blocks of the ring, and maximum size of each frame (any bigger packet is truncated)
+#define RX_RING_BLOCK_SIZE (1<<18)
+#define RX_RING_BLOCK_NR 16
+#define RX_RING_FRAME_SIZE 2048
+
+#define CHECK_RR_NULL(RR) (RR==NULL)
+
+typedef struct _rxRing *rxRing;
+
+// Frame received by rxRingRecv(): 'data' points to the Ethernet header, inside the ring, and it remains valid (and can be
+// modified, e.g. to build a reply in place) until the next call to rxRingRecv() or rxRingFree()
+typedef struct rxRingFrame {
+	byte_t *data;
+	ssize_t len;
+	struct timeval ts; // Kernel (or hardware) receive timestamp
+	uint8_t ts_hw; // = 1 if 'ts' is a hardware timestamp, = 0 otherwise
+	uint8_t pkttype; // As in struct sockaddr_ll (PACKET_HOST, PACKET_OUTGOING, ...)
+} rxRingFrame;
+
+// 'ctl_fd' is the AF_PACKET socket used for the same test: its SO_RCVTIMEO timeout is applied to rxRingRecv() too
+// 'blk_tov' is the block retire timeout, in ms; when 'hw_timestamps' is 1, the frames carry the hardware timestamps
+rxRing rxRingInit(const char *devname, int ifindex, uint16_t udp_port, uint32_t ctrl_mask, int ctl_fd, uint32_t blk_tov, uint8_t hw_timestamps);
+ssize_t rxRingRecv(rxRing RR, rxRingFrame *frame);
+int rxRingSetTimestamping(rxRing RR, uint8_t hw_timestamps);
+void rxRingFree(rxRing RR);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef LATENCYTEST_SESSIONTABLE_H_INCLUDED
+#define LATENCYTEST_SESSIONTABLE_H_INCLUDED
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define CHECK_ST_NULL(ST) (ST==NULL)
+
+// sessionTable errors
+#define ST_EXISTS	3
+#define ST_NOTFOUND	2
+#define ST_NOMEM	1
+#define ST_NOERR	0
+
+// Minimum number of buckets of the table (the table is grown, doubling the number of buckets, when the number of sessions
+// becomes larger than twice the number of buckets)
+#define ST_MIN_BUCKETS 64
+
+// Key identifying a server session: client IP address, client UDP port and LaMP id (all in network byte order, except
+// the LaMP id)
+typedef struct sessionKey {
+	in_addr_t ip;
+	in_port_t port;
+	uint16_t lamp_id;
+} sessionKey;
+
+// Callback used by sessionTableForEach(): it should return 1 if the entry should be removed from the table (in this case,
+// the callback is responsible for freeing 'session', if needed), 0 otherwise
+typedef int (*sessionTableCallback)(sessionKey key,void *session,void *arg);
+
+typedef struct _sessionTable *sessionTable;
+
+sessionTable sessionTableInit(unsigned int size);
+void *sessionTableLookup(sessionTable ST,sessionKey key);
+int sessionTableInsert(sessionTable ST,sessionKey key,void *session);
+void *sessionTableRemove(sessionTable ST,sessionKey key);
+void sessionTableForEach(sessionTable ST,sessionTableCallback callback,void *arg);
+unsigned int sessionTableCount(sessionTable ST);
+void sessionTableFree(sessionTable ST);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef LATENCYTEST_TFILEBINARY_H_INCLUDED
+#define LATENCYTEST_TFILEBINARY_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include "report_data_structs.h"
+
+/* Binary per-packet trace format ('-W' with --report-perpacket-binary)
+
+   A trace file is a sequence of sections, each one describing a single test: a new section is started every time
+   the file is opened (including when LaTe is appending data to an already existing file).
+   Each section starts with a header record, followed by one record for each packet.
+
+   Every record starts with a 'tag' byte: if its most significant bit is set, the record is a header record,
+   otherwise it is a packet record, and the least significant bit of the tag is the error flag of the packet.
+
+   Header record (multi-byte fields in network byte order):
+   +------+-------+---------+-------+---------+----------+-------+------+---------+-----------+
+   | tag  | magic | version | LaMP  | latency | follow-  | -X    | side | decimal | time unit |
+   | 0x80 | 'LTBT'| (8)     | ID    | type    | up (8)   | mask  | (8)  | digits  | [ns]      |
+   | (8)  | (32)  |         | (16)  | (8)     |          | (16)  |      | (8)     | (32)      |
+   +------+-------+---------+-------+---------+----------+-------+------+---------+-----------+
+
+   Packet record: all the values are LEB128 varints; signed values are zigzag-encoded and all the times
+   are expressed in 'time unit' (i.e. in us, at the moment):
+   +-----+------------+------------+--------------+-----------+-------------------------+
+   | tag | seq delta  | latency    | proc. time   | tx time   | -X extra fields         |
+   | (8) | (signed,   | (signed)   | (follow-up   | delta     | (only the enabled ones) |
+   |     | from prev) |            | mode only)   | (signed)  |                         |
+   +-----+------------+------------+--------------+-----------+-------------------------+
+   -X extra fields: 'p' -> IEEE 754 binary64 (64, network byte order), 'r' -> unsigned varint,
+   'm', 'n' -> signed varints, in 'time unit' (-1 ms is used when the value is not available).
+   The first packet record of each section is delta-encoded with respect to 0. */
+
+#define TFILE_BIN_TAG_HEADER 0x80
+#define TFILE_BIN_TAG_ERROR 0x01
+#define TFILE_BIN_MAGIC 0x4C544254 // 'LTBT'
+#define TFILE_BIN_VERSION 1
+#define TFILE_BIN_TIME_UNIT_NS 1000
+#define TFILE_BIN_HDR_SIZE 18
+// Maximum size of a packet record (tag + 4 varints + 'p' + 3 varints)
+#define TFILE_BIN_MAX_RECORD_SIZE (1+4*10+8+3*10)
+
+// Side of the test which is writing the trace
+#define TFILE_BIN_SIDE_CLIENT 0
+#define TFILE_BIN_SIDE_SERVER 1
+
+typedef struct tfileBinaryHeader {
+	uint16_t lamp_id;
+	uint8_t latency_type; // latencytypes_t value
+	uint8_t followup_on_flag;
+	uint16_t enabled_extra_data;
+	uint8_t side; // TFILE_BIN_SIDE_CLIENT or TFILE_BIN_SIDE_SERVER
+	uint8_t decimal_digits; // Number of decimal digits which should be used when converting the trace to CSV
+} tfileBinaryHeader;
+
+// Delta encoding state, reset at the beginning of each section
+typedef struct tfileBinaryState {
+	uint64_t prevSeqNo;
+	int64_t prevTxTime;
+	uint8_t followup_on_flag;
+	uint16_t enabled_extra_data;
+} tfileBinaryState;
+
+size_t tfileBinaryHeaderEncode(uint8_t *buf,tfileBinaryHeader *hdr,tfileBinaryState *state);
+size_t tfileBinaryRecordEncode(uint8_t *buf,tfileBinaryState *state,perPackerDataStructure *perPktData,perPacketExtraData *extraData);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef LATENCYTEST_TFILEWRITER_H_INCLUDED
+#define LATENCYTEST_TFILEWRITER_H_INCLUDED
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include "report_data_structs.h"
+#include "tfile_binary.h"
+
+// Asynchronous writer for the per-packet data ('-W' CSV file)
+// The receive thread pushes fixed-size records inside a single producer single consumer ring buffer, without performing
+// any system call or any formatting; a separate thread periodically formats the queued records and writes them to the
+// file in large blocks, with writev()
+// Records can be written either as CSV lines or using the binary trace format defined in tfile_binary.h
+// The same writer is also used for the batched '-w' mode (--report-socket-batch): in this case, the records are packed
+// into multi-record UDP datagrams (text or binary, see report_sock_binary.h), which are sent with sendmmsg() every
+// TFILE_WRITER_SOCK_DEADLINE ms at most
+// If the writer thread cannot keep up with the incoming packets, the new records are dropped (and counted), without
+// ever blocking the receive thread
+// The '-W' file can also be rotated by size and/or by wall-clock interval (see tfileRotationParams): the segments are
+// opened (one in advance), closed and passed to the optional hook command only by the writer thread
+
+// Number of records in the ring buffer (it must be a power of 2)
+#define TFILE_WRITER_RING_SIZE 8192
+// Interval (in ms) after which the writer thread checks for new records
+#define TFILE_WRITER_POLL_INTERVAL 50
+// Size and number of the blocks written with each writev() call (each block is filled up to the point where
+// a full CSV line, or binary record, of maximum size could not fit anymore)
+#define TFILE_WRITER_BLOCK_SIZE 65536
+#define TFILE_WRITER_IOV_NUM 4
+
+// Batched '-w' mode: maximum time (in ms) a record can wait before being sent, and maximum number of datagrams
+// sent with a single sendmmsg() call
+#define TFILE_WRITER_SOCK_DEADLINE 10
+#define TFILE_WRITER_SOCK_BATCH 32
+// Space reserved for the header of each datagram (i.e. the 'LaTeB,<LaMP ID>,<datagram sequence number>,<number of records>'
+// line, or the binary header defined in report_sock_binary.h)
+#define TFILE_WRITER_SOCK_HDR_SIZE 48
+
+#define CHECK_TW_NULL(TW) (TW==NULL)
+
+typedef struct _tfileWriter *tfileWriter;
+
+// Rotation of the '-W' file: a new segment, named <first segment name without extension>_seg<n>.<extension>, is started when
+// the current one becomes larger than 'size' bytes, and/or when a multiple of 'interval' s (since the Epoch) is reached
+// The first segment is the file passed to tfileWriterInit(), which should have been opened with openTfileNamed()
+typedef struct {
+	uint64_t size; // Maximum size of each segment, in bytes (=0: no size-based rotation)
+	uint32_t interval; // Rotation interval, in s (=0: no time-based rotation)
+	const char *hook; // Command executed through '/bin/sh -c' on each closed segment, with its name as $1 (NULL: no command)
+	const char *filename; // Name of the first segment
+	uint8_t overwrite; // =1 to overwrite already existing segments, =0 to skip them
+	int followup_on_flag; // Used to write the CSV header of each new segment
+	char enabled_extra_data; // Used to write the CSV header of each new segment
+} tfileRotationParams;
+
+tfileWriter tfileWriterInit(int Tfiledescriptor,int decimal_digits,tfileBinaryHeader *binaryHeader,tfileRotationParams *rotation);
+tfileWriter tfileWriterInitSocket(int sockfd,struct sockaddr_in *addrto,int decimal_digits,uint16_t test_id,uint8_t binary);
+int tfileWriterPush(tfileWriter TW,perPackerDataStructure *perPktData);
+void tfileWriterFree(tfileWriter TW);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef LATENCYTEST_TXRING_H_INCLUDED
+#define LATENCYTEST_TXRING_H_INCLUDED
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/if_packet.h>
+#include "rawsock.h"
+#include "rawsock_lamp.h"
+#include "packet_structs.h"
+
+// PACKET_TX_RING transmission path for the raw client (--tx-ring)
+// The frames are built directly inside the slots of a TPACKET_V2 ring shared with the kernel, owned by a second AF_PACKET
+// socket, and they are handed to the kernel with a single sendto() "kick" for each batch of opts->tx_ring_batch frames
+// (or as soon as the last frame of the test is written), instead of calling sendto() for each frame; the LaMP timestamp of each
+// frame is set only just before its kick
+// When requested, the socket bypasses the qdisc layer (PACKET_QDISC_BYPASS, --qdisc-bypass), sending the frames directly to
+// the driver; when transmit timestamps are requested, they are reported through the error queue of the ring socket (see txRingFd())
+
+// Number of slots of the ring and size of each slot (including the TPACKET_V2 header)
+#define TX_RING_FRAME_NR 256
+#define TX_RING_FRAME_SIZE 2048
+// Offset of the frame data inside each slot, and maximum size of a frame
+#define TX_RING_DATA_OFFSET (TPACKET2_HDRLEN-sizeof(struct sockaddr_ll))
+#define TX_RING_MAX_FRAME_LEN (TX_RING_FRAME_SIZE-TX_RING_DATA_OFFSET)
+
+// Transmit timestamps to be requested on the ring socket (see txRingInit())
+#define TX_RING_TSTAMP_NONE 0
+#define TX_RING_TSTAMP_SW 1
+#define TX_RING_TSTAMP_HW 2
+
+#define CHECK_TR_NULL(TR) (TR==NULL)
+
+typedef struct _txRing *txRing;
+
+// 'ctl_fd' is the AF_PACKET socket used for the same test, whose SO_PRIORITY is applied to the ring socket too, and 'addrll' is
+// the address the frames are sent to; 'tx_timestamps' is one of the TX_RING_TSTAMP_* values
+// A ring can be used by only one thread at a time
+txRing txRingInit(const char *devname, int ctl_fd, struct sockaddr_ll addrll, unsigned int batch, uint8_t qdisc_bypass, uint8_t tx_timestamps);
+byte_t *txRingGetFrame(txRing TR);
+size_t txRingLampFrameBuild(byte_t *frame, struct pktheaders_udp *headers, byte_t *payload, size_t payloadlen);
+int txRingLampSend(txRing TR, struct lamphdr *inpacket_lamphdr, byte_t *frame, size_t len, endflag_t flag);
+int txRingFlush(txRing TR);
+int txRingFd(txRing TR);
+void txRingFree(txRing TR);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef LATENCYTEST_UDPREFLECTOR_H_INCLUDED
+#define LATENCYTEST_UDPREFLECTOR_H_INCLUDED
+
+#include "options.h"
+#include "rawsock_lamp.h"
+#include "common_socket_man.h"
+#include "xdp_sock.h"
+
+// Batched reflector for the ping-like sessions without follow-up (--reflector-batch): the requests are received in batches
+// with recvmmsg(), their control field is rewritten in place and the whole batch is sent back with sendmmsg()
+// After the first request of a batch is received, the reflector waits for up to opts->reflector_batch_latency us for more
+// requests, before replying (0: only the requests already queued in the socket are added to the batch)
+// The server residence time (from the kernel receive timestamp to the transmission) is measured for each packet
+
+// In-kernel reflector (--xdp-reflector): the requests are reflected by an XDP program (see xdp_sock.h), while the server
+// only polls its counters, every XDP_REFLECTOR_POLL_INTERVAL ms, to detect the end of the session or the timeout
+#define XDP_REFLECTOR_POLL_INTERVAL 10
+
+// udpReflectorRun() and udpXdpReflectorRun() return values
+#define REFLECTOR_END		0 // The last request of the session (ENDREQ) has been reflected
+#define REFLECTOR_TIMEOUT	1 // No request was received for the whole server timeout
+#define REFLECTOR_ERROR		2 // Memory allocation or socket error
+
+int udpReflectorRun(struct lampsock_data sData, struct options *opts, uint16_t lamp_id);
+int udpXdpReflectorRun(struct lampsock_data sData, struct options *opts, uint16_t lamp_id);
+
+#endif
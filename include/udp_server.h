@@ -6,5 +6,6 @@
 #include "common_socket_man.h"
 
 unsigned int runUDPserver(struct lampsock_data sData, struct options *opts);
+void runUDPserverFree(void);
 
 #endif
\ No newline at end of file
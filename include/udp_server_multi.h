@@ -0,0 +1,29 @@
+#ifndef LATENCYTEST_UDPSERVERMULTI_H_INCLUDED
+#define LATENCYTEST_UDPSERVERMULTI_H_INCLUDED
+
+#include <signal.h>
+#include "options.h"
+#include "rawsock_lamp.h"
+#include "common_socket_man.h"
+
+// Multi-session UDP server (--multi-session): the same socket is used to serve any number of concurrent sessions, each one
+// identified by the client IP address, UDP port and LaMP id (see session_table.h), and with its own mode, follow-up mode,
+// report, '-W' file, Carbon metrics ('-g') and timeout
+// A single loop receives all the packets, without ever blocking on a single session: the INIT procedure, the report
+// transmission (with its retries) and the session timeouts are all managed inside this loop
+// With --server-threads, the server is sharded over more threads, each one running this loop on its own socket of the same
+// SO_REUSEPORT group and with its own session table: the kernel picks the socket (i.e. the thread) depending on the hash of
+// the client IP address and port or, with --reuseport-cbpf, depending on the LaMP id of each packet
+
+// Maximum time (in ms) the server waits for new packets before checking the session timeouts and the pending reports
+#define MULTI_SESSION_TICK_MS 50
+// Maximum number of packets received in a row, before checking the session timeouts and the pending reports
+#define MULTI_SESSION_MAX_RX_BURST 64
+// Expected number of concurrent sessions (the session table is anyway grown when needed)
+#define MULTI_SESSION_TABLE_SIZE 64
+// Initial size of the list of the sessions whose Carbon metrics are flushed together by each thread (grown when needed)
+#define MULTI_SESSION_CARBON_LIST_SIZE 64
+
+unsigned int runUDPserverMulti(struct lampsock_data sData, struct options *opts, volatile sig_atomic_t *stop_flag);
+
+#endif
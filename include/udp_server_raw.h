@@ -7,5 +7,6 @@
 #include "common_socket_man.h"
 
 unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, struct in_addr srcIP, struct options *opts);
+void runUDPserverFree_raw(void);
 
 #endif
\ No newline at end of file
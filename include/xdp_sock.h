@@ -0,0 +1,60 @@
+#ifndef LATENCYTEST_XDPSOCK_H_INCLUDED
+#define LATENCYTEST_XDPSOCK_H_INCLUDED
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "rawsock.h"
+#include "rawsock_lamp.h"
+
+// AF_XDP transport for the raw client and server (--xdp)
+// A small XDP program, attached to the interface used for the test, redirects the LaMP data packets (i.e. the requests,
+// replies, unidirectional packets and follow-ups, selected by their control field) received on one RX queue to an AF_XDP
+// socket, while any other packet (including the LaMP INIT, ACK and REPORT control packets) still reaches the AF_PACKET socket
+// The frames are received from and transmitted to a UMEM area shared with the kernel, through the fill/completion/rx/tx rings,
+// and they are built with the same raw header builders used for AF_PACKET (etherheadPopulate(), IP4headPopulateS(), ...)
+// The XDP program is attached in native (driver) mode when possible (unless --xdp-generic is specified), otherwise in generic
+// (skb) mode, which works on any device, including veth; the socket is bound in zero-copy mode only when the driver supports it, otherwise in copy mode
+
+// Number of UMEM frames and size of each frame: the first half of the frames is given to the kernel, through the fill ring,
+// for the reception, while the second half is used for the transmission
+#define XDP_SOCK_NUM_FRAMES 4096
+#define XDP_SOCK_FRAME_SIZE 2048
+// Number of descriptors in each ring (it should be a power of 2, not smaller than XDP_SOCK_NUM_FRAMES/2)
+#define XDP_SOCK_RING_SIZE 2048
+
+// Control fields masks: bit 'n' is set when the LaMP packets with control field 'n' should be redirected to the AF_XDP socket
+// Only the lowest 4 bits of the control field are used, as the highest ones are the same for all the LaMP packets
+#define XDP_SOCK_CTRL_BIT(ctrl) (1U<<((ctrl) & 0x0F))
+#define XDP_SOCK_CLIENT_CTRL_MASK (XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_REPLY) | XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_ENDREPLY) | \
+	XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_REPLY_TLESS) | XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_ENDREPLY_TLESS) | XDP_SOCK_CTRL_BIT(CTRL_FOLLOWUP_DATA))
+#define XDP_SOCK_SERVER_CTRL_MASK (XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_REQ) | XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_ENDREQ) | \
+	XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_REQ_TLESS) | XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_ENDREQ_TLESS) | \
+	XDP_SOCK_CTRL_BIT(CTRL_UNIDIR_CONTINUE) | XDP_SOCK_CTRL_BIT(CTRL_UNIDIR_STOP) | XDP_SOCK_CTRL_BIT(CTRL_FOLLOWUP_CTRL))
+
+#define CHECK_XS_NULL(XS) (XS==NULL)
+#define CHECK_XR_NULL(XR) (XR==NULL)
+
+typedef struct _xdpSock *xdpSock;
+typedef struct _xdpReflector *xdpReflector;
+
+// 'ctl_fd' is the AF_PACKET socket used for the same test: its SO_RCVTIMEO timeout is applied to xdpSockRecv() too
+// xdpSockRecv() and xdpSockSend()/xdpLampSend() use different rings, thus they can be called at the same time by two threads
+// (e.g. by the rx and tx loops of the client), but each of them should not be called by more than one thread
+// When 'force_generic' is 1, the XDP program is always attached in generic mode
+xdpSock xdpSockInit(const char *devname, int ifindex, uint32_t queue, uint16_t udp_port, uint32_t ctrl_mask, int ctl_fd, uint8_t force_generic);
+ssize_t xdpSockRecv(xdpSock XS, byte_t *buf, size_t len);
+int xdpSockSend(xdpSock XS, byte_t *frame, size_t len);
+int xdpLampSend(xdpSock XS, struct lamphdr *inpacket_lamphdr, byte_t *frame, size_t len, endflag_t flag);
+const char *xdpSockModeStr(xdpSock XS);
+void xdpSockFree(xdpSock XS);
+
+// In-kernel reflector for the ping-like sessions (--xdp-reflector): an XDP program replies with XDP_TX to the requests of the
+// session with id 'lamp_id' received on 'udp_port' (using 'dst_port', if >0, as destination port of the replies), while any
+// other packet, including the control ones, still reaches the userspace server
+// The reflector is active until xdpReflectorFree() is called
+xdpReflector xdpReflectorInit(const char *devname, int ifindex, uint16_t udp_port, uint16_t lamp_id, int dst_port, uint8_t force_generic);
+int xdpReflectorGetCounters(xdpReflector XR, uint64_t *reflected, uint64_t *ended);
+const char *xdpReflectorModeStr(xdpReflector XR);
+void xdpReflectorFree(xdpReflector XR);
+
+#endif
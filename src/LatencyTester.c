@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/time.h>
 #include "rawsock.h"
 #include "rawsock_lamp.h"
 #include "timer_man.h"
@@ -9,12 +10,15 @@
 #include "udp_server_raw.h"
 #include "udp_client.h"
 #include "udp_server.h"
+#include "udp_server_multi.h"
 #include "options.h"
 #include <linux/wireless.h>
 #include <signal.h>
 #include "common_socket_man.h"
 #include <errno.h>
 #include "report_manager.h"
+#include "aggr_table.h"
+#include "admission_ctrl.h"
 
 #if AMQP_1_0_ENABLED
 #include <proton/proactor.h>
@@ -62,6 +66,12 @@ int main (int argc, char **argv) {
 	// Data for the UDP Socket when -w is specified
 	report_sock_data_t sock_w_data;
 
+	// In continuous daemon mode, the UDP server keeps the same socket (and its pre-allocated session data) for all the sessions,
+	// instead of re-opening it for each session: the packets of a new session, received while the previous one is being
+	// closed, are thus queued instead of being dropped
+	uint8_t persistent_server=0;
+	uint8_t socket_opened=0;
+
 	// Read options from command line
 	options_initialize(&opts);
 	if(parse_options(argc, argv, &opts)) {
@@ -69,6 +79,8 @@ int main (int argc, char **argv) {
 		exit(EXIT_FAILURE);
 	}
 
+	persistent_server=opts.dmode && opts.protocol==UDP && !opts.multi_session && (opts.mode_cs==SERVER || opts.mode_cs==LOOPBACK_SERVER);
+
 	// Print an info message when in continuous daemon mode
 	if(opts.dmode) {
 		fprintf(stdout,"The server will run in continuous mode. You can terminate it by calling 'kill -s USR1 <pid>'\n"
@@ -93,12 +105,45 @@ int main (int argc, char **argv) {
 			fprintf(stdout,"The program is bound to IP address: %s\n\n",
 				inet_ntoa(opts.opt_ipaddr));
 		}
+
+		// No session has ended yet
+		timerclear(&(sData.session_end));
+
+		// With --aggregate-stats, the statistics of all the sessions are aggregated (and periodically exported) until the
+		// server is terminated
+		sData.aggr_table=NULL;
+		if(opts.aggr_interval>0) {
+			sData.aggr_table=aggrTableInit(&opts);
+			if(CHECK_AT_NULL(sData.aggr_table)) {
+				fprintf(stderr,"Error: cannot allocate the table for the aggregated statistics.\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		// With --rate-limit and --max-sessions, the same limits apply to all the sessions (and to all the server threads)
+		sData.admission_ctrl=NULL;
+		if(opts.rate_limit>0 || opts.max_sessions>0) {
+			sData.admission_ctrl=admissionCtrlInit(&opts);
+			if(CHECK_AC_NULL(sData.admission_ctrl)) {
+				fprintf(stderr,"Error: cannot allocate the admission control data.\n");
+				exit(EXIT_FAILURE);
+			}
+		}
 	}
 
 	do {
 		if(opts.protocol!=AMQP_1_0) {
-			if(!socketOpen(opts.protocol,&sData,&opts,&addresses)) {
-				exit(EXIT_FAILURE);
+			if(socket_opened) {
+				// Persistent server socket: just disable the timestamps which may have been requested by the previous client
+				if(socketResetTimestamping(sData)<0) {
+					fprintf(stderr,"Warning: cannot reset the socket timestamping options of the previous session.\n");
+				}
+			} else {
+				if(!socketOpen(opts.protocol,&sData,&opts,&addresses)) {
+					exit(EXIT_FAILURE);
+				}
+
+				socket_opened=persistent_server;
 			}
 		}	
 		#if AMQP_1_0_ENABLED
@@ -207,7 +252,9 @@ int main (int argc, char **argv) {
 			case SERVER:
 			case LOOPBACK_SERVER:
 				if(opts.protocol==UDP) {
-					if(opts.mode_raw == RAW ? runUDPserver_raw(sData, addresses.srcmacaddr, addresses.srcIPaddr, &opts) : runUDPserver(sData, &opts)) {
+					// With --multi-session, runUDPserverMulti() serves all the sessions, returning only after end_prog_flag is set
+					if(opts.mode_raw == RAW ? runUDPserver_raw(sData, addresses.srcmacaddr, addresses.srcIPaddr, &opts) :
+						(opts.multi_session ? runUDPserverMulti(sData, &opts, &end_prog_flag) : runUDPserver(sData, &opts))) {
 						if(!opts.dmode) {
 							close(sData.descriptor);
 							exit(EXIT_FAILURE);
@@ -233,13 +280,36 @@ int main (int argc, char **argv) {
 				break;
 		}
 
-		close(sData.descriptor);
+		if(persistent_server) {
+			// Used to report the gap between the end of this session and the beginning of the next one
+			gettimeofday(&(sData.session_end),NULL);
+		} else {
+			close(sData.descriptor);
+		}
 
 		// If -w was specified (i.e. if pts.udp_params.enabled is equal to 1), close the additional UDP socket
 		if(opts.udp_params.enabled) {
 			closeReportSocket(&sock_w_data);
 		}
-	} while(opts.dmode && !end_prog_flag && (opts.mode_cs==SERVER || opts.mode_cs==LOOPBACK_SERVER));  // Continuosly run the server if the 'continuous daemon mode' is selected (a new socket will be created for each new session)
+	} while(opts.dmode && !end_prog_flag && (opts.mode_cs==SERVER || opts.mode_cs==LOOPBACK_SERVER));  // Continuosly run the server if the 'continuous daemon mode' is selected (the same socket is kept for all the sessions)
+
+	if(socket_opened) {
+		close(sData.descriptor);
+
+		if(opts.mode_raw==RAW) {
+			runUDPserverFree_raw();
+		} else {
+			runUDPserverFree();
+		}
+	}
+
+	if(opts.protocol!=AMQP_1_0 && !CHECK_AT_NULL(sData.aggr_table)) {
+		aggrTableFree(sData.aggr_table);
+	}
+
+	if(opts.protocol!=AMQP_1_0 && !CHECK_AC_NULL(sData.admission_ctrl)) {
+		admissionCtrlFree(sData.admission_ctrl);
+	}
 
 	fprintf(stdout,"\nProgram terminated.\n");
 
@@ -0,0 +1,286 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "admission_ctrl.h"
+
+#if (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__))
+	#include <stdatomic.h>
+	#define AC_ATOMICS_SUPPORTED 1
+	typedef _Atomic uint64_t acCounter;
+#else
+	#define AC_ATOMICS_SUPPORTED 0
+	typedef uint64_t acCounter;
+#endif
+
+// The times are counted in units of 1/2^AC_TIME_SHIFT ns since admissionCtrlInit(), so that the time taken by each packet
+// is close enough to 1/rate even at the highest rates (the counters overflow only after about 36 years)
+#define AC_TIME_SHIFT 4
+
+// Each bucket is stored as the time at which it will be full again (a GCRA "theoretical arrival time"), which is the same as
+// storing its number of tokens and the time of its last refill: at time 'now', it contains capacity-(tat-now)/cost tokens
+// (or it is full, if tat<=now); this makes it possible to update it with a single compare-and-swap
+struct tokenBucket {
+	acCounter owner; // AC_OWNER(ip) of the client using the slot, or 0 if the slot is empty
+	acCounter tat;
+};
+
+#define AC_OWNER(ip) (((uint64_t) 1<<32) | (uint32_t) (ip))
+
+struct _admissionCtrl {
+	uint64_t rate; // packets/s (0: no rate limit)
+	uint64_t cost; // Time taken by each packet (1/rate s), in AC_TIME_SHIFT units
+	uint64_t capacity; // Time needed to fill an empty bucket, in AC_TIME_SHIFT units
+	uint64_t start_ns;
+	uint32_t max_sessions; // 0: no limit
+
+	// Protects the session counters; if C11 atomic variables are not supported, it protects the buckets too
+	pthread_mutex_t mut;
+
+	struct tokenBucket *buckets;
+	struct tokenBucket overflow; // Shared by the clients which do not find a free slot in the table
+
+	uint32_t sessions; // Number of currently active sessions
+
+	// Counters printed by admissionCtrlFree()
+	acCounter packets_limited;
+	acCounter packets_overflow; // Packets checked against the shared bucket
+	uint64_t inits_refused; // INIT packets ignored because of the maximum number of sessions
+	uint32_t sessions_peak;
+};
+
+static inline uint64_t acLoad(acCounter *var) {
+	#if AC_ATOMICS_SUPPORTED
+		return atomic_load_explicit(var,memory_order_relaxed);
+	#else
+		return *var;
+	#endif
+}
+
+static inline void acIncrement(acCounter *var) {
+	#if AC_ATOMICS_SUPPORTED
+		atomic_fetch_add_explicit(var,1,memory_order_relaxed);
+	#else
+		(*var)++;
+	#endif
+}
+
+// Set 'var' to 'desired' only if it is still equal to '*expected'; otherwise, '*expected' is updated with its current value
+// and 0 is returned
+static inline int acCompareExchange(acCounter *var,uint64_t *expected,uint64_t desired) {
+	#if AC_ATOMICS_SUPPORTED
+		return atomic_compare_exchange_weak_explicit(var,expected,desired,memory_order_relaxed,memory_order_relaxed);
+	#else
+		if(*var!=*expected) {
+			*expected=*var;
+			return 0;
+		}
+
+		*var=desired;
+		return 1;
+	#endif
+}
+
+// Fibonacci (multiplicative) hashing of the IP address, as in session_table.c
+static inline uint64_t ipHash(in_addr_t ip,unsigned int bits) {
+	return ((uint64_t) ip*0x9E3779B97F4A7C15ULL)>>(64-bits);
+}
+
+static inline uint64_t monotonicNs(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+
+	return (uint64_t) now.tv_sec*1000000000ULL+now.tv_nsec;
+}
+
+// Get the bucket of a client: its own slot, if it has one, otherwise the first empty slot, or the first slot whose bucket is
+// full (i.e. not used for a while), in the AC_PROBE_WINDOW slots starting from the hash of its address
+// A full bucket is the same as a new one, thus a slot is taken just by setting its owner; NULL is returned if none of these
+// slots can be used, or if another thread takes the chosen slot first
+// If a slot is taken while another thread is checking a packet of its previous client against it, that packet is counted
+// against the bucket of the new client: as this can only happen to a full bucket, at most one token is lost
+static struct tokenBucket *admissionCtrlGetBucket(admissionCtrl AC,in_addr_t ip,uint64_t now) {
+	uint64_t mask=((uint64_t) 1<<AC_TABLE_BITS)-1;
+	uint64_t idx=ipHash(ip,AC_TABLE_BITS);
+	uint64_t owner=AC_OWNER(ip);
+	uint64_t free_owner=0;
+	uint64_t slot_owner;
+	struct tokenBucket *free_slot=NULL;
+	struct tokenBucket *slot;
+
+	for(int i=0;i<AC_PROBE_WINDOW;i++) {
+		slot=&(AC->buckets[(idx+i) & mask]);
+		slot_owner=acLoad(&(slot->owner));
+
+		if(slot_owner==owner) {
+			return slot;
+		}
+
+		if(free_slot==NULL && (slot_owner==0 || acLoad(&(slot->tat))<=now)) {
+			free_slot=slot;
+			free_owner=slot_owner;
+		}
+	}
+
+	// The slot may have been taken by another packet of the same client in the meantime
+	if(free_slot!=NULL) {
+		while(!acCompareExchange(&(free_slot->owner),&free_owner,owner)) {
+			if(free_owner==owner) {
+				break;
+			} else if(free_owner!=0 && acLoad(&(free_slot->tat))>now) {
+				return NULL;
+			}
+		}
+	}
+
+	return free_slot;
+}
+
+// Refill a bucket and take a token from it; 0 is returned (and the bucket is not modified) if the bucket is empty
+static inline int tokenBucketTake(admissionCtrl AC,struct tokenBucket *bucket,uint64_t now) {
+	uint64_t tat=acLoad(&(bucket->tat));
+	uint64_t from;
+
+	do {
+		// An earlier 'now' read by another thread may have already been used: the bucket is never refilled twice
+		from=tat>now ? tat : now;
+
+		if(from+AC->cost-now>AC->capacity) {
+			return 0;
+		}
+	} while(!acCompareExchange(&(bucket->tat),&tat,from+AC->cost));
+
+	return 1;
+}
+
+admissionCtrl admissionCtrlInit(struct options *opts) {
+	admissionCtrl AC;
+
+	AC=calloc(1,sizeof(struct _admissionCtrl));
+	if(!AC) {
+		return NULL;
+	}
+
+	AC->rate=opts->rate_limit;
+	AC->max_sessions=opts->max_sessions;
+
+	if(AC->rate>0) {
+		// Round the time taken by each packet up, so that the rate limit is never exceeded
+		AC->cost=((1000000000ULL<<AC_TIME_SHIFT)+AC->rate-1)/AC->rate;
+		AC->capacity=(uint64_t) opts->rate_limit_burst*AC->cost;
+		AC->start_ns=monotonicNs();
+
+		// All the buckets, including the shared one, are initially empty slots with a full bucket (tat=0)
+		AC->buckets=calloc((size_t) 1<<AC_TABLE_BITS,sizeof(struct tokenBucket));
+		if(!AC->buckets) {
+			free(AC);
+			return NULL;
+		}
+	}
+
+	if(pthread_mutex_init(&(AC->mut),NULL)!=0) {
+		free(AC->buckets);
+		free(AC);
+		return NULL;
+	}
+
+	return AC;
+}
+
+// Check whether a packet received from 'ip' (in network byte order) is within the rate limit of its client
+// No lock is taken (unless C11 atomic variables are not supported), as this is called for every packet by every server thread
+int admissionCtrlPacket(admissionCtrl AC, in_addr_t ip) {
+	struct tokenBucket *bucket;
+	uint64_t now;
+	int return_val=AC_ACCEPT;
+
+	if(CHECK_AC_NULL(AC) || AC->rate==0) {
+		return AC_ACCEPT;
+	}
+
+	#if !AC_ATOMICS_SUPPORTED
+		pthread_mutex_lock(&(AC->mut));
+	#endif
+
+	now=(monotonicNs()-AC->start_ns)<<AC_TIME_SHIFT;
+
+	bucket=admissionCtrlGetBucket(AC,ip,now);
+	if(bucket==NULL) {
+		bucket=&(AC->overflow);
+		acIncrement(&(AC->packets_overflow));
+	}
+
+	if(!tokenBucketTake(AC,bucket,now)) {
+		acIncrement(&(AC->packets_limited));
+		return_val=AC_LIMITED;
+	}
+
+	#if !AC_ATOMICS_SUPPORTED
+		pthread_mutex_unlock(&(AC->mut));
+	#endif
+
+	return return_val;
+}
+
+// Reserve a place for a new session: AC_LIMITED is returned (and the session should be refused) if there are already
+// opts->max_sessions active sessions, otherwise admissionCtrlSessionEnd() should be called when the session is freed
+int admissionCtrlSessionStart(admissionCtrl AC) {
+	int return_val=AC_ACCEPT;
+
+	if(CHECK_AC_NULL(AC)) {
+		return AC_ACCEPT;
+	}
+
+	pthread_mutex_lock(&(AC->mut));
+
+	if(AC->max_sessions>0 && AC->sessions>=AC->max_sessions) {
+		AC->inits_refused++;
+		return_val=AC_LIMITED;
+	} else {
+		AC->sessions++;
+		if(AC->sessions>AC->sessions_peak) {
+			AC->sessions_peak=AC->sessions;
+		}
+	}
+
+	pthread_mutex_unlock(&(AC->mut));
+
+	return return_val;
+}
+
+void admissionCtrlSessionEnd(admissionCtrl AC) {
+	if(CHECK_AC_NULL(AC)) {
+		return;
+	}
+
+	pthread_mutex_lock(&(AC->mut));
+
+	if(AC->sessions>0) {
+		AC->sessions--;
+	}
+
+	pthread_mutex_unlock(&(AC->mut));
+}
+
+void admissionCtrlFree(admissionCtrl AC) {
+	if(CHECK_AC_NULL(AC)) {
+		return;
+	}
+
+	if(AC->rate>0) {
+		fprintf(stdout,"Rate limit: %" PRIu64 " packets discarded (%" PRIu64 " packets checked against the bucket shared by the clients\n"
+			"not fitting in the table).\n",
+			acLoad(&(AC->packets_limited)),acLoad(&(AC->packets_overflow)));
+	}
+
+	if(AC->max_sessions>0) {
+		fprintf(stdout,"Maximum number of concurrent sessions: %" PRIu32 " (peak: %" PRIu32 "), %" PRIu64 " INIT packets refused.\n",
+			AC->max_sessions,AC->sessions_peak,AC->inits_refused);
+	}
+
+	pthread_mutex_destroy(&(AC->mut));
+	free(AC->buckets);
+	free(AC);
+}
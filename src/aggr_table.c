@@ -0,0 +1,369 @@
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "aggr_table.h"
+#include "carbon_report_manager.h"
+#include "report_manager.h"
+#include "timer_man.h"
+
+// The client aggregates are stored in an open addressing hash table, with linear probing, indexed by the client IP address
+// The table has at least twice as many slots as the maximum number of clients, and its entries are never removed (the
+// aggregates are kept for the whole lifetime of the server), thus a lookup never needs to probe more than a few slots
+struct aggrTableSlot {
+	in_addr_t ip;
+	aggrStatsStructure *stats; // NULL if the slot is empty
+};
+
+struct _aggrTable {
+	struct options *opts;
+	// Copy of the options used by the Carbon sink of the aggregates (see aggrTableInit())
+	struct options sink_opts;
+	carbonSink sink;
+
+	pthread_mutex_t mut; // Protects all the aggregates, which are updated at the end of each session and read by the export thread
+
+	aggrStatsStructure global;
+	aggrStatsStructure other;
+	struct aggrTableSlot *slots;
+	unsigned int bits; // The number of slots is always 2^bits
+	unsigned int nclients;
+
+	// List of the aggregates exported at each interval (global, other and up to opts->aggr_max_clients clients)
+	aggrStatsStructure **export_list;
+	uint8_t csv_first_export; // = 1 until the first export to the -f CSV file (which is the only one overwriting it, with -o)
+
+	struct timespec start;
+
+	pthread_t tid;
+	// Pipe used to unblock the export thread when calling aggrTableFree(), as in carbon_thread_manager.c
+	int unlock_pd[2];
+};
+
+// Fibonacci (multiplicative) hashing of the IP address, as in session_table.c
+static inline uint64_t ipHash(in_addr_t ip,unsigned int bits) {
+	return ((uint64_t) ip*0x9E3779B97F4A7C15ULL)>>(64-bits);
+}
+
+static void aggrStatsInit(aggrStatsStructure *stats,struct options *opts,const char *name,uint8_t isClient) {
+	snprintf(stats->name,sizeof(stats->name),"%s",name);
+	stats->isClient=isClient;
+
+	stats->sessions=0;
+	stats->sessionsUnidir=0;
+	stats->sessionsPinglike=0;
+	stats->sessionsTimedout=0;
+	stats->sessionsInterval=0;
+
+	// Duplicated packets detection is never needed for the aggregates, as they are only updated by merging other reports
+	reportStructureInit(&(stats->report),0,0,opts->latencyType,FOLLOWUP_OFF,0);
+	latencyHistInit(&(stats->latencyHist));
+}
+
+static void aggrStatsAddSession(aggrStatsStructure *stats,modeub_t mode,reportStructure *report,latencyHist *hist,uint8_t timedout) {
+	stats->sessions++;
+	stats->sessionsInterval++;
+
+	if(timedout) {
+		stats->sessionsTimedout++;
+	}
+
+	if(mode==UNIDIR) {
+		stats->sessionsUnidir++;
+
+		if(report!=NULL) {
+			reportStructureMerge(&(stats->report),report);
+		}
+
+		if(hist!=NULL) {
+			latencyHistMerge(&(stats->latencyHist),hist);
+		}
+	} else {
+		stats->sessionsPinglike++;
+	}
+}
+
+// Get the aggregate of a client, adding it to the table if it is not there yet
+// NULL is returned when the table is full (or the memory for a new aggregate cannot be allocated)
+static aggrStatsStructure *aggrTableGetClient(aggrTable AT,struct in_addr ip) {
+	uint64_t mask=((uint64_t) 1<<AT->bits)-1;
+	uint64_t idx=ipHash(ip.s_addr,AT->bits);
+	aggrStatsStructure *stats;
+	char name[INET_ADDRSTRLEN];
+
+	while(AT->slots[idx].stats!=NULL) {
+		if(AT->slots[idx].ip==ip.s_addr) {
+			return AT->slots[idx].stats;
+		}
+
+		idx=(idx+1) & mask;
+	}
+
+	if(AT->nclients>=AT->opts->aggr_max_clients) {
+		return NULL;
+	}
+
+	stats=malloc(sizeof(aggrStatsStructure));
+	if(!stats) {
+		return NULL;
+	}
+
+	// inet_ntop() is used instead of inet_ntoa(), as the table may be accessed by more than one thread
+	inet_ntop(AF_INET,&ip,name,sizeof(name));
+	aggrStatsInit(stats,AT->opts,name,1);
+
+	AT->slots[idx].ip=ip.s_addr;
+	AT->slots[idx].stats=stats;
+	AT->nclients++;
+
+	return stats;
+}
+
+// Export the aggregates to Carbon and to the -f CSV file, and start a new interval for the session rate
+// Only the clients with at least one session ended in the last interval are exported
+static void aggrTableExport(aggrTable AT) {
+	int nstats=0;
+
+	pthread_mutex_lock(&(AT->mut));
+
+	AT->export_list[nstats++]=&(AT->global);
+
+	if(AT->other.sessionsInterval>0) {
+		AT->export_list[nstats++]=&(AT->other);
+	}
+
+	for(uint64_t i=0;i<((uint64_t) 1<<AT->bits);i++) {
+		if(AT->slots[i].stats!=NULL && AT->slots[i].stats->sessionsInterval>0) {
+			AT->export_list[nstats++]=AT->slots[i].stats;
+		}
+	}
+
+	// The metrics are only queued to the sink, without blocking on the connection to Carbon
+	if(!CHECK_CS_NULL(AT->sink)) {
+		carbonAggrStatsFlush(AT->export_list,nstats,AT->sink,&(AT->sink_opts),AT->opts->aggr_interval,g_DECIMAL_DIGITS);
+	}
+
+	if(AT->opts->filename!=NULL) {
+		if(printAggrStatsCSV(AT->opts,AT->export_list,nstats,AT->opts->aggr_interval,AT->csv_first_export && AT->opts->overwrite,AT->opts->filename)) {
+			fprintf(stderr,"Warning: cannot write the aggregated statistics to %s.\n",AT->opts->filename);
+		}
+
+		AT->csv_first_export=0;
+	}
+
+	AT->global.sessionsInterval=0;
+	AT->other.sessionsInterval=0;
+	for(uint64_t i=0;i<((uint64_t) 1<<AT->bits);i++) {
+		if(AT->slots[i].stats!=NULL) {
+			AT->slots[i].stats->sessionsInterval=0;
+		}
+	}
+
+	pthread_mutex_unlock(&(AT->mut));
+}
+
+static void *aggrExportLoop(void *arg) {
+	aggrTable AT=(aggrTable) arg;
+	struct itimerspec new_value;
+	int clockFd;
+	struct pollfd timerMon[2];
+	unsigned long long junk;
+
+	clockFd=timerfd_create(CLOCK_MONOTONIC,NO_FLAGS_TIMER);
+	if(clockFd==-1) {
+		fprintf(stderr,"Error: cannot create the timer for the export of the aggregated statistics.\n");
+		pthread_exit(NULL);
+	}
+
+	timerMon[0].fd=clockFd;
+	timerMon[0].revents=0;
+	timerMon[0].events=POLLIN;
+
+	timerMon[1].fd=AT->unlock_pd[0];
+	timerMon[1].revents=0;
+	timerMon[1].events=POLLIN;
+
+	new_value.it_interval.tv_sec=(time_t) AT->opts->aggr_interval;
+	new_value.it_interval.tv_nsec=0;
+	new_value.it_value=new_value.it_interval;
+
+	if(timerfd_settime(clockFd,NO_FLAGS_TIMER,&new_value,NULL)==-1) {
+		close(clockFd);
+		pthread_exit(NULL);
+	}
+
+	while(1) {
+		if(poll(timerMon,2,INDEFINITE_BLOCK)>0) {
+			// If poll was unlocked via pipe, export the aggregates one last time and terminate the thread
+			if(timerMon[1].revents>0) {
+				aggrTableExport(AT);
+				break;
+			}
+
+			if(timerMon[0].revents>0 && read(clockFd,&junk,sizeof(junk))==-1) {
+				break;
+			}
+		}
+
+		aggrTableExport(AT);
+	}
+
+	close(clockFd);
+
+	pthread_exit(NULL);
+}
+
+aggrTable aggrTableInit(struct options *opts) {
+	aggrTable AT;
+
+	AT=calloc(1,sizeof(struct _aggrTable));
+	if(!AT) {
+		return NULL;
+	}
+
+	AT->opts=opts;
+
+	AT->bits=0;
+	while(((unsigned int) 1<<AT->bits)<2*opts->aggr_max_clients) {
+		AT->bits++;
+	}
+
+	AT->slots=calloc((size_t) 1<<AT->bits,sizeof(struct aggrTableSlot));
+	AT->export_list=malloc((opts->aggr_max_clients+2)*sizeof(aggrStatsStructure *));
+	if(!AT->slots || !AT->export_list) {
+		free(AT->slots);
+		free(AT->export_list);
+		free(AT);
+		return NULL;
+	}
+
+	aggrStatsInit(&(AT->global),opts,AGGR_GLOBAL_NAME,0);
+	aggrStatsInit(&(AT->other),opts,AGGR_OTHER_NAME,0);
+	AT->csv_first_export=1;
+
+	if(pthread_mutex_init(&(AT->mut),NULL)!=0) {
+		free(AT->slots);
+		free(AT->export_list);
+		free(AT);
+		return NULL;
+	}
+
+	// The aggregates are sent through their own Carbon sink, which is kept for the whole lifetime of the server
+	// The spool file (if any) is left to the sink of the per-session metrics, as two sinks cannot share the same file
+	if(opts->carbon_sock_params.enabled) {
+		AT->sink_opts=*opts;
+		AT->sink_opts.carbon_spool_filename=NULL;
+
+		AT->sink=carbonSinkInit(&(AT->sink_opts));
+		if(CHECK_CS_NULL(AT->sink)) {
+			fprintf(stderr,"Warning: cannot open the sink for sending the aggregated statistics to Carbon/Graphite.\n");
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC,&(AT->start));
+
+	if(pipe(AT->unlock_pd)<0) {
+		fprintf(stderr,"Error: could not create the pipe for the graceful termination of the aggregated statistics export thread.\n");
+		if(!CHECK_CS_NULL(AT->sink)) {
+			carbonSinkFree(AT->sink);
+		}
+		pthread_mutex_destroy(&(AT->mut));
+		free(AT->slots);
+		free(AT->export_list);
+		free(AT);
+		return NULL;
+	}
+
+	if(pthread_create(&(AT->tid),NULL,&aggrExportLoop,(void *) AT)!=0) {
+		fprintf(stderr,"Error: could not start the aggregated statistics export thread.\n");
+		close(AT->unlock_pd[0]);
+		close(AT->unlock_pd[1]);
+		if(!CHECK_CS_NULL(AT->sink)) {
+			carbonSinkFree(AT->sink);
+		}
+		pthread_mutex_destroy(&(AT->mut));
+		free(AT->slots);
+		free(AT->export_list);
+		free(AT);
+		return NULL;
+	}
+
+	return AT;
+}
+
+// Merge a session which just ended into the global aggregate and into the aggregate of its client
+// 'report' and 'hist' are used only for the unidirectional sessions (and they can be NULL)
+int aggrTableAddSession(aggrTable AT, struct in_addr ip, modeub_t mode, reportStructure *report, latencyHist *hist, uint8_t timedout) {
+	aggrStatsStructure *client;
+
+	if(CHECK_AT_NULL(AT)) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&(AT->mut));
+
+	aggrStatsAddSession(&(AT->global),mode,report,hist,timedout);
+
+	client=aggrTableGetClient(AT,ip);
+	aggrStatsAddSession(client!=NULL ? client : &(AT->other),mode,report,hist,timedout);
+
+	pthread_mutex_unlock(&(AT->mut));
+
+	return 0;
+}
+
+void aggrTableFree(aggrTable AT) {
+	struct timespec now;
+	double elapsed;
+
+	if(CHECK_AT_NULL(AT)) {
+		return;
+	}
+
+	// Stop the export thread, which exports the aggregates one last time
+	if(write(AT->unlock_pd[1],"\0",1)<0) {
+		fprintf(stderr,"Warning: could not gracefully terminate the aggregated statistics export thread.\n"
+			"Its termination will be forced.\n");
+		pthread_cancel(AT->tid);
+	}
+
+	pthread_join(AT->tid,NULL);
+
+	close(AT->unlock_pd[0]);
+	close(AT->unlock_pd[1]);
+
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	elapsed=(now.tv_sec-AT->start.tv_sec)+(now.tv_nsec-AT->start.tv_nsec)/1e9;
+
+	fprintf(stdout,"Aggregated statistics: %" PRIu64 " sessions (unidirectional: %" PRIu64 ", ping-like: %" PRIu64 ", timed out: %" PRIu64 ")\n"
+		"from %u client(s)%s, %.3f sessions/s.\n",
+		AT->global.sessions,AT->global.sessionsUnidir,AT->global.sessionsPinglike,AT->global.sessionsTimedout,
+		AT->nclients,AT->other.sessions>0 ? " plus the ones not fitting in the table" : "",
+		elapsed>0 ? AT->global.sessions/elapsed : 0);
+
+	if(AT->global.report.minLatency!=UINT64_MAX) {
+		fprintf(stdout,"Unidirectional sessions: %" PRIu64 " packets, latency min/avg/max: %.3f/%.3f/%.3f ms, lost packets: %" PRIu64 ".\n",
+			AT->global.report.packetCount,AT->global.report.minLatency/1000.0,AT->global.report.averageLatency/1000.0,
+			AT->global.report.maxLatency/1000.0,AT->global.report.lossCount);
+	}
+
+	if(!CHECK_CS_NULL(AT->sink)) {
+		carbonSinkFree(AT->sink);
+	}
+
+	for(uint64_t i=0;i<((uint64_t) 1<<AT->bits);i++) {
+		if(AT->slots[i].stats!=NULL) {
+			free(AT->slots[i].stats);
+		}
+	}
+
+	pthread_mutex_destroy(&(AT->mut));
+	free(AT->slots);
+	free(AT->export_list);
+	free(AT);
+}
@@ -1,193 +1,200 @@
 #include <inttypes.h>
-#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "carbon_dup_list.h"
 
-struct carbonDupStoreListNode {
-	unsigned int seqNo; // Acting as search key
-
-	unsigned int occupied;
-
-	struct carbonDupStoreListNode *next;
+// Minimum number of slots of each table
+#define CDSL_MIN_SLOTS 16
+// First valid epoch: slots with an epoch equal to 0 (i.e. never used, as the tables are allocated with calloc()) must never
+// be considered as belonging to the "past" epoch
+#define CDSL_FIRST_EPOCH 2
+
+// The carbonDupStoreList is made of two preallocated open addressing (linear probing) hash tables: one storing the sequence
+// numbers received during the current reporting interval, and one storing the ones received during the previous interval
+// Each slot is tagged with the epoch (i.e. the reporting interval) in which it was written: a slot is occupied only if its
+// tag is equal to the epoch of the table it belongs to, thus resetting the structure at the end of each reporting interval
+// just means swapping the two tables and increasing the epoch, in O(1), without clearing or freeing anything
+// As slots never become free during an epoch, and a table is only read during the following epoch, the first slot not
+// belonging to the current epoch always terminates a probe sequence
+struct carbonDupStoreListSlot {
+	uint64_t seqNo; // Acting as search key (full width, when extended sequence numbers are used)
+	uint32_t epoch;
 };
 
 struct _carbonDupStoreList {
-	struct carbonDupStoreListNode **heads;
-	int size;
-	int8_t past_list_pos; // = -1 if uninitialized, = 0 if past list is between 0 and CDSL->size-1, = 1 if past list is between CDSL->size and CDSL->size*2-1
+	struct carbonDupStoreListSlot *tables[2];
+	uint64_t mask; // Number of slots of each table minus one (the number of slots is always a power of 2)
+	uint64_t maxEntries; // Maximum number of entries in each table (load factor: 3/4)
+	uint64_t entries; // Number of entries in the current table
+	uint64_t attempts; // Number of insertions requested during the current epoch (used to grow the tables when needed)
+	uint32_t epoch; // Current epoch (the past table holds the entries of epoch-1)
+	uint8_t curr; // Index of the current table inside 'tables'
 };
 
+// Get the smallest power of 2 which is greater than or equal to 'val'
+static inline uint64_t nextPow2(uint64_t val) {
+	return val<=1 ? 1 : (uint64_t) 1<<(64-__builtin_clzll(val-1));
+}
+
+// Look for 'seqNo' inside 'table', considering only the slots of the given epoch
+// It returns CDSL_FOUND or CDSL_NOTFOUND, and it sets 'idx' to the slot containing 'seqNo' or to the first free slot
+static inline int lookupSlot(struct carbonDupStoreListSlot *table, uint64_t mask, uint32_t epoch, uint64_t seqNo, uint64_t *idx) {
+	uint64_t i=seqNo & mask;
+
+	while(table[i].epoch==epoch) {
+		if(table[i].seqNo==seqNo) {
+			*idx=i;
+			return CDSL_FOUND;
+		}
+		i=(i+1) & mask;
+	}
+
+	*idx=i;
+
+	return CDSL_NOTFOUND;
+}
+
+static int allocTables(carbonDupStoreList CDSL, uint64_t slots) {
+	CDSL->tables[0]=calloc(slots,sizeof(struct carbonDupStoreListSlot));
+	CDSL->tables[1]=calloc(slots,sizeof(struct carbonDupStoreListSlot));
+
+	if(!CDSL->tables[0] || !CDSL->tables[1]) {
+		free(CDSL->tables[0]);
+		free(CDSL->tables[1]);
+		return -1;
+	}
+
+	CDSL->mask=slots-1;
+	CDSL->maxEntries=slots/4*3;
+
+	return 0;
+}
+
+// Grow the tables when more sequence numbers than the maximum number of entries were received during the current epoch
+// The entries of the current table are moved to the new one, and the past table is discarded (it is going to become
+// stale anyway, as this function is called just before starting a new epoch)
+// This is the only place (outside carbonDupSL_init()) where memory is allocated, and it is not on the per-packet path
+static void growTables(carbonDupStoreList CDSL) {
+	struct carbonDupStoreListSlot *old_tables[2]={CDSL->tables[0],CDSL->tables[1]};
+	uint64_t old_mask=CDSL->mask;
+	uint64_t old_maxEntries=CDSL->maxEntries;
+	uint64_t idx;
+
+	if(allocTables(CDSL,nextPow2(CDSL->attempts*2))<0) {
+		// Keep the current (too small) tables if no memory is available
+		CDSL->tables[0]=old_tables[0];
+		CDSL->tables[1]=old_tables[1];
+		CDSL->mask=old_mask;
+		CDSL->maxEntries=old_maxEntries;
+		return;
+	}
+
+	for(uint64_t i=0;i<=old_mask;i++) {
+		if(old_tables[CDSL->curr][i].epoch==CDSL->epoch) {
+			lookupSlot(CDSL->tables[CDSL->curr],CDSL->mask,CDSL->epoch,old_tables[CDSL->curr][i].seqNo,&idx);
+			CDSL->tables[CDSL->curr][idx]=old_tables[CDSL->curr][i];
+		}
+	}
+
+	free(old_tables[0]);
+	free(old_tables[1]);
+}
+
+// 'size' is the expected number of sequence numbers received during each reporting interval
 carbonDupStoreList carbonDupSL_init(int size) {
 	carbonDupStoreList CDSL;
-	int i=0;
+	uint64_t slots;
 
 	if(size<=0) {
 		return NULL;
 	}
 
 	CDSL=malloc(sizeof(struct _carbonDupStoreList));
-	if(!CHECK_CDSL_NULL(CDSL)) {
-		CDSL->size=size;
-
-		CDSL->heads=(struct carbonDupStoreListNode **) malloc(CDSL->size*2*sizeof(struct carbonDupStoreListNode));
-
-		if(!CDSL->heads) {
-			free(CDSL);
-			return NULL;
-		}
-
-		for(i=0;i<CDSL->size*2;i++) {
-			// Allocate first node (i.e. the 'head' of each sub-list), which is always allocated (it is freed only when calling carbonDupSL_free())
-			CDSL->heads[i]=(struct carbonDupStoreListNode *) malloc(sizeof(struct carbonDupStoreListNode));
-			if(CDSL->heads[i]!=NULL) {
-				CDSL->heads[i]->next=NULL;
-				CDSL->heads[i]->occupied=0;
-			} else {
-				break;
-			}
-		}
+	if(CHECK_CDSL_NULL(CDSL)) {
+		return NULL;
+	}
 
-		if(i!=CDSL->size*2) {
-			for(int j=0;j<i;j++) {
-				free(CDSL->heads[i]);
-			}
+	slots=nextPow2((uint64_t) size*2);
+	if(slots<CDSL_MIN_SLOTS) {
+		slots=CDSL_MIN_SLOTS;
+	}
 
-			free(CDSL->heads);
-			free(CDSL);
-			CDSL=NULL;
-		}
+	if(allocTables(CDSL,slots)<0) {
+		free(CDSL);
+		return NULL;
 	}
 
-	CDSL->past_list_pos=-1;
+	CDSL->entries=0;
+	CDSL->attempts=0;
+	CDSL->epoch=CDSL_FIRST_EPOCH;
+	CDSL->curr=0;
 
 	return CDSL;
 }
 
-int carbonDupSL_insertandcheck(carbonDupStoreList CDSL, unsigned int seqNo) {
-	unsigned int seqNoHash = seqNo % CDSL->size;
-	unsigned int pastSeqNoHash;
-	struct carbonDupStoreListNode *nptr, *nptr_prev, *CDSLN;
-	unsigned int found=CDSL_NOTFOUND;
+// The duplicate check is performed considering the sequence numbers inserted in the current epoch and in the previous one
+// If the current table is full, CDSL_NOMEM is returned and the sequence number is not stored (the tables will then be
+// enlarged at the next carbonDupSL_reset())
+int carbonDupSL_insertandcheck(carbonDupStoreList CDSL, uint64_t seqNo) {
+	struct carbonDupStoreListSlot *curr_table;
+	uint64_t idx;
 
-	if(CDSL->size==0) {
+	if(CHECK_CDSL_NULL(CDSL)) {
 		return CDSL_ZEROSIZE;
 	}
 
-	if(CDSL->past_list_pos!=-1) {
-		if(CDSL->past_list_pos==1) {
-			pastSeqNoHash=seqNoHash+CDSL->size;
-		} else {
-			pastSeqNoHash=seqNoHash;
-		}
-
-		// Look into the past part of the list
-		if(CDSL->heads[pastSeqNoHash]->occupied==0) {
-			found=CDSL_NOTFOUND;
-		} else {
-			if(CDSL->heads[pastSeqNoHash]->occupied==1 && seqNo==CDSL->heads[pastSeqNoHash]->seqNo) {
-				found=CDSL_FOUND;
-			} else {
-				for(nptr=CDSL->heads[pastSeqNoHash]->next;nptr!=NULL && found==CDSL_NOTFOUND;nptr=nptr->next) {
-					if(seqNo==nptr->seqNo) {
-						found=CDSL_FOUND;
-					}
-				}
-			}
-		}
+	CDSL->attempts++;
 
-		if(found==CDSL_FOUND) {
-			return found;
-		}
+	// Look into the past table
+	if(lookupSlot(CDSL->tables[!CDSL->curr],CDSL->mask,CDSL->epoch-1,seqNo,&idx)==CDSL_FOUND) {
+		return CDSL_FOUND;
 	}
 
-	// Look into the current part of the list
-	if(CDSL->past_list_pos==0) {
-		seqNoHash+=CDSL->size;
-	}
-
-	// Check if the head at the current hash is free
-	if(CDSL->heads[seqNoHash]->occupied==0) {
-		// Store the new data here
-		CDSL->heads[seqNoHash]->seqNo=seqNo;
-		CDSL->heads[seqNoHash]->occupied=1;
-		return CDSL_NOTFOUND;
-	}
-
-	// Look at the head, is the right data there?
-	// If yes, the data is there -> return CDSL_FOUND
-	if(CDSL->heads[seqNoHash]->occupied==1 && seqNo==CDSL->heads[seqNoHash]->seqNo) {
-		found=CDSL_FOUND;
-	} else {
-		// Scan list
-		nptr_prev=CDSL->heads[seqNoHash];
-		for(nptr=CDSL->heads[seqNoHash]->next;nptr!=NULL && found==CDSL_NOTFOUND;nptr=nptr->next) {
-			nptr_prev=nptr;
-			if(seqNo==nptr->seqNo) {
-				// Node found!
-				found=CDSL_FOUND;
-			}
-		}
-
-		if(found==CDSL_NOTFOUND) {
-			// Allocate a new element in the list
-			CDSLN=(struct carbonDupStoreListNode *) malloc(sizeof(struct carbonDupStoreListNode));
-
-			if(CDSLN==NULL) {
-				return CDSL_NOMEM;
-			}
+	// Look into the current table
+	curr_table=CDSL->tables[CDSL->curr];
+	if(lookupSlot(curr_table,CDSL->mask,CDSL->epoch,seqNo,&idx)==CDSL_FOUND) {
+		return CDSL_FOUND;
+	}
 
-			CDSLN->seqNo=seqNo;
-			CDSLN->occupied=1;
-			CDSLN->next=NULL;
-			nptr_prev->next=CDSLN;
-		}
+	if(CDSL->entries>=CDSL->maxEntries) {
+		return CDSL_NOMEM;
 	}
 
-	return found;
+	curr_table[idx].seqNo=seqNo;
+	curr_table[idx].epoch=CDSL->epoch;
+	CDSL->entries++;
+
+	return CDSL_NOTFOUND;
 }
 
+// Start a new epoch: the current table becomes the past one, and the past table, which is now stale, becomes the current one
 void carbonDupSL_reset(carbonDupStoreList CDSL) {
-	struct carbonDupStoreListNode *nptr, *nnptr;
-	int start_i = CDSL->past_list_pos==0 ? 0 : CDSL->size;
-	int stop_i = CDSL->past_list_pos==0 ? CDSL->size : CDSL->size*2;
-
-	// Try to reset all the sub-lists
-	for(int i=start_i;i<stop_i;i++) {
-		// Scan sub-list (the loop will not be executed if the sub-list head only is present)
-		for(nptr=CDSL->heads[i]->next;nptr!=NULL;nptr=nnptr) {
-			nnptr=nptr->next;
-			free(nptr);
-		}
-
-		CDSL->heads[i]->next=NULL;
+	if(CHECK_CDSL_NULL(CDSL)) {
+		return;
+	}
 
-		// Un-occupy the head
-		if(CDSL->heads[i]->occupied==1) {
-			CDSL->heads[i]->occupied=0;
-		}
+	if(CDSL->attempts>CDSL->maxEntries) {
+		growTables(CDSL);
 	}
 
-	// Update the position of the current list, which will become the new past list
-	if(CDSL->past_list_pos==0) {
-		CDSL->past_list_pos=1;
-	} else {
-		CDSL->past_list_pos=0;
+	CDSL->epoch++;
+
+	// After about 2^32 reporting intervals the epoch wraps around: in this (very unlikely) case, clear both tables
+	if(CDSL->epoch<CDSL_FIRST_EPOCH) {
+		memset(CDSL->tables[0],0,(CDSL->mask+1)*sizeof(struct carbonDupStoreListSlot));
+		memset(CDSL->tables[1],0,(CDSL->mask+1)*sizeof(struct carbonDupStoreListSlot));
+		CDSL->epoch=CDSL_FIRST_EPOCH;
 	}
+
+	CDSL->curr=!CDSL->curr;
+	CDSL->entries=0;
+	CDSL->attempts=0;
 }
 
 void carbonDupSL_free(carbonDupStoreList CDSL) {
-	struct carbonDupStoreListNode *nptr, *nnptr;
-
 	if(!CHECK_CDSL_NULL(CDSL)) {
-		if(!CHECK_CDSL_NULL(CDSL->heads)) {
-			for(int i=0;i<CDSL->size;i++) {
-				for(nptr=CDSL->heads[i];nptr!=NULL;nptr=nnptr) {
-					nnptr=nptr->next;
-					free(nptr);
-				}
-			}
-			free(CDSL->heads);
-		}
+		free(CDSL->tables[0]);
+		free(CDSL->tables[1]);
 		free(CDSL);
 	}
-}
\ No newline at end of file
+}
@@ -1,25 +1,36 @@
 #include "carbon_report_manager.h"
-#include "common_socket_man.h"
-#include <errno.h>
+#include "fixed_point_fmt.h"
+#include <arpa/inet.h>
+#include <endian.h>
 #include <inttypes.h>
-#include <linux/if.h>
 #include <math.h>
-#include <sys/ioctl.h>
+#include <sched.h>
 #include <time.h>
-#include <unistd.h>
 
-static void carbonReportStructureReset(carbonReportStructure *report,uint8_t reset_dup_list) {
-	report->averageLatency=0;
-	report->maxLatency=0;
-	report->minLatency=UINT64_MAX;
-	report->variance=0;
-	report->packetCount=0;
-	report->errorsCount=0;
+static void carbonIntervalDataReset(carbonIntervalData *iv) {
+	iv->averageLatency=0;
+	iv->maxLatency=0;
+	iv->minLatency=UINT64_MAX;
+	iv->variance=0;
+	iv->packetCount=0;
+	iv->errorsCount=0;
 
-	report->_welfordM2=0;
+	iv->_welfordM2=0;
 
-	report->outOfOrderCount=0;
+	iv->outOfOrderCount=0;
 
+	iv->lossCount=0;
+	iv->netlossCount=0;
+
+	iv->dupCount=0;
+
+	lossBurstInit(&iv->lossBursts);
+
+	latencyHistReset(&iv->latencyHist);
+}
+
+// Roll the sequence number tracking state over to a new flush interval (called only by the receive thread)
+static void carbonReportStructureRollover(carbonReportStructure *report,uint8_t reset_dup_list) {
 	// When a cyclical sequence number reset occurred during the last reporting interval,
 	// _maxSeqNumber is a 'reconstructed' value (>65535, as if numbers were not cyclical)
 	// Thus, for the next reporting interval, it should be set again to its 'non reconstructed'
@@ -32,31 +43,121 @@ static void carbonReportStructureReset(carbonReportStructure *report,uint8_t res
 	// to 1 otherwise
 	report->_detectedSeqNoReset=0;
 
-	report->lossCount=0;
-	report->netlossCount=0;
-
 	if(reset_dup_list) {
-		report->dupCount=0;
 		carbonDupSL_reset(report->dupCountList);
 	}
 
 	report->_precMaxSeqNumber=report->_maxSeqNumber;
 }
 
+// Get the interval data to be updated by the receive thread for the current packet
+// When the flush thread has started a new epoch since the last received packet, the sequence number tracking state
+// is rolled over first (this was done by the flush thread when a mutex was shared between the two threads: doing it
+// here, just before the first packet of the new interval is processed, gives the same result)
+static inline carbonIntervalData *carbonReportStructureBeginUpdate(carbonReportStructure *report,uint8_t dup_detect_enabled) {
+	uint32_t epoch;
+
+	#if CARBON_ATOMICS_SUPPORTED
+		// Signal that an update is in progress before reading the epoch: the flush thread, which increases the epoch
+		// before reading '_writing', is then guaranteed to wait for the update to complete if it retired the buffer
+		// which is going to be updated (both are sequentially consistent operations)
+		atomic_store_explicit(&(report->_writing),1,memory_order_seq_cst);
+		epoch=atomic_load_explicit(&(report->epoch),memory_order_seq_cst);
+	#else
+		pthread_mutex_lock(&(report->_epoch_mut));
+		epoch=report->epoch;
+	#endif
+
+	if(epoch!=report->_rxEpoch) {
+		carbonReportStructureRollover(report,dup_detect_enabled);
+		report->_rxEpoch=epoch;
+	}
+
+	return &(report->intervals[epoch & 1]);
+}
+
+static inline void carbonReportStructureEndUpdate(carbonReportStructure *report) {
+	#if CARBON_ATOMICS_SUPPORTED
+		atomic_store_explicit(&(report->_writing),0,memory_order_release);
+	#else
+		pthread_mutex_unlock(&(report->_epoch_mut));
+	#endif
+}
+
+// Retire the interval data currently updated by the receive thread, by starting a new epoch (called only by the flush thread)
+// The retired interval data (see carbonReportStructureRetired()) can then be read and reset without any lock, as the
+// receive thread will only update the other buffer until the next call to this function
+static void carbonReportStructureSwap(carbonReportStructure *report) {
+	uint32_t epoch;
+
+	#if CARBON_ATOMICS_SUPPORTED
+		epoch=atomic_load_explicit(&(report->epoch),memory_order_relaxed);
+		atomic_store_explicit(&(report->epoch),epoch+1,memory_order_seq_cst);
+
+		// Wait for any update which may have started before the new epoch was visible to the receive thread (each
+		// update lasts at most a few hundreds of ns)
+		while(atomic_load_explicit(&(report->_writing),memory_order_seq_cst)) {
+			sched_yield();
+		}
+	#else
+		pthread_mutex_lock(&(report->_epoch_mut));
+		epoch=report->epoch;
+		report->epoch=epoch+1;
+		pthread_mutex_unlock(&(report->_epoch_mut));
+	#endif
+}
+
+// Get the interval data retired by the last call to carbonReportStructureSwap() (called only by the flush thread)
+static inline carbonIntervalData *carbonReportStructureRetired(carbonReportStructure *report) {
+	uint32_t epoch;
+
+	#if CARBON_ATOMICS_SUPPORTED
+		epoch=atomic_load_explicit(&(report->epoch),memory_order_relaxed);
+	#else
+		pthread_mutex_lock(&(report->_epoch_mut));
+		epoch=report->epoch;
+		pthread_mutex_unlock(&(report->_epoch_mut));
+	#endif
+
+	return &(report->intervals[(epoch-1) & 1]);
+}
+
 void carbonReportStructureInit(carbonReportStructure *report,struct options *opts) {
 	report->_maxSeqNumber=INITIAL_SEQ_NO-1;
 	report->_precMaxSeqNumber=-1;
+	report->_detectedSeqNoReset=0;
+	report->_rxEpoch=0;
+
+	#if CARBON_ATOMICS_SUPPORTED
+		atomic_init(&(report->epoch),0);
+		atomic_init(&(report->_writing),0);
+	#else
+		report->epoch=0;
+		pthread_mutex_init(&(report->_epoch_mut),NULL);
+	#endif
 
 	if(opts->dup_detect_enabled) {
-		report->dupCountList=carbonDupSL_init(opts->mode_cs == SERVER || opts->mode_cs == LOOPBACK_SERVER ? 
-			CARBON_REPORT_DEFAULT_FLUSH_STRUCT_SIZE :
-			(int) (opts->carbon_interval*1000/opts->interval));
+		// The carbonDupStoreList is sized from the expected number of packets in each reporting interval
+		// As the server cannot know the client periodicity in advance, the default one is assumed, and the structure
+		// will then grow automatically (at the end of a reporting interval) if more packets are received
+		report->dupCountList=carbonDupSL_init(CARBON_DUP_STRUCT_SIZE(opts->carbon_interval,
+			opts->mode_cs == SERVER || opts->mode_cs == LOOPBACK_SERVER || opts->interval==0 ? CLIENT_DEF_INTERVAL : opts->interval));
+
+		if(CHECK_CDSL_NULL(report->dupCountList)) {
+			fprintf(stderr,"Warning: cannot allocate memory for the detection of duplicated packets.\n"
+				"Duplicated packets will not be detected in the data sent to Carbon/Graphite.\n");
+		}
 	}
 
-	carbonReportStructureReset(report,0);
+	latencyHistInit(&(report->intervals[0].latencyHist));
+	latencyHistInit(&(report->intervals[1].latencyHist));
+	carbonIntervalDataReset(&(report->intervals[0]));
+	carbonIntervalDataReset(&(report->intervals[1]));
+	carbonReportStructureRollover(report,0);
 }
 
 void carbonReportStructureUpdate(carbonReportStructure *report,uint64_t tripTime,int32_t seqNo,uint8_t dup_detect_enabled) {
+	carbonIntervalData *iv=carbonReportStructureBeginUpdate(report,dup_detect_enabled);
 	uint8_t detectedSeqNoResetNow=0;
 	int32_t gap;
 
@@ -66,9 +167,9 @@ void carbonReportStructureUpdate(carbonReportStructure *report,uint64_t tripTime
 	// before, dupSL_insertandcheck() will return CDSL_FOUND to signal a duplicated packet
 	// The duplicate check is performed considering the numbers received in the current reporting interval and in the previous one
 	if(dup_detect_enabled && carbonDupSL_insertandcheck(report->dupCountList,seqNo)==CDSL_FOUND) {
-		report->dupCount++;
+		iv->dupCount++;
 	} else {
-		report->packetCount++;
+		iv->packetCount++;
 		// Compute the gap between the currently received sequence number and the last maximum sequence number received so far
 		gap=(int32_t)seqNo-(int32_t)report->_maxSeqNumber;
 
@@ -96,26 +197,28 @@ void carbonReportStructureUpdate(carbonReportStructure *report,uint64_t tripTime
 
 		// A packet containing a timestamping error should not be taken into account in the current latency computation
 		if(tripTime!=0) {
-			report->_welfordAverageLatencyOld=report->averageLatency;
-			report->averageLatency+=(tripTime-report->averageLatency)/report->packetCount;
+			iv->_welfordAverageLatencyOld=iv->averageLatency;
+			iv->averageLatency+=(tripTime-iv->averageLatency)/iv->packetCount;
 
-			if(tripTime<report->minLatency) {
-				report->minLatency=tripTime;
+			if(tripTime<iv->minLatency) {
+				iv->minLatency=tripTime;
 			}
 
-			if(tripTime>report->maxLatency) {
-				report->maxLatency=tripTime;
+			if(tripTime>iv->maxLatency) {
+				iv->maxLatency=tripTime;
 			}
 
+			latencyHistUpdate(&iv->latencyHist,tripTime);
+
 			// Compute the current variance (std dev squared) value using Welford's online algorithm
-			report->_welfordM2=report->_welfordM2+(tripTime-report->_welfordAverageLatencyOld)*(tripTime-report->averageLatency);
-			if(report->packetCount>1) {
-				report->variance=report->_welfordM2/(report->packetCount-1);
+			iv->_welfordM2=iv->_welfordM2+(tripTime-iv->_welfordAverageLatencyOld)*(tripTime-iv->averageLatency);
+			if(iv->packetCount>1) {
+				iv->variance=iv->_welfordM2/(iv->packetCount-1);
 			}
 		} else {
 			// If tripTime is zero, a timestamping error occurred: count the current packet as a packet containing an error
 			// This packet will be counter as received, but it will not be used to compute the final statistics
-			report->errorsCount++;
+			iv->errorsCount++;
 		}
 
 		// Try to see if a packet has been received out of order - when no duplicate packet detection is enabled
@@ -128,17 +231,17 @@ void carbonReportStructureUpdate(carbonReportStructure *report,uint64_t tripTime
 		// In this case, '65534' is out of order (causing a big positive gap with respect to the (cyclical) maximum received
 		// so far, i.e. 4). However, it is not strictly true that 'seqNo<=report->_maxSeqNumber'
 		if(detectedSeqNoResetNow==0 && (seqNo<=report->_maxSeqNumber || gap>=SEQUENCE_NUMBERS_RESET_THRESHOLD)) {
-			report->outOfOrderCount++;
+			iv->outOfOrderCount++;
 
 			// When an out of order packet is detected, we can remove one loss,
 			// as an older missing packet, which was detected as lost, has been
 			// received now
 			// This is done only if the out of order packet is related to the current reporting interval and it is actually
 			// 'restoring' a packet loss which occurred during the current interval (checking 'seqNo>report->_precMaxSeqNumber')
-			if(report->lossCount>0 && seqNo>report->_precMaxSeqNumber) {
-				report->lossCount--;
+			if(iv->lossCount>0 && seqNo>report->_precMaxSeqNumber) {
+				iv->lossCount--;
 			}
-			report->netlossCount--;
+			iv->netlossCount--;
 		}
 
 		// Compute the maximum received sequence number and try to see if there is a gap in the sequence numbers, which could
@@ -147,230 +250,592 @@ void carbonReportStructureUpdate(carbonReportStructure *report,uint64_t tripTime
 		// considered, as they are likely out of order after a cyclical sequence number reset occurs
 		if(seqNo>report->_maxSeqNumber && gap<SEQUENCE_NUMBERS_RESET_THRESHOLD) {
 			if(seqNo>report->_maxSeqNumber+1) {
-				report->lossCount+=seqNo-1-report->_maxSeqNumber;
-				report->netlossCount+=seqNo-1-report->_maxSeqNumber;
+				iv->lossCount+=seqNo-1-report->_maxSeqNumber;
+				iv->netlossCount+=seqNo-1-report->_maxSeqNumber;
 			}
 
+			// Update the loss burst statistics for the current flush interval
+			lossBurstUpdate(&iv->lossBursts,seqNo-1-report->_maxSeqNumber);
+
 			report->_maxSeqNumber=seqNo;
 		}
 	}
+
+	carbonReportStructureEndUpdate(report);
 }
 
-int carbonReportStructureFlush(carbonReportStructure *report,struct options *opts,int decimal_digits,uint8_t add_one) {
-	char sockbuff[MAX_g_SOCK_BUF_SIZE];
-	struct timespec now;
+// Same as carbonReportStructureUpdate(), but using a full width (extended) sequence number, available when the extended
+// sequence numbers have been negotiated during the INIT procedure
+// As extended sequence numbers are never reset, no reconstruction is needed and _detectedSeqNoReset is never set
+void carbonReportStructureUpdateExt(carbonReportStructure *report,uint64_t tripTime,uint64_t seqNo,uint8_t dup_detect_enabled) {
+	carbonIntervalData *iv=carbonReportStructureBeginUpdate(report,dup_detect_enabled);
 
-	if(report==NULL) {
-		return -1;
-	}
+	if(dup_detect_enabled && carbonDupSL_insertandcheck(report->dupCountList,seqNo)==CDSL_FOUND) {
+		iv->dupCount++;
+	} else {
+		iv->packetCount++;
+
+		// A packet containing a timestamping error should not be taken into account in the current latency computation
+		if(tripTime!=0) {
+			iv->_welfordAverageLatencyOld=iv->averageLatency;
+			iv->averageLatency+=(tripTime-iv->averageLatency)/iv->packetCount;
 
-	// Don't send anything if there is no data in the report structure (maybe the report flush interval is too short?)
-	if(report->minLatency==UINT64_MAX) {
-		if(report->errorsCount) {
-			fprintf(stderr,"Warning: all the packets received during the current flush interval were invalid.\n");
+			if(tripTime<iv->minLatency) {
+				iv->minLatency=tripTime;
+			}
+
+			if(tripTime>iv->maxLatency) {
+				iv->maxLatency=tripTime;
+			}
+
+			latencyHistUpdate(&iv->latencyHist,tripTime);
+
+			// Compute the current variance (std dev squared) value using Welford's online algorithm
+			iv->_welfordM2=iv->_welfordM2+(tripTime-iv->_welfordAverageLatencyOld)*(tripTime-iv->averageLatency);
+			if(iv->packetCount>1) {
+				iv->variance=iv->_welfordM2/(iv->packetCount-1);
+			}
+		} else {
+			// If tripTime is zero, a timestamping error occurred: count the current packet as a packet containing an error
+			// This packet will be counter as received, but it will not be used to compute the final statistics
+			iv->errorsCount++;
+		}
+
+		if((int64_t)seqNo<=report->_maxSeqNumber) {
+			iv->outOfOrderCount++;
+
+			// Remove one loss only if the out of order packet is 'restoring' a loss which occurred during the current interval
+			if(iv->lossCount>0 && (int64_t)seqNo>report->_precMaxSeqNumber) {
+				iv->lossCount--;
+			}
+			iv->netlossCount--;
+		} else {
+			iv->lossCount+=seqNo-1-report->_maxSeqNumber;
+			iv->netlossCount+=seqNo-1-report->_maxSeqNumber;
+
+			// Update the loss burst statistics for the current flush interval
+			lossBurstUpdate(&iv->lossBursts,seqNo-1-report->_maxSeqNumber);
+
+			report->_maxSeqNumber=seqNo;
 		}
-		return 1;
 	}
 
-	if(opts->carbon_metric_path==NULL || !opts->carbon_sock_params.enabled) {
-		return -1;
+	carbonReportStructureEndUpdate(report);
+}
+
+// Batch of metrics, queued to the Carbon sink (see carbon_sink.h) and then sent with a single send() call (more than one
+// batch is used only when the metrics do not fit inside a single one, i.e. inside a single UDP datagram or inside
+// CARBON_TCP_BATCH_SIZE bytes when using TCP)
+// Each batch contains either plaintext protocol lines ('<metric path>.<name> <value> <timestamp>\n'), or, when the pickle
+// protocol is used, a 4 bytes big-endian length header followed by a pickled list of '(<metric path>.<name>, (<timestamp>, <value>))'
+// tuples (see https://graphite.readthedocs.io/en/latest/feeding-carbon.html#the-pickle-protocol)
+struct carbonBatch {
+	carbonSink sink;
+	uint8_t pickle;
+	size_t maxlen;
+	size_t len;
+	unsigned int nmetrics;
+	time_t timestamp;
+	int error; // Set to the first error which occurred (see carbonBatchAdd()): no more metrics are added after an error
+	char buf[CARBON_TCP_BATCH_SIZE];
+};
+
+// Pickle (protocol 2) opcodes used to encode the metrics
+#define PICKLE_PROTO '\x80'
+#define PICKLE_EMPTY_LIST ']'
+#define PICKLE_MARK '('
+#define PICKLE_BINUNICODE 'X'
+#define PICKLE_LONG1 '\x8a'
+#define PICKLE_BINFLOAT 'G'
+#define PICKLE_TUPLE2 '\x86'
+#define PICKLE_APPENDS 'e'
+#define PICKLE_STOP '.'
+
+// Size of the pickle header (length + PROTO + EMPTY_LIST + MARK) and trailer (APPENDS + STOP)
+#define PICKLE_HDR_SIZE (4+2+1+1)
+#define PICKLE_TRAILER_SIZE 2
+
+static void carbonBatchBegin(struct carbonBatch *batch) {
+	batch->len=0;
+	batch->nmetrics=0;
+
+	if(batch->pickle) {
+		// The length is written just before sending the batch
+		batch->len=4;
+		batch->buf[batch->len++]=PICKLE_PROTO;
+		batch->buf[batch->len++]=2;
+		batch->buf[batch->len++]=PICKLE_EMPTY_LIST;
+		batch->buf[batch->len++]=PICKLE_MARK;
 	}
+}
 
-	// Get current timestamp
-	clock_gettime(CLOCK_REALTIME,&now);
+static void carbonBatchInit(struct carbonBatch *batch,carbonSink sink,struct options *opts,time_t timestamp) {
+	batch->sink=sink;
+	batch->pickle=opts->carbon_sock_type==G_TCP_PICKLE;
+	batch->maxlen=opts->carbon_sock_type==G_UDP ? MAX_g_SOCK_BUF_SIZE : CARBON_TCP_BATCH_SIZE;
+	batch->timestamp=timestamp;
+	batch->error=0;
 
-	now.tv_sec+=add_one;
+	carbonBatchBegin(batch);
+}
 
-	// Prepare buffer for the average latency
-	snprintf(sockbuff,MAX_g_SOCK_BUF_SIZE,"%s.avg %.*f %" PRIu64 "\n",opts->carbon_metric_path,decimal_digits,report->averageLatency/1000.0,now.tv_sec);
+// Queue the metrics which have been added to the batch so far, and start a new batch
+static int carbonBatchSend(struct carbonBatch *batch) {
+	uint32_t pickle_len;
 
-	// Send to Graphite
-	if(send(report->socketDescriptor,sockbuff,strlen(sockbuff),0)!=strlen(sockbuff)) {
-		fprintf(stderr,"%s() error: cannot send the average latency metric to Carbon. Details: %s\n",__func__,strerror(errno));
-		return -3;
+	if(batch->nmetrics==0) {
+		return 0;
 	}
 
-	// Prepare buffer for the maximum latency
-	snprintf(sockbuff,MAX_g_SOCK_BUF_SIZE,"%s.max %.*f %" PRIu64 "\n",opts->carbon_metric_path,decimal_digits,(double)report->maxLatency/1000.0,now.tv_sec);
+	if(batch->pickle) {
+		batch->buf[batch->len++]=PICKLE_APPENDS;
+		batch->buf[batch->len++]=PICKLE_STOP;
 
-	// Send to Graphite
-	if(send(report->socketDescriptor,sockbuff,strlen(sockbuff),0)!=strlen(sockbuff)) {
-		fprintf(stderr,"%s() error: cannot send the maximum latency metric to Carbon. Details: %s\n",__func__,strerror(errno));
-		return -3;
+		pickle_len=htonl(batch->len-4);
+		memcpy(batch->buf,&pickle_len,sizeof(pickle_len));
 	}
 
-	// Prepare buffer for the minimum latency
-	snprintf(sockbuff,MAX_g_SOCK_BUF_SIZE,"%s.min %.*f %" PRIu64 "\n",opts->carbon_metric_path,decimal_digits,(double)report->minLatency/1000.0,now.tv_sec);
-
-	// Send to Graphite
-	if(send(report->socketDescriptor,sockbuff,strlen(sockbuff),0)!=strlen(sockbuff)) {
-		fprintf(stderr,"%s() error: cannot send the minimum latency metric to Carbon. Details: %s\n",__func__,strerror(errno));
-		return -3;
+	// The batch is never sent from here: the sink thread will take care of sending it, without blocking the caller
+	if(carbonSinkEnqueue(batch->sink,batch->buf,batch->len)<0) {
+		carbonBatchBegin(batch);
+		return -1;
 	}
 
-	// Prepare buffer for the standard deviation
-	snprintf(sockbuff,MAX_g_SOCK_BUF_SIZE,"%s.stdev %.*f %" PRIu64 "\n",opts->carbon_metric_path,decimal_digits,sqrt(report->variance)/1000.0,now.tv_sec);
+	carbonBatchBegin(batch);
 
-	// Send to Graphite
-	if(send(report->socketDescriptor,sockbuff,strlen(sockbuff),0)!=strlen(sockbuff)) {
-		fprintf(stderr,"%s() error: cannot send the average latency metric to Carbon. Details: %s\n",__func__,strerror(errno));
-		return -3;
+	return 0;
+}
+
+// Add a metric to the batch: 'value' is used with the pickle protocol, while 'valuestr' (already formatted with the
+// functions defined in fixed_point_fmt.h, or with snprintf()) is used with the plaintext protocol
+// If the metric does not fit inside the current batch, the batch is queued first
+// The return value is 0 on success, -1 if the batch could not be queued, or -2 if the metric is too long to fit inside any batch
+static int carbonBatchAdd(struct carbonBatch *batch,const char *metric_path,const char *name,double value,const char *valuestr,size_t valuelen) {
+	size_t pathlen=strlen(metric_path);
+	size_t namelen=strlen(name);
+	size_t metriclen;
+	size_t reserved=batch->pickle ? PICKLE_TRAILER_SIZE : 0;
+	uint64_t value_bits;
+	uint64_t timestamp_le;
+	uint32_t pathlen_le;
+
+	if(batch->error) {
+		return batch->error;
 	}
 
-	// Prepare buffer for the packet count
-	snprintf(sockbuff,MAX_g_SOCK_BUF_SIZE,"%s.count %" PRIu64 " %" PRIu64 "\n",opts->carbon_metric_path,report->packetCount,now.tv_sec);
+	if(batch->pickle) {
+		// BINUNICODE + path, LONG1 + timestamp, BINFLOAT + value, two TUPLE2
+		metriclen=1+4+pathlen+1+namelen+2+8+1+8+2;
+	} else {
+		metriclen=pathlen+1+namelen+1+valuelen+1+FPFMT_MAX_LEN+1;
+	}
 
-	// Send to Graphite
-	if(send(report->socketDescriptor,sockbuff,strlen(sockbuff),0)!=strlen(sockbuff)) {
-		fprintf(stderr,"%s() error: cannot send the packet count metric to Carbon. Details: %s\n",__func__,strerror(errno));
-		return -3;
+	if(batch->len+metriclen+reserved>batch->maxlen) {
+		if(carbonBatchSend(batch)<0) {
+			batch->error=-1;
+			return -1;
+		}
+
+		if(batch->len+metriclen+reserved>batch->maxlen) {
+			batch->error=-2;
+			return -2;
+		}
 	}
 
-	// Prepare buffer for the error count
-	snprintf(sockbuff,MAX_g_SOCK_BUF_SIZE,"%s.errors %" PRIu64 " %" PRIu64 "\n",opts->carbon_metric_path,report->errorsCount,now.tv_sec);
+	if(batch->pickle) {
+		batch->buf[batch->len++]=PICKLE_BINUNICODE;
+		pathlen_le=htole32(pathlen+1+namelen);
+		memcpy(batch->buf+batch->len,&pathlen_le,4);
+		batch->len+=4;
+	}
 
-	// Send to Graphite
-	if(send(report->socketDescriptor,sockbuff,strlen(sockbuff),0)!=strlen(sockbuff)) {
-		fprintf(stderr,"%s() error: cannot send the error count metric to Carbon. Details: %s\n",__func__,strerror(errno));
-		return -3;
+	memcpy(batch->buf+batch->len,metric_path,pathlen);
+	batch->len+=pathlen;
+	batch->buf[batch->len++]='.';
+	memcpy(batch->buf+batch->len,name,namelen);
+	batch->len+=namelen;
+
+	if(batch->pickle) {
+		// The timestamp is encoded as an 8 bytes little-endian two's complement integer
+		batch->buf[batch->len++]=PICKLE_LONG1;
+		batch->buf[batch->len++]=8;
+		timestamp_le=htole64((uint64_t) batch->timestamp);
+		memcpy(batch->buf+batch->len,&timestamp_le,8);
+		batch->len+=8;
+
+		// The value is encoded as a big-endian IEEE 754 double
+		batch->buf[batch->len++]=PICKLE_BINFLOAT;
+		memcpy(&value_bits,&value,sizeof(value_bits));
+		value_bits=htobe64(value_bits);
+		memcpy(batch->buf+batch->len,&value_bits,8);
+		batch->len+=8;
+
+		batch->buf[batch->len++]=PICKLE_TUPLE2;
+		batch->buf[batch->len++]=PICKLE_TUPLE2;
+	} else {
+		batch->buf[batch->len++]=' ';
+		memcpy(batch->buf+batch->len,valuestr,valuelen);
+		batch->len+=valuelen;
+		batch->buf[batch->len++]=' ';
+		batch->len+=fpfmtI64(batch->buf+batch->len,batch->timestamp);
+		batch->buf[batch->len++]='\n';
 	}
 
-	// Prepare buffer for the out of order count
-	snprintf(sockbuff,MAX_g_SOCK_BUF_SIZE,"%s.outoforder %" PRIu64 " %" PRIu64 "\n",opts->carbon_metric_path,report->outOfOrderCount,now.tv_sec);
+	batch->nmetrics++;
 
-	// Send to Graphite
-	if(send(report->socketDescriptor,sockbuff,strlen(sockbuff),0)!=strlen(sockbuff)) {
-		fprintf(stderr,"%s() error: cannot send the out of order count metric to Carbon. Details: %s\n",__func__,strerror(errno));
-		return -3;
+	return 0;
+}
+
+static int carbonBatchAddU64(struct carbonBatch *batch,const char *metric_path,const char *name,uint64_t value) {
+	char valuebuff[FPFMT_MAX_LEN];
+	size_t valuelen=0;
+
+	if(!batch->pickle) {
+		valuelen=fpfmtU64(valuebuff,value);
 	}
 
-	// Prepare buffer for the estimated packet loss count (local)
-	snprintf(sockbuff,MAX_g_SOCK_BUF_SIZE,"%s.packetloss.local %" PRIu64 " %" PRIu64 "\n",opts->carbon_metric_path,report->lossCount,now.tv_sec);
+	return carbonBatchAdd(batch,metric_path,name,(double) value,valuebuff,valuelen);
+}
+
+static int carbonBatchAddI64(struct carbonBatch *batch,const char *metric_path,const char *name,int64_t value) {
+	char valuebuff[FPFMT_MAX_LEN];
+	size_t valuelen=0;
 
-	// Send to Graphite
-	if(send(report->socketDescriptor,sockbuff,strlen(sockbuff),0)!=strlen(sockbuff)) {
-		fprintf(stderr,"%s() error: cannot send the packet loss count (local) metric to Carbon. Details: %s\n",__func__,strerror(errno));
-		return -3;
+	if(!batch->pickle) {
+		valuelen=fpfmtI64(valuebuff,value);
 	}
 
-	// Prepare buffer for the estimated packet loss count (net)
-	snprintf(sockbuff,MAX_g_SOCK_BUF_SIZE,"%s.packetloss.net %" PRIi64 " %" PRIu64 "\n",opts->carbon_metric_path,report->netlossCount,now.tv_sec);
+	return carbonBatchAdd(batch,metric_path,name,(double) value,valuebuff,valuelen);
+}
+
+// Add a latency value, in ms, starting from a value in us
+static int carbonBatchAddLatency(struct carbonBatch *batch,const char *metric_path,const char *name,uint64_t value_us,int decimal_digits) {
+	char valuebuff[FPFMT_MAX_LEN];
+	size_t valuelen=0;
 
-	// Send to Graphite
-	if(send(report->socketDescriptor,sockbuff,strlen(sockbuff),0)!=strlen(sockbuff)) {
-		fprintf(stderr,"%s() error: cannot send the packet loss count (net) metric to Carbon. Details: %s\n",__func__,strerror(errno));
-		return -3;
+	if(!batch->pickle) {
+		valuelen=fpfmtFixed(valuebuff,value_us,3,decimal_digits);
 	}
 
-	if(opts->dup_detect_enabled) {
-		// Prepare buffer for the detected number of duplicated packets
-		snprintf(sockbuff,MAX_g_SOCK_BUF_SIZE,"%s.dupcount %" PRIu64 " %" PRIu64 "\n",opts->carbon_metric_path,report->dupCount,now.tv_sec);
+	return carbonBatchAdd(batch,metric_path,name,value_us/1000.0,valuebuff,valuelen);
+}
+
+// Add a floating point value, which, with the plaintext protocol, is formatted with snprintf()
+static int carbonBatchAddDouble(struct carbonBatch *batch,const char *metric_path,const char *name,double value,int decimal_digits) {
+	char valuebuff[FPFMT_MAX_LEN];
+	int valuelen=0;
+
+	if(!batch->pickle) {
+		valuelen=snprintf(valuebuff,FPFMT_MAX_LEN,"%.*f",decimal_digits,value);
 
-		// Send to Graphite
-		if(send(report->socketDescriptor,sockbuff,strlen(sockbuff),0)!=strlen(sockbuff)) {
-			fprintf(stderr,"%s() error: cannot send the duplicate packet count metric to Carbon. Details: %s\n",__func__,strerror(errno));
-			return -3;
+		if(valuelen<0 || valuelen>=FPFMT_MAX_LEN) {
+			batch->error=-2;
+			return -2;
 		}
 	}
 
-	if(opts->verboseFlag) {		
-		fprintf(stdout,"[INFO] Reporting the following metrics related to network reliability:\n"
-			"Current interval packet loss (local) = %" PRIu64 "\n"
-			"Current interval packet loss (net) = %" PRIi64 "\n"
-			"Current interval out of order count = %" PRIu64 "\n"
-			"Current interval duplicated packet count = %" PRIu64 "\n",
-			report->lossCount,
-			report->netlossCount,
-			report->outOfOrderCount,
-			report->dupCount
-			);
+	return carbonBatchAdd(batch,metric_path,name,value,valuebuff,valuelen);
+}
+
+// Add the latency percentiles, estimated from the histogram 'lh' (the values are kept within the exact minimum and maximum,
+// in us), and, if requested, the histogram bucket counts
+static void carbonBatchAddHist(struct carbonBatch *batch,latencyHist *lh,uint64_t minLatency,uint64_t maxLatency,const char *metric_path,struct options *opts,int decimal_digits) {
+	char name[32];
+
+	for(int i=0;i<opts->carbon_percentiles_num;i++) {
+		uint64_t percentile=latencyHistPercentile(lh,opts->carbon_percentiles[i]);
+		int namelen;
+
+		if(percentile<minLatency) {
+			percentile=minLatency;
+		} else if(percentile>maxLatency) {
+			percentile=maxLatency;
+		}
+
+		// 'p<percentile>', with '_' instead of the decimal point, which would be interpreted as a path separator
+		namelen=snprintf(name,sizeof(name),"p%g",opts->carbon_percentiles[i]);
+		for(int j=0;j<namelen && j<(int) sizeof(name);j++) {
+			if(name[j]=='.' || name[j]==',') {
+				name[j]='_';
+			}
+		}
+
+		carbonBatchAddLatency(batch,metric_path,name,percentile,decimal_digits);
 	}
 
-	// Reset the report
-	carbonReportStructureReset(report,opts->dup_detect_enabled);
+	// Histogram bucket counts, one metric for each bucket, named after its upper bound (in us)
+	if(opts->carbon_histogram) {
+		unsigned int ngroups=latencyHistUsedGroups(lh);
 
-	return 0;
+		for(unsigned int g=0;g<ngroups;g++) {
+			memcpy(name,"hist.",5);
+			name[5+fpfmtU64(name+5,latencyHistGroupUpperBound(g))]='\0';
+
+			carbonBatchAddU64(batch,metric_path,name,latencyHistGroupCount(lh,g));
+		}
+	}
 }
 
-void carbonReportStructureFree(carbonReportStructure *report,struct options *opts) {
+// Add all the metrics of a flush interval to the batch
+// The return value is the same as carbonBatchAdd()
+static int carbonBatchAddReport(struct carbonBatch *batch,carbonIntervalData *report,const char *metric_path,struct options *opts,int decimal_digits) {
+	geParams_t ge;
+
+	carbonBatchAddDouble(batch,metric_path,"avg",report->averageLatency/1000.0,decimal_digits);
+	carbonBatchAddLatency(batch,metric_path,"max",report->maxLatency,decimal_digits);
+	carbonBatchAddLatency(batch,metric_path,"min",report->minLatency,decimal_digits);
+	carbonBatchAddDouble(batch,metric_path,"stdev",sqrt(report->variance)/1000.0,decimal_digits);
+	carbonBatchAddU64(batch,metric_path,"count",report->packetCount);
+	carbonBatchAddU64(batch,metric_path,"errors",report->errorsCount);
+	carbonBatchAddU64(batch,metric_path,"outoforder",report->outOfOrderCount);
+	carbonBatchAddU64(batch,metric_path,"packetloss.local",report->lossCount);
+	carbonBatchAddI64(batch,metric_path,"packetloss.net",report->netlossCount);
+
 	if(opts->dup_detect_enabled) {
-		carbonDupSL_free(report->dupCountList);
+		carbonBatchAddU64(batch,metric_path,"dupcount",report->dupCount);
 	}
+
+	carbonBatchAddU64(batch,metric_path,"lossbursts.count",report->lossBursts.burstCount);
+	carbonBatchAddU64(batch,metric_path,"lossbursts.max",report->lossBursts.maxBurst);
+
+	// Gilbert-Elliott model parameters estimated over the current interval
+	lossBurstGetGE(&report->lossBursts,&ge);
+	carbonBatchAddDouble(batch,metric_path,"ge.p",ge.p,decimal_digits);
+	carbonBatchAddDouble(batch,metric_path,"ge.r",ge.r,decimal_digits);
+	carbonBatchAddDouble(batch,metric_path,"ge.h",ge.h,decimal_digits);
+
+	carbonBatchAddHist(batch,&report->latencyHist,report->minLatency,report->maxLatency,metric_path,opts,decimal_digits);
+
+	// Any error which occurred while adding the metrics is stored inside the batch
+	return batch->error;
 }
 
-int openCarbonReportSocket(carbonReportStructure *report,struct options *opts) {
-	struct sockaddr_in bind_addrin;
-	struct sockaddr_in connect_addrin;
-	struct ifreq ifreq;
-	int connect_rval=0;
-	int sfd;
+int carbonReportStructureFlush(carbonReportStructure *report,struct options *opts,int decimal_digits,uint8_t add_one) {
+	const char *metric_path=opts->carbon_metric_path;
+
+	if(report==NULL) {
+		return -1;
+	}
+
+	return carbonReportStructureFlushMulti(&report,&metric_path,1,report->sink,opts,decimal_digits,add_one);
+}
+
+// Flush the metrics of 'nreports' report structures, each one with its own metric path, coalescing all of them in a single
+// transmission towards Carbon through 'sink' (i.e. usually a single send() call, unless the metrics do not fit inside
+// a single batch)
+// The interval data of each report structure is retired with carbonReportStructureSwap() before being flushed, so that
+// the receive thread can keep updating the report structures, without any lock, while the metrics are being formatted
+// This function never blocks on the connection to Carbon, as the batches are only queued to the sink
+// The return value is 0 if the metrics were queued, 1 if no report structure contained any data, or a negative value
+// in case of error (in this case, the metrics of the retired interval are discarded)
+int carbonReportStructureFlushMulti(carbonReportStructure **reports,const char **metric_paths,int nreports,carbonSink sink,struct options *opts,int decimal_digits,uint8_t add_one) {
+	struct carbonBatch batch;
+	struct timespec now;
+	carbonIntervalData *iv;
+	int nflushed=0;
+	int rval=0;
+
+	if(reports==NULL || metric_paths==NULL) {
+		return -1;
+	}
 
 	if(!opts->carbon_sock_params.enabled) {
-		return -3;
+		return -1;
 	}
 
-	// Check if the user specified the usage of a UDP or TCP socket
-	if(opts->carbon_sock_type==G_UDP) {
-		sfd=socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
-	} else {
-		sfd=socket(AF_INET,SOCK_STREAM,IPPROTO_TCP);
+	// Get current timestamp
+	clock_gettime(CLOCK_REALTIME,&now);
+
+	now.tv_sec+=add_one;
+
+	// Start a new flush interval for all the report structures at once
+	for(int i=0;i<nreports;i++) {
+		carbonReportStructureSwap(reports[i]);
+	}
+
+	carbonBatchInit(&batch,sink,opts,now.tv_sec);
+
+	for(int i=0;i<nreports && rval==0;i++) {
+		iv=carbonReportStructureRetired(reports[i]);
+
+		// Don't send anything if there is no data in the retired interval (maybe the report flush interval is too short?)
+		if(iv->minLatency==UINT64_MAX) {
+			if(iv->errorsCount) {
+				fprintf(stderr,"Warning: all the packets received during the current flush interval were invalid.\n");
+			}
+			continue;
+		}
+
+		if(metric_paths[i]==NULL) {
+			rval=-1;
+			continue;
+		}
+
+		rval=carbonBatchAddReport(&batch,iv,metric_paths[i],opts,decimal_digits);
+
+		if(rval==-2) {
+			fprintf(stderr,"%s() error: the metric path is too long to send the metrics to Carbon.\n",__func__);
+			rval=-3;
+		} else if(rval!=0) {
+			fprintf(stderr,"%s() error: cannot queue the metrics to be sent to Carbon (queue full).\n",__func__);
+			rval=-3;
+		}
+
+		nflushed++;
+	}
+
+	if(rval==0 && nflushed==0) {
+		rval=1;
 	}
 
-	// Bind to the given interface/IP address, if an interface name was specified
-   	if(opts->carbon_sock_params.devname!=NULL) {
-    	// First of all, retrieve the IP address from the specified devname
-    	strncpy(ifreq.ifr_name,opts->carbon_sock_params.devname,IFNAMSIZ);
-    	ifreq.ifr_addr.sa_family=AF_INET;
+	// Queue to the sink, which will send the metrics to Graphite
+	if(rval==0 && carbonBatchSend(&batch)<0) {
+		fprintf(stderr,"%s() error: cannot queue the metrics to be sent to Carbon (queue full).\n",__func__);
+		rval=-3;
+	}
 
-    	if(ioctl(sfd,SIOCGIFADDR,&ifreq)!=-1) {
-			bind_addrin.sin_addr.s_addr=((struct sockaddr_in*)&ifreq.ifr_addr)->sin_addr.s_addr;
+	for(int i=0;i<nreports;i++) {
+		iv=carbonReportStructureRetired(reports[i]);
+
+		if(rval==0 && opts->verboseFlag && iv->minLatency!=UINT64_MAX) {
+			fprintf(stdout,"[INFO] Reporting the following metrics related to network reliability:\n"
+				"Current interval packet loss (local) = %" PRIu64 "\n"
+				"Current interval packet loss (net) = %" PRIi64 "\n"
+				"Current interval out of order count = %" PRIu64 "\n"
+				"Current interval duplicated packet count = %" PRIu64 "\n"
+				"Current interval loss bursts = %" PRIu64 " (max length = %" PRIu64 ")\n",
+				iv->lossCount,
+				iv->netlossCount,
+				iv->outOfOrderCount,
+				iv->dupCount,
+				iv->lossBursts.burstCount,
+				iv->lossBursts.maxBurst
+				);
+		}
+
+		// Reset the retired interval data, which will be updated again by the receive thread after the next swap
+		carbonIntervalDataReset(iv);
+	}
+
+	return rval;
+}
+
+// Send the running aggregates of the daemon mode sessions (--aggregate-stats, see aggr_table.h) through 'sink', coalescing
+// all of them in as few batches as possible, as in carbonReportStructureFlushMulti()
+// The metrics of each aggregate are sent under <-g metric path>.aggregate.<name>, where <name> is "global", "other" or
+// "clients.<client IP address>" (with '_' instead of '.'); the latency metrics are sent only if at least one unidirectional
+// session provided some data, and the session rate is computed over the last 'interval' seconds
+// The return value is 0 if the metrics were queued, or a negative value in case of error
+int carbonAggrStatsFlush(aggrStatsStructure **stats,int nstats,carbonSink sink,struct options *opts,unsigned int interval,int decimal_digits) {
+	struct carbonBatch batch;
+	struct timespec now;
+	reportStructure *report;
+	char metric_path[MAX_g_METRIC_PATH_LEN+INET_ADDRSTRLEN+32];
+	int pathlen;
+	int rval=0;
+
+	if(stats==NULL || !opts->carbon_sock_params.enabled) {
+		return -1;
+	}
+
+	clock_gettime(CLOCK_REALTIME,&now);
+
+	carbonBatchInit(&batch,sink,opts,now.tv_sec);
+
+	for(int i=0;i<nstats && rval==0;i++) {
+		report=&(stats[i]->report);
+
+		if(!stats[i]->isClient) {
+			pathlen=snprintf(metric_path,sizeof(metric_path),"%s.aggregate.%s",opts->carbon_metric_path,stats[i]->name);
 		} else {
-			fprintf(stderr,"Error: cannot bind the socket for metrics transmission to Carbon to\nthe specified interface (-g option).\n"
-				"Details: cannot retrieve IP address for interface %s.\n",opts->carbon_sock_params.devname);
-			return -3;
+			pathlen=snprintf(metric_path,sizeof(metric_path),"%s.aggregate.clients.%s",opts->carbon_metric_path,stats[i]->name);
+
+			// The '.' inside the IP address would be interpreted as a path separator
+			for(int j=pathlen-strlen(stats[i]->name);j<pathlen;j++) {
+				if(metric_path[j]=='.') {
+					metric_path[j]='_';
+				}
+			}
 		}
 
-    	bind_addrin.sin_port=0;
-    	bind_addrin.sin_family=AF_INET;
+		carbonBatchAddU64(&batch,metric_path,"sessions.total",stats[i]->sessions);
+		carbonBatchAddU64(&batch,metric_path,"sessions.unidir",stats[i]->sessionsUnidir);
+		carbonBatchAddU64(&batch,metric_path,"sessions.pinglike",stats[i]->sessionsPinglike);
+		carbonBatchAddU64(&batch,metric_path,"sessions.timedout",stats[i]->sessionsTimedout);
+		carbonBatchAddU64(&batch,metric_path,"sessions.interval",stats[i]->sessionsInterval);
+		carbonBatchAddDouble(&batch,metric_path,"sessions.rate",interval>0 ? (double) stats[i]->sessionsInterval/interval : 0,decimal_digits);
+
+		if(report->minLatency!=UINT64_MAX) {
+			carbonBatchAddDouble(&batch,metric_path,"unidir.avg",report->averageLatency/1000.0,decimal_digits);
+			carbonBatchAddLatency(&batch,metric_path,"unidir.max",report->maxLatency,decimal_digits);
+			carbonBatchAddLatency(&batch,metric_path,"unidir.min",report->minLatency,decimal_digits);
+			carbonBatchAddDouble(&batch,metric_path,"unidir.stdev",sqrt(report->variance)/1000.0,decimal_digits);
+			carbonBatchAddU64(&batch,metric_path,"unidir.count",report->packetCount);
+			carbonBatchAddU64(&batch,metric_path,"unidir.errors",report->errorsCount);
+			carbonBatchAddU64(&batch,metric_path,"unidir.outoforder",report->outOfOrderCount);
+			carbonBatchAddU64(&batch,metric_path,"unidir.packetloss",report->lossCount);
+
+			if(opts->dup_detect_enabled) {
+				carbonBatchAddU64(&batch,metric_path,"unidir.dupcount",report->dupCount);
+			}
+
+			carbonBatchAddU64(&batch,metric_path,"unidir.lossbursts.count",report->lossBursts.burstCount);
+			carbonBatchAddU64(&batch,metric_path,"unidir.lossbursts.max",report->lossBursts.maxBurst);
 
-    	// Call bind() to bind the UDP socket to specified interface
-		if(bind(sfd,(struct sockaddr *) &(bind_addrin),sizeof(bind_addrin))<0) {
-			fprintf(stderr,"Error: cannot bind the socket for metrics transmission to Carbon to\nthe specified interface (-g option).\n"
-				"Details: %s\n",strerror(errno));
-			return -3;
+			// The percentiles and histogram are sent under <metric path>.unidir
+			if(pathlen+7<(int) sizeof(metric_path)) {
+				memcpy(metric_path+pathlen,".unidir",8);
+				carbonBatchAddHist(&batch,&(stats[i]->latencyHist),report->minLatency,report->maxLatency,metric_path,opts,decimal_digits);
+			}
 		}
-    }
-
-    // Prepare a data struct and call connect() 
-    // For TCP it will perform the actual connection establishment
-    // For UDP it will just set the default address at which packets will be sent, for each send() call
-    connect_addrin.sin_addr=opts->carbon_sock_params.ip_addr;
-    connect_addrin.sin_port=htons(opts->carbon_sock_params.port);
-    connect_addrin.sin_family=AF_INET;
-
-    if(opts->carbon_sock_type==G_UDP) {
-    	connect_rval=connect(sfd,(struct sockaddr *) &(connect_addrin),sizeof(connect_addrin));
-    } else {
-    	connect_rval=connectWithTimeout(sfd,(struct sockaddr *) &(connect_addrin),sizeof(connect_addrin),TCP_g_SOCKET_CONNECT_TIMEOUT);
-    	if(connect_rval!=0) {
-    		fprintf(stderr,"Error: connectWithTimeout() could not be completed. Details: %s.\n",connectWithTimeoutStrError(connect_rval));
-    	}
-    }
-
-    if(connect_rval!=0) {
-    	fprintf(stderr,"Error: cannot connect the socket to any Carbon server. Please check if any server is running at %s:%" PRIu16 ".\n",
-    		inet_ntoa(opts->carbon_sock_params.ip_addr),opts->carbon_sock_params.port);
-    	close(sfd);
-    	return -2;
-    }
-
-    report->socketDescriptor=sfd;
+
+		rval=batch.error;
+
+		if(rval==-2) {
+			fprintf(stderr,"%s() error: the metric path is too long to send the metrics to Carbon.\n",__func__);
+			rval=-3;
+		} else if(rval!=0) {
+			fprintf(stderr,"%s() error: cannot queue the aggregated metrics to be sent to Carbon (queue full).\n",__func__);
+			rval=-3;
+		}
+	}
+
+	// Queue to the sink, which will send the metrics to Graphite
+	if(rval==0 && carbonBatchSend(&batch)<0) {
+		fprintf(stderr,"%s() error: cannot queue the aggregated metrics to be sent to Carbon (queue full).\n",__func__);
+		rval=-3;
+	}
+
+	return rval;
+}
+
+void carbonReportStructureFree(carbonReportStructure *report,struct options *opts) {
+	if(opts->dup_detect_enabled) {
+		carbonDupSL_free(report->dupCountList);
+	}
+
+	#if !CARBON_ATOMICS_SUPPORTED
+		pthread_mutex_destroy(&(report->_epoch_mut));
+	#endif
+}
+
+// Create the non-blocking sink which will send the metrics to Carbon (see carbon_sink.h)
+// A failure in connecting to Carbon is not considered an error, as the sink will keep trying to connect in background
+int openCarbonReportSocket(carbonReportStructure *report,struct options *opts) {
+	if(!opts->carbon_sock_params.enabled) {
+		return -3;
+	}
+
+	report->sink=carbonSinkInit(opts);
+
+	if(CHECK_CS_NULL(report->sink)) {
+		return -2;
+	}
 
 	return 0;
 }
 
 void closeCarbonReportSocket(carbonReportStructure *report) {
-	if(report->socketDescriptor>0) {
-		close(report->socketDescriptor);
-	}
-}
\ No newline at end of file
+	carbonSinkFree(report->sink);
+	report->sink=NULL;
+}
@@ -0,0 +1,622 @@
+#include "carbon_sink.h"
+#include "common_socket_man.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/if.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Size of the length field preceding each batch inside the spool file
+#define CS_SPOOL_LEN_SIZE 4
+
+struct carbonSinkSlot {
+	size_t len;
+	char buf[CARBON_TCP_BATCH_SIZE];
+};
+
+struct _carbonSink {
+	struct options *opts;
+	int sockfd; // =-1 when the sink is not connected to Carbon
+
+	// In-memory queue: 'mutex' is held only to copy a batch inside or outside the queue, never while performing
+	// any system call
+	struct carbonSinkSlot *queue;
+	unsigned int q_head;
+	unsigned int q_count;
+	pthread_mutex_t mutex;
+
+	// Batch which is currently being sent: it is kept until it is completely sent, also across reconnections
+	// (in this case, it is sent again from the beginning)
+	// When it has been read from the spool file, it is removed from the file only after being completely sent
+	// ('current_spooled'=1), so that it is never lost, nor moved after any newer spooled batch
+	struct carbonSinkSlot current;
+	size_t current_sent;
+	uint8_t has_current;
+	uint8_t current_spooled;
+
+	// Spool file (=-1 if no spool file was specified): the batches between 'spool_rd' and 'spool_wr' are always older
+	// than the ones stored in the in-memory queue
+	int spoolfd;
+	off_t spool_rd;
+	off_t spool_wr;
+
+	// Reconnection management (CLOCK_MONOTONIC times)
+	unsigned int backoff; // s
+	struct timespec next_attempt;
+	struct timespec last_progress;
+	uint8_t warned_disconnected;
+
+	// Statistics (written only by the sink thread, except 'dropped_queue', which is written only with 'mutex' held)
+	uint64_t dropped_queue; // Batches dropped because the in-memory queue was full
+	uint64_t dropped_spool; // Batches dropped because the spool file was full or could not be written
+	uint64_t dropped_udp; // Batches which could not be sent over UDP
+
+	pthread_t tid;
+	// Pipe used to unblock and terminate the sink thread when calling carbonSinkFree()
+	int unlock_pd[2];
+};
+
+static inline int64_t elapsedMs(struct timespec *from,struct timespec *to) {
+	return (int64_t) (to->tv_sec-from->tv_sec)*1000+(to->tv_nsec-from->tv_nsec)/1000000;
+}
+
+// Create the socket towards Carbon, binding it to the interface specified with '-g', if any
+// The return value is the socket descriptor, or -1 in case of error
+static int carbonSinkSocket(carbonSink CS,uint8_t print_errors) {
+	struct sockaddr_in bind_addrin;
+	struct ifreq ifreq;
+	int sfd;
+
+	// Check if the user specified the usage of a UDP or TCP socket
+	if(CS->opts->carbon_sock_type==G_UDP) {
+		sfd=socket(AF_INET,SOCK_DGRAM | SOCK_CLOEXEC,IPPROTO_UDP);
+	} else {
+		sfd=socket(AF_INET,SOCK_STREAM | SOCK_CLOEXEC,IPPROTO_TCP);
+	}
+
+	if(sfd<0) {
+		return -1;
+	}
+
+	// Bind to the given interface/IP address, if an interface name was specified
+	if(CS->opts->carbon_sock_params.devname!=NULL) {
+		// First of all, retrieve the IP address from the specified devname
+		strncpy(ifreq.ifr_name,CS->opts->carbon_sock_params.devname,IFNAMSIZ);
+		ifreq.ifr_addr.sa_family=AF_INET;
+
+		if(ioctl(sfd,SIOCGIFADDR,&ifreq)!=-1) {
+			bind_addrin.sin_addr.s_addr=((struct sockaddr_in*)&ifreq.ifr_addr)->sin_addr.s_addr;
+		} else {
+			if(print_errors) {
+				fprintf(stderr,"Error: cannot bind the socket for metrics transmission to Carbon to\nthe specified interface (-g option).\n"
+					"Details: cannot retrieve IP address for interface %s.\n",CS->opts->carbon_sock_params.devname);
+			}
+			close(sfd);
+			return -1;
+		}
+
+		bind_addrin.sin_port=0;
+		bind_addrin.sin_family=AF_INET;
+
+		// Call bind() to bind the socket to specified interface
+		if(bind(sfd,(struct sockaddr *) &(bind_addrin),sizeof(bind_addrin))<0) {
+			if(print_errors) {
+				fprintf(stderr,"Error: cannot bind the socket for metrics transmission to Carbon to\nthe specified interface (-g option).\n"
+					"Details: %s\n",strerror(errno));
+			}
+			close(sfd);
+			return -1;
+		}
+	}
+
+	return sfd;
+}
+
+// Try to (re)connect to Carbon: in case of failure, the next attempt is scheduled after an exponentially increasing interval
+// The return value is 0 on success, -1 if the socket could not be created, or -2 if the connection could not be established
+static int carbonSinkConnect(carbonSink CS,uint8_t print_errors) {
+	struct sockaddr_in connect_addrin;
+	int connect_rval;
+	int sfd;
+
+	sfd=carbonSinkSocket(CS,print_errors);
+
+	if(sfd>=0) {
+		// For TCP connect() will perform the actual connection establishment
+		// For UDP it will just set the default address at which packets will be sent, for each send() call
+		connect_addrin.sin_addr=CS->opts->carbon_sock_params.ip_addr;
+		connect_addrin.sin_port=htons(CS->opts->carbon_sock_params.port);
+		connect_addrin.sin_family=AF_INET;
+
+		if(CS->opts->carbon_sock_type==G_UDP) {
+			connect_rval=connect(sfd,(struct sockaddr *) &(connect_addrin),sizeof(connect_addrin));
+		} else {
+			connect_rval=connectWithTimeout(sfd,(struct sockaddr *) &(connect_addrin),sizeof(connect_addrin),TCP_g_SOCKET_CONNECT_TIMEOUT);
+		}
+
+		if(connect_rval==0) {
+			CS->sockfd=sfd;
+			CS->backoff=CARBON_SINK_BACKOFF_MIN;
+			CS->current_sent=0;
+			clock_gettime(CLOCK_MONOTONIC,&(CS->last_progress));
+
+			if(CS->warned_disconnected) {
+				fprintf(stdout,"[INFO] The connection to Carbon has been (re-)established.\n");
+				CS->warned_disconnected=0;
+			}
+
+			return 0;
+		}
+
+		close(sfd);
+	}
+
+	if(!CS->warned_disconnected) {
+		fprintf(stderr,"Warning: cannot connect to any Carbon server at %s:%" PRIu16 ". LaTe will keep trying to connect in background.\n"
+			"In the meanwhile, the metrics will be %s.\n",
+			inet_ntoa(CS->opts->carbon_sock_params.ip_addr),CS->opts->carbon_sock_params.port,
+			CS->spoolfd>=0 ? "stored inside the spool file" : "kept in memory (up to a limited number of flush intervals)");
+		CS->warned_disconnected=1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC,&(CS->next_attempt));
+	CS->next_attempt.tv_sec+=CS->backoff;
+
+	CS->backoff*=2;
+	if(CS->backoff>CARBON_SINK_BACKOFF_MAX) {
+		CS->backoff=CARBON_SINK_BACKOFF_MAX;
+	}
+
+	return sfd<0 ? -1 : -2;
+}
+
+static void carbonSinkDisconnect(carbonSink CS) {
+	close(CS->sockfd);
+	CS->sockfd=-1;
+	CS->current_sent=0;
+
+	// Try to reconnect immediately
+	clock_gettime(CLOCK_MONOTONIC,&(CS->next_attempt));
+}
+
+static unsigned int carbonSinkQueueCount(carbonSink CS) {
+	unsigned int count;
+
+	pthread_mutex_lock(&(CS->mutex));
+	count=CS->q_count;
+	pthread_mutex_unlock(&(CS->mutex));
+
+	return count;
+}
+
+// Pop the oldest batch from the in-memory queue
+static int carbonSinkQueuePop(carbonSink CS,struct carbonSinkSlot *slot) {
+	int popped=0;
+
+	pthread_mutex_lock(&(CS->mutex));
+	if(CS->q_count>0) {
+		slot->len=CS->queue[CS->q_head].len;
+		memcpy(slot->buf,CS->queue[CS->q_head].buf,slot->len);
+		CS->q_head=(CS->q_head+1)%CARBON_SINK_QUEUE_SIZE;
+		CS->q_count--;
+		popped=1;
+	}
+	pthread_mutex_unlock(&(CS->mutex));
+
+	return popped;
+}
+
+// Append a batch to the spool file
+static void carbonSinkSpoolWrite(carbonSink CS,struct carbonSinkSlot *slot) {
+	uint8_t lenbuf[CS_SPOOL_LEN_SIZE];
+
+	if(CS->spool_wr+CS_SPOOL_LEN_SIZE+(off_t) slot->len>(off_t) CARBON_SINK_SPOOL_MAX_SIZE_MIB*1024*1024) {
+		CS->dropped_spool++;
+		return;
+	}
+
+	// The length is written in big-endian byte order
+	lenbuf[0]=(slot->len>>24) & 0xFF;
+	lenbuf[1]=(slot->len>>16) & 0xFF;
+	lenbuf[2]=(slot->len>>8) & 0xFF;
+	lenbuf[3]=slot->len & 0xFF;
+
+	if(pwrite(CS->spoolfd,lenbuf,CS_SPOOL_LEN_SIZE,CS->spool_wr)!=CS_SPOOL_LEN_SIZE ||
+		pwrite(CS->spoolfd,slot->buf,slot->len,CS->spool_wr+CS_SPOOL_LEN_SIZE)!=(ssize_t) slot->len) {
+		CS->dropped_spool++;
+		return;
+	}
+
+	CS->spool_wr+=CS_SPOOL_LEN_SIZE+slot->len;
+}
+
+// Read the oldest batch from the spool file, without removing it (see carbonSinkSpoolConsume())
+static int carbonSinkSpoolRead(carbonSink CS,struct carbonSinkSlot *slot) {
+	uint8_t lenbuf[CS_SPOOL_LEN_SIZE];
+
+	if(CS->spoolfd<0 || CS->spool_rd>=CS->spool_wr) {
+		return 0;
+	}
+
+	if(pread(CS->spoolfd,lenbuf,CS_SPOOL_LEN_SIZE,CS->spool_rd)!=CS_SPOOL_LEN_SIZE) {
+		slot->len=0;
+	} else {
+		slot->len=((size_t) lenbuf[0]<<24) | ((size_t) lenbuf[1]<<16) | ((size_t) lenbuf[2]<<8) | lenbuf[3];
+	}
+
+	// A corrupted (or truncated) spool file is discarded
+	if(slot->len==0 || slot->len>CARBON_TCP_BATCH_SIZE ||
+		pread(CS->spoolfd,slot->buf,slot->len,CS->spool_rd+CS_SPOOL_LEN_SIZE)!=(ssize_t) slot->len) {
+		fprintf(stderr,"Warning: the Carbon spool file is corrupted. The remaining spooled metrics will be discarded.\n");
+		CS->spool_rd=0;
+		CS->spool_wr=0;
+		if(ftruncate(CS->spoolfd,0)<0) {
+			fprintf(stderr,"Warning: cannot truncate the Carbon spool file. Details: %s\n",strerror(errno));
+		}
+
+		return 0;
+	}
+
+	return 1;
+}
+
+// Remove the oldest batch, read with carbonSinkSpoolRead(), from the spool file, once it has been sent
+// When the whole spool file has been sent, it is truncated
+static void carbonSinkSpoolConsume(carbonSink CS,struct carbonSinkSlot *slot) {
+	CS->spool_rd+=CS_SPOOL_LEN_SIZE+slot->len;
+
+	if(CS->spool_rd>=CS->spool_wr) {
+		CS->spool_rd=0;
+		CS->spool_wr=0;
+		if(ftruncate(CS->spoolfd,0)<0) {
+			fprintf(stderr,"Warning: cannot truncate the Carbon spool file. Details: %s\n",strerror(errno));
+		}
+	}
+}
+
+// Release the batch which is currently being sent (after it has been completely sent, or dropped)
+static void carbonSinkCurrentDone(carbonSink CS) {
+	if(CS->current_spooled) {
+		carbonSinkSpoolConsume(CS,&(CS->current));
+		CS->current_spooled=0;
+	}
+
+	CS->has_current=0;
+}
+
+// Move the batches which have not been sent yet at the beginning of the spool file, so that the batches which were
+// already sent are not sent again at the next execution
+static void carbonSinkSpoolCompact(carbonSink CS) {
+	char buf[CARBON_TCP_BATCH_SIZE];
+	off_t src=CS->spool_rd;
+	off_t dst=0;
+	ssize_t rval;
+
+	if(CS->spoolfd<0 || CS->spool_rd==0) {
+		return;
+	}
+
+	while(src<CS->spool_wr) {
+		rval=pread(CS->spoolfd,buf,sizeof(buf),src);
+		if(rval<=0 || pwrite(CS->spoolfd,buf,rval,dst)!=rval) {
+			fprintf(stderr,"Warning: cannot compact the Carbon spool file: some metrics may be sent twice at the next execution.\n");
+			return;
+		}
+
+		src+=rval;
+		dst+=rval;
+	}
+
+	CS->spool_wr-=CS->spool_rd;
+	CS->spool_rd=0;
+
+	if(ftruncate(CS->spoolfd,CS->spool_wr)<0) {
+		fprintf(stderr,"Warning: cannot truncate the Carbon spool file. Details: %s\n",strerror(errno));
+	}
+}
+
+// Move the batches stored in the in-memory queue (and the batch being sent, if any) to the spool file
+static void carbonSinkSpoolQueue(carbonSink CS) {
+	struct carbonSinkSlot slot;
+
+	if(CS->spoolfd<0) {
+		return;
+	}
+
+	// The batch being sent is the oldest one: if it comes from the spool file, it is still at its head, and it is
+	// simply read again later; otherwise, it is more recent than any spooled batch
+	if(CS->has_current) {
+		if(!CS->current_spooled) {
+			carbonSinkSpoolWrite(CS,&(CS->current));
+		}
+		CS->has_current=0;
+		CS->current_spooled=0;
+	}
+
+	while(carbonSinkQueuePop(CS,&slot)) {
+		carbonSinkSpoolWrite(CS,&slot);
+	}
+}
+
+// Send as many batches as possible, without blocking: the spooled batches are sent first, as they are older than the
+// ones stored in the in-memory queue
+static void carbonSinkSend(carbonSink CS) {
+	struct timespec now;
+	ssize_t rval;
+
+	while(CS->sockfd>=0) {
+		if(!CS->has_current) {
+			if(carbonSinkSpoolRead(CS,&(CS->current))) {
+				CS->current_spooled=1;
+			} else if(!carbonSinkQueuePop(CS,&(CS->current))) {
+				break;
+			}
+
+			CS->has_current=1;
+			CS->current_sent=0;
+			clock_gettime(CLOCK_MONOTONIC,&(CS->last_progress));
+		}
+
+		rval=send(CS->sockfd,CS->current.buf+CS->current_sent,CS->current.len-CS->current_sent,MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if(rval<0) {
+			if(errno==EINTR) {
+				continue;
+			}
+
+			clock_gettime(CLOCK_MONOTONIC,&now);
+
+			if(errno==EAGAIN || errno==EWOULDBLOCK) {
+				// Carbon is not accepting any data: consider the connection as lost after CARBON_SINK_STALL_TIMEOUT s
+				if(elapsedMs(&(CS->last_progress),&now)>=CARBON_SINK_STALL_TIMEOUT*1000) {
+					fprintf(stderr,"Warning: the connection to Carbon is stalled. Trying to reconnect.\n");
+					carbonSinkDisconnect(CS);
+				}
+			} else if(CS->opts->carbon_sock_type==G_UDP) {
+				// With UDP, there is no connection to be re-established: the batch is simply dropped
+				CS->dropped_udp++;
+				carbonSinkCurrentDone(CS);
+				continue;
+			} else {
+				fprintf(stderr,"Warning: the connection to Carbon has been lost (%s). Trying to reconnect.\n",strerror(errno));
+				carbonSinkDisconnect(CS);
+			}
+
+			break;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC,&(CS->last_progress));
+		CS->current_sent+=rval;
+
+		if(CS->current_sent>=CS->current.len) {
+			carbonSinkCurrentDone(CS);
+		}
+	}
+}
+
+static void *carbonSinkLoop(void *arg) {
+	carbonSink CS=(carbonSink) arg;
+	struct pollfd pollMon[2];
+	struct timespec now;
+	struct timespec close_start;
+	int npoll;
+	int stop=0;
+
+	pollMon[0].fd=CS->unlock_pd[0];
+	pollMon[0].events=POLLIN;
+
+	while(!stop) {
+		pollMon[0].revents=0;
+		npoll=1;
+
+		// When the last send() could not be completed, wait for the socket to be writable again
+		if(CS->sockfd>=0 && CS->has_current) {
+			pollMon[1].fd=CS->sockfd;
+			pollMon[1].events=POLLOUT;
+			pollMon[1].revents=0;
+			npoll=2;
+		}
+
+		// Wait for CARBON_SINK_POLL_INTERVAL ms, or until carbonSinkFree() is called
+		if(poll(pollMon,npoll,CARBON_SINK_POLL_INTERVAL)>0 && pollMon[0].revents>0) {
+			stop=1;
+		}
+
+		if(CS->sockfd<0) {
+			// Move the batches to the spool file while Carbon is not reachable, so that the in-memory queue never fills up
+			carbonSinkSpoolQueue(CS);
+
+			clock_gettime(CLOCK_MONOTONIC,&now);
+			if(!stop && elapsedMs(&(CS->next_attempt),&now)>=0) {
+				carbonSinkConnect(CS,0);
+			}
+		}
+
+		carbonSinkSend(CS);
+	}
+
+	// Try to send the pending batches for up to CARBON_SINK_CLOSE_TIMEOUT ms
+	clock_gettime(CLOCK_MONOTONIC,&close_start);
+	clock_gettime(CLOCK_MONOTONIC,&now);
+
+	while(CS->sockfd>=0 && (CS->has_current || carbonSinkQueueCount(CS)>0 || CS->spool_rd<CS->spool_wr) &&
+		elapsedMs(&close_start,&now)<CARBON_SINK_CLOSE_TIMEOUT) {
+		pollMon[1].fd=CS->sockfd;
+		pollMon[1].events=POLLOUT;
+		poll(&pollMon[1],1,CARBON_SINK_POLL_INTERVAL);
+
+		carbonSinkSend(CS);
+
+		clock_gettime(CLOCK_MONOTONIC,&now);
+	}
+
+	// Anything which could not be sent is stored inside the spool file, to be sent at the next execution
+	carbonSinkSpoolCompact(CS);
+	carbonSinkSpoolQueue(CS);
+
+	pthread_exit(NULL);
+}
+
+// Free the memory allocated by carbonSinkInit() (the sink thread should not be running anymore)
+static void carbonSinkMemFree(carbonSink CS) {
+	if(CS->sockfd>=0) {
+		close(CS->sockfd);
+	}
+
+	if(CS->spoolfd>=0) {
+		close(CS->spoolfd);
+	}
+
+	free(CS->queue);
+	free(CS);
+}
+
+// Create the sink and start the sink thread
+// A first connection attempt is performed immediately: if it fails, the metrics are queued (or spooled) and the sink thread
+// keeps trying to connect in background
+// NULL is returned only in case of a non-recoverable error (e.g. if the socket cannot be bound to the specified interface)
+carbonSink carbonSinkInit(struct options *opts) {
+	carbonSink CS;
+
+	if(!opts->carbon_sock_params.enabled) {
+		return NULL;
+	}
+
+	CS=calloc(1,sizeof(struct _carbonSink));
+	if(CHECK_CS_NULL(CS)) {
+		return NULL;
+	}
+
+	CS->opts=opts;
+	CS->sockfd=-1;
+	CS->spoolfd=-1;
+	CS->backoff=CARBON_SINK_BACKOFF_MIN;
+
+	CS->queue=malloc(CARBON_SINK_QUEUE_SIZE*sizeof(struct carbonSinkSlot));
+	if(!CS->queue) {
+		free(CS);
+		return NULL;
+	}
+
+	// Open the spool file, without truncating it, in order to send any metric spooled during a previous execution
+	if(opts->carbon_spool_filename!=NULL) {
+		CS->spoolfd=open(opts->carbon_spool_filename,O_RDWR | O_CREAT | O_CLOEXEC,S_IRUSR | S_IWUSR);
+
+		if(CS->spoolfd<0) {
+			fprintf(stderr,"Error: cannot open the Carbon spool file %s. Details: %s\n",opts->carbon_spool_filename,strerror(errno));
+			carbonSinkMemFree(CS);
+			return NULL;
+		}
+
+		CS->spool_rd=0;
+		CS->spool_wr=lseek(CS->spoolfd,0,SEEK_END);
+
+		if(CS->spool_wr<0) {
+			CS->spool_wr=0;
+		} else if(CS->spool_wr>0) {
+			fprintf(stdout,"[INFO] %" PRIi64 " B of spooled metrics will be sent to Carbon, with their original timestamps.\n",(int64_t) CS->spool_wr);
+		}
+	}
+
+	if(carbonSinkConnect(CS,1)==-1) {
+		carbonSinkMemFree(CS);
+		return NULL;
+	}
+
+	if(pthread_mutex_init(&(CS->mutex),NULL)!=0) {
+		carbonSinkMemFree(CS);
+		return NULL;
+	}
+
+	if(pipe(CS->unlock_pd)<0) {
+		pthread_mutex_destroy(&(CS->mutex));
+		carbonSinkMemFree(CS);
+		return NULL;
+	}
+
+	if(pthread_create(&(CS->tid),NULL,&carbonSinkLoop,(void *) CS)!=0) {
+		close(CS->unlock_pd[0]);
+		close(CS->unlock_pd[1]);
+		pthread_mutex_destroy(&(CS->mutex));
+		carbonSinkMemFree(CS);
+		return NULL;
+	}
+
+	return CS;
+}
+
+// Queue a batch, to be sent by the sink thread
+// This function never blocks, and it never performs any system call: if the in-memory queue is full, the batch is
+// dropped and -1 is returned
+int carbonSinkEnqueue(carbonSink CS,const char *buf,size_t len) {
+	int rval=0;
+
+	if(CHECK_CS_NULL(CS) || len>CARBON_TCP_BATCH_SIZE) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&(CS->mutex));
+	if(CS->q_count<CARBON_SINK_QUEUE_SIZE) {
+		unsigned int tail=(CS->q_head+CS->q_count)%CARBON_SINK_QUEUE_SIZE;
+
+		memcpy(CS->queue[tail].buf,buf,len);
+		CS->queue[tail].len=len;
+		CS->q_count++;
+	} else {
+		CS->dropped_queue++;
+		rval=-1;
+	}
+	pthread_mutex_unlock(&(CS->mutex));
+
+	return rval;
+}
+
+// Send the pending batches (for up to CARBON_SINK_CLOSE_TIMEOUT ms), terminate the sink thread and close the socket
+// The batches which could not be sent are stored inside the spool file, if any
+void carbonSinkFree(carbonSink CS) {
+	if(CHECK_CS_NULL(CS)) {
+		return;
+	}
+
+	// Write a single byte to the unlock_pd pipe to unlock the thread, to gracefully terminate it
+	if(write(CS->unlock_pd[1],"\0",1)<0) {
+		fprintf(stderr,"Warning: could not gracefully terminate the Carbon sink thread.\n"
+			"Its termination will be forced and some metrics may not be sent.\n");
+		pthread_cancel(CS->tid);
+	}
+
+	pthread_join(CS->tid,NULL);
+
+	close(CS->unlock_pd[0]);
+	close(CS->unlock_pd[1]);
+
+	if(CS->dropped_queue+CS->dropped_spool+CS->dropped_udp>0) {
+		fprintf(stderr,"Warning: %" PRIu64 " batches of metrics could not be sent to Carbon (%" PRIu64 " because the queue was full, "
+			"%" PRIu64 " because the spool file was full or could not be written, %" PRIu64 " because of UDP send errors).\n",
+			CS->dropped_queue+CS->dropped_spool+CS->dropped_udp,CS->dropped_queue,CS->dropped_spool,CS->dropped_udp);
+	}
+
+	if(CS->has_current || CS->q_count>0) {
+		fprintf(stderr,"Warning: %u batches of metrics could not be sent to Carbon before terminating.\n",CS->q_count+CS->has_current);
+	}
+
+	if(CS->spool_wr>CS->spool_rd) {
+		fprintf(stderr,"Warning: %" PRIi64 " B of metrics could not be sent to Carbon: they have been stored inside the spool file %s,\n"
+			"and they will be sent at the next execution.\n",(int64_t) (CS->spool_wr-CS->spool_rd),CS->opts->carbon_spool_filename);
+	}
+
+	pthread_mutex_destroy(&(CS->mutex));
+
+	carbonSinkMemFree(CS);
+}
@@ -72,9 +72,8 @@ static void *flush_loop (void *arg) {
 			}
 		}
 
-		pthread_mutex_lock(&(flush_loop_args->ctd->mutex));
+		// No lock is needed, as the receive thread keeps updating the other interval buffer (see carbon_report_manager.c)
 		carbonReportStructureFlush(flush_loop_args->reportPtr,flush_loop_args->opts,g_DECIMAL_DIGITS,0);
-		pthread_mutex_unlock(&(flush_loop_args->ctd->mutex));
 	}
 
 	pthread_exit(NULL);
@@ -91,12 +90,6 @@ int startCarbonTimedThread(carbon_pthread_data_t *ctd,carbonReportStructure *rep
 		return -1;
 	}
 
-	// Initialize the specified mutex
-	if(pthread_mutex_init(&(ctd->mutex),NULL)!=0) {
-		fprintf(stderr,"Error: could not allocate a mutex to synchronize the Graphite/Carbon flush thread.\n");
-		return -1;
-	}
-
 	// Fill the flush_callback_args structure (arguments to be passed to the thread flush loop, which will periodically flush the metrics to Carbon)
 	args->opts=opts;
 	args->reportPtr=reportPtr;
@@ -111,7 +104,6 @@ int startCarbonTimedThread(carbon_pthread_data_t *ctd,carbonReportStructure *rep
 
 	// Create the thread, passing as argument a pointer to 'args'
 	if(pthread_create(&(ctd->tid),NULL,&flush_loop,(void *) args)!=0) {
-		pthread_mutex_destroy(&(ctd->mutex));
 		close(ctd->unlock_pd[0]);
 		close(ctd->unlock_pd[1]);
 
@@ -139,6 +131,4 @@ void stopCarbonTimedThread(carbon_pthread_data_t *ctd) {
 	if(ctd->args) {
 		free(ctd->args);
 	}
-
-	pthread_mutex_destroy(&(ctd->mutex));
 }
\ No newline at end of file
@@ -3,12 +3,15 @@
 #include <fcntl.h>
 #include <linux/if.h>
 #include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
 #include <linux/sockios.h>
 #include <linux/ethtool.h>
 #include <sys/ioctl.h>
 #include <poll.h>
 #include <unistd.h>
 #include <ifaddrs.h>
+#include <stddef.h>
+#include <linux/filter.h>
 
 int socketCreator(protocol_t protocol) {
 	int sFd;
@@ -272,6 +275,18 @@ int socketOpen(protocol_t protocol,struct lampsock_data *sData,struct options *o
 				sData->addru.addrin[0].sin_addr.s_addr=opts->opt_ipaddr.s_addr;
 			}
 
+			// When the server is sharded over more threads (--server-threads), this socket is the first one of the SO_REUSEPORT
+			// group (the others are opened by each thread with socketOpenShard())
+			if((opts->mode_cs==SERVER || opts->mode_cs==LOOPBACK_SERVER) && opts->server_threads>1) {
+				int reuseport=1;
+
+				if(setsockopt(sData->descriptor,SOL_SOCKET,SO_REUSEPORT,&reuseport,sizeof(reuseport))!=0) {
+					perror("setsockopt() for SO_REUSEPORT error");
+					close(sData->descriptor);
+					return 0;
+				}
+			}
+
 			// Bind to the specified interface
 			if(bind(sData->descriptor,(struct sockaddr *) &(sData->addru.addrin[0]),sizeof(sData->addru.addrin[0]))<0) {
 				perror("Cannot bind to interface: bind() error");
@@ -297,6 +312,64 @@ int socketOpen(protocol_t protocol,struct lampsock_data *sData,struct options *o
 	return 1;
 }
 
+// Open another UDP socket of the SO_REUSEPORT group of a sharded server, bound to the same address and port of the socket
+// already opened with socketOpen() (sData), and with the same options
+// It returns the descriptor of the new socket, or -1 in case of error
+int socketOpenShard(struct lampsock_data *sData,struct options *opts) {
+	int sFd;
+	int reuseport=1;
+
+	sFd=socketCreator(UDP);
+
+	if(sFd==-1) {
+		perror("socket() error");
+		return -1;
+	}
+
+	if(setsockopt(sFd,SOL_SOCKET,SO_REUSEPORT,&reuseport,sizeof(reuseport))!=0) {
+		perror("setsockopt() for SO_REUSEPORT error");
+		close(sFd);
+		return -1;
+	}
+
+	if(bind(sFd,(struct sockaddr *) &(sData->addru.addrin[0]),sizeof(sData->addru.addrin[0]))<0) {
+		perror("Cannot bind to interface: bind() error");
+		close(sFd);
+		return -1;
+	}
+
+	if(opts->macUP!=UINT8_MAX && setsockopt(sFd,SOL_SOCKET,SO_PRIORITY,&(opts->macUP),sizeof(opts->macUP))!=0) {
+		perror("setsockopt() for SO_PRIORITY error");
+		close(sFd);
+		return -1;
+	}
+
+	return sFd;
+}
+
+// Attach to a SO_REUSEPORT group of 'shards' sockets a classic BPF program selecting, for each received datagram, the socket
+// with index <LaMP id> % 'shards' (i.e. the index, in bind() order, of the socket inside the group), so that all the packets
+// of a session are always received by the same socket, even if the client changes its source port
+// Datagrams too short to contain a LaMP id make the program return 0, and are thus received by the first socket
+int socketAttachReuseportCBPF(int sFd,unsigned int shards) {
+	struct sock_filter code[]={
+		// The program is run with the packet data starting from the UDP payload, i.e. from the LaMP header
+		{BPF_LD | BPF_H | BPF_ABS,	0, 0, offsetof(struct lamphdr,id)},
+		{BPF_ALU | BPF_MOD | BPF_K,	0, 0, shards},
+		{BPF_RET | BPF_A,			0, 0, 0}
+	};
+	struct sock_fprog prog={
+		.len=sizeof(code)/sizeof(code[0]),
+		.filter=code
+	};
+
+	if(shards==0) {
+		return -1;
+	}
+
+	return setsockopt(sFd,SOL_SOCKET,SO_ATTACH_REUSEPORT_CBPF,&prog,sizeof(prog));
+}
+
 int socketSetTimestamping(struct lampsock_data sData, int mode) {
 	int flags;
 	int setsockopt_optname;
@@ -363,6 +436,28 @@ int socketSetTimestamping(struct lampsock_data sData, int mode) {
 	return setsockopt(sData.descriptor,SOL_SOCKET,setsockopt_optname,&flags,sizeof(flags));
 }
 
+// Disable any receive/transmit timestamp enabled with socketSetTimestamping() and discard the transmit timestamps still
+// queued in the socket error queue, so that a socket can be reused for a new session (e.g. in continuous daemon mode)
+// without being affected by the timestamping mode requested by the client of the previous session
+int socketResetTimestamping(struct lampsock_data sData) {
+	int flags=0;
+	char ctrlBuf[CMSG_SPACE(sizeof(struct scm_timestamping))];
+	byte_t errqueueBuf[RAW_RX_PACKET_BUF_SIZE];
+	struct iovec iov={.iov_base=errqueueBuf,.iov_len=sizeof(errqueueBuf)};
+	struct msghdr mhdr={.msg_iov=&iov,.msg_iovlen=1,.msg_control=ctrlBuf,.msg_controllen=sizeof(ctrlBuf)};
+
+	if(setsockopt(sData.descriptor,SOL_SOCKET,SO_TIMESTAMP,&flags,sizeof(flags))<0 ||
+		setsockopt(sData.descriptor,SOL_SOCKET,SO_TIMESTAMPING,&flags,sizeof(flags))<0) {
+		return SOCKETSETTS_ESETSOCKOPT;
+	}
+
+	while(recvmsg(sData.descriptor,&mhdr,MSG_ERRQUEUE | MSG_DONTWAIT)>=0) {
+		mhdr.msg_controllen=sizeof(ctrlBuf);
+	}
+
+	return 0;
+}
+
 int pollErrqueueWait(int sFd,uint64_t timeout_ms) {
 	struct pollfd errqueueMon;
 	int poll_retval;
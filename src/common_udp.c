@@ -8,18 +8,40 @@
 #include <unistd.h>
 #include <stdio.h>   
 #include <stdlib.h> 
+#include <string.h>
+
+// Prepare the control packet to be sent, i.e. the LaMP header followed, only for INIT and ACK messages requesting
+// or accepting at least one extension, by the extension block
+// Returns the size of the control packet, which should always be less than or equal to LAMP_HDR_SIZE()+LAMP_EXT_SIZE
+static size_t controlPacketPrepare(byte_t *ctrlPacket, struct lamphdr *lampHeader, lamptype_t type, uint16_t ext_flags) {
+	memcpy(ctrlPacket,lampHeader,LAMP_HDR_SIZE());
+
+	if((type==INIT || type==ACK) && ext_flags!=LAMP_EXT_FLAG_NONE) {
+		lampExtWrite(ctrlPacket+LAMP_HDR_SIZE(),ext_flags);
+		return LAMP_HDR_SIZE()+LAMP_EXT_SIZE;
+	}
+
+	return LAMP_HDR_SIZE();
+}
 
 /* Send control message.
+'ctrl_param' is the follow-up control type when sending FOLLOWUP_CTRL messages, while it contains the LaMP extension
+flags (LAMP_EXT_FLAG_*, see lamp_ext.h) when sending INIT and ACK messages: if they are different than LAMP_EXT_FLAG_NONE,
+an extension block is appended after the LaMP header.
 Return values:
 0: ok
 -1: invalid argument
 -2: sendto() error: cannot send packet
 -3: read() error: cannot clear timer event
 */
-int controlSenderUDP(arg_struct_udp *args, uint16_t session_id, int max_attempts, lamptype_t type, uint16_t followup_type, time_t interval_ms, uint8_t *termination_flag, pthread_mutex_t *termination_flag_mutex) {
+int controlSenderUDP(arg_struct_udp *args, uint16_t session_id, int max_attempts, lamptype_t type, uint16_t ctrl_param, time_t interval_ms, uint8_t *termination_flag, pthread_mutex_t *termination_flag_mutex) {
 	struct lamphdr lampHeader;
 	int counter=0;
 
+	// Control packet buffer (LaMP header, followed by the extension block, if any) and its size
+	byte_t ctrlPacket[LAMP_HDR_SIZE()+LAMP_EXT_SIZE];
+	size_t ctrlPacketSize;
+
 	// Junk variable (needed to clear the timer event with read())
 	unsigned long long junk;
 
@@ -30,7 +52,7 @@ int controlSenderUDP(arg_struct_udp *args, uint16_t session_id, int max_attempts
 	// Return value of poll()
 	int poll_retval=1;
 
-	if(max_attempts<=0 || (type!=INIT && type!=ACK && type!=FOLLOWUP_CTRL) || (type==FOLLOWUP_CTRL && !IS_FOLLOWUP_CTRL_TYPE_VALID(followup_type))) {
+	if(max_attempts<=0 || (type!=INIT && type!=ACK && type!=FOLLOWUP_CTRL) || (type==FOLLOWUP_CTRL && !IS_FOLLOWUP_CTRL_TYPE_VALID(ctrl_param))) {
 		return -1;
 	}
 
@@ -54,11 +76,13 @@ int controlSenderUDP(arg_struct_udp *args, uint16_t session_id, int max_attempts
 	if(type==INIT) {
 		lampHeadSetConnType(&lampHeader,args->opts->mode_ub);
 	} else if(type==FOLLOWUP_CTRL) {
-		lampHeadSetFollowupCtrlType(&lampHeader,followup_type);
+		lampHeadSetFollowupCtrlType(&lampHeader,ctrl_param);
 	}
 
+	ctrlPacketSize=controlPacketPrepare(ctrlPacket,&lampHeader,type,ctrl_param);
+
 	if(max_attempts==1) {
-		if(sendto(args->sData.descriptor,&lampHeader,LAMP_HDR_SIZE(),NO_FLAGS,(struct sockaddr *)&(args->sData.addru.addrin[1]),sizeof(struct sockaddr_in))!=LAMP_HDR_SIZE()) {
+		if(sendto(args->sData.descriptor,ctrlPacket,ctrlPacketSize,NO_FLAGS,(struct sockaddr *)&(args->sData.addru.addrin[1]),sizeof(struct sockaddr_in))!=ctrlPacketSize) {
 			return -2;
 		}
 	} else {
@@ -75,12 +99,13 @@ int controlSenderUDP(arg_struct_udp *args, uint16_t session_id, int max_attempts
 				}
 				pthread_mutex_unlock(termination_flag_mutex);
 
-				if(sendto(args->sData.descriptor,&lampHeader,LAMP_HDR_SIZE(),NO_FLAGS,(struct sockaddr *)&(args->sData.addru.addrin[1]),sizeof(struct sockaddr_in))!=LAMP_HDR_SIZE()) {
+				if(sendto(args->sData.descriptor,ctrlPacket,ctrlPacketSize,NO_FLAGS,(struct sockaddr *)&(args->sData.addru.addrin[1]),sizeof(struct sockaddr_in))!=ctrlPacketSize) {
 					return -2;
 				}
 
 				// Successive attempts will have an increased sequence number
 				lampHeadIncreaseSeq(&lampHeader);
+				memcpy(ctrlPacket,&lampHeader,LAMP_HDR_SIZE());
 			}
 
 			poll_retval=poll(&timerMon,1,INDEFINITE_BLOCK);
@@ -97,6 +122,7 @@ int controlSenderUDP(arg_struct_udp *args, uint16_t session_id, int max_attempts
 }
 
 /* Send raw control message.
+'ctrl_param' has the same meaning as in controlSenderUDP().
 Return values:
 0: ok
 -1: invalid argument
@@ -104,7 +130,7 @@ Return values:
 -3: malloc() error: cannot allocate memory
 -4: read() error: cannot clear timer event
 */
-int controlSenderUDP_RAW(arg_struct *args, controlRCVdata *rcvData, uint16_t session_id, int max_attempts, lamptype_t type, uint16_t followup_type, time_t interval_ms, uint8_t *termination_flag, pthread_mutex_t *termination_flag_mutex) {
+int controlSenderUDP_RAW(arg_struct *args, controlRCVdata *rcvData, uint16_t session_id, int max_attempts, lamptype_t type, uint16_t ctrl_param, time_t interval_ms, uint8_t *termination_flag, pthread_mutex_t *termination_flag_mutex) {
 	// Packet buffers and headers
 	struct pktheaders_udp headers;
 	struct pktbuffers_udp buffers = {NULL, NULL, NULL, NULL};
@@ -116,6 +142,10 @@ int controlSenderUDP_RAW(arg_struct *args, controlRCVdata *rcvData, uint16_t ses
 	// Final packet size
 	size_t finalpktsize;
 
+	// Control packet buffer (LaMP header, followed by the extension block, if any) and its size
+	byte_t ctrlPacket[LAMP_HDR_SIZE()+LAMP_EXT_SIZE];
+	size_t ctrlPacketSize;
+
 	int counter=0;
 
 	// Junk variable (needed to clear the timer event with read())
@@ -128,7 +158,7 @@ int controlSenderUDP_RAW(arg_struct *args, controlRCVdata *rcvData, uint16_t ses
 	// Return value of poll()
 	int poll_retval=1;
 
-	if(max_attempts<=0 || (type!=INIT && type!=ACK && type!=FOLLOWUP_CTRL) || (type==FOLLOWUP_CTRL && !IS_FOLLOWUP_CTRL_TYPE_VALID(followup_type))) {
+	if(max_attempts<=0 || (type!=INIT && type!=ACK && type!=FOLLOWUP_CTRL) || (type==FOLLOWUP_CTRL && !IS_FOLLOWUP_CTRL_TYPE_VALID(ctrl_param))) {
 		return -1;
 	}
 
@@ -157,23 +187,26 @@ int controlSenderUDP_RAW(arg_struct *args, controlRCVdata *rcvData, uint16_t ses
 	if(type==INIT) {
 		lampHeadSetConnType(&(headers.lampHeader), args->opts->mode_ub);
 	} else if(type==FOLLOWUP_CTRL) {
-		lampHeadSetFollowupCtrlType(&(headers.lampHeader),followup_type);
+		lampHeadSetFollowupCtrlType(&(headers.lampHeader),ctrl_param);
 	}
 
-	// Allocating packet buffers (without payload - as an ACK is sent and it does not require any payload)
+	ctrlPacketSize=controlPacketPrepare(ctrlPacket,&(headers.lampHeader),type,ctrl_param);
+
+	// Allocating packet buffers (without payload - as a control message is sent and it does not require any payload,
+	// except for the optional extension block)
 	// There is no need to allocate the lamppacket buffer, as the LaMP header will be directly encapsulated inside UDP
-	buffers.udppacket=malloc(UDP_PACKET_SIZE_S(LAMP_HDR_SIZE()));
+	buffers.udppacket=malloc(UDP_PACKET_SIZE_S(ctrlPacketSize));
 	if(!buffers.udppacket) {
 		return -3;
 	}
 
-	buffers.ippacket=malloc(IP_UDP_PACKET_SIZE_S(LAMP_HDR_SIZE()));
+	buffers.ippacket=malloc(IP_UDP_PACKET_SIZE_S(ctrlPacketSize));
 	if(!buffers.ippacket) {
 		free(buffers.udppacket);
 		return -3;
 	}
 
-	buffers.ethernetpacket=malloc(ETH_IP_UDP_PACKET_SIZE_S(LAMP_HDR_SIZE()));
+	buffers.ethernetpacket=malloc(ETH_IP_UDP_PACKET_SIZE_S(ctrlPacketSize));
 	if(!buffers.ethernetpacket) {
 		free(buffers.ippacket);
 		free(buffers.udppacket);
@@ -186,11 +219,11 @@ int controlSenderUDP_RAW(arg_struct *args, controlRCVdata *rcvData, uint16_t ses
 	// Prepare datagram (ctrl = ACK is already set in lampHeadPopulate(), few lines before this one)
 	IP4headAddID(&(headers.ipHeader),(unsigned short) (rand()%UINT16_MAX)); // random ID could be okay?
 
-	UDPencapsulate(buffers.udppacket,&(headers.udpHeader),(byte_t *)&(headers.lampHeader),LAMP_HDR_SIZE(),ipaddrs);
+	UDPencapsulate(buffers.udppacket,&(headers.udpHeader),ctrlPacket,ctrlPacketSize,ipaddrs);
 
 	// 'IP4headAddTotLen' may also be skipped since IP4Encapsulate already takes care of filling the length field
-	IP4Encapsulate(buffers.ippacket, &(headers.ipHeader), buffers.udppacket, UDP_PACKET_SIZE_S(LAMP_HDR_SIZE()));
-	finalpktsize=etherEncapsulate(buffers.ethernetpacket, &(headers.etherHeader), buffers.ippacket, IP_UDP_PACKET_SIZE_S(LAMP_HDR_SIZE()));
+	IP4Encapsulate(buffers.ippacket, &(headers.ipHeader), buffers.udppacket, UDP_PACKET_SIZE_S(ctrlPacketSize));
+	finalpktsize=etherEncapsulate(buffers.ethernetpacket, &(headers.etherHeader), buffers.ippacket, IP_UDP_PACKET_SIZE_S(ctrlPacketSize));
 
 	if(max_attempts==1) {
 		if(rawLampSend(args->sData.descriptor, args->sData.addru.addrll, inpacket_lamphdr, buffers.ethernetpacket, finalpktsize, FLG_NONE, UDP)) {
@@ -284,7 +317,7 @@ int controlReceiverUDP(int sFd, controlRCVdata *rcvData, lamptype_t type, uint8_
 		}
 
 		// Check whether the packet is really encapsulating LaMP; if it is not, discard packet
-		if(!IS_LAMP(lampHeaderPtr->reserved,lampHeaderPtr->ctrl)) {
+		if(rcv_bytes<LAMP_HDR_SIZE() || !IS_LAMP(lampHeaderPtr->reserved,lampHeaderPtr->ctrl)) {
 			continue;
 		}
 
@@ -300,12 +333,16 @@ int controlReceiverUDP(int sFd, controlRCVdata *rcvData, lamptype_t type, uint8_
 			if(lamp_id_rx!=rcvData->session_id) {
 				continue;
 			}
+
+			// Get the extensions accepted by the server (this is meaningful only for the ACK replying to an INIT)
+			rcvData->controlRCV.ext_flags=lampExtRead(lampPacket+LAMP_HDR_SIZE(),rcv_bytes-LAMP_HDR_SIZE());
 		} else if((type==INIT && IS_INIT_INDEX_VALID(lamp_type_idx)) || (type==FOLLOWUP_CTRL && IS_FOLLOWUP_CTRL_TYPE_VALID(lamp_type_idx))) {
 			// If the type is INIT, populate the rcvData structure
 			rcvData->controlRCV.ip=srcAddr.sin_addr;
 			rcvData->controlRCV.port=srcAddr.sin_port;
 			rcvData->controlRCV.session_id=lamp_id_rx;
 			rcvData->controlRCV.type_idx=lamp_type_idx;
+			rcvData->controlRCV.ext_flags=type==INIT ? lampExtRead(lampPacket+LAMP_HDR_SIZE(),rcv_bytes-LAMP_HDR_SIZE()) : LAMP_EXT_FLAG_NONE;
 		} else {
 			continue;
 		}
@@ -394,7 +431,7 @@ int controlReceiverUDP_RAW(int sFd, in_port_t port, in_addr_t ip, controlRCVdata
 		}
 
 		// Check whether the packet is really encapsulating LaMP; if it is not, discard packet
-		if(!IS_LAMP((headerptrs.lampHeader)->reserved,(headerptrs.lampHeader)->ctrl)) {
+		if(UDPpayloadsize<LAMP_HDR_SIZE() || !IS_LAMP((headerptrs.lampHeader)->reserved,(headerptrs.lampHeader)->ctrl)) {
 			continue;
 		}
 
@@ -410,12 +447,16 @@ int controlReceiverUDP_RAW(int sFd, in_port_t port, in_addr_t ip, controlRCVdata
 			if(lamp_id_rx!=rcvData->session_id) {
 				continue;
 			}
+
+			// Get the extensions accepted by the server (this is meaningful only for the ACK replying to an INIT)
+			rcvData->controlRCV.ext_flags=lampExtRead(lampPacket+LAMP_HDR_SIZE(),UDPpayloadsize-LAMP_HDR_SIZE());
 		} else if((type==INIT && IS_INIT_INDEX_VALID(lamp_type_idx)) || (type==FOLLOWUP_CTRL && IS_FOLLOWUP_CTRL_TYPE_VALID(lamp_type_idx))) {
 			// If the type is init, populate the rcvData structure
 			rcvData->controlRCV.ip.s_addr=headerptrs.ipHeader->saddr;
 			rcvData->controlRCV.port=ntohs(headerptrs.udpHeader->source);
 			rcvData->controlRCV.session_id=lamp_id_rx;
 			rcvData->controlRCV.type_idx=lamp_type_idx;
+			rcvData->controlRCV.ext_flags=type==INIT ? lampExtRead(lampPacket+LAMP_HDR_SIZE(),UDPpayloadsize-LAMP_HDR_SIZE()) : LAMP_EXT_FLAG_NONE;
 			memcpy(rcvData->controlRCV.mac,(headerptrs.etherHeader)->ether_shost,ETHER_ADDR_LEN);
 		} else {
 			continue;
@@ -434,6 +475,27 @@ int controlReceiverUDP_RAW(int sFd, in_port_t port, in_addr_t ip, controlRCVdata
 	return 0;
 }
 
+// In continuous daemon mode, print the time elapsed between the end of the previous session ('session_end', if any)
+// and the reception of the INIT packet of the current one
+void printInterSessionGap(struct timeval *session_end) {
+	struct timeval now, gap;
+
+	if(!timerisset(session_end)) {
+		return;
+	}
+
+	gettimeofday(&now,NULL);
+
+	if(timercmp(&now,session_end,<)) {
+		timerclear(&gap);
+	} else {
+		timersub(&now,session_end,&gap);
+	}
+
+	fprintf(stdout,"Inter-session gap: %.3f ms since the end of the previous session.\n",
+		(double) gap.tv_sec*SEC_TO_MILLISEC+(double) gap.tv_usec/MICROSEC_TO_MILLISEC);
+}
+
 /* Send FOLLOWUP_DATA message with no payload
 Return values:
 0: message sent correctly
@@ -477,4 +539,35 @@ int sendFollowUpData_RAW(arg_struct *args,controlRCVdata *rcvData,uint16_t id,ui
 	inpacket_lamphdr=(struct lamphdr *) (buffers.ethernetpacket+sizeof(struct ether_header)+sizeof(struct iphdr)+sizeof(struct udphdr));
 
 	return rawLampSend(args->sData.descriptor, args->sData.addru.addrll, inpacket_lamphdr, buffers.ethernetpacket, finalpktsize, FLG_NONE, UDP);
+}
+
+// Internet checksum of the UDP datagram, including the IPv4 pseudo-header, for the frames which are fixed up after being
+// built (e.g. by xdpLampSend()), i.e. which are not sent through rawLampSend()
+uint16_t rawUDPChecksum(struct iphdr *ipHeader, struct udphdr *udpHeader, size_t udplen) {
+	uint32_t sum=0;
+	uint16_t word;
+	byte_t *ptr=(byte_t *) udpHeader;
+
+	sum+=(ipHeader->saddr & 0xFFFF)+(ipHeader->saddr>>16);
+	sum+=(ipHeader->daddr & 0xFFFF)+(ipHeader->daddr>>16);
+	sum+=htons(IPPROTO_UDP)+udpHeader->len;
+
+	for(;udplen>1;udplen-=2,ptr+=2) {
+		memcpy(&word,ptr,sizeof(word));
+		sum+=word;
+	}
+
+	if(udplen==1) {
+		word=0;
+		memcpy(&word,ptr,1);
+		sum+=word;
+	}
+
+	while(sum>>16) {
+		sum=(sum & 0xFFFF)+(sum>>16);
+	}
+
+	word=~sum;
+
+	return word==0 ? 0xFFFF : word;
 }
\ No newline at end of file
@@ -1,22 +1,32 @@
 #include <inttypes.h>
-#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "dup_list.h"
 
-struct dupStoreListNode {
-	unsigned int seqNo; // Acting as search key
-
-	unsigned int occupied;
-
-	struct dupStoreListNode *next;
-};
+// Number of bits in each bitmap word
+#define DSL_WORD_BITS 64
+#define DSL_WORD_SHIFT 6
 
+// The dupStoreList is implemented as a sliding window bitmap over the (reconstructed) sequence number space,
+// similar to the anti-replay windows used by IPsec (RFC 6479): each sequence number is mapped to a single bit
+// and the bitmap is managed as a circular buffer of 64 bit words, so that moving the window forward only requires
+// to clear the words which are entering it, without actually shifting the whole bitmap
+// Both the insertion and the check are performed in O(1); no hash collision can ever occur inside the window
 struct _dupStoreList {
-	struct dupStoreListNode *array;
-	int size;
-	int8_t past_list_pos; // = -1 if uninitialized, = 0 if past list is between 0 and DSL->size-1, = 1 if past list is between DSL->size and DSL->size*2-1
+	uint64_t *bitmap;
+	uint64_t words; // Number of bitmap words (always a power of 2)
+	uint64_t topSeqNo; // Highest sequence number inserted so far
+	uint8_t initialized; // = 0 if no sequence number has been inserted yet, = 1 otherwise
 };
 
+// Get the smallest power of 2 which is greater than or equal to 'val'
+static inline uint64_t nextPow2(uint64_t val) {
+	return val<=1 ? 1 : (uint64_t) 1<<(64-__builtin_clzll(val-1));
+}
+
+// 'size' is the minimum number of previously received sequence numbers (before the highest one) which should be taken
+// into account when detecting duplicated packets; it is rounded up so that the bitmap is made of a power of 2 of words,
+// plus one more word, as the oldest word of the circular buffer may be only partially valid
 dupStoreList dupSL_init(int size) {
 	dupStoreList DSL;
 
@@ -25,107 +35,87 @@ dupStoreList dupSL_init(int size) {
 	}
 
 	DSL=malloc(sizeof(struct _dupStoreList));
-	if(!CHECK_DSL_NULL(DSL)) {
-		DSL->size=size;
+	if(CHECK_DSL_NULL(DSL)) {
+		return NULL;
+	}
 
-		DSL->array=(struct dupStoreListNode *) malloc(DSL->size*2*sizeof(struct dupStoreListNode));
+	DSL->words=nextPow2((((uint64_t) size+DSL_WORD_BITS-1)>>DSL_WORD_SHIFT)+1);
 
-		if(!DSL->array) {
-			free(DSL);
-			return NULL;
-		}
+	DSL->bitmap=calloc(DSL->words,sizeof(uint64_t));
+	if(!DSL->bitmap) {
+		free(DSL);
+		return NULL;
 	}
 
-	DSL->past_list_pos=-1;
+	DSL->topSeqNo=0;
+	DSL->initialized=0;
 
 	return DSL;
 }
 
-int dupSL_insertandcheck(dupStoreList DSL, unsigned int seqNo) {
-	unsigned int seqNoHash = seqNo % DSL->size;
-	unsigned int pastSeqNoHash;
-	unsigned int found=DSL_NOTFOUND;
+// Returns DSL_NOTFOUND if 'seqNo' was never inserted before (and insert it), DSL_FOUND if it is a duplicate,
+// or DSL_OUTOFWINDOW if 'seqNo' is too old to be checked (it is considered as not being a duplicate, but it is not
+// inserted, as the window never moves back)
+int dupSL_insertandcheck(dupStoreList DSL, uint64_t seqNo) {
+	uint64_t seqWord=seqNo>>DSL_WORD_SHIFT;
+	uint64_t topWord;
+	uint64_t bitMask=(uint64_t) 1<<(seqNo & (DSL_WORD_BITS-1));
+	uint64_t *word;
 
-	if(DSL->size==0) {
+	if(DSL->words==0) {
 		return DSL_ZEROSIZE;
 	}
 
-	if(DSL->past_list_pos!=-1) {
-		if(DSL->past_list_pos==1) {
-			pastSeqNoHash=seqNoHash+DSL->size;
-		} else {
-			pastSeqNoHash=seqNoHash;
-		}
+	if(!DSL->initialized) {
+		DSL->initialized=1;
+		DSL->topSeqNo=seqNo;
+	}
 
-		// Look into the past part of the list
-		if(DSL->array[pastSeqNoHash].occupied==0) {
-			found=DSL_NOTFOUND;
-		} else if(DSL->array[pastSeqNoHash].occupied==1 && seqNo==DSL->array[pastSeqNoHash].seqNo) {
-			found=DSL_FOUND;
-		}
+	topWord=DSL->topSeqNo>>DSL_WORD_SHIFT;
 
-		if(found==DSL_FOUND) {
-			return found;
+	if(seqNo>DSL->topSeqNo) {
+		// Move the window forward, clearing all the words which are entering it (at most all the words of the bitmap,
+		// when the gap is larger than the whole window)
+		uint64_t clearWords=seqWord-topWord;
+
+		if(clearWords>=DSL->words) {
+			memset(DSL->bitmap,0,DSL->words*sizeof(uint64_t));
+		} else {
+			for(uint64_t i=1;i<=clearWords;i++) {
+				DSL->bitmap[(topWord+i) & (DSL->words-1)]=0;
+			}
 		}
-	}
 
-	// Look into the current part of the list
-	if(DSL->past_list_pos==0) {
-		seqNoHash+=DSL->size;
+		DSL->topSeqNo=seqNo;
+	} else if(topWord-seqWord>=DSL->words) {
+		// Sequence number older than the oldest word of the window
+		return DSL_OUTOFWINDOW;
 	}
 
-	// Check if the array data at the current hash (which is simply seqNo % DSL->size) is free
-	if(DSL->array[seqNoHash].occupied==0) {
-		// Store the new data here
-		DSL->array[seqNoHash].occupied=1;
-		DSL->array[seqNoHash].seqNo=seqNo;
-		return DSL_NOTFOUND;
-	}
+	word=&(DSL->bitmap[seqWord & (DSL->words-1)]);
 
-	// Look at the current array position, is the right data there?
-	// If yes, the data is there -> return DSL_FOUND
-	if(DSL->array[seqNoHash].occupied==1 && seqNo==DSL->array[seqNoHash].seqNo) {
-		found=DSL_FOUND;
-	} else {
-		int newSeqNoHash = DSL->past_list_pos==0 ? seqNoHash-DSL->size : seqNoHash+DSL->size;
-		// Switch current <-> past list, as the current list is full
-		dupSL_reset(DSL);
-
-		// Now the position corresponding to seqNoHash (which is now a past list index) should be free
-		if(DSL->array[newSeqNoHash].occupied==0) {
-			DSL->array[newSeqNoHash].occupied=1;
-			DSL->array[newSeqNoHash].seqNo=seqNo;
-			found=DSL_NOTFOUND;
-		} else {
-			found=DSL_POSCONFLICT; // An error occurred if the position is still not free
-		}
+	if(*word & bitMask) {
+		return DSL_FOUND;
 	}
 
-	return found;
+	*word|=bitMask;
+
+	return DSL_NOTFOUND;
 }
 
+// Forget all the sequence numbers inserted so far
 void dupSL_reset(dupStoreList DSL) {
-	int start_i = DSL->past_list_pos==0 ? 0 : DSL->size;
-	int stop_i = DSL->past_list_pos==0 ? DSL->size : DSL->size*2;
-
-	// Try to reset all the sub-lists
-	for(int i=start_i;i<stop_i;i++) {
-		DSL->array[i].occupied=0;
-	}
+	memset(DSL->bitmap,0,DSL->words*sizeof(uint64_t));
 
-	// Update the position of the current list, which will become the new past list
-	if(DSL->past_list_pos==0) {
-		DSL->past_list_pos=1;
-	} else {
-		DSL->past_list_pos=0;
-	}
+	DSL->topSeqNo=0;
+	DSL->initialized=0;
 }
 
 void dupSL_free(dupStoreList DSL) {
 	if(!CHECK_DSL_NULL(DSL)) {
-		if(!CHECK_DSL_NULL(DSL->array)) {
-			free(DSL->array);
+		if(DSL->bitmap) {
+			free(DSL->bitmap);
 		}
 		free(DSL);
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,126 @@
+#include "fixed_point_fmt.h"
+#include <string.h>
+
+static const uint64_t pow10_table[FPFMT_MAX_DECIMAL_DIGITS+2]={
+	1ULL,10ULL,100ULL,1000ULL,10000ULL,100000ULL,1000000ULL,10000000ULL,100000000ULL,1000000000ULL,
+	10000000000ULL,100000000000ULL,1000000000000ULL,10000000000000ULL,100000000000000ULL,
+	1000000000000000ULL,10000000000000000ULL,100000000000000000ULL,1000000000000000000ULL,
+	10000000000000000000ULL
+};
+
+// Pairs of digits from "00" to "99", to convert two digits with a single division
+static const char digit_pairs[201]=
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// Write the digits of 'val' starting from the end of 'end', at least 'width' digits long (zero-padded)
+// The return value is a pointer to the first written digit
+static inline char *writeDigitsBackwards(char *end,uint64_t val,unsigned int width) {
+	char *p=end;
+
+	while(val>=100) {
+		unsigned int pair=(unsigned int) (val%100)*2;
+		val/=100;
+		*--p=digit_pairs[pair+1];
+		*--p=digit_pairs[pair];
+	}
+
+	if(val>=10) {
+		*--p=digit_pairs[val*2+1];
+		*--p=digit_pairs[val*2];
+	} else {
+		*--p=(char) ('0'+val);
+	}
+
+	while((unsigned int) (end-p)<width) {
+		*--p='0';
+	}
+
+	return p;
+}
+
+// Same as printf("%" PRIu64,val)
+size_t fpfmtU64(char *buf,uint64_t val) {
+	return fpfmtU64Pad(buf,val,0);
+}
+
+// Same as printf("%" PRIi64,val)
+size_t fpfmtI64(char *buf,int64_t val) {
+	if(val<0) {
+		buf[0]='-';
+		// The conversion to uint64_t is needed to correctly handle INT64_MIN
+		return 1+fpfmtU64Pad(buf+1,-(uint64_t) val,0);
+	}
+
+	return fpfmtU64Pad(buf,(uint64_t) val,0);
+}
+
+// Same as printf("%0*" PRIu64,width,val) (the maximum supported width is 20)
+size_t fpfmtU64Pad(char *buf,uint64_t val,unsigned int width) {
+	char tmp[20];
+	char *start;
+	size_t len;
+
+	if(width>sizeof(tmp)) {
+		width=sizeof(tmp);
+	}
+
+	start=writeDigitsBackwards(tmp+sizeof(tmp),val,width);
+	len=tmp+sizeof(tmp)-start;
+	memcpy(buf,start,len);
+
+	return len;
+}
+
+// Write 'val'/10^'scale_digits' with 'decimal_digits' decimal digits, e.g. fpfmtFixed(buf,1234,3,3) -> "1.234" (a latency
+// in us written in ms)
+// The result is the same as printf("%.*f",decimal_digits,(double) val/10^scale_digits) whenever 'decimal_digits' is greater
+// than or equal to 'scale_digits', i.e. when no rounding is involved; otherwise, the value is rounded half away from zero,
+// which may differ from printf() only when the discarded digits are exactly a half
+size_t fpfmtFixed(char *buf,int64_t val,unsigned int scale_digits,unsigned int decimal_digits) {
+	uint64_t mag=val<0 ? -(uint64_t) val : (uint64_t) val;
+	size_t len=0;
+
+	if(scale_digits>FPFMT_MAX_DECIMAL_DIGITS) {
+		scale_digits=FPFMT_MAX_DECIMAL_DIGITS;
+	}
+
+	if(decimal_digits>FPFMT_MAX_DECIMAL_DIGITS) {
+		decimal_digits=FPFMT_MAX_DECIMAL_DIGITS;
+	}
+
+	// Discard the digits which should not be printed
+	if(decimal_digits<scale_digits) {
+		uint64_t div=pow10_table[scale_digits-decimal_digits];
+		mag=mag/div+(mag%div>=div/2);
+		scale_digits=decimal_digits;
+	}
+
+	// As in printf(), the sign is kept even when the printed value is zero
+	if(val<0) {
+		buf[len++]='-';
+	}
+
+	len+=fpfmtU64Pad(buf+len,mag/pow10_table[scale_digits],0);
+
+	if(decimal_digits>0) {
+		buf[len++]='.';
+
+		if(scale_digits>0) {
+			len+=fpfmtU64Pad(buf+len,mag%pow10_table[scale_digits],scale_digits);
+		}
+
+		memset(buf+len,'0',decimal_digits-scale_digits);
+		len+=decimal_digits-scale_digits;
+	}
+
+	return len;
+}
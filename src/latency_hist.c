@@ -0,0 +1,120 @@
+#include <math.h>
+#include <string.h>
+#include "latency_hist.h"
+
+// Get the bucket of a latency value in O(1)
+static inline unsigned int valueToBucket(uint64_t value) {
+	unsigned int exp;
+
+	if(value<LATENCY_HIST_SUB_BUCKETS) {
+		return (unsigned int) value;
+	}
+
+	// floor(log2(value)), computed by counting the leading zeros
+	exp=63-__builtin_clzll(value);
+
+	if(exp>=LATENCY_HIST_MAX_EXP) {
+		return LATENCY_HIST_BUCKETS-1;
+	}
+
+	return (exp-LATENCY_HIST_SUB_BITS+1)*LATENCY_HIST_SUB_BUCKETS+((value>>(exp-LATENCY_HIST_SUB_BITS)) & (LATENCY_HIST_SUB_BUCKETS-1));
+}
+
+// Get the highest value which is counted in a given bucket
+static inline uint64_t bucketUpperBound(unsigned int bucket) {
+	unsigned int group=bucket/LATENCY_HIST_SUB_BUCKETS;
+	uint64_t sub=bucket%LATENCY_HIST_SUB_BUCKETS;
+
+	if(group==0) {
+		return sub;
+	}
+
+	return ((LATENCY_HIST_SUB_BUCKETS+sub+1)<<(group-1))-1;
+}
+
+void latencyHistInit(latencyHist *lh) {
+	memset(lh,0,sizeof(latencyHist));
+}
+
+// Reset the histogram at the end of a flush interval: only the buckets which have been used are cleared, which, with the
+// usual latency values, are much less than LATENCY_HIST_BUCKETS
+void latencyHistReset(latencyHist *lh) {
+	memset(lh->counts,0,lh->_usedBuckets*sizeof(lh->counts[0]));
+	lh->count=0;
+	lh->_usedBuckets=0;
+}
+
+void latencyHistUpdate(latencyHist *lh, uint64_t value) {
+	unsigned int bucket=valueToBucket(value);
+
+	lh->counts[bucket]++;
+	lh->count++;
+
+	if(bucket>=lh->_usedBuckets) {
+		lh->_usedBuckets=bucket+1;
+	}
+}
+
+// Add all the latency values counted in 'src' to 'dst' (e.g. to aggregate the histograms of several sessions)
+// Only the buckets which have been used in 'src' are read, as in latencyHistReset()
+void latencyHistMerge(latencyHist *dst, latencyHist *src) {
+	for(unsigned int i=0;i<src->_usedBuckets;i++) {
+		dst->counts[i]+=src->counts[i];
+	}
+
+	dst->count+=src->count;
+
+	if(src->_usedBuckets>dst->_usedBuckets) {
+		dst->_usedBuckets=src->_usedBuckets;
+	}
+}
+
+// Get the given percentile (0-100) of the latency values, i.e. the highest value of the bucket containing the value with
+// rank ceil(percentile/100*count) (0 is returned if the histogram is empty)
+uint64_t latencyHistPercentile(latencyHist *lh, double percentile) {
+	uint64_t rank;
+	uint64_t cumulative=0;
+
+	if(lh->count==0) {
+		return 0;
+	}
+
+	rank=(uint64_t) ceil(percentile/100.0*lh->count);
+
+	if(rank<1) {
+		rank=1;
+	} else if(rank>lh->count) {
+		rank=lh->count;
+	}
+
+	for(unsigned int i=0;i<lh->_usedBuckets;i++) {
+		cumulative+=lh->counts[i];
+
+		if(cumulative>=rank) {
+			return bucketUpperBound(i);
+		}
+	}
+
+	return bucketUpperBound(lh->_usedBuckets-1);
+}
+
+// Get the number of coarse groups up to the highest non-empty one
+unsigned int latencyHistUsedGroups(latencyHist *lh) {
+	return (lh->_usedBuckets+LATENCY_HIST_SUB_BUCKETS-1)/LATENCY_HIST_SUB_BUCKETS;
+}
+
+// Get the number of latency values in a coarse group (see LATENCY_HIST_GROUPS)
+uint64_t latencyHistGroupCount(latencyHist *lh, unsigned int group) {
+	uint64_t count=0;
+
+	for(unsigned int i=group*LATENCY_HIST_SUB_BUCKETS;i<(group+1)*LATENCY_HIST_SUB_BUCKETS && i<LATENCY_HIST_BUCKETS;i++) {
+		count+=lh->counts[i];
+	}
+
+	return count;
+}
+
+// Get the (exclusive) upper bound, in us, of a coarse group
+uint64_t latencyHistGroupUpperBound(unsigned int group) {
+	return (uint64_t) 1<<(group+LATENCY_HIST_SUB_BITS);
+}
@@ -0,0 +1,150 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "loss_burst.h"
+
+// Get the distribution bucket of a run of 'len' (>0) packets in O(1)
+static inline unsigned int runLenToBucket(uint64_t len) {
+	unsigned int bucket;
+
+	if(len<=1) {
+		return 0;
+	}
+
+	// ceil(log2(len)), computed by counting the leading zeros of len-1
+	bucket=64-__builtin_clzll(len-1);
+
+	return bucket<LOSS_BURST_HIST_BUCKETS ? bucket : LOSS_BURST_HIST_BUCKETS-1;
+}
+
+// Close the current Gilbert-Elliott "bad" period, updating the counters of the model
+// A "bad" period containing a single loss is an isolated loss, and it is considered as a loss in the "good" state
+static inline void geCloseBurst(lossBurstStats *lb) {
+	if(lb->_geBurstLost==1) {
+		lb->_geGoodPkts+=lb->_geBurstPkts;
+		lb->_geGoodLost++;
+	} else {
+		lb->_geBadPkts+=lb->_geBurstPkts;
+		lb->_geBadLost+=lb->_geBurstLost;
+		lb->_geTransitions++;
+	}
+
+	lb->_geGoodPkts+=lb->_gePendingRx;
+
+	lb->_geInBurst=0;
+	lb->_geBurstPkts=0;
+	lb->_geBurstLost=0;
+	lb->_gePendingRx=0;
+}
+
+void lossBurstInit(lossBurstStats *lb) {
+	memset(lb,0,sizeof(lossBurstStats));
+}
+
+// This function should be called for each received packet which is increasing the maximum sequence number received
+// so far, specifying how many packets were detected as lost just before it (i.e. the sequence number gap minus one)
+// Everything is computed in O(1), as only counters are updated (no list of lost sequence numbers is stored)
+// Out of order packets, which may "fill" an already detected burst, are not taken into account, as it would require
+// to store the position of each burst
+void lossBurstUpdate(lossBurstStats *lb, uint64_t lostBefore) {
+	if(lostBefore>0) {
+		// A new loss burst just ended: update the burst statistics
+		lb->burstHist[runLenToBucket(lostBefore)]++;
+		lb->burstCount++;
+
+		if(lostBefore>lb->maxBurst) {
+			lb->maxBurst=lostBefore;
+		}
+
+		// The gap length distribution only considers the runs of received packets between two bursts
+		if(lb->_lossSeen) {
+			lb->gapHist[runLenToBucket(lb->_currGap)]++;
+		}
+
+		lb->_lossSeen=1;
+		lb->_currGap=0;
+
+		// Gilbert-Elliott model: if less than GE_GMIN packets have been received after the last loss,
+		// the current burst is still part of the same "bad" period
+		if(lb->_geInBurst) {
+			lb->_geBurstPkts+=lb->_gePendingRx+lostBefore;
+			lb->_geBurstLost+=lostBefore;
+			lb->_gePendingRx=0;
+		} else {
+			lb->_geInBurst=1;
+			lb->_geBurstPkts=lostBefore;
+			lb->_geBurstLost=lostBefore;
+		}
+	}
+
+	// Account for the currently received packet
+	lb->_currGap++;
+
+	if(lb->_geInBurst) {
+		lb->_gePendingRx++;
+
+		if(lb->_gePendingRx>=GE_GMIN) {
+			geCloseBurst(lb);
+		}
+	} else {
+		lb->_geGoodPkts++;
+	}
+}
+
+// Close the current "bad" period, if any, as if the flow ended now
+// This function should be called only when no more packets are going to be received
+void lossBurstFinalize(lossBurstStats *lb) {
+	if(lb->_geInBurst) {
+		geCloseBurst(lb);
+	}
+}
+
+// Add the distributions and the Gilbert-Elliott model counters of 'src' to 'dst' (e.g. to aggregate several sessions)
+// A "bad" period still open in 'src' is considered as if it ended now, as in lossBurstGetGE(), while the run of packets
+// received so far is not carried over, as the sessions are independent
+void lossBurstMerge(lossBurstStats *dst, lossBurstStats *src) {
+	lossBurstStats lb_tmp=*src;
+
+	lossBurstFinalize(&lb_tmp);
+
+	for(int i=0;i<LOSS_BURST_HIST_BUCKETS;i++) {
+		dst->burstHist[i]+=lb_tmp.burstHist[i];
+		dst->gapHist[i]+=lb_tmp.gapHist[i];
+	}
+
+	dst->burstCount+=lb_tmp.burstCount;
+
+	if(lb_tmp.maxBurst>dst->maxBurst) {
+		dst->maxBurst=lb_tmp.maxBurst;
+	}
+
+	dst->_geGoodPkts+=lb_tmp._geGoodPkts;
+	dst->_geGoodLost+=lb_tmp._geGoodLost;
+	dst->_geBadPkts+=lb_tmp._geBadPkts;
+	dst->_geBadLost+=lb_tmp._geBadLost;
+	dst->_geTransitions+=lb_tmp._geTransitions;
+}
+
+// Get the current estimation of the Gilbert-Elliott model parameters
+// A "bad" period which is still open is considered as if it ended now, without modifying the internal state
+void lossBurstGetGE(lossBurstStats *lb, geParams_t *ge) {
+	lossBurstStats lb_tmp=*lb;
+
+	lossBurstFinalize(&lb_tmp);
+
+	ge->p=lb_tmp._geGoodPkts>0 ? (double)lb_tmp._geTransitions/lb_tmp._geGoodPkts : 0;
+	ge->r=lb_tmp._geBadPkts>0 ? (double)lb_tmp._geTransitions/lb_tmp._geBadPkts : 0;
+	ge->h=lb_tmp._geBadPkts>0 ? (double)lb_tmp._geBadLost/lb_tmp._geBadPkts : 0;
+	ge->k=lb_tmp._geGoodPkts>0 ? (double)lb_tmp._geGoodLost/lb_tmp._geGoodPkts : 0;
+}
+
+// Write a burst/gap length distribution as a list of ';' separated counters (it can be used in CSV files)
+void lossBurstSerializeHist(uint64_t *hist, char *buf, size_t bufsize) {
+	int str_char_count=0;
+
+	buf[0]='\0';
+
+	for(int i=0;i<LOSS_BURST_HIST_BUCKETS && str_char_count<bufsize;i++) {
+		str_char_count+=snprintf(buf+str_char_count,bufsize-str_char_count,i==0 ? "%" PRIu64 : ";%" PRIu64,hist[i]);
+	}
+}
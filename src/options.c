@@ -12,9 +12,14 @@
 #include <inttypes.h>
 #include "rawsock.h"
 #include "timer_man.h"
+#include "lamp_ext.h"
+#include "tfile_writer.h"
+#include "report_sock_binary.h"
+#include "carbon_sink.h"
 
 #define CSV_EXTENSION_LEN 4 // '.csv' length
 #define CSV_EXTENSION_STR ".csv"
+#define LTB_EXTENSION_STR ".ltb" // Binary per-packet trace extension (same length as CSV_EXTENSION_STR)
 #define TXRX_STR_LEN 3 // '_tx/_rx' length
 #define TX_STR ".tx"
 #define RX_STR ".rx"
@@ -76,6 +81,35 @@
 #define LONGOPT_udp_force_src_port "udp-force-src-port"
 #define LONGOPT_udp_force_dst_port "udp-force-dst-port"
 #define LONGOPT_bind_to_ip "bind-to-ip"
+#define LONGOPT_ext_seq "ext-seq"
+#define LONGOPT_W_binary "report-perpacket-binary"
+#define LONGOPT_w_batch "report-socket-batch"
+#define LONGOPT_w_binary "report-socket-binary"
+#define LONGOPT_W_rotate_size "report-perpacket-rotate-size"
+#define LONGOPT_W_rotate_interval "report-perpacket-rotate-interval"
+#define LONGOPT_W_rotate_hook "report-perpacket-rotate-hook"
+#define LONGOPT_g_spool "report-graphite-spool"
+#define LONGOPT_g_percentiles "report-graphite-percentiles"
+#define LONGOPT_g_histogram "report-graphite-histogram"
+#define LONGOPT_multi_session "multi-session"
+#define LONGOPT_server_threads "server-threads"
+#define LONGOPT_reuseport_cbpf "reuseport-cbpf"
+#define LONGOPT_reflector_batch "reflector-batch"
+#define LONGOPT_reflector_batch_latency "reflector-batch-latency"
+#define LONGOPT_xdp "xdp"
+#define LONGOPT_xdp_queue "xdp-queue"
+#define LONGOPT_xdp_reflector "xdp-reflector"
+#define LONGOPT_xdp_generic "xdp-generic"
+#define LONGOPT_aggregate_stats "aggregate-stats"
+#define LONGOPT_aggregate_max_clients "aggregate-max-clients"
+#define LONGOPT_rate_limit "rate-limit"
+#define LONGOPT_rate_limit_burst "rate-limit-burst"
+#define LONGOPT_max_sessions "max-sessions"
+#define LONGOPT_rx_ring "rx-ring"
+#define LONGOPT_rx_ring_timeout "rx-ring-timeout"
+#define LONGOPT_tx_ring "tx-ring"
+#define LONGOPT_tx_ring_batch "tx-ring-batch"
+#define LONGOPT_qdisc_bypass "qdisc-bypass"
 
 #define LONGOPT_t_client "interval"
 #define LONGOPT_t_server "server-timeout"
@@ -86,6 +120,35 @@
 #define LONGOPT_udp_force_src_port_val 260
 #define LONGOPT_udp_force_dst_port_val 261
 #define LONGOPT_bind_to_ip_val 262
+#define LONGOPT_ext_seq_client_val 263
+#define LONGOPT_W_binary_val 264
+#define LONGOPT_w_batch_val 265
+#define LONGOPT_w_binary_val 266
+#define LONGOPT_W_rotate_size_val 267
+#define LONGOPT_W_rotate_interval_val 268
+#define LONGOPT_W_rotate_hook_val 269
+#define LONGOPT_g_spool_val 270
+#define LONGOPT_g_percentiles_val 271
+#define LONGOPT_g_histogram_val 272
+#define LONGOPT_multi_session_server_val 273
+#define LONGOPT_server_threads_server_val 274
+#define LONGOPT_reuseport_cbpf_server_val 275
+#define LONGOPT_reflector_batch_server_val 276
+#define LONGOPT_reflector_batch_latency_server_val 277
+#define LONGOPT_xdp_val 278
+#define LONGOPT_xdp_queue_val 279
+#define LONGOPT_xdp_reflector_server_val 280
+#define LONGOPT_xdp_generic_val 281
+#define LONGOPT_aggregate_stats_server_val 282
+#define LONGOPT_aggregate_max_clients_server_val 283
+#define LONGOPT_rate_limit_server_val 284
+#define LONGOPT_rate_limit_burst_server_val 285
+#define LONGOPT_max_sessions_server_val 286
+#define LONGOPT_rx_ring_val 287
+#define LONGOPT_rx_ring_timeout_val 288
+#define LONGOPT_tx_ring_client_val 289
+#define LONGOPT_tx_ring_batch_client_val 290
+#define LONGOPT_qdisc_bypass_client_val 291
 
 #define LONGOPT_STR_CONSTRUCTOR(LONGOPT_STR) "  --"LONGOPT_STR"\n"
 
@@ -106,6 +169,35 @@ static const struct option late_long_opts[]={
 	{LONGOPT_log_init_failures, no_argument, NULL, LONGOPT_log_init_failures_client_val},
 	{LONGOPT_udp_force_src_port,	required_argument, 	NULL, LONGOPT_udp_force_src_port_val},
 	{LONGOPT_udp_force_dst_port,	required_argument, 	NULL, LONGOPT_udp_force_dst_port_val},
+	{LONGOPT_ext_seq,	no_argument,	NULL, LONGOPT_ext_seq_client_val},
+	{LONGOPT_W_binary,	no_argument,	NULL, LONGOPT_W_binary_val},
+	{LONGOPT_w_batch,	no_argument,	NULL, LONGOPT_w_batch_val},
+	{LONGOPT_w_binary,	no_argument,	NULL, LONGOPT_w_binary_val},
+	{LONGOPT_W_rotate_size,	required_argument,	NULL, LONGOPT_W_rotate_size_val},
+	{LONGOPT_W_rotate_interval,	required_argument,	NULL, LONGOPT_W_rotate_interval_val},
+	{LONGOPT_W_rotate_hook,	required_argument,	NULL, LONGOPT_W_rotate_hook_val},
+	{LONGOPT_g_spool,	required_argument,	NULL, LONGOPT_g_spool_val},
+	{LONGOPT_g_percentiles,	required_argument,	NULL, LONGOPT_g_percentiles_val},
+	{LONGOPT_g_histogram,	no_argument,	NULL, LONGOPT_g_histogram_val},
+	{LONGOPT_multi_session,	no_argument,	NULL, LONGOPT_multi_session_server_val},
+	{LONGOPT_server_threads,	required_argument,	NULL, LONGOPT_server_threads_server_val},
+	{LONGOPT_reuseport_cbpf,	no_argument,	NULL, LONGOPT_reuseport_cbpf_server_val},
+	{LONGOPT_reflector_batch,	required_argument,	NULL, LONGOPT_reflector_batch_server_val},
+	{LONGOPT_reflector_batch_latency,	required_argument,	NULL, LONGOPT_reflector_batch_latency_server_val},
+	{LONGOPT_xdp,	no_argument,	NULL, LONGOPT_xdp_val},
+	{LONGOPT_xdp_queue,	required_argument,	NULL, LONGOPT_xdp_queue_val},
+	{LONGOPT_xdp_reflector,	no_argument,	NULL, LONGOPT_xdp_reflector_server_val},
+	{LONGOPT_xdp_generic,	no_argument,	NULL, LONGOPT_xdp_generic_val},
+	{LONGOPT_aggregate_stats,	required_argument,	NULL, LONGOPT_aggregate_stats_server_val},
+	{LONGOPT_aggregate_max_clients,	required_argument,	NULL, LONGOPT_aggregate_max_clients_server_val},
+	{LONGOPT_rate_limit,	required_argument,	NULL, LONGOPT_rate_limit_server_val},
+	{LONGOPT_rate_limit_burst,	required_argument,	NULL, LONGOPT_rate_limit_burst_server_val},
+	{LONGOPT_max_sessions,	required_argument,	NULL, LONGOPT_max_sessions_server_val},
+	{LONGOPT_rx_ring,	no_argument,	NULL, LONGOPT_rx_ring_val},
+	{LONGOPT_rx_ring_timeout,	required_argument,	NULL, LONGOPT_rx_ring_timeout_val},
+	{LONGOPT_tx_ring,	no_argument,	NULL, LONGOPT_tx_ring_client_val},
+	{LONGOPT_tx_ring_batch,	required_argument,	NULL, LONGOPT_tx_ring_batch_client_val},
+	{LONGOPT_qdisc_bypass,	no_argument,	NULL, LONGOPT_qdisc_bypass_client_val},
 	{LONGOPT_z,			required_argument,	NULL, 'z'},
 	{LONGOPT_A,			required_argument,	NULL, 'A'},
 	{LONGOPT_C,			required_argument,	NULL, 'C'},
@@ -230,7 +322,8 @@ static const struct option late_long_opts[]={
 	"  -f <filename, without extension>: print the report to a CSV file other than printing\n" \
 	"\t  it on the screen.\n" \
 	"\t  The default behaviour will append to an existing file; if the file does not exist,\n" \
-	"\t  it is created.\n"
+	"\t  it is created. If the existing file has different columns (e.g. it was written by an older\n" \
+	"\t  version of LaTe), the report is saved to <filename>_0001.csv (or _0002.csv, and so on) instead.\n"
 #define OPT_o_client \
 	LONGOPT_STR_CONSTRUCTOR(LONGOPT_o) \
 	"  -o: valid only with '-f'; instead of appending to an existing file, overwrite it.\n"
@@ -247,6 +340,40 @@ static const struct option late_long_opts[]={
 	"  -r: use raw sockets, if supported for the current protocol.\n" \
 	"\t  When '-r' is set, the program tries to insert the LaMP timestamp in the last \n" \
 	"\t  possible instant before sending. 'sudo' (or proper permissions) is required in this case.\n"
+#define OPT_xdp_both \
+	"  --"LONGOPT_xdp": valid only with '-r': send and receive the LaMP data packets (requests, replies, unidirectional packets\n" \
+	"\t   and follow-ups) through an AF_XDP socket, bypassing the kernel network stack, while the INIT, ACK and REPORT\n" \
+	"\t   packets still use the raw socket. An XDP program is attached to the interface for the whole test, in native\n" \
+	"\t   mode if the driver supports it, otherwise in generic mode (e.g. on veth), and the socket works in zero-copy mode\n" \
+	"\t   only if the driver supports it, otherwise in copy mode. Only the packets received on the queue selected with\n" \
+	"\t   --"LONGOPT_xdp_queue" are redirected: on multi-queue devices, the LaMP packets should be steered to that queue\n" \
+	"\t   (e.g. with 'ethtool -N'). Only user-to-user latency is supported. Linux >= 5.9 is required.\n" \
+	"  --"LONGOPT_xdp_queue" <queue>: valid only with --"LONGOPT_xdp": RX queue of the interface the AF_XDP socket is bound to\n" \
+	"\t   (up to "STRINGIFY(MAX_XDP_QUEUE)"). Default: 0.\n" \
+	"  --"LONGOPT_xdp_generic": valid only with --"LONGOPT_xdp" or --"LONGOPT_xdp_reflector": always attach the XDP program in generic\n" \
+	"\t   mode, instead of trying the native mode first (e.g. on veth, where XDP_TX in native mode requires an XDP program\n" \
+	"\t   on the peer too).\n"
+#define OPT_rx_ring_both \
+	"  --"LONGOPT_rx_ring": valid only with '-r': receive the LaMP data packets (replies and follow-ups on the client, requests on\n" \
+	"\t   the server) through a TPACKET_V3 memory mapped ring, filled by the kernel one block at a time, instead of\n" \
+	"\t   calling recvfrom()/recvmsg() for each packet. Each packet carries its kernel receive timestamp (the hardware one\n" \
+	"\t   with '-L h'), which is always used as receive timestamp. As a block is handed to the program only when it is full\n" \
+	"\t   or when its timeout expires, a user-space receive timestamp would include this wait: thus, this option cannot be\n" \
+	"\t   used with '-L u' (the default), and '-L r' (or '-L s'/'-L h' on the client) should be specified instead.\n" \
+	"\t   On the server, the replies to the ping-like requests are delayed by up to --"LONGOPT_rx_ring_timeout" too: this delay is\n" \
+	"\t   always included in the RTT measured by the client, unless the client requests a follow-up mode (-F), whose\n" \
+	"\t   processing time is then computed starting from the kernel receive timestamp of each request.\n" \
+	"  --"LONGOPT_rx_ring_timeout" <time in ms>: valid only with --"LONGOPT_rx_ring": maximum time a partially filled block is kept\n" \
+	"\t   by the kernel before being handed to the program (from 1 to "STRINGIFY(MAX_RX_RING_TIMEOUT)" ms). Default: "STRINGIFY(RX_RING_DEF_TIMEOUT)" ms.\n"
+#define OPT_tx_ring_client \
+	"  --"LONGOPT_tx_ring": valid only with '-r': build the LaMP data packets directly inside a PACKET_TX_RING memory mapped\n" \
+	"\t   ring and hand them to the kernel with a single send() for each batch (see --"LONGOPT_tx_ring_batch"), instead of copying\n" \
+	"\t   each packet and calling sendto() for it. With '-L s' or '-L h', the transmit timestamps are taken on the ring socket.\n" \
+	"  --"LONGOPT_tx_ring_batch" <number of packets>: valid only with --"LONGOPT_tx_ring": number of packets handed to the kernel\n" \
+	"\t   together (from 1 to "STRINGIFY(MAX_TX_RING_BATCH)"). The packets of each batch are timestamped just before being handed\n" \
+	"\t   to the kernel, thus the time they spend waiting for the rest of the batch is not measured. Default: 1.\n" \
+	"  --"LONGOPT_qdisc_bypass": valid only with --"LONGOPT_tx_ring": send the packets directly to the driver, bypassing the\n" \
+	"\t   qdisc layer (PACKET_QDISC_BYPASS), for the minimum transmission latency (any traffic shaping is skipped too).\n"
 #define OPT_A_both \
 	LONGOPT_STR_CONSTRUCTOR(LONGOPT_A) \
 	"  -A <access category: BK | BE | VI | VO>: forces a certain EDCA MAC access category to\n" \
@@ -364,7 +491,9 @@ static const struct option late_long_opts[]={
 #define OPT_d_server \
 	LONGOPT_STR_CONSTRUCTOR(LONGOPT_d) \
 	"  -d: set the server in 'continuous daemon mode': as a session is terminated, the server\n" \
-	"\t  will be restarted and will be able to accept new packets from other clients.\n"
+	"\t  will be restarted and will be able to accept new packets from other clients.\n" \
+	"\t  The same socket is kept open for all the sessions, so that a new session can start immediately, and\n" \
+	"\t  the gap between the end of a session and the INIT packet of the next one is reported.\n"
 #define OPT_L_server \
 	LONGOPT_STR_CONSTRUCTOR(LONGOPT_L) \
 	"  -L <latency type: u | r>: select latency type: user-to-user or KRT (Kernel Receive Timestamp).\n" \
@@ -395,14 +524,21 @@ static const struct option late_long_opts[]={
 	"\t     will be appended, depending on the type of flushed metric (i.e. '.avg' for the average values, '.stdev' for\n" \
 	"\t     the standard deviation, and so on).\n" \
 	"\t    -<socket type> can optionally be used to force a UDP or TCP socket to be used. The character 't' should be\n" \
-	"\t     specied for TCP and 'u' for UDP. By default, a TCP socket is used.\n" \
+	"\t     specied for TCP and 'u' for UDP. By default, a TCP socket is used. 'p' can also be specified to use a TCP\n" \
+	"\t     socket with the Carbon pickle protocol, instead of the plaintext one (the Carbon pickle receiver usually\n" \
+	"\t     listens on port 2004, which should be explicitly specified).\n" \
 	"\t  The flush interval should correspond to a correctly configured Carbon retetion rate, in storage-schemas.conf.\n" \
 	"\t  To avoid losing any data, the flush interval should be >= than the highest resolution retention rate in Carbon.\n" \
-	"\t  The plaintext protocol is currently used for sending the metrics to Carbon. For more information see:\n" \
+	"\t  The plaintext protocol is used by default for sending the metrics to Carbon. For more information see:\n" \
 	"\t  https://graphite.readthedocs.io/en/latest/feeding-carbon.html#the-plaintext-protocol\n" \
+	"\t  All the metrics of each flush interval are sent together, with a single send() call (i.e. inside a single datagram\n" \
+	"\t  with UDP, unless they do not fit inside "STRINGIFY(MAX_g_SOCK_BUF_SIZE)" B).\n" \
+	"\t  The metrics are sent by a separate thread, so that an unreachable or slow Carbon server never delays the test:\n" \
+	"\t  if the connection cannot be established (or it is lost), LaTe keeps running and tries to reconnect in background.\n" \
 	"\t  Example (assuming a Carbon plaintext reciver running on loopback and listening on port 2003, flush interval = 2s): \n" \
 	"\t  '-g 2-127.0.0.1:2003-test.metrics.late' (TCP socket)\n" \
 	"\t  '-g 2-127.0.0.1:2003-test.metrics.late-u' (UDP socket)\n" \
+	"\t  '-g 2-127.0.0.1:2004-test.metrics.late-p' (TCP socket, pickle protocol)\n" \
 	"\t  Two packet loss metrics are flushed to Graphite. A 'local' packet loss metric, showing the number of packets which are\n" \
 	"\t  detected as lost during the current flush interval, looking locally for missing packets, and a 'net' packet loss metric,\n" \
 	"\t  which also takes into account that out-of-order packets may 'recover' losses detected in the previous flush intervals.\n" \
@@ -425,6 +561,70 @@ static const struct option late_long_opts[]={
 	"  --"LONGOPT_initial_timeout": make the server terminate after the timeout specified with -t, even if no client\n" \
 	"\t   attempted a connection.\n"
 
+#define OPT_multi_session_server \
+	"  --"LONGOPT_multi_session": valid only with '-d': serve any number of clients at the same time, instead of one\n" \
+	"\t   client after the other. Each session is identified by the client IP address, UDP port and LaMP id, and it has\n" \
+	"\t   its own mode, follow-up mode, report and timeout (-t). When '-W' is specified, each unidirectional session writes\n" \
+	"\t   its own file, named <-W file name>_<client IP>_<client port>_<LaMP id>.csv. When '-g' is specified, the metrics\n" \
+	"\t   of each unidirectional session are sent under <metrics path>.sessions.<client IP>_<client port>_<LaMP id>\n" \
+	"\t   (with '_' instead of '.' inside the IP address). After the termination command, the server waits for all the\n" \
+	"\t   active sessions to end, without accepting any new one.\n" \
+	"\t   Only the application and kernel receive follow-up modes are accepted (the others are denied).\n" \
+	"\t   This option can only be used with non-raw UDP sockets, and it cannot be used together with '-w'.\n" \
+	"  --"LONGOPT_server_threads" <n>: valid only with --"LONGOPT_multi_session": serve the sessions with <n> threads (up to "STRINGIFY(MAX_SERVER_THREADS)"),\n" \
+	"\t   each one pinned to a different CPU and with its own socket, bound to the same port with SO_REUSEPORT (also\n" \
+	"\t   when a specific interface or IP address is selected). By default, the kernel distributes the clients among the\n" \
+	"\t   threads depending on their IP address and port. The statistics of all the threads are merged when the server\n" \
+	"\t   is terminated. Default: 1.\n" \
+	"  --"LONGOPT_reuseport_cbpf": valid only with --"LONGOPT_server_threads": steer the packets to the threads depending on\n" \
+	"\t   their LaMP id (<LaMP id> modulo <n>), with a classic BPF program attached to the sockets, instead of\n" \
+	"\t   depending on the client IP address and port.\n"
+
+#define OPT_reflector_batch_server \
+	"  --"LONGOPT_reflector_batch" <n>: reply to the ping-like requests of the sessions without follow-up in batches of up\n" \
+	"\t   to <n> packets (up to "STRINGIFY(MAX_REFLECTOR_BATCH)"), received with a single recvmmsg() and sent back with a single sendmmsg().\n" \
+	"\t   In this mode, no message is printed for each packet: at the end of the session, the server prints instead the number\n" \
+	"\t   of batches and the server residence time (from the kernel receive timestamp to the transmission of the reply) of\n" \
+	"\t   the packets, which is measured for each packet. Default: 1 (no batching).\n" \
+	"\t   This option can only be used with non-raw UDP sockets, and it cannot be used together with --"LONGOPT_multi_session".\n" \
+	"  --"LONGOPT_reflector_batch_latency" <us>: valid only with --"LONGOPT_reflector_batch": after receiving the first request\n" \
+	"\t   of a batch, wait for up to <us> microseconds (up to "STRINGIFY(MAX_REFLECTOR_BATCH_LATENCY)") for more requests, before replying.\n" \
+	"\t   Default: 0 (only the requests already waiting in the socket queue are added to the batch).\n"
+
+#define OPT_xdp_reflector_server \
+	"  --"LONGOPT_xdp_reflector": reply to the ping-like requests of the sessions without follow-up directly in the kernel, with\n" \
+	"\t   an XDP program attached to the interface, which swaps the addresses and ports of each request, rewrites its\n" \
+	"\t   LaMP type and transmits it back with XDP_TX, making the server processing time almost zero and constant.\n" \
+	"\t   The INIT, ACK and follow-up packets, and the first request of each session, are still managed by the userspace\n" \
+	"\t   server, which waits for the end of the session by polling the counters of the XDP program.\n" \
+	"\t   This option can only be used with non-raw UDP sockets bound to a specific interface (i.e. not with '-S'), and it\n" \
+	"\t   cannot be used together with --"LONGOPT_multi_session" or --"LONGOPT_reflector_batch". Linux >= 5.9 is required.\n"
+
+#define OPT_aggregate_stats_server \
+	"  --"LONGOPT_aggregate_stats" <s>: valid only with '-d': keep running statistics aggregated over all the sessions, both\n" \
+	"\t   globally and for each client IP address: number of sessions (total, unidirectional, ping-like, timed out) and\n" \
+	"\t   session rate, and, for the unidirectional sessions, the merged latency statistics, packet loss and percentiles.\n" \
+	"\t   Each session is merged when it ends, at a cost which does not depend on its number of packets.\n" \
+	"\t   Every <s> seconds (up to "STRINGIFY(MAX_AGGR_INTERVAL)"), the aggregates are sent to Carbon, under <metric path>.aggregate,\n" \
+	"\t   if '-g' is specified, and written to the CSV file specified with '-f' (one line for each aggregate, appending\n" \
+	"\t   to the file, unless '-o' is specified too). Only the clients with at least one session ended in the last <s>\n" \
+	"\t   seconds are exported, while the global aggregate is always exported.\n" \
+	"  --"LONGOPT_aggregate_max_clients" <n>: valid only with --"LONGOPT_aggregate_stats": keep separate statistics for up to <n>\n" \
+	"\t   clients (up to "STRINGIFY(MAX_AGGR_CLIENTS)"): the sessions of any further client are aggregated together, as \"other\".\n" \
+	"\t   Default: "STRINGIFY(AGGR_DEF_MAX_CLIENTS)".\n"
+
+#define OPT_rate_limit_server \
+	"  --"LONGOPT_rate_limit" <pps>: accept at most <pps> packets per second (up to "STRINGIFY(MAX_RATE_LIMIT)") from each client IP\n" \
+	"\t   address, with a token bucket: any further packet, including the INIT packets, is discarded as soon as it is\n" \
+	"\t   received, before being processed (thus, in unidirectional mode, it is counted as lost, and, in ping-like mode,\n" \
+	"\t   it is not replied to). The number of discarded packets is printed at the end of each session and when the server\n" \
+	"\t   is terminated. This option can only be used with UDP, and it cannot be used together with --"LONGOPT_xdp_reflector".\n" \
+	"  --"LONGOPT_rate_limit_burst" <n>: valid only with --"LONGOPT_rate_limit": size, in packets, of the token bucket of each client\n" \
+	"\t   (up to "STRINGIFY(MAX_RATE_LIMIT_BURST)"), i.e. maximum number of packets accepted in a row at any rate.\n" \
+	"\t   Default: the number of packets received in "STRINGIFY(RATE_LIMIT_DEF_BURST_MS)" ms at the rate limit (at least 1).\n" \
+	"  --"LONGOPT_max_sessions" <n>: valid only with --"LONGOPT_multi_session": serve at most <n> concurrent sessions (over all the\n" \
+	"\t   server threads): the INIT packets of any further session are ignored, until an active session ends.\n"
+
 #define OPT_log_init_failures_client \
 	"  --"LONGOPT_log_init_failures": enables logging of empty lines to the CSV file specified with -f when failures\n" \
 	"\t   occur during the INIT procedure. The normal behaviour, when no connection can be established between client\n" \
@@ -441,6 +641,72 @@ static const struct option late_long_opts[]={
 	"\t   different than the one contained as source port in the packets received from the client.\n" \
 	"\t   This option is server-only and it can only be used with non-raw sockets.\n"
 
+#define OPT_ext_seq_client \
+	"  --"LONGOPT_ext_seq": request the usage of extended (64 bit) sequence numbers, carried in the first "STRINGIFY(LAMP_EXTSEQ_SIZE)" bytes of\n" \
+	"\t   the LaMP payload, instead of relying on the cyclical 16 bit LaMP sequence numbers. This avoids any ambiguity in the\n" \
+	"\t   packet loss and out of order computation in high rate and long duration tests. The extension is negotiated with the\n" \
+	"\t   server during the INIT procedure: if the server does not support it, 16 bit sequence numbers are used.\n" \
+	"\t   If a payload smaller than "STRINGIFY(LAMP_EXTSEQ_SIZE)" B is specified with -P, it will be increased to "STRINGIFY(LAMP_EXTSEQ_SIZE)" B.\n" \
+	"\t   This option is client-only and it is not supported with AMQP 1.0.\n"
+
+#define OPT_W_binary_both \
+	"  --"LONGOPT_W_binary": valid only with '-W': write the single packet measurement data using a compact binary trace\n" \
+	"\t   format (with a "LTB_EXTENSION_STR" extension) instead of CSV, i.e. a header describing the test, followed by delta and\n" \
+	"\t   varint encoded per-packet records (usually less than 12 B per packet, instead of 40-80 B). The trace can be\n" \
+	"\t   converted to the usual CSV format with the converter available in the 'examples' directory.\n" \
+	"\t   This option is not supported with AMQP 1.0.\n"
+
+#define OPT_g_spool_both \
+	"  --"LONGOPT_g_spool" <file>: valid only with '-g' and a TCP socket: when Carbon is not reachable, store the metrics\n" \
+	"\t   inside <file>, instead of keeping only the last few flush intervals in memory. The stored metrics are sent, with\n" \
+	"\t   their original timestamps, as soon as the connection to Carbon is established again (and before any newer\n" \
+	"\t   metric). If <file> is not empty when LaTe is started (e.g. as a previous execution was terminated while Carbon\n" \
+	"\t   was not reachable), its content is sent too. The file can grow up to "STRINGIFY(CARBON_SINK_SPOOL_MAX_SIZE_MIB)" MiB.\n"
+
+#define OPT_g_hist_both \
+	"  --"LONGOPT_g_percentiles" <p1>,<p2>,...: valid only with '-g': set the latency percentiles (in (0,100], up to "STRINGIFY(MAX_g_PERCENTILES)")\n" \
+	"\t   which are sent for each flush interval, in ms, as '<metrics path>.p<percentile>' (with '_' instead of the decimal\n" \
+	"\t   point, e.g. '.p99_9' for the 99.9th percentile). Default: '50,90,99,99.9'. 'none' can be specified to send no percentile.\n" \
+	"\t   The percentiles are computed from a log-linear histogram of the latency values, with a relative error lower than 3%%.\n" \
+	"  --"LONGOPT_g_histogram": valid only with '-g': send also the histogram of the latency values of each flush interval,\n" \
+	"\t   as '<metrics path>.hist.<upper bound>', where each bucket counts the packets with a latency between the upper\n" \
+	"\t   bound of the previous bucket (or 0) and <upper bound>, in us (upper bounds are powers of 2, starting from 32 us).\n" \
+	"\t   All the buckets up to the highest non-empty one are sent, to be used, for instance, in a Grafana heatmap panel\n" \
+	"\t   ('Time series buckets' data format, with 'aliasByNode()' selecting the last node of the metrics path).\n"
+
+#define OPT_W_rotate_both \
+	"  --"LONGOPT_W_rotate_size" <size>: valid only with '-W': start a new '-W' file (segment) every time the current one\n" \
+	"\t   becomes larger than <size> bytes (a 'k', 'M' or 'G' suffix can be used, e.g. '100M'). The segments are named\n" \
+	"\t   <-W file name>_seg<n>.csv (or "LTB_EXTENSION_STR"), and each of them starts with its own CSV header line (or binary header).\n" \
+	"\t   This is mainly useful with '-d', in which a single long session would otherwise produce a single huge file.\n" \
+	"\t   The size is checked after each group of records is written, so a segment may slightly exceed <size>.\n" \
+	"  --"LONGOPT_W_rotate_interval" <seconds>: valid only with '-W': same as --"LONGOPT_W_rotate_size", but start a new\n" \
+	"\t   segment every <seconds> s of wall-clock time (aligned to multiples of <seconds> since the Epoch, e.g. on the hour\n" \
+	"\t   when 3600 is specified). No new segment is started if no packet was written to the current one. Both options can be\n" \
+	"\t   specified at the same time. The segments are opened and closed by the per-packet data writer thread (the next\n" \
+	"\t   segment is always opened in advance), so that the receive loop never blocks when rotating the file.\n" \
+	"  --"LONGOPT_W_rotate_hook" <command>: valid only with --"LONGOPT_W_rotate_size" or --"LONGOPT_W_rotate_interval": run\n" \
+	"\t   <command> through '/bin/sh -c' (in background) every time a segment is closed, with the segment file name as\n" \
+	"\t   first argument ($1), e.g. to compress or ship it: --"LONGOPT_W_rotate_hook" 'gzip \"$1\"'.\n" \
+	"\t   The last segment is passed to <command> when the test (or the '-d' session) ends.\n" \
+	"\t   These options are not supported with AMQP 1.0.\n"
+
+#define OPT_w_batch_both \
+	"  --"LONGOPT_w_batch": valid only with '-w': pack the per-packet data of several packets inside each UDP datagram (up to\n" \
+	"\t   "STRINGIFY(MAX_w_UDP_SOCK_BUF_SIZE)" B), instead of sending one datagram per packet. The data of each packet is sent after at most\n" \
+	"\t   "STRINGIFY(TFILE_WRITER_SOCK_DEADLINE)" ms. Each datagram is formatted as: 'LaTeB,<LaMP ID>,<datagram seq>,<n>\\n<record 1>\\n...<record n>\\n',\n" \
+	"\t   where each record contains the comma-separated <f1>,<f2>,...,<fn> fields and <datagram seq> is increased by one\n" \
+	"\t   for each datagram (starting from 0), to let the receiving application detect lost datagrams.\n" \
+	"\t   When this option is specified, ',framing=batch' is appended to 'LaTeINIT'.\n"
+
+#define OPT_w_binary_both \
+	"  --"LONGOPT_w_binary": valid only with '-w': send the per-packet data using a binary framing, instead of text. Each\n" \
+	"\t   datagram contains a "STRINGIFY(REPORT_SOCK_BIN_HDR_SIZE)" B header (magic 'LTBW', version, LaMP ID, datagram seq, number of records and\n" \
+	"\t   record size) followed by fixed-size little-endian records (more than one only with --"LONGOPT_w_batch"),\n" \
+	"\t   with all the latency and time fields expressed as integer ns. The record layout is described once, by appending\n" \
+	"\t   ',framing=binary,binlayout=<name>:<type>;...' to 'LaTeINIT', e.g.\n" \
+	"\t   'binlayout=seq:u64;latency_ns:i64;tx_timestamp_ns:i64;error:u8'. See 'include/report_sock_binary.h' for more details.\n"
+
 #define OPT_bind_to_ip_both \
 	"  --"LONGOPT_bind_to_ip" <IP address>: this option can be used to bind to a specific IP address, instead of specifying an\n" \
 	"\t   interface name (-S) or internal index (-I). This option can be useful when IP aliases are in use on a single interface.\n" \
@@ -594,6 +860,9 @@ static void print_long_info(void) {
 			OPT_n_client
 			OPT_p_both
 			OPT_r_both
+			OPT_xdp_both
+			OPT_rx_ring_both
+			OPT_tx_ring_client
 			OPT_t_client
 			OPT_z_client
 			OPT_A_both
@@ -607,19 +876,26 @@ static void print_long_info(void) {
 			OPT_V_both
 			OPT_log_init_failures_client
 			OPT_udp_force_src_port
+			OPT_ext_seq_client
 
 			// File options
 			OPT_f_client
 			OPT_g_both
+			OPT_g_spool_both
+			OPT_g_hist_both
 			"\t  This options applies to a client only in ping-like mode.\n"
 			OPT_o_client
 			OPT_w_both
+			OPT_w_batch_both
+			OPT_w_binary_both
 			"\t  When in unidirectional mode, no per-packet data or 'LaTeINIT' is sent with -w, as they are managed by\n"
 			"\t  the server. A 'LaTeEND' packet, with the final statistics, will be sent via TCP at the end of the test\n"
 			"\t  only.\n"
 			OPT_y_both
 			OPT_W_both
 			"\t  This options applies to a client only in ping-like mode.\n"
+			OPT_W_binary_both
+			OPT_W_rotate_both
 			OPT_X_both
 
 			// Interface options
@@ -652,6 +928,8 @@ static void print_long_info(void) {
 			OPT_d_server
 			OPT_p_both
 			OPT_r_both
+			OPT_xdp_both
+			OPT_rx_ring_both
 			OPT_t_server
 			OPT_A_both
 			OPT_D_both
@@ -660,12 +938,21 @@ static void print_long_info(void) {
 			OPT_0_server
 			OPT_1_server
 			OPT_initial_timeout_server
+			OPT_multi_session_server
+			OPT_reflector_batch_server
+			OPT_xdp_reflector_server
+			OPT_aggregate_stats_server
+			OPT_rate_limit_server
 			OPT_udp_force_dst_port
 
 			// File options
 			OPT_g_both
+			OPT_g_spool_both
+			OPT_g_hist_both
 			"\t  This options applies to a server only in unidirectional mode.\n"
 			OPT_w_both
+			OPT_w_batch_both
+			OPT_w_binary_both
 			"\t  This options applies to a server only in unidirectional mode; in this case, 'LaTeEND' won't contain\n"
 			"\t  any final report, but it will just be formatted as 'LaTe,<LaMP ID>,srvtermination' and it can be used\n"
 			"\t  to gracefully terminate the connection from the application reading the -w data. A server, during a\n"
@@ -673,6 +960,8 @@ static void print_long_info(void) {
 			OPT_y_both
 			OPT_W_both
 			"\t  This options applies to a server only in unidirectional mode.\n"
+			OPT_W_binary_both
+			OPT_W_rotate_both
 			OPT_X_both
 
 			// Interface options
@@ -791,6 +1080,20 @@ void options_initialize(struct options *options) {
 	options->verboseFlag=0;
 
 	options->Wfilename=NULL;
+	options->W_binary=0;
+	options->w_batch=0;
+	options->w_binary=0;
+	options->W_rotate_size=0;
+	options->W_rotate_interval=0;
+	options->W_rotate_hook=NULL;
+	options->carbon_spool_filename=NULL;
+	// -g default percentiles
+	options->carbon_percentiles[0]=50;
+	options->carbon_percentiles[1]=90;
+	options->carbon_percentiles[2]=99;
+	options->carbon_percentiles[3]=99.9;
+	options->carbon_percentiles_num=4;
+	options->carbon_histogram=0;
 
 	options->printAfter=0;
 
@@ -830,6 +1133,32 @@ void options_initialize(struct options *options) {
 
 	options->udp_forced_src_port=-1;
 	options->udp_forced_dst_port=-1;
+
+	options->ext_seq_enabled=0;
+	options->multi_session=0;
+	options->server_threads=1;
+	options->reuseport_cbpf=0;
+	options->reflector_batch=1;
+	options->reflector_batch_latency=0;
+
+	options->xdp_enabled=0;
+	options->xdp_queue=0;
+	options->xdp_reflector=0;
+	options->xdp_generic=0;
+
+	options->aggr_interval=0;
+	options->aggr_max_clients=AGGR_DEF_MAX_CLIENTS;
+
+	options->rate_limit=0;
+	options->rate_limit_burst=0;
+	options->max_sessions=0;
+
+	options->rx_ring=0;
+	options->rx_ring_timeout=RX_RING_DEF_TIMEOUT;
+
+	options->tx_ring=0;
+	options->tx_ring_batch=1;
+	options->qdisc_bypass=0;
 }
 
 unsigned int parse_options(int argc, char **argv, struct options *options) {
@@ -845,6 +1174,11 @@ unsigned int parse_options(int argc, char **argv, struct options *options) {
 	uint8_t T_flag=0; // = 1 if -T was specified, otherwise = 0
 	uint8_t N_flag=0; // = 1 if -N was specified, otherwise = 0
 	uint8_t n_flag=0; // = 1 if -n was specified, otherwise = 0
+	uint8_t g_hist_flag=0; // = 1 if --report-graphite-percentiles or --report-graphite-histogram was specified, otherwise = 0
+	uint8_t aggr_max_clients_flag=0; // = 1 if --aggregate-max-clients was specified, otherwise = 0
+	uint8_t rate_limit_burst_flag=0; // = 1 if --rate-limit-burst was specified, otherwise = 0
+	uint8_t rx_ring_timeout_flag=0; // = 1 if --rx-ring-timeout was specified, otherwise = 0
+	uint8_t tx_ring_batch_flag=0; // = 1 if --tx-ring-batch was specified, otherwise = 0
 	uint8_t t_long_flag=0; // = 0 if neither -t, nor --interval/--server-timeout have been specified, = 1 if --interval is specified, = 2 if --server-timeout is specified, = 3 if just the short option (-t) is specified
 
 	char *sPtr; // String pointer for strtoul() and strtol() calls.
@@ -1169,9 +1503,13 @@ unsigned int parse_options(int argc, char **argv, struct options *options) {
 						options->carbon_sock_type=G_UDP;
 						break;
 
+					case 'p':
+						options->carbon_sock_type=G_TCP_PICKLE;
+						break;
+
 					default:
 						fprintf(stderr,"Error. '%c' is not a valid socket type identifier (-g option).\n"
-						"Valid socket types are 't' for TCP (default) or 'u' for UDP.\n",sock_type);
+						"Valid socket types are 't' for TCP (default), 'u' for UDP or 'p' for TCP with the pickle protocol.\n",sock_type);
 							print_short_info_err(options);
 				}
 
@@ -1548,6 +1886,266 @@ unsigned int parse_options(int argc, char **argv, struct options *options) {
 				options->log_init_failures=1;
 				break;
 
+			case LONGOPT_ext_seq_client_val:
+				options->ext_seq_enabled=1;
+				break;
+
+			case LONGOPT_multi_session_server_val:
+				options->multi_session=1;
+				break;
+
+			case LONGOPT_server_threads_server_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->server_threads=strtoul(optarg,&sPtr,10);
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->server_threads<1 || options->server_threads>MAX_SERVER_THREADS) {
+					fprintf(stderr,"Error: the number of threads specified with --"LONGOPT_server_threads" should be between 1 and "STRINGIFY(MAX_SERVER_THREADS)".\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_reuseport_cbpf_server_val:
+				options->reuseport_cbpf=1;
+				break;
+
+			case LONGOPT_reflector_batch_server_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->reflector_batch=strtoul(optarg,&sPtr,10);
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->reflector_batch<1 || options->reflector_batch>MAX_REFLECTOR_BATCH) {
+					fprintf(stderr,"Error: the batch size specified with --"LONGOPT_reflector_batch" should be between 1 and "STRINGIFY(MAX_REFLECTOR_BATCH)".\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_reflector_batch_latency_server_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->reflector_batch_latency=strtoul(optarg,&sPtr,10);
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->reflector_batch_latency>MAX_REFLECTOR_BATCH_LATENCY) {
+					fprintf(stderr,"Error: the batch latency specified with --"LONGOPT_reflector_batch_latency" should be between 0 and "STRINGIFY(MAX_REFLECTOR_BATCH_LATENCY)" us.\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_xdp_val:
+				options->xdp_enabled=1;
+				break;
+
+			case LONGOPT_xdp_reflector_server_val:
+				options->xdp_reflector=1;
+				break;
+
+			case LONGOPT_xdp_generic_val:
+				options->xdp_generic=1;
+				break;
+
+			case LONGOPT_rx_ring_val:
+				options->rx_ring=1;
+				break;
+
+			case LONGOPT_rx_ring_timeout_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->rx_ring_timeout=strtoul(optarg,&sPtr,10);
+				rx_ring_timeout_flag=1;
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->rx_ring_timeout<1 || options->rx_ring_timeout>MAX_RX_RING_TIMEOUT) {
+					fprintf(stderr,"Error: the timeout specified with --"LONGOPT_rx_ring_timeout" should be between 1 and "STRINGIFY(MAX_RX_RING_TIMEOUT)" ms.\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_tx_ring_client_val:
+				options->tx_ring=1;
+				break;
+
+			case LONGOPT_tx_ring_batch_client_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->tx_ring_batch=strtoul(optarg,&sPtr,10);
+				tx_ring_batch_flag=1;
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->tx_ring_batch<1 || options->tx_ring_batch>MAX_TX_RING_BATCH) {
+					fprintf(stderr,"Error: the number of packets specified with --"LONGOPT_tx_ring_batch" should be between 1 and "STRINGIFY(MAX_TX_RING_BATCH)".\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_qdisc_bypass_client_val:
+				options->qdisc_bypass=1;
+				break;
+
+			case LONGOPT_aggregate_stats_server_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->aggr_interval=strtoul(optarg,&sPtr,10);
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->aggr_interval<1 || options->aggr_interval>MAX_AGGR_INTERVAL) {
+					fprintf(stderr,"Error: the interval specified with --"LONGOPT_aggregate_stats" should be between 1 and "STRINGIFY(MAX_AGGR_INTERVAL)" s.\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_aggregate_max_clients_server_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->aggr_max_clients=strtoul(optarg,&sPtr,10);
+				aggr_max_clients_flag=1;
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->aggr_max_clients<1 || options->aggr_max_clients>MAX_AGGR_CLIENTS) {
+					fprintf(stderr,"Error: the number of clients specified with --"LONGOPT_aggregate_max_clients" should be between 1 and "STRINGIFY(MAX_AGGR_CLIENTS)".\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_rate_limit_server_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->rate_limit=strtoul(optarg,&sPtr,10);
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->rate_limit<1 || options->rate_limit>MAX_RATE_LIMIT) {
+					fprintf(stderr,"Error: the rate specified with --"LONGOPT_rate_limit" should be between 1 and "STRINGIFY(MAX_RATE_LIMIT)" packets/s.\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_rate_limit_burst_server_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->rate_limit_burst=strtoul(optarg,&sPtr,10);
+				rate_limit_burst_flag=1;
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->rate_limit_burst<1 || options->rate_limit_burst>MAX_RATE_LIMIT_BURST) {
+					fprintf(stderr,"Error: the bucket size specified with --"LONGOPT_rate_limit_burst" should be between 1 and "STRINGIFY(MAX_RATE_LIMIT_BURST)" packets.\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_max_sessions_server_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->max_sessions=strtoul(optarg,&sPtr,10);
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->max_sessions<1 || options->max_sessions>MAX_MAX_SESSIONS) {
+					fprintf(stderr,"Error: the number of sessions specified with --"LONGOPT_max_sessions" should be between 1 and "STRINGIFY(MAX_MAX_SESSIONS)".\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_xdp_queue_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->xdp_queue=strtoul(optarg,&sPtr,10);
+
+				if(sPtr==optarg || *sPtr!='\0' || errno || options->xdp_queue>MAX_XDP_QUEUE) {
+					fprintf(stderr,"Error: the queue specified with --"LONGOPT_xdp_queue" should be between 0 and "STRINGIFY(MAX_XDP_QUEUE)".\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_w_batch_val:
+				options->w_batch=1;
+				break;
+
+			case LONGOPT_w_binary_val:
+				options->w_binary=1;
+				break;
+
+			case LONGOPT_W_binary_val:
+				options->W_binary=1;
+				break;
+
+			case LONGOPT_W_rotate_size_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->W_rotate_size=strtoull(optarg,&sPtr,0);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified '-W' rotation size.\n");
+					print_short_info_err(options);
+				}
+
+				// Optional 'k', 'M' or 'G' suffix
+				if(*sPtr=='k' || *sPtr=='K') {
+					options->W_rotate_size*=1024ULL;
+					sPtr++;
+				} else if(*sPtr=='M') {
+					options->W_rotate_size*=1024ULL*1024ULL;
+					sPtr++;
+				} else if(*sPtr=='G') {
+					options->W_rotate_size*=1024ULL*1024ULL*1024ULL;
+					sPtr++;
+				}
+
+				if(errno || *sPtr!='\0' || options->W_rotate_size==0) {
+					fprintf(stderr,"Error in parsing the '-W' rotation size.\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_W_rotate_interval_val:
+				errno=0; // Setting errno to 0 as suggested in the strtol() man page
+				options->W_rotate_interval=strtoul(optarg,&sPtr,0);
+
+				if(sPtr==optarg) {
+					fprintf(stderr,"Cannot find any digit in the specified '-W' rotation interval.\n");
+					print_short_info_err(options);
+				} else if(errno || *sPtr!='\0' || options->W_rotate_interval==0) {
+					fprintf(stderr,"Error in parsing the '-W' rotation interval.\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_W_rotate_hook_val:
+				if(options->W_rotate_hook) {
+					free(options->W_rotate_hook);
+				}
+
+				options->W_rotate_hook=strdup(optarg);
+
+				if(!options->W_rotate_hook) {
+					fprintf(stderr,"Error: cannot parse the '-W' rotation command: unable to allocate memory.\n");
+					print_short_info_err(options);
+				}
+				break;
+
+			case LONGOPT_g_percentiles_val:
+				g_hist_flag=1;
+				options->carbon_percentiles_num=0;
+
+				if(strcmp(optarg,"none")!=0) {
+					sPtr=optarg;
+
+					do {
+						if(options->carbon_percentiles_num==MAX_g_PERCENTILES) {
+							fprintf(stderr,"Error: at most "STRINGIFY(MAX_g_PERCENTILES)" percentiles can be specified with --"LONGOPT_g_percentiles".\n");
+							print_short_info_err(options);
+						}
+
+						errno=0;
+						options->carbon_percentiles[options->carbon_percentiles_num]=strtod(*sPtr==',' ? sPtr+1 : sPtr,&sPtr);
+
+						if(errno || (*sPtr!=',' && *sPtr!='\0') ||
+							!(options->carbon_percentiles[options->carbon_percentiles_num]>0 && options->carbon_percentiles[options->carbon_percentiles_num]<=100)) {
+							fprintf(stderr,"Error in parsing the percentiles specified with --"LONGOPT_g_percentiles": each of them should be in (0,100].\n");
+							print_short_info_err(options);
+						}
+
+						options->carbon_percentiles_num++;
+					} while(*sPtr==',');
+				}
+				break;
+
+			case LONGOPT_g_histogram_val:
+				g_hist_flag=1;
+				options->carbon_histogram=1;
+				break;
+
+			case LONGOPT_g_spool_val:
+				if(options->carbon_spool_filename) {
+					free(options->carbon_spool_filename);
+				}
+
+				options->carbon_spool_filename=strdup(optarg);
+
+				if(!options->carbon_spool_filename) {
+					fprintf(stderr,"Error: cannot parse the Carbon spool file name: unable to allocate memory.\n");
+					print_short_info_err(options);
+				}
+				break;
+
 			case LONGOPT_udp_force_src_port_val:
 				errno=0; // Setting errno to 0 as suggested in the strtol() man page
 				options->udp_forced_src_port=strtoul(optarg,&sPtr,0);
@@ -1799,6 +2397,27 @@ unsigned int parse_options(int argc, char **argv, struct options *options) {
 		print_short_info_err(options);
 	}
 
+	if(options->ext_seq_enabled==1) {
+		if(options->mode_cs==SERVER || options->mode_cs==LOOPBACK_SERVER) {
+			fprintf(stderr,"Error: --"LONGOPT_ext_seq" is a client-only option (the server always accepts extended sequence numbers).\n");
+			print_short_info_err(options);
+		}
+
+		#if AMQP_1_0_ENABLED
+		if(options->protocol==AMQP_1_0) {
+			fprintf(stderr,"Error: --"LONGOPT_ext_seq" is not supported with AMQP 1.0.\n");
+			print_short_info_err(options);
+		}
+		#endif
+
+		// The extended sequence number is carried inside the LaMP payload, which should be large enough to contain it
+		if(options->payloadlen<LAMP_EXTSEQ_SIZE) {
+			fprintf(stderr,"Warning: --"LONGOPT_ext_seq" requires a LaMP payload of at least %d B. The payload size will be set to %d B.\n",
+				LAMP_EXTSEQ_SIZE,LAMP_EXTSEQ_SIZE);
+			options->payloadlen=LAMP_EXTSEQ_SIZE;
+		}
+	}
+
 	if(options->udp_forced_src_port!=-1 && (options->mode_cs==SERVER || options->mode_cs==LOOPBACK_SERVER)) {
 		fprintf(stderr,"Error: --"LONGOPT_udp_force_src_port" is a client-only option.\n");
 		print_short_info_err(options);
@@ -1814,6 +2433,209 @@ unsigned int parse_options(int argc, char **argv, struct options *options) {
 		print_short_info_err(options);
 	}
 
+	if(options->multi_session==1) {
+		if(options->mode_cs!=SERVER && options->mode_cs!=LOOPBACK_SERVER) {
+			fprintf(stderr,"Error: --"LONGOPT_multi_session" is a server-only option.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->protocol!=UDP || options->mode_raw==RAW) {
+			fprintf(stderr,"Error: --"LONGOPT_multi_session" can only be used with non-raw UDP sockets.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->dmode==0) {
+			fprintf(stderr,"Error: --"LONGOPT_multi_session" can only be specified together with '-d'.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->udp_params.enabled) {
+			fprintf(stderr,"Error: --"LONGOPT_multi_session" cannot be used together with '-w', as it describes a single test at a time.\n");
+			print_short_info_err(options);
+		}
+	}
+
+	if(options->server_threads>1 && options->multi_session==0) {
+		fprintf(stderr,"Error: --"LONGOPT_server_threads" can only be specified together with --"LONGOPT_multi_session".\n");
+		print_short_info_err(options);
+	}
+
+	if(options->reuseport_cbpf==1 && options->server_threads<=1) {
+		fprintf(stderr,"Error: --"LONGOPT_reuseport_cbpf" can only be specified together with --"LONGOPT_server_threads" (with more than one thread).\n");
+		print_short_info_err(options);
+	}
+
+	if(options->reflector_batch>1) {
+		if(options->mode_cs!=SERVER && options->mode_cs!=LOOPBACK_SERVER) {
+			fprintf(stderr,"Error: --"LONGOPT_reflector_batch" is a server-only option.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->protocol!=UDP || options->mode_raw==RAW) {
+			fprintf(stderr,"Error: --"LONGOPT_reflector_batch" can only be used with non-raw UDP sockets.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->multi_session==1) {
+			fprintf(stderr,"Error: --"LONGOPT_reflector_batch" cannot be used together with --"LONGOPT_multi_session".\n");
+			print_short_info_err(options);
+		}
+	}
+
+	if(options->reflector_batch_latency>0 && options->reflector_batch<=1) {
+		fprintf(stderr,"Error: --"LONGOPT_reflector_batch_latency" can only be specified together with --"LONGOPT_reflector_batch" (with more than one packet).\n");
+		print_short_info_err(options);
+	}
+
+	if(options->xdp_enabled==1) {
+		if(options->protocol!=UDP || options->mode_raw!=RAW) {
+			fprintf(stderr,"Error: --"LONGOPT_xdp" can only be used with raw UDP sockets ('-r').\n");
+			print_short_info_err(options);
+		}
+
+		if(options->latencyType!=USERTOUSER) {
+			fprintf(stderr,"Error: --"LONGOPT_xdp" only supports user-to-user latency, as no kernel or hardware timestamp is available\n"
+				"for the packets received through an AF_XDP socket.\n");
+			print_short_info_err(options);
+		}
+	}
+
+	if(options->xdp_queue>0 && options->xdp_enabled==0) {
+		fprintf(stderr,"Error: --"LONGOPT_xdp_queue" can only be specified together with --"LONGOPT_xdp".\n");
+		print_short_info_err(options);
+	}
+
+	if(options->xdp_reflector==1) {
+		if(options->mode_cs!=SERVER && options->mode_cs!=LOOPBACK_SERVER) {
+			fprintf(stderr,"Error: --"LONGOPT_xdp_reflector" is a server-only option.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->protocol!=UDP || options->mode_raw==RAW) {
+			fprintf(stderr,"Error: --"LONGOPT_xdp_reflector" can only be used with non-raw UDP sockets.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->nonwlan_mode==NONWLAN_MODE_ANY) {
+			fprintf(stderr,"Error: --"LONGOPT_xdp_reflector" requires a specific interface, as the XDP program is attached to it.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->multi_session==1 || options->reflector_batch>1) {
+			fprintf(stderr,"Error: --"LONGOPT_xdp_reflector" cannot be used together with --"LONGOPT_multi_session" or --"LONGOPT_reflector_batch".\n");
+			print_short_info_err(options);
+		}
+	}
+
+	if(options->xdp_generic==1 && options->xdp_enabled==0 && options->xdp_reflector==0) {
+		fprintf(stderr,"Error: --"LONGOPT_xdp_generic" can only be specified together with --"LONGOPT_xdp" or --"LONGOPT_xdp_reflector".\n");
+		print_short_info_err(options);
+	}
+
+	if(options->rx_ring==1) {
+		if(options->protocol!=UDP || options->mode_raw!=RAW) {
+			fprintf(stderr,"Error: --"LONGOPT_rx_ring" can only be used with raw UDP sockets ('-r').\n");
+			print_short_info_err(options);
+		}
+
+		if(options->xdp_enabled==1) {
+			fprintf(stderr,"Error: --"LONGOPT_rx_ring" cannot be used together with --"LONGOPT_xdp".\n");
+			print_short_info_err(options);
+		}
+
+		// The packets are read only after their block has been retired by the kernel (up to --rx-ring-timeout later)
+		if(options->latencyType==USERTOUSER) {
+			fprintf(stderr,"Error: --"LONGOPT_rx_ring" cannot be used with user-to-user latency ('-L u', the default), as the packets are\n"
+				"received only when their ring block is full or its timeout expires. Please specify '-L r' (or '-L s'/'-L h' on the client).\n");
+			print_short_info_err(options);
+		}
+	}
+
+	if(rx_ring_timeout_flag==1 && options->rx_ring==0) {
+		fprintf(stderr,"Error: --"LONGOPT_rx_ring_timeout" can only be specified together with --"LONGOPT_rx_ring".\n");
+		print_short_info_err(options);
+	}
+
+	if(options->tx_ring==1) {
+		if(options->mode_cs!=CLIENT && options->mode_cs!=LOOPBACK_CLIENT) {
+			fprintf(stderr,"Error: --"LONGOPT_tx_ring" is a client-only option.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->protocol!=UDP || options->mode_raw!=RAW) {
+			fprintf(stderr,"Error: --"LONGOPT_tx_ring" can only be used with raw UDP sockets ('-r').\n");
+			print_short_info_err(options);
+		}
+
+		if(options->xdp_enabled==1) {
+			fprintf(stderr,"Error: --"LONGOPT_tx_ring" cannot be used together with --"LONGOPT_xdp".\n");
+			print_short_info_err(options);
+		}
+	}
+
+	if((tx_ring_batch_flag==1 || options->qdisc_bypass==1) && options->tx_ring==0) {
+		fprintf(stderr,"Error: --"LONGOPT_tx_ring_batch" and --"LONGOPT_qdisc_bypass" can only be specified together with --"LONGOPT_tx_ring".\n");
+		print_short_info_err(options);
+	}
+
+	if(options->aggr_interval>0) {
+		if(options->mode_cs!=SERVER && options->mode_cs!=LOOPBACK_SERVER) {
+			fprintf(stderr,"Error: --"LONGOPT_aggregate_stats" is a server-only option.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->dmode==0) {
+			fprintf(stderr,"Error: --"LONGOPT_aggregate_stats" can only be specified together with '-d'.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->protocol!=UDP) {
+			fprintf(stderr,"Error: --"LONGOPT_aggregate_stats" can only be used with UDP.\n");
+			print_short_info_err(options);
+		}
+	}
+
+	if(aggr_max_clients_flag==1 && options->aggr_interval==0) {
+		fprintf(stderr,"Error: --"LONGOPT_aggregate_max_clients" can only be specified together with --"LONGOPT_aggregate_stats".\n");
+		print_short_info_err(options);
+	}
+
+	if(options->rate_limit>0) {
+		if(options->mode_cs!=SERVER && options->mode_cs!=LOOPBACK_SERVER) {
+			fprintf(stderr,"Error: --"LONGOPT_rate_limit" is a server-only option.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->protocol!=UDP) {
+			fprintf(stderr,"Error: --"LONGOPT_rate_limit" can only be used with UDP.\n");
+			print_short_info_err(options);
+		}
+
+		if(options->xdp_reflector==1) {
+			fprintf(stderr,"Error: --"LONGOPT_rate_limit" cannot be used together with --"LONGOPT_xdp_reflector", as the requests are\n"
+				"then reflected in the kernel.\n");
+			print_short_info_err(options);
+		}
+
+		// Set the default size of the token buckets
+		if(rate_limit_burst_flag==0) {
+			options->rate_limit_burst=(uint32_t) (((uint64_t) options->rate_limit*RATE_LIMIT_DEF_BURST_MS)/1000);
+			if(options->rate_limit_burst<1) {
+				options->rate_limit_burst=1;
+			}
+		}
+	}
+
+	if(rate_limit_burst_flag==1 && options->rate_limit==0) {
+		fprintf(stderr,"Error: --"LONGOPT_rate_limit_burst" can only be specified together with --"LONGOPT_rate_limit".\n");
+		print_short_info_err(options);
+	}
+
+	if(options->max_sessions>0 && options->multi_session==0) {
+		fprintf(stderr,"Error: --"LONGOPT_max_sessions" can only be specified together with --"LONGOPT_multi_session".\n");
+		print_short_info_err(options);
+	}
+
 	// -i and -z cannot be specified together
 	if(options->seconds_to_end!=-1 && options->duration_interval!=0) {
 		fprintf(stderr,"Error: -z and -i cannot be specified together, as -z will automatically compute a test duration.\n");
@@ -1940,8 +2762,63 @@ unsigned int parse_options(int argc, char **argv, struct options *options) {
 		print_short_info_err(options);
 	}
 
-	if(options->filename!=NULL && options->mode_cs==SERVER) {
-		fprintf(stderr,"Error: '-f' is client-only, since only the client can print reports in the current version.\n");
+	if(options->W_binary==1) {
+		if(options->Wfilename==NULL) {
+			fprintf(stderr,"Error: --"LONGOPT_W_binary" can be specified only when the output to a file (with -W) is requested.\n");
+			print_short_info_err(options);
+		}
+
+		#if AMQP_1_0_ENABLED
+		if(options->protocol==AMQP_1_0) {
+			fprintf(stderr,"Error: --"LONGOPT_W_binary" is not supported with AMQP 1.0.\n");
+			print_short_info_err(options);
+		}
+		#endif
+
+		// Replace the CSV extension which was appended when parsing -W
+		strcpy(options->Wfilename+strlen(options->Wfilename)-CSV_EXTENSION_LEN,LTB_EXTENSION_STR);
+	}
+
+	if(options->W_rotate_size>0 || options->W_rotate_interval>0) {
+		if(options->Wfilename==NULL) {
+			fprintf(stderr,"Error: --"LONGOPT_W_rotate_size" and --"LONGOPT_W_rotate_interval" can be specified only when the output to a file (with -W) is requested.\n");
+			print_short_info_err(options);
+		}
+
+		#if AMQP_1_0_ENABLED
+		if(options->protocol==AMQP_1_0) {
+			fprintf(stderr,"Error: --"LONGOPT_W_rotate_size" and --"LONGOPT_W_rotate_interval" are not supported with AMQP 1.0.\n");
+			print_short_info_err(options);
+		}
+		#endif
+	} else if(options->W_rotate_hook!=NULL) {
+		fprintf(stderr,"Error: --"LONGOPT_W_rotate_hook" can be specified only together with --"LONGOPT_W_rotate_size" or --"LONGOPT_W_rotate_interval".\n");
+		print_short_info_err(options);
+	}
+
+	if(g_hist_flag==1 && !options->carbon_sock_params.enabled) {
+		fprintf(stderr,"Error: --"LONGOPT_g_percentiles" and --"LONGOPT_g_histogram" can be specified only when the output to Carbon (with -g) is requested.\n");
+		print_short_info_err(options);
+	}
+
+	if(options->carbon_spool_filename!=NULL && (!options->carbon_sock_params.enabled || options->carbon_sock_type==G_UDP)) {
+		fprintf(stderr,"Error: --"LONGOPT_g_spool" can be specified only when the output to Carbon (with -g) over TCP is requested.\n");
+		print_short_info_err(options);
+	}
+
+	if(options->w_batch==1 && !options->udp_params.enabled) {
+		fprintf(stderr,"Error: --"LONGOPT_w_batch" can be specified only when the output to a socket (with -w) is requested.\n");
+		print_short_info_err(options);
+	}
+
+	if(options->w_binary==1 && !options->udp_params.enabled) {
+		fprintf(stderr,"Error: --"LONGOPT_w_binary" can be specified only when the output to a socket (with -w) is requested.\n");
+		print_short_info_err(options);
+	}
+
+	if(options->filename!=NULL && options->mode_cs==SERVER && options->aggr_interval==0) {
+		fprintf(stderr,"Error: '-f' is client-only, since only the client can print reports in the current version\n"
+			"(the server can only write the statistics aggregated with --"LONGOPT_aggregate_stats").\n");
 		print_short_info_err(options);
 	}
 
@@ -2028,6 +2905,14 @@ void options_free(struct options *options) {
 		free(options->Wfilename);
 	}
 
+	if(options->W_rotate_hook) {
+		free(options->W_rotate_hook);
+	}
+
+	if(options->carbon_spool_filename) {
+		free(options->carbon_spool_filename);
+	}
+
 	if(options->udp_params.enabled==1 && options->udp_params.devname) {
 		free(options->udp_params.devname);
 	}
@@ -2,6 +2,7 @@
 #include "common_qpid_proton.h"
 #include "qpid_proton_consumer.h"
 #include "report_manager.h"
+#include "report_encoding.h"
 #include "rawsock_lamp.h"
 #include "timer_man.h"
 #include "timeval_utils.h"
@@ -36,9 +37,11 @@ static void lampPacketBytesFree(lampPacket_bytes_t *lampPacket) {
 static int amqpACKReportSender(lamptype_t type,pn_link_t *lnk,struct amqp_data *aData,struct options *opts,reportStructure *reportPtr) {
 	pn_data_t* message_body;
 
-	// Report payload length and report buffer
-	size_t report_payloadlen;
-	char report_buff[REPORT_BUFF_SIZE]; // REPORT_BUFF_SIZE defined inside report_manager.h
+	// Binary encoded report, its length and the buffer containing it as a single fragment
+	uint8_t *report_enc;
+	size_t report_enclen;
+	byte_t report_frag[REPORT_FRAG_MAX_SIZE]; // REPORT_FRAG_MAX_SIZE defined inside report_encoding.h
+	size_t report_fraglen=0;
 
 	// LaMP header and LaMP packet buffer
 	struct lamphdr lampHeader;
@@ -54,26 +57,35 @@ static int amqpACKReportSender(lamptype_t type,pn_link_t *lnk,struct amqp_data *
 	}
 
 	if(type==REPORT) {
-		// Allocating buffers
-		lampPacket=malloc(sizeof(struct lamphdr)+REPORT_BUFF_SIZE);
-		if(!lampPacket) {
+		report_enc=reportEncode(reportPtr,&report_enclen);
+		if(!report_enc) {
+			return -1;
+		}
+
+		// Only one REPORT message is expected by the producer: the report cannot be fragmented when using AMQP 1.0
+		if(reportFragmentsNumber(report_enclen)!=1) {
+			fprintf(stderr,"Error: the report is too big to be sent inside a single AMQP 1.0 message.\n");
+			free(report_enc);
 			return -1;
 		}
 
-		// Copying the report string inside the report buffer
-		repprintf(report_buff,(*reportPtr));
+		report_fraglen=reportFragmentPrepare(report_frag,report_enc,report_enclen,0);
+		free(report_enc);
 
-		// Compute report payload length
-		report_payloadlen=strlen(report_buff);
+		// Allocating buffers
+		lampPacket=malloc(sizeof(struct lamphdr)+report_fraglen);
+		if(!lampPacket) {
+			return -1;
+		}
 	}
 
 	lampHeadPopulate(&lampHeader,TYPE_TO_CTRL(type),lamp_id_session,0);
 
 	if(type==REPORT) {
-		lampPacketSize=LAMP_HDR_PAYLOAD_SIZE(report_payloadlen);
+		lampPacketSize=LAMP_HDR_PAYLOAD_SIZE(report_fraglen);
 
 		// Prepare the LaMP packet
-		lampEncapsulate(lampPacket,&lampHeader,(byte_t *) report_buff,report_payloadlen);
+		lampEncapsulate(lampPacket,&lampHeader,report_frag,report_fraglen);
 	} else {
 		lampPacketSize=LAMP_HDR_SIZE();
 		lampPacket=(byte_t *)&lampHeader;
@@ -223,9 +235,7 @@ static int amqpUNIDIRReceiver(pn_link_t *lnk,pn_delivery_t *d,struct amqp_data *
 					}
 				}
 
-				carbon_pthread_mutex_lock(ctd);
 				carbonReportStructureUpdate(&carbonReportData,tripTime,lamp_seq_rx,opts->dup_detect_enabled);
-				carbon_pthread_mutex_unlock(ctd);
 			}
 		}
 	}
@@ -403,7 +413,7 @@ static int consumerEventHandler(struct amqp_data *aData,struct options *opts,rep
 							if(opts->Wfilename!=NULL) {
 								// No follow-up is supported for AMQP 1.0 testing, but, instead of passing just '0' to openTfile() it can be useful to keep
 								//  the check for a possible follow-up mode, as it may be implemented in some way in the future
-								aData->Wfiledescriptor=openTfile(opts->Wfilename,opts->overwrite_W,opts->followup_mode!=FOLLOWUP_OFF,opts->report_extra_data);
+								aData->Wfiledescriptor=openTfile(opts->Wfilename,opts->overwrite_W,opts->followup_mode!=FOLLOWUP_OFF,opts->report_extra_data,0);
 
 								// Already set some fields in the per-packet data structure, which won't change during the whole test
 								aData->perPktData.followup_on_flag=opts->followup_mode!=FOLLOWUP_OFF;
@@ -1,6 +1,7 @@
 #include "common_qpid_proton.h"
 #include "qpid_proton_producer.h"
 #include "report_manager.h"
+#include "report_encoding.h"
 #include "rawsock_lamp.h"
 #include "timer_man.h"
 
@@ -190,11 +191,23 @@ static int amqpReportACKreceiver(lamptype_t type,reportStructure *reportDataPtr,
 			if(lamp_type_rx==type && lamp_id_rx==lamp_id_session) {
 				isRightMsgReceived=1;
 				if(lamp_type_rx==REPORT && reportDataPtr!=NULL) {
-					// We must now parse the report
-					// Using & and * is a very dirty trick to allow the repscanf macro work even when reportDataPtr is a pointer
-					//  to a reportStructure instead of a reportStructure (as, internally, the macro is using '.' to access the
-					//  structure members instead of '->'). Shall be improved in the future.
-					repscanf((const char *)lampPayloadPtr,&(*reportDataPtr));
+					// We must now parse the report (which is always sent as a single fragment when using AMQP 1.0)
+					reportReasm reportRA=reportReasm_init();
+					int reasm_retval=REPORT_ENC_ERR_NOMEM;
+
+					if(!CHECK_REASM_NULL(reportRA)) {
+						reasm_retval=reportReasm_add(reportRA,lampPayloadPtr,lampPacketBytes.lampPacket.size-LAMP_HDR_SIZE());
+						if(reasm_retval==REPORT_REASM_COMPLETE) {
+							reasm_retval=reportReasm_decode(reportRA,reportDataPtr);
+						}
+						reportReasm_free(reportRA);
+					}
+
+					if(reasm_retval!=REPORT_ENC_NOERR) {
+						fprintf(stderr,"Error: cannot decode the received report (%s).\n",
+							reasm_retval==REPORT_REASM_INCOMPLETE ? "fragmented report" : reportEncErrStr(reasm_retval));
+						isRightMsgReceived=0;
+					}
 				}
 			}
 		}
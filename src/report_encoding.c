@@ -0,0 +1,416 @@
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+#include "report_encoding.h"
+
+struct _reportReasm {
+	uint8_t *buf;
+	size_t totalLen;
+	unsigned int fragNum;
+	unsigned int fragReceived;
+	uint64_t fragMask; // Bit i is set when fragment i has been received (REPORT_FRAG_MAX_NUM must be <= 64)
+};
+
+static inline void put_u16(uint8_t *p, uint16_t v) { v=htobe16(v); memcpy(p,&v,sizeof(v)); }
+static inline void put_u32(uint8_t *p, uint32_t v) { v=htobe32(v); memcpy(p,&v,sizeof(v)); }
+static inline void put_u64(uint8_t *p, uint64_t v) { v=htobe64(v); memcpy(p,&v,sizeof(v)); }
+static inline uint16_t get_u16(const uint8_t *p) { uint16_t v; memcpy(&v,p,sizeof(v)); return be16toh(v); }
+static inline uint32_t get_u32(const uint8_t *p) { uint32_t v; memcpy(&v,p,sizeof(v)); return be32toh(v); }
+static inline uint64_t get_u64(const uint8_t *p) { uint64_t v; memcpy(&v,p,sizeof(v)); return be64toh(v); }
+
+static inline void put_double(uint8_t *p, double d) {
+	uint64_t v;
+	memcpy(&v,&d,sizeof(v));
+	put_u64(p,v);
+}
+
+static inline double get_double(const uint8_t *p) {
+	uint64_t v=get_u64(p);
+	double d;
+	memcpy(&d,&v,sizeof(d));
+	return d;
+}
+
+// Bitwise CRC-32 (reflected, polynomial 0xEDB88320): the report is encoded only once per test,
+// so a lookup table is not worth the additional memory
+static uint32_t crc32_compute(const uint8_t *buf, size_t len) {
+	uint32_t crc=0xFFFFFFFF;
+
+	for(size_t i=0;i<len;i++) {
+		crc^=buf[i];
+		for(int j=0;j<8;j++) {
+			crc=(crc>>1)^(0xEDB88320 & (-(crc & 1)));
+		}
+	}
+
+	return ~crc;
+}
+
+// Loss burst TLV value: number of buckets (16) - reserved (16) - burst count (64) - max burst (64) -
+// burst distribution (n x 64) - gap distribution (n x 64) - Gilbert-Elliott counters (5 x 64)
+#define REPORT_TLV_LOSS_BURST_SIZE(nbuckets) (4+16+(nbuckets)*16+5*8)
+
+// Total size of the optional TLV sections which will be appended after the fixed section
+static size_t reportTLVsSize(reportStructure *report) {
+	return REPORT_ENC_TLV_HDR_SIZE+REPORT_TLV_LOSS_BURST_SIZE(LOSS_BURST_HIST_BUCKETS);
+}
+
+// Write the optional TLV sections starting from 'ptr'; returns a pointer to the first byte after them
+static uint8_t *reportTLVsWrite(reportStructure *report, uint8_t *ptr) {
+	lossBurstStats lb=report->lossBursts;
+
+	// Close any "bad" period which is still open, so that the client receives the final Gilbert-Elliott counters
+	lossBurstFinalize(&lb);
+
+	put_u16(ptr,REPORT_TLV_LOSS_BURST);
+	put_u16(ptr+2,REPORT_TLV_LOSS_BURST_SIZE(LOSS_BURST_HIST_BUCKETS));
+	ptr+=REPORT_ENC_TLV_HDR_SIZE;
+
+	put_u16(ptr,LOSS_BURST_HIST_BUCKETS);
+	put_u16(ptr+2,0);
+	put_u64(ptr+4,lb.burstCount);
+	put_u64(ptr+12,lb.maxBurst);
+	ptr+=20;
+
+	for(int i=0;i<LOSS_BURST_HIST_BUCKETS;i++,ptr+=8) {
+		put_u64(ptr,lb.burstHist[i]);
+	}
+
+	for(int i=0;i<LOSS_BURST_HIST_BUCKETS;i++,ptr+=8) {
+		put_u64(ptr,lb.gapHist[i]);
+	}
+
+	put_u64(ptr,lb._geGoodPkts);
+	put_u64(ptr+8,lb._geGoodLost);
+	put_u64(ptr+16,lb._geBadPkts);
+	put_u64(ptr+24,lb._geBadLost);
+	put_u64(ptr+32,lb._geTransitions);
+
+	return ptr+40;
+}
+
+static int reportTLVParseLossBurst(reportStructure *report, const uint8_t *value, uint16_t len) {
+	lossBurstStats *lb=&report->lossBursts;
+	uint16_t nbuckets;
+	const uint8_t *ptr;
+
+	if(len<4) {
+		return REPORT_ENC_ERR_MALFORMED;
+	}
+
+	nbuckets=get_u16(value);
+	if(nbuckets==0 || len<REPORT_TLV_LOSS_BURST_SIZE(nbuckets)) {
+		return REPORT_ENC_ERR_MALFORMED;
+	}
+
+	lossBurstInit(lb);
+
+	lb->burstCount=get_u64(value+4);
+	lb->maxBurst=get_u64(value+12);
+	ptr=value+20;
+
+	// If the server uses more buckets, the extra ones are merged into the last local bucket
+	for(int i=0;i<nbuckets;i++,ptr+=8) {
+		lb->burstHist[i<LOSS_BURST_HIST_BUCKETS ? i : LOSS_BURST_HIST_BUCKETS-1]+=get_u64(ptr);
+	}
+
+	for(int i=0;i<nbuckets;i++,ptr+=8) {
+		lb->gapHist[i<LOSS_BURST_HIST_BUCKETS ? i : LOSS_BURST_HIST_BUCKETS-1]+=get_u64(ptr);
+	}
+
+	lb->_geGoodPkts=get_u64(ptr);
+	lb->_geGoodLost=get_u64(ptr+8);
+	lb->_geBadPkts=get_u64(ptr+16);
+	lb->_geBadLost=get_u64(ptr+24);
+	lb->_geTransitions=get_u64(ptr+32);
+
+	// Any additional field appended by newer versions is ignored
+	return REPORT_ENC_NOERR;
+}
+
+// Parse a single TLV section; unknown types are silently skipped, to allow older clients to
+// still decode the fixed part of reports coming from newer servers
+static int reportTLVParse(reportStructure *report, uint16_t type, const uint8_t *value, uint16_t len) {
+	switch(type) {
+		case REPORT_TLV_LOSS_BURST:
+			return reportTLVParseLossBurst(report,value,len);
+		default:
+			break;
+	}
+
+	return REPORT_ENC_NOERR;
+}
+
+uint8_t *reportEncode(reportStructure *report, size_t *encodedLen) {
+	uint8_t *buf, *ptr;
+	size_t len;
+
+	len=REPORT_ENC_HDR_SIZE+REPORT_ENC_FIXED_SIZE+reportTLVsSize(report)+REPORT_ENC_CRC_SIZE;
+
+	if(len>REPORT_ENC_MAX_SIZE) {
+		return NULL;
+	}
+
+	buf=malloc(len*sizeof(uint8_t));
+	if(!buf) {
+		return NULL;
+	}
+
+	// Header
+	put_u16(buf,REPORT_ENC_MAGIC);
+	buf[2]=REPORT_ENC_VERSION;
+	buf[3]=0; // Flags (reserved for future use)
+	put_u16(buf+4,REPORT_ENC_FIXED_SIZE);
+	put_u32(buf+6,(uint32_t) len);
+
+	// Fixed section
+	ptr=buf+REPORT_ENC_HDR_SIZE;
+	put_u64(ptr,report->minLatency);
+	put_double(ptr+8,report->averageLatency);
+	put_u64(ptr+16,report->maxLatency);
+	put_u64(ptr+24,report->packetCount);
+	put_u64(ptr+32,report->outOfOrderCount);
+	put_u64(ptr+40,report->errorsCount);
+	put_double(ptr+48,report->variance);
+	put_u64(ptr+56,report->seqNumberResets);
+	put_u64(ptr+64,report->dupCount);
+	put_u32(ptr+72,(uint32_t) report->lastMaxSeqNumber);
+	ptr[76]=(uint8_t) report->latencyType;
+	ptr[77]=report->_timeoutOccurred;
+	ptr[78]=report->dupCountEnabled;
+	ptr[79]=0; // Padding
+
+	// Optional TLV sections
+	ptr=reportTLVsWrite(report,ptr+REPORT_ENC_FIXED_SIZE);
+
+	// Trailer (checksum)
+	put_u32(ptr,crc32_compute(buf,len-REPORT_ENC_CRC_SIZE));
+
+	*encodedLen=len;
+
+	return buf;
+}
+
+// Decode a full (i.e. already reassembled) report, filling only the fields which are computed by the server
+// The other fields (e.g. totalPackets, which is known to the client only) are left untouched
+int reportDecode(reportStructure *report, const uint8_t *buf, size_t len) {
+	uint16_t fixedLen;
+	const uint8_t *ptr, *end;
+	int tlv_retval;
+
+	if(len<REPORT_ENC_HDR_SIZE+REPORT_ENC_CRC_SIZE) {
+		return REPORT_ENC_ERR_SHORT;
+	}
+
+	if(get_u16(buf)!=REPORT_ENC_MAGIC) {
+		return REPORT_ENC_ERR_MAGIC;
+	}
+
+	if(buf[2]!=REPORT_ENC_VERSION) {
+		return REPORT_ENC_ERR_VERSION;
+	}
+
+	if(get_u32(buf+6)!=len) {
+		return REPORT_ENC_ERR_SHORT;
+	}
+
+	if(crc32_compute(buf,len-REPORT_ENC_CRC_SIZE)!=get_u32(buf+len-REPORT_ENC_CRC_SIZE)) {
+		return REPORT_ENC_ERR_CHECKSUM;
+	}
+
+	fixedLen=get_u16(buf+4);
+	if(fixedLen<REPORT_ENC_FIXED_SIZE || REPORT_ENC_HDR_SIZE+fixedLen+REPORT_ENC_CRC_SIZE>len) {
+		return REPORT_ENC_ERR_MALFORMED;
+	}
+
+	ptr=buf+REPORT_ENC_HDR_SIZE;
+	report->minLatency=get_u64(ptr);
+	report->averageLatency=get_double(ptr+8);
+	report->maxLatency=get_u64(ptr+16);
+	report->packetCount=get_u64(ptr+24);
+	report->outOfOrderCount=get_u64(ptr+32);
+	report->errorsCount=get_u64(ptr+40);
+	report->variance=get_double(ptr+48);
+	report->seqNumberResets=get_u64(ptr+56);
+	report->dupCount=get_u64(ptr+64);
+	report->lastMaxSeqNumber=(int32_t) get_u32(ptr+72);
+	report->latencyType=(latencytypes_t) ptr[76];
+	report->_timeoutOccurred=ptr[77];
+	report->dupCountEnabled=ptr[78];
+
+	// Skip also any field appended to the fixed section by newer versions
+	ptr+=fixedLen;
+	end=buf+len-REPORT_ENC_CRC_SIZE;
+
+	while(ptr<end) {
+		uint16_t tlv_type, tlv_len;
+
+		if(end-ptr<REPORT_ENC_TLV_HDR_SIZE) {
+			return REPORT_ENC_ERR_MALFORMED;
+		}
+
+		tlv_type=get_u16(ptr);
+		tlv_len=get_u16(ptr+2);
+		ptr+=REPORT_ENC_TLV_HDR_SIZE;
+
+		if(end-ptr<tlv_len) {
+			return REPORT_ENC_ERR_MALFORMED;
+		}
+
+		tlv_retval=reportTLVParse(report,tlv_type,ptr,tlv_len);
+		if(tlv_retval!=REPORT_ENC_NOERR) {
+			return tlv_retval;
+		}
+
+		ptr+=tlv_len;
+	}
+
+	return REPORT_ENC_NOERR;
+}
+
+unsigned int reportFragmentsNumber(size_t encodedLen) {
+	return (encodedLen+REPORT_FRAG_MAX_PAYLOAD-1)/REPORT_FRAG_MAX_PAYLOAD;
+}
+
+// Prepare fragment number 'fragIdx' inside 'fragBuf', which should be at least REPORT_FRAG_MAX_SIZE bytes long
+// Returns the fragment size (header included)
+size_t reportFragmentPrepare(uint8_t *fragBuf, const uint8_t *encoded, size_t encodedLen, unsigned int fragIdx) {
+	size_t offset=fragIdx*REPORT_FRAG_MAX_PAYLOAD;
+	size_t payloadLen;
+
+	if(offset>=encodedLen) {
+		return 0;
+	}
+
+	payloadLen=encodedLen-offset>REPORT_FRAG_MAX_PAYLOAD ? REPORT_FRAG_MAX_PAYLOAD : encodedLen-offset;
+
+	put_u16(fragBuf,REPORT_FRAG_MAGIC);
+	fragBuf[2]=(uint8_t) fragIdx;
+	fragBuf[3]=(uint8_t) reportFragmentsNumber(encodedLen);
+	put_u32(fragBuf+4,(uint32_t) encodedLen);
+	memcpy(fragBuf+REPORT_FRAG_HDR_SIZE,encoded+offset,payloadLen);
+
+	return REPORT_FRAG_HDR_SIZE+payloadLen;
+}
+
+reportReasm reportReasm_init(void) {
+	reportReasm RR;
+
+	RR=malloc(sizeof(struct _reportReasm));
+	if(!CHECK_REASM_NULL(RR)) {
+		RR->buf=NULL;
+		RR->totalLen=0;
+		RR->fragNum=0;
+		RR->fragReceived=0;
+		RR->fragMask=0;
+	}
+
+	return RR;
+}
+
+// Add a received fragment; fragments can be received in any order and duplicates (e.g. due to
+// the report being retransmitted by the server) are ignored
+// Returns REPORT_REASM_COMPLETE when all the fragments have been received, REPORT_REASM_INCOMPLETE
+// when more fragments are still needed, or a negative value if the fragment is not valid
+int reportReasm_add(reportReasm RR, const uint8_t *frag, size_t fragLen) {
+	unsigned int fragIdx, fragNum;
+	size_t totalLen, offset, expectedLen;
+
+	if(fragLen<REPORT_FRAG_HDR_SIZE) {
+		return REPORT_ENC_ERR_SHORT;
+	}
+
+	if(get_u16(frag)!=REPORT_FRAG_MAGIC) {
+		return REPORT_ENC_ERR_MAGIC;
+	}
+
+	fragIdx=frag[2];
+	fragNum=frag[3];
+	totalLen=get_u32(frag+4);
+
+	if(fragNum==0 || fragNum>REPORT_FRAG_MAX_NUM || fragIdx>=fragNum || totalLen>REPORT_ENC_MAX_SIZE || reportFragmentsNumber(totalLen)!=fragNum) {
+		return REPORT_ENC_ERR_MALFORMED;
+	}
+
+	offset=fragIdx*REPORT_FRAG_MAX_PAYLOAD;
+	expectedLen=totalLen-offset>REPORT_FRAG_MAX_PAYLOAD ? REPORT_FRAG_MAX_PAYLOAD : totalLen-offset;
+
+	if(fragLen-REPORT_FRAG_HDR_SIZE<expectedLen) {
+		return REPORT_ENC_ERR_SHORT;
+	}
+
+	// First fragment: allocate the reassembly buffer
+	if(RR->buf==NULL) {
+		RR->buf=malloc(totalLen*sizeof(uint8_t));
+		if(!RR->buf) {
+			return REPORT_ENC_ERR_NOMEM;
+		}
+		RR->totalLen=totalLen;
+		RR->fragNum=fragNum;
+	} else if(RR->totalLen!=totalLen || RR->fragNum!=fragNum) {
+		return REPORT_ENC_ERR_MALFORMED;
+	}
+
+	if(!(RR->fragMask & (UINT64_C(1)<<fragIdx))) {
+		memcpy(RR->buf+offset,frag+REPORT_FRAG_HDR_SIZE,expectedLen);
+		RR->fragMask|=UINT64_C(1)<<fragIdx;
+		RR->fragReceived++;
+	}
+
+	return RR->fragReceived==RR->fragNum ? REPORT_REASM_COMPLETE : REPORT_REASM_INCOMPLETE;
+}
+
+int reportReasm_decode(reportReasm RR, reportStructure *report) {
+	if(RR->buf==NULL || RR->fragReceived!=RR->fragNum) {
+		return REPORT_ENC_ERR_SHORT;
+	}
+
+	return reportDecode(report,RR->buf,RR->totalLen);
+}
+
+// Discard all the fragments received so far (e.g. when the reassembled report turned out to be corrupted,
+// and a retransmission from the server is expected)
+void reportReasm_reset(reportReasm RR) {
+	if(RR->buf) {
+		free(RR->buf);
+		RR->buf=NULL;
+	}
+
+	RR->totalLen=0;
+	RR->fragNum=0;
+	RR->fragReceived=0;
+	RR->fragMask=0;
+}
+
+void reportReasm_free(reportReasm RR) {
+	if(CHECK_REASM_NULL(RR)) {
+		return;
+	}
+
+	if(RR->buf) {
+		free(RR->buf);
+	}
+
+	free(RR);
+}
+
+const char *reportEncErrStr(int err) {
+	switch(err) {
+		case REPORT_ENC_NOERR:
+			return "no error";
+		case REPORT_ENC_ERR_SHORT:
+			return "truncated report";
+		case REPORT_ENC_ERR_MAGIC:
+			return "invalid magic number";
+		case REPORT_ENC_ERR_VERSION:
+			return "unsupported report version";
+		case REPORT_ENC_ERR_CHECKSUM:
+			return "checksum mismatch";
+		case REPORT_ENC_ERR_MALFORMED:
+			return "malformed report";
+		case REPORT_ENC_ERR_NOMEM:
+			return "cannot allocate memory";
+		default:
+			return "unknown error";
+	}
+}
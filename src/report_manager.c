@@ -1,5 +1,8 @@
 #include "common_socket_man.h"
 #include "report_manager.h"
+#include "fixed_point_fmt.h"
+#include "report_sock_binary.h"
+#include "tfile_writer.h"
 #include <limits.h>
 #include <inttypes.h>
 #include <sys/stat.h> 
@@ -33,9 +36,10 @@
 	((double)(perPktData->reportDataPointer->lossCount))/((double)perPktData->reportDataPointer->seqNumberResets*UINT16_TOP+perPktData->reportDataPointer->lastMaxSeqNumber+1-INITIAL_SEQ_NO) : \
 	-1
 
-#define compute_minLatency(perPktData) perPktData->reportDataPointer!=NULL ? (double)(perPktData->reportDataPointer->minLatency)/1000 : -1
+// The current minimum and maximum are returned in us (-1000 us, i.e. -1 ms, when they are not available)
+#define compute_minLatency(perPktData) perPktData->reportDataPointer!=NULL ? (int64_t)(perPktData->reportDataPointer->minLatency) : -1000
 
-#define compute_maxLatency(perPktData) perPktData->reportDataPointer!=NULL ? (double)perPktData->reportDataPointer->maxLatency/1000 : -1
+#define compute_maxLatency(perPktData) perPktData->reportDataPointer!=NULL ? (int64_t)perPktData->reportDataPointer->maxLatency : -1000
 
 
 static inline double computeLostPktPerc(reportStructure *report) {
@@ -154,13 +158,31 @@ static double tsCalculator(int dof, int intervalIndex) {
 	return ts;
 }
 
+// Print a loss burst/gap length distribution, labelling each bucket with the corresponding range of lengths
+static void printLossBurstHist(FILE *stream, const char *name, uint64_t *hist) {
+	fprintf(stream,"%s:",name);
+
+	for(int i=0;i<LOSS_BURST_HIST_BUCKETS;i++) {
+		if(i<=1) {
+			fprintf(stream," [%d]=%" PRIu64,i+1,hist[i]);
+		} else if(i==LOSS_BURST_HIST_BUCKETS-1) {
+			fprintf(stream," [>%d]=%" PRIu64,1<<(i-1),hist[i]);
+		} else {
+			fprintf(stream," [%d-%d]=%" PRIu64,(1<<(i-1))+1,1<<i,hist[i]);
+		}
+	}
+
+	fprintf(stream,"\n");
+}
+
 static inline struct tm *getLocalTime(void) {
 	time_t currtime=time(NULL);
 
 	return localtime(&currtime);
 }
 
-void reportStructureInit(reportStructure *report, uint16_t initialSeqNumber, uint64_t totalPackets, latencytypes_t latencyType, modefollowup_t followupMode, uint8_t dup_detect_enabled) {
+// Initialize all the members of the report structure, except the ones related to the detection of duplicated packets
+static void reportStructureInitCounters(reportStructure *report, uint64_t totalPackets, latencytypes_t latencyType, modefollowup_t followupMode) {
 	report->averageLatency=0.0;
 	report->minLatency=UINT64_MAX;
 	report->maxLatency=0;
@@ -193,7 +215,14 @@ void reportStructureInit(reportStructure *report, uint16_t initialSeqNumber, uin
 		report->confidenceIntervalDev[i]=-1.0;
 	}
 
+	lossBurstInit(&report->lossBursts);
+
 	report->dupCount=0;
+}
+
+void reportStructureInit(reportStructure *report, uint16_t initialSeqNumber, uint64_t totalPackets, latencytypes_t latencyType, modefollowup_t followupMode, uint8_t dup_detect_enabled) {
+	reportStructureInitCounters(report,totalPackets,latencyType,followupMode);
+
 	if(dup_detect_enabled) {
 		// Initialize a dupStoreList data structure for detecting sequence numbers
 		// Its size is equal to the minimum number of previously received sequence numbers which should be taken
@@ -205,8 +234,20 @@ void reportStructureInit(reportStructure *report, uint16_t initialSeqNumber, uin
 	}
 }
 
+// Re-initialize, for a new session, a report structure already initialized with reportStructureInit() and not yet freed
+// The list used to detect the duplicated packets (if any) is kept and just cleared, instead of being allocated again
+void reportStructureReset(reportStructure *report, uint64_t totalPackets, latencytypes_t latencyType, modefollowup_t followupMode) {
+	reportStructureInitCounters(report,totalPackets,latencyType,followupMode);
+
+	if(report->dupCountEnabled) {
+		dupSL_reset(report->dupCountList);
+	}
+}
+
 void reportStructureUpdate(reportStructure *report, uint64_t tripTime, uint16_t seqNumber) {
 	uint8_t seqNumberResetOccurred=0;
+	// Number of packets detected as lost just before the current one (used for the loss burst analysis)
+	uint64_t lostBefore=0;
 
 	// Compute the gap between the currently received sequence number and the last maximum sequence number received so far
 	int32_t gap=(int32_t)seqNumber-(int32_t)report->lastMaxSeqNumber;
@@ -228,7 +269,7 @@ void reportStructureUpdate(reportStructure *report, uint64_t tripTime, uint16_t
 		seqNumber :
 		(report->seqNumberResets-(gap>=SEQUENCE_NUMBERS_RESET_THRESHOLD))*UINT16_TOP+seqNumber;
 
-	// Check for duplicates, saving the current sequence number into a "dupStoreList" (a sort of optimized list for storing
+	// Check for duplicates, saving the current sequence number into a "dupStoreList" (a sliding window bitmap storing the
 	// already received sequence numbers). If the sequence number has been never received before, DSL_NOTFOUND is returned by
 	// dupSL_insertandcheck() and the number is stored. If instead it has been received before, dupSL_insertandcheck() will
 	// return DSL_FOUND to signal a duplicated packet
@@ -275,13 +316,15 @@ void reportStructureUpdate(reportStructure *report, uint64_t tripTime, uint16_t
 				(seqNumberResetOccurred==0 && seqNumber>report->lastMaxSeqNumber+1)) && 
 				gap<SEQUENCE_NUMBERS_RESET_THRESHOLD) {
 
-				report->lossCount+=seqNumber-1-report->lastMaxSeqNumber;
+				lostBefore=seqNumber-1-report->lastMaxSeqNumber;
 
 				// Negative loss correction (i.e. if a sequence number reset just occurred, we must consider, as said before,
 				// seqNumber+UINT16_TOP, thus summing UINT16_TOP to the previous report->lossCount computation)
 				if(seqNumberResetOccurred==1) {
-					report->lossCount+=UINT16_TOP;
+					lostBefore+=UINT16_TOP;
 				}
+
+				report->lossCount+=lostBefore;
 			}
 
 			// Compute the maximum received sequence number so far (as "last sequence number")
@@ -290,13 +333,82 @@ void reportStructureUpdate(reportStructure *report, uint64_t tripTime, uint16_t
 			// In this way, it is possible to consider a cyclically resetting lastMaxSeqNumber
 			// A new maximum is not detected if gap>=SEQUENCE_NUMBERS_RESET_THRESHOLD (i.e. with a very large positive gap), as the
 			// current packet is considered, in this case, as out of order.
+			// Each time a new maximum is detected, the loss burst statistics are updated too, with the number of packets
+			// lost just before it (if any)
 			if(report->lastMaxSeqNumber!=-1 && (seqNumberResetOccurred==1 || (seqNumber>report->lastMaxSeqNumber && gap<SEQUENCE_NUMBERS_RESET_THRESHOLD))) {
 				report->lastMaxSeqNumber=seqNumber;
+				lossBurstUpdate(&report->lossBursts,lostBefore);
 			}
 
 			// Set, at the beginning, the maximum sequence number so far to seqNumber
 			if(report->lastMaxSeqNumber==-1) {
 				report->lastMaxSeqNumber=seqNumber;
+				lossBurstUpdate(&report->lossBursts,lostBefore);
+			}
+
+			// Compute the current variance (std dev squared) value using Welford's online algorithm
+			report->_welfordM2=report->_welfordM2+(tripTime-report->_welfordAverageLatencyOld)*(tripTime-report->averageLatency);
+			if(report->packetCount>1) {
+				report->variance=report->_welfordM2/(report->packetCount-1);
+			}
+		} else {
+			// If tripTime is zero, a timestamping error occurred: count the current packet as a packet containing an error
+			// This packet will be counter as received, but it will not be used to compute the final statistics
+			report->errorsCount++;
+		}
+	}
+}
+
+// Same as reportStructureUpdate(), but using a full width (extended) sequence number, available when the extended
+// sequence numbers have been negotiated during the INIT procedure
+// No reconstruction heuristic is needed in this case: a packet is out of order if and only if its sequence number is lower
+// than the maximum received so far, whatever the size of any loss or reordering burst is
+// lastMaxSeqNumber and seqNumberResets are kept consistent with the cyclical 16 bit case, i.e. lastMaxSeqNumber stores the
+// 16 least significant bits of the maximum sequence number, while seqNumberResets stores the remaining most significant
+// bits, so that all the statistics derived from them (and the transmitted report) stay the same
+void reportStructureUpdateExt(reportStructure *report, uint64_t tripTime, uint64_t seqNumber) {
+	// Maximum (full width) sequence number received so far
+	uint64_t lastMaxSeqNo=report->seqNumberResets*UINT16_TOP+report->lastMaxSeqNumber;
+	// Number of packets detected as lost just before the current one (used for the loss burst analysis)
+	uint64_t lostBefore=0;
+
+	report->_lastReconstructedSeqNo=seqNumber;
+
+	if(report->dupCountEnabled && dupSL_insertandcheck(report->dupCountList,seqNumber)==DSL_FOUND) {
+		report->dupCount++;
+	} else {
+		report->packetCount++;
+
+		if(tripTime!=0) {
+			report->_welfordAverageLatencyOld=report->averageLatency;
+			report->averageLatency+=(tripTime-report->averageLatency)/report->packetCount;
+
+			if(tripTime<report->minLatency) {
+				report->minLatency=tripTime;
+			}
+
+			if(tripTime>report->maxLatency) {
+				report->maxLatency=tripTime;
+			}
+
+			if(report->lastMaxSeqNumber!=-1 && seqNumber<=lastMaxSeqNo) {
+				report->outOfOrderCount++;
+
+				if(seqNumber!=lastMaxSeqNo && report->lossCount>0) {
+					report->lossCount--;
+				}
+			} else {
+				// The packets lost before the first received one are counted too, as in reportStructureUpdate()
+				if(report->lastMaxSeqNumber!=-1) {
+					lostBefore=seqNumber-1-lastMaxSeqNo;
+				} else {
+					lostBefore=seqNumber-INITIAL_SEQ_NO;
+				}
+				report->lossCount+=lostBefore;
+
+				report->seqNumberResets=seqNumber/UINT16_TOP;
+				report->lastMaxSeqNumber=(int32_t) (seqNumber%UINT16_TOP);
+				lossBurstUpdate(&report->lossBursts,lostBefore);
 			}
 
 			// Compute the current variance (std dev squared) value using Welford's online algorithm
@@ -338,9 +450,52 @@ void reportStructureChangeTotalPackets(reportStructure *report, uint64_t totalPa
 	report->totalPackets=totalPackets;
 }
 
+// Merge the statistics of 'src' (e.g. the report of a session which just ended) into 'dst' (e.g. the running aggregate
+// of several sessions, initialized with reportStructureInit(), without duplicated packets detection)
+// The latency average and variance are merged with the parallel version of Welford's algorithm (Chan et al.), weighting
+// each structure by its number of received packets, as done by reportStructureUpdate()
+// The counters are summed, while 'totalPackets' is increased by the number of packets expected in 'src' (received plus lost)
+// The sequence number tracking members of 'dst' are not meaningful after a merge
+void reportStructureMerge(reportStructure *dst, reportStructure *src) {
+	uint64_t n_dst=dst->packetCount;
+	uint64_t n_src=src->packetCount;
+	double delta;
+
+	if(n_src>0 && src->minLatency!=UINT64_MAX) {
+		delta=src->averageLatency-dst->averageLatency;
+
+		dst->averageLatency+=delta*n_src/(n_dst+n_src);
+		dst->_welfordM2+=src->_welfordM2+delta*delta*((double) n_dst*n_src/(n_dst+n_src));
+
+		if(n_dst+n_src>1) {
+			dst->variance=dst->_welfordM2/(n_dst+n_src-1);
+		}
+
+		if(src->minLatency<dst->minLatency) {
+			dst->minLatency=src->minLatency;
+		}
+
+		if(src->maxLatency>dst->maxLatency) {
+			dst->maxLatency=src->maxLatency;
+		}
+	}
+
+	dst->packetCount+=src->packetCount;
+	dst->errorsCount+=src->errorsCount;
+	dst->outOfOrderCount+=src->outOfOrderCount;
+	dst->lossCount+=src->lossCount;
+	dst->dupCount+=src->dupCount;
+	dst->totalPackets+=src->packetCount+src->lossCount;
+
+	dst->_timeoutOccurred|=src->_timeoutOccurred;
+
+	lossBurstMerge(&dst->lossBursts,&src->lossBursts);
+}
+
 void printStats(reportStructure *report, FILE *stream, uint8_t confidenceIntervalsMask) {
 	int i;
 	const char *confidenceIntervalLabels[]={".90",".95",".99"};
+	geParams_t ge;
 
 	if(report->minLatency==UINT64_MAX) {
 		// No packets have been received (or they all caused timestamping errors)
@@ -405,6 +560,21 @@ void printStats(reportStructure *report, FILE *stream, uint8_t confidenceInterva
 				report->dupCount);
 		}
 
+		// Print the loss burst analysis results (distributions are printed only if at least one loss burst was detected)
+		lossBurstGetGE(&report->lossBursts,&ge);
+
+		fprintf(stream,"Loss bursts: %" PRIu64 " - Maximum burst length: %" PRIu64 "\n",
+			report->lossBursts.burstCount,
+			report->lossBursts.maxBurst);
+
+		if(report->lossBursts.burstCount>0) {
+			printLossBurstHist(stream,"Burst length distribution",report->lossBursts.burstHist);
+			printLossBurstHist(stream,"Gap length distribution",report->lossBursts.gapHist);
+		}
+
+		fprintf(stream,"Gilbert-Elliott model: p=%.5f - r=%.5f - bad state loss density=%.5f - good state loss density=%.5f\n",
+			ge.p,ge.r,ge.h,ge.k);
+
 		// If a timeout occurred, print that a timeout occurred and print also the packet loss up to that sequence number.
 		// The real last (highest so far) sequence number (as if LaMP sequence numbers were not cyclical) is estimated using report->seqNumberResets, with:
 		// (report->seqNumberResets*UINT16_TOP)+report->lastMaxSeqNumber-report->packetCount+1).
@@ -425,73 +595,201 @@ void printStats(reportStructure *report, FILE *stream, uint8_t confidenceInterva
 	}
 }
 
-int printStatsCSV(struct options *opts, reportStructure *report, const char *filename) {
+// Header line of the CSV file written by printStatsCSV()
+#define STATS_CSV_HEADER "Date," \
+	"Time," \
+	"ClientMode," \
+	"SocketType," \
+	"Protocol," \
+	"UP," \
+	"PayloadLen-B," \
+	"TotReqPackets," \
+	"TestDuration-s," \
+	"Interval-ms," \
+	"Interval-type," \
+	"Interval-Distrib-Param," \
+	"Interval-Distrib-Batch-Size," \
+	"LatencyType," \
+	"FollowUp," \
+	"MinLatency-ms," \
+	"MaxLatency-ms," \
+	"AvgLatency-ms," \
+	"LostPackets-Perc," \
+	"ErrorsCount," \
+	"OutOfOrderCountDecr," \
+	"StDev-ms," \
+	"SeqNumberResets," \
+	"TimeoutOccurred," \
+	"HighestSeqNumber," \
+	"HighestSeqNumber-reconstructed-noncyclical," \
+	"LostPacketHighestSeq-Perc," \
+	"reportingSuccessful," \
+	"ConfInt90l," \
+	"ConfInt90u," \
+	"ConfInt95l," \
+	"ConfInt95u," \
+	"ConfInt99l," \
+	"ConfInt99u," \
+	"LossBursts," \
+	"MaxLossBurst," \
+	"BurstLenDistrib," \
+	"GapLenDistrib," \
+	"GE-p," \
+	"GE-r," \
+	"GE-BadStateLossDensity," \
+	"GE-GoodStateLossDensity"
+
+// Header line of the CSV file written by printAggrStatsCSV(), without the latency percentile columns
+#define AGGR_CSV_HEADER "Date," \
+	"Time," \
+	"Client," \
+	"Interval-s," \
+	"Sessions," \
+	"UnidirSessions," \
+	"PinglikeSessions," \
+	"TimedoutSessions," \
+	"IntervalSessions," \
+	"SessionRate-per-s," \
+	"Packets," \
+	"MinLatency-ms," \
+	"MaxLatency-ms," \
+	"AvgLatency-ms," \
+	"StDev-ms," \
+	"LostPackets-Perc," \
+	"ErrorsCount," \
+	"OutOfOrderCount," \
+	"DupCount," \
+	"LossBursts," \
+	"MaxLossBurst"
+
+// Compare the first line of the existing CSV file 'filename' with 'header'
+// Return 1 if they are equal, 2 if the file is empty, 0 if they differ, and -1 if the file cannot be read
+static int statsCSVHeaderCheck(const char *filename, const char *header) {
+	FILE *csvfile;
+	char *line=NULL;
+	size_t linesize=0;
+	ssize_t linelen;
+	size_t headerlen=strlen(header);
+	int retval;
+
+	csvfile=fopen(filename,"r");
+	if(csvfile==NULL) {
+		return -1;
+	}
+
+	linelen=getline(&line,&linesize,csvfile);
+
+	if(linelen<=0) {
+		retval=2;
+	} else {
+		retval=(size_t) linelen==headerlen+1 && line[headerlen]=='\n' && strncmp(line,header,headerlen)==0;
+	}
+
+	free(line);
+	fclose(csvfile);
+
+	return retval;
+}
+
+// Open the CSV file used by printStatsCSV() and printAggrStatsCSV(), overwriting it if 'overwrite' is = 1, or appending
+// to it otherwise; 'header' (without the final '\n') is written at the beginning of any new (or overwritten) file
+// When appending, the columns of the existing file are checked first: if its header line differs from 'header' (e.g. as it
+// was written by an older version of LaTe), the new rows are written to <filename>_0001.csv (or _0002.csv, and so on, as for
+// '-W', appending to the first of them with the same columns), instead of adding rows which do not match the header
+// The name of the file which was actually opened is returned inside '*openedname' (it should be freed by the caller, and it is
+// set to NULL if it cannot be allocated); -1 is returned if the file cannot be opened
+static int openStatsCSV(const char *filename, uint8_t overwrite, const char *header, char **openedname) {
 	int csvfp;
-	int printOpErrStatus=0;
-	int fileAlreadyExists=0;
-	struct tm *currdate;
-	double lostPktPerc=0;
-	double lostPktPercLastSeqNo=0;
+	int headerCheck;
+	int fileno=1;
+	uint8_t writeHeader=1;
+	size_t filename_fileno_size=strlen(filename)+W_MAX_FILE_NUMBER_DIGITS+2;
+	char *filename_fileno=NULL;
+	const char *currfilename=filename;
+
+	*openedname=NULL;
 
-	if(opts->overwrite) {
+	if(overwrite) {
 		csvfp=open(filename, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
 	} else {
-		errno=0;
+		while(1) {
+			errno=0;
 
-		csvfp=open(filename, O_CREAT | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR);
+			csvfp=open(currfilename, O_CREAT | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR);
 
-		if(csvfp<0) {
-			if(errno==EEXIST) {
-				fileAlreadyExists=1;
-				csvfp=open(filename, O_WRONLY | O_APPEND);
-			} else {
-				printOpErrStatus=1;
+			if(csvfp>=0 || errno!=EEXIST) {
+				break;
+			}
+
+			headerCheck=statsCSVHeaderCheck(currfilename,header);
+
+			if(headerCheck!=0) {
+				// Append to the file with the same columns (or to an empty file, or, if it cannot be read, at least try)
+				writeHeader=headerCheck==2;
+				csvfp=open(currfilename, O_WRONLY | O_APPEND);
+				break;
 			}
+
+			if(fileno>W_MAX_FILE_NUMBER) {
+				fprintf(stderr,"Error: %s has different columns than the current ones, and no new file can be created.\n"
+					"Use -o to overwrite it, or specify a different file name.\n",filename);
+				csvfp=-1;
+				break;
+			}
+
+			if(filename_fileno==NULL) {
+				filename_fileno=malloc(filename_fileno_size*sizeof(char));
+
+				if(!filename_fileno) {
+					return -1;
+				}
+			}
+
+			snprintf(filename_fileno,filename_fileno_size,"%.*s_%0*d%s",(int) (strlen(filename)-4),filename,W_MAX_FILE_NUMBER_DIGITS,fileno,filename+strlen(filename)-4);
+			currfilename=filename_fileno;
+			fileno++;
 		}
 	}
 
+	if(csvfp<0) {
+		free(filename_fileno);
+		return -1;
+	}
+
+	if(writeHeader) {
+		if(filename_fileno!=NULL) {
+			fprintf(stderr,"Warning: %s has different columns than the current ones. %s will be used instead.\n",filename,filename_fileno);
+		}
+
+		dprintf(csvfp,"%s\n",header);
+	}
+
+	*openedname=filename_fileno!=NULL ? filename_fileno : strdup(filename);
+
+	return csvfp;
+}
+
+int printStatsCSV(struct options *opts, reportStructure *report, const char *filename) {
+	int csvfp;
+	int printOpErrStatus=0;
+	char *openedname=NULL;
+	struct tm *currdate;
+	double lostPktPerc=0;
+	double lostPktPercLastSeqNo=0;
+	geParams_t ge;
+	// Each distribution is written as LOSS_BURST_HIST_BUCKETS ';' separated values (20 characters max each)
+	char burstHistStr[LOSS_BURST_HIST_BUCKETS*21];
+	char gapHistStr[LOSS_BURST_HIST_BUCKETS*21];
+
+	csvfp=openStatsCSV(filename,opts->overwrite,STATS_CSV_HEADER,&openedname);
+	if(csvfp<0) {
+		printOpErrStatus=1;
+	}
+
 	if(csvfp && printOpErrStatus==0) {
 		// Get current time and day
 		currdate=getLocalTime();
 
-		if(opts->overwrite || !fileAlreadyExists) {
-			// Recreate CSV first line
-			dprintf(csvfp,"Date,"
-				"Time,"
-				"ClientMode,"
-				"SocketType,"
-				"Protocol,"
-				"UP,"
-				"PayloadLen-B,"
-				"TotReqPackets,"
-				"TestDuration-s,"
-				"Interval-ms,"
-				"Interval-type,"
-				"Interval-Distrib-Param,"
-				"Interval-Distrib-Batch-Size,"
-				"LatencyType,"
-				"FollowUp,"
-				"MinLatency-ms,"
-				"MaxLatency-ms,"
-				"AvgLatency-ms,"
-				"LostPackets-Perc,"
-				"ErrorsCount,"
-				"OutOfOrderCountDecr,"
-				"StDev-ms,"
-				"SeqNumberResets,"
-				"TimeoutOccurred,"
-				"HighestSeqNumber,"
-				"HighestSeqNumber-reconstructed-noncyclical,"
-				"LostPacketHighestSeq-Perc,"
-				"reportingSuccessful,"
-				"ConfInt90l,"
-				"ConfInt90u,"
-				"ConfInt95l,"
-				"ConfInt95u,"
-				"ConfInt99l,"
-				"ConfInt99u\n");
-		}
-
 		lostPktPerc=computeLostPktPerc(report);
 
 		lostPktPercLastSeqNo=computeLostPktPercLastSeqNo(report);
@@ -566,30 +864,151 @@ int printStatsCSV(struct options *opts, reportStructure *report, const char *fil
 					report->averageLatency-report->confidenceIntervalDev[i]<0?0:(report->averageLatency-report->confidenceIntervalDev[i])/1000,
 					(report->averageLatency+report->confidenceIntervalDev[i])/1000);
 
-				if(i<CONFINT_NUMBER-1) {
-					dprintf(csvfp,",");
-				} else {
-					dprintf(csvfp,"\n");
-				}
+				dprintf(csvfp,",");
 			}
 		} else {
-			dprintf(csvfp,"-1,-1,-1,-1,-1,-1\n");
+			dprintf(csvfp,"-1,-1,-1,-1,-1,-1,");
 		}
 
+		// Save the loss burst analysis data
+		lossBurstGetGE(&report->lossBursts,&ge);
+		lossBurstSerializeHist(report->lossBursts.burstHist,burstHistStr,sizeof(burstHistStr));
+		lossBurstSerializeHist(report->lossBursts.gapHist,gapHistStr,sizeof(gapHistStr));
+
+		dprintf(csvfp,"%" PRIu64 ","	// loss bursts
+			"%" PRIu64 ","				// max loss burst length
+			"%s,"						// burst length distribution
+			"%s,"						// gap length distribution
+			"%.5f,"						// Gilbert-Elliott p
+			"%.5f,"						// Gilbert-Elliott r
+			"%.5f,"						// Gilbert-Elliott bad state loss density
+			"%.5f\n",					// Gilbert-Elliott good state loss density
+			report->lossBursts.burstCount,
+			report->lossBursts.maxBurst,
+			burstHistStr,
+			gapHistStr,
+			ge.p,ge.r,ge.h,ge.k);
+
 		close(csvfp);
 
 		if(report->minLatency!=UINT64_MAX) {
-			fprintf(stdout,"Report data was saved inside %s\n",opts->filename);
+			fprintf(stdout,"Report data was saved inside %s\n",openedname ? openedname : filename);
 		} else {
-			fprintf(stdout,"Empty report data (test failed) was saved inside %s\n",opts->filename);
+			fprintf(stdout,"Empty report data (test failed) was saved inside %s\n",openedname ? openedname : filename);
 		}
 	} else {
 		printOpErrStatus=1;
 	}
 
+	free(openedname);
+
 	return printOpErrStatus;
 }
 
+// Write one line for each of the 'nstats' aggregates (--aggregate-stats) to a CSV file, with the session counters and
+// rate over the last 'interval' seconds, and the merged statistics and latency percentiles of the unidirectional sessions
+// The percentiles are the same ones sent to Carbon (--report-graphite-percentiles)
+// The file is overwritten only if 'overwrite' is = 1 (i.e. only at the first export, when '-o' is specified)
+int printAggrStatsCSV(struct options *opts, aggrStatsStructure **stats, int nstats, unsigned int interval, uint8_t overwrite, const char *filename) {
+	int csvfp;
+	char *openedname=NULL;
+	struct tm *currdate;
+	reportStructure *report;
+	uint64_t percentile;
+	// The header depends on the selected percentiles: each of them adds a ",P<percentile>-ms" column (24 characters max)
+	char header[sizeof(AGGR_CSV_HEADER)+MAX_g_PERCENTILES*24];
+	size_t headerlen;
+
+	headerlen=snprintf(header,sizeof(header),"%s",AGGR_CSV_HEADER);
+	for(int i=0;i<opts->carbon_percentiles_num && headerlen<sizeof(header);i++) {
+		headerlen+=snprintf(header+headerlen,sizeof(header)-headerlen,",P%g-ms",opts->carbon_percentiles[i]);
+	}
+
+	csvfp=openStatsCSV(filename,overwrite,header,&openedname);
+	if(csvfp<0) {
+		return 1;
+	}
+
+	free(openedname);
+
+	// Get current time and day
+	currdate=getLocalTime();
+
+	for(int s=0;s<nstats;s++) {
+		report=&(stats[s]->report);
+
+		dprintf(csvfp,"%d-%02d-%02d,%02d:%02d:%02d,",currdate->tm_year+1900,currdate->tm_mon+1,currdate->tm_mday,currdate->tm_hour,currdate->tm_min,currdate->tm_sec);
+
+		dprintf(csvfp,"%s,"		// client
+			"%u,"					// export interval
+			"%" PRIu64 ","			// sessions
+			"%" PRIu64 ","			// unidirectional sessions
+			"%" PRIu64 ","			// ping-like sessions
+			"%" PRIu64 ","			// timed out sessions
+			"%" PRIu64 ","			// sessions in the last interval
+			"%.3f,"					// session rate
+			"%" PRIu64 ","			// received packets
+			"%.3f,"					// minLatency
+			"%.3f,"					// maxLatency
+			"%.3f,"					// avgLatency
+			"%.4f,"					// standard deviation
+			"%.2f,"					// lost packets (perc)
+			"%" PRIu64 ","			// errors count
+			"%" PRIu64 ","			// out-of-order count
+			"%" PRIu64 ","			// duplicated packets count
+			"%" PRIu64 ","			// loss bursts
+			"%" PRIu64,				// max loss burst length
+			stats[s]->name,
+			interval,
+			stats[s]->sessions,
+			stats[s]->sessionsUnidir,
+			stats[s]->sessionsPinglike,
+			stats[s]->sessionsTimedout,
+			stats[s]->sessionsInterval,
+			interval>0 ? (double) stats[s]->sessionsInterval/interval : 0,
+			report->packetCount,
+			report->minLatency==UINT64_MAX ? 0 : ((double) report->minLatency)/1000,
+			((double) report->maxLatency)/1000,
+			report->minLatency==UINT64_MAX ? 0 : report->averageLatency/1000,
+			sqrt(report->variance)/1000,
+			report->totalPackets>0 ? ((double) report->lossCount)*100/report->totalPackets : 0,
+			report->errorsCount,
+			report->outOfOrderCount,
+			report->dupCount,
+			report->lossBursts.burstCount,
+			report->lossBursts.maxBurst);
+
+		// Latency percentiles, estimated from the histogram (the values are kept within the exact minimum and maximum)
+		for(int i=0;i<opts->carbon_percentiles_num;i++) {
+			percentile=latencyHistPercentile(&(stats[s]->latencyHist),opts->carbon_percentiles[i]);
+
+			if(report->minLatency==UINT64_MAX) {
+				percentile=0;
+			} else if(percentile<report->minLatency) {
+				percentile=report->minLatency;
+			} else if(percentile>report->maxLatency) {
+				percentile=report->maxLatency;
+			}
+
+			dprintf(csvfp,",%.3f",((double) percentile)/1000);
+		}
+
+		dprintf(csvfp,"\n");
+	}
+
+	close(csvfp);
+
+	return 0;
+}
+
+// Send all the per-packet data still queued in the batched '-w' mode, and stop the writer thread started by writeToReportSocket()
+static void reportSocketBatchFlush(report_sock_data_t *sock_data) {
+	if(sock_data->batch_writer!=NULL) {
+		tfileWriterFree(sock_data->batch_writer);
+		sock_data->batch_writer=NULL;
+	}
+}
+
 // If this function is called with report==NULL, an empty LaTeEND packet will be sent, formatting its content as:
 // 'LaTeEND,<LaMP ID>,srvtermination'
 int printStatsSocket(struct options *opts, reportStructure *report, report_sock_data_t *sock_data,uint16_t test_id) {
@@ -601,6 +1020,9 @@ int printStatsSocket(struct options *opts, reportStructure *report, report_sock_
 
 	const int confidenceIntervals[CONFINT_NUMBER]={90,95,99};
 
+	// 'LaTeEND' should never be received before the last per-packet data
+	reportSocketBatchFlush(sock_data);
+
 	if(report==NULL) {
 		snprintf(sockbuff_tcp,MAX_w_TCP_SOCK_BUF_SIZE,"LaTeEND,%" PRIu16 ",srvtermination",test_id);
 	} else {
@@ -686,12 +1108,25 @@ int printStatsSocket(struct options *opts, reportStructure *report, report_sock_
 	return 0;
 }
 
-int openTfile(const char *Tfilename, uint8_t overwrite, int followup_on_flag, char enabled_extra_data) {
+// When 'binary' is = 1, the file is opened for a binary trace (see tfile_binary.h), and no CSV header line is written
+// (the binary header record is written by the writer thread defined in tfile_writer.h)
+int openTfile(const char *Tfilename, uint8_t overwrite, int followup_on_flag, char enabled_extra_data, uint8_t binary) {
+	return openTfileNamed(Tfilename,overwrite,followup_on_flag,enabled_extra_data,binary,NULL);
+}
+
+// Same as openTfile(), but, if 'openedname' is not NULL, the name of the file which was actually opened (i.e. <Tfilename>, or
+// <Tfilename> with an increasing number appended) is also returned inside '*openedname'; it should be freed by the caller
+// If the name cannot be allocated, '*openedname' is set to NULL, but the file descriptor is still returned
+int openTfileNamed(const char *Tfilename, uint8_t overwrite, int followup_on_flag, char enabled_extra_data, uint8_t binary, char **openedname) {
 	int csvfd;
-	char *Tfilename_fileno;
+	char *Tfilename_fileno=NULL;
 
 	errno=0;
 
+	if(openedname!=NULL) {
+		*openedname=NULL;
+	}
+
 	if(Tfilename==NULL) {
 		return -2;
 	}
@@ -710,14 +1145,14 @@ int openTfile(const char *Tfilename, uint8_t overwrite, int followup_on_flag, ch
 			int fileno=1;
 			int fileopendone=0;
 
-			Tfilename_fileno=malloc((strlen(Tfilename)+W_MAX_FILE_NUMBER_DIGITS+1)*sizeof(char));
+			Tfilename_fileno=malloc((strlen(Tfilename)+W_MAX_FILE_NUMBER_DIGITS+2)*sizeof(char));
 
 			if(!Tfilename_fileno) {
 				return -3;
 			}
 
 			while(fileno<=W_MAX_FILE_NUMBER && fileopendone==0) {
-				snprintf(Tfilename_fileno,strlen(Tfilename)+W_MAX_FILE_NUMBER_DIGITS+2,"%.*s_%0*d.csv",(int) (strlen(Tfilename)-4),Tfilename,W_MAX_FILE_NUMBER_DIGITS,fileno);
+				snprintf(Tfilename_fileno,strlen(Tfilename)+W_MAX_FILE_NUMBER_DIGITS+2,"%.*s_%0*d%s",(int) (strlen(Tfilename)-4),Tfilename,W_MAX_FILE_NUMBER_DIGITS,fileno,Tfilename+strlen(Tfilename)-4);
 
 				csvfd=open(Tfilename_fileno, O_CREAT | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR);
 				if(csvfd<0 && errno==EEXIST) {
@@ -729,20 +1164,37 @@ int openTfile(const char *Tfilename, uint8_t overwrite, int followup_on_flag, ch
 				}
 			}
 
-			free(Tfilename_fileno);
-
 			// Attempted to create W_MAX_FILE_NUMBER different files but they all already exist
 			// In this case, just append to the original file which was specified
 			if(fileopendone==0) {
+				free(Tfilename_fileno);
+				Tfilename_fileno=NULL;
 				csvfd=open(Tfilename, O_WRONLY | O_APPEND);
 			}
 		}
 	}
 
-	if(csvfd<0) {
+	if(csvfd>=0 && openedname!=NULL) {
+		*openedname=Tfilename_fileno!=NULL ? Tfilename_fileno : strdup(Tfilename);
+		Tfilename_fileno=NULL;
+	}
+
+	if(Tfilename_fileno!=NULL) {
+		free(Tfilename_fileno);
+	}
+
+	if(csvfd<0 || binary) {
 		return csvfd;
 	}
 
+	writeTfileHeader(csvfd,followup_on_flag,enabled_extra_data);
+
+	return csvfd;
+}
+
+// Write the CSV header line of a '-W' file (this function is called by openTfile(), and, when rotating the '-W' file,
+// for each new segment)
+void writeTfileHeader(int csvfd, int followup_on_flag, char enabled_extra_data) {
 	// Write CSV file header, depending on the followup_on_flag flag value
 	if(followup_on_flag==0) {
 		dprintf(csvfd,PERPACKET_COMMON_FILE_HEADER_NO_FOLLOWUP);
@@ -768,8 +1220,6 @@ int openTfile(const char *Tfilename, uint8_t overwrite, int followup_on_flag, ch
 	}
 
 	dprintf(csvfd,"\n");
-
-	return csvfd;
 }
 
 // This function tries to open a UDP socket for the per-packet data transmission and a TCP socket for the
@@ -786,6 +1236,11 @@ int openReportSocket(report_sock_data_t *sock_data,struct options *opts) {
 		return -3;
 	}
 
+	sock_data->batched=opts->w_batch;
+	sock_data->batch_writer=NULL;
+	sock_data->binary=opts->w_binary;
+	sock_data->dgram_seq=0;
+
 	sock_data->descriptor_udp=socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
 
     if(sock_data->descriptor_udp==-1) {
@@ -853,58 +1308,141 @@ int openReportSocket(report_sock_data_t *sock_data,struct options *opts) {
 	return 0;
 }
 
+// Take a snapshot of the extra (-X) data related to the current packet
 // When printing additional data with -X, this function shall always be called after updating the report with "reportStructureUpdate()"
-int writeToTFile(int Tfiledescriptor,int decimal_digits,perPackerDataStructure *perPktData) {
-	int dprintf_ret_val;
+void perPacketExtraDataGet(perPackerDataStructure *perPktData,perPacketExtraData *extraData) {
 	// "PER Till Now" (Packet Error Rate till now) is basically computed as the percentage packet loss over all the packets before the last one
-	double perTillNow;
-	uint64_t reconstructedSeqNo;
-
-	if(perPktData->followup_on_flag==0) {
-		dprintf_ret_val=dprintf(Tfiledescriptor,"%" PRIu64 ",%.*f,%ld.%06ld,%d",
-			perPktData->seqNo,
-			decimal_digits,(double)(perPktData->signedTripTime)/1000,
-			(long int)(perPktData->tx_timestamp.tv_sec),(long int)(perPktData->tx_timestamp.tv_usec),
-			perPktData->signedTripTime<=0 ? 1 : 0);
-	} else {
-		dprintf_ret_val=dprintf(Tfiledescriptor,"%" PRIu64 ",%.*f,%.*f,%ld.%06ld,%d",
-			perPktData->seqNo,
-			decimal_digits,(double)(perPktData->signedTripTime)/1000,
-			decimal_digits,(double)(perPktData->tripTimeProc)/1000,
-			(long int)(perPktData->tx_timestamp.tv_sec),(long int)(perPktData->tx_timestamp.tv_usec),
-			perPktData->signedTripTime<=0 ? 1 : 0);
+	extraData->perTillNow=compute_perTillNow(perPktData);
+	extraData->reconstructedSeqNo=compute_reconstructedSeqNo(perPktData);
+	// perPktData->reportDataPointer->minLatency/maxLatency contain the current minimum/maximum measured latency (at the end of the test
+	// they will contain the global test minimum/maximum)
+	extraData->minLatency=compute_minLatency(perPktData);
+	extraData->maxLatency=compute_maxLatency(perPktData);
+}
+
+// Format the comma-separated fields of the current packet inside 'buf', which should be at least MAX_W_LINE_SIZE characters
+// long, without any final newline or '\0' (at most MAX_W_LINE_SIZE-2 characters are written)
+// All the values are written with the fixed-point formatter defined in fixed_point_fmt.h, apart from the "PER till now"
+// (-X 'p') floating point value; the output is the same obtained with "%.*f" on the latency values converted to ms
+static size_t formatPerPacketFields(char *buf,int decimal_digits,perPackerDataStructure *perPktData,perPacketExtraData *extraData) {
+	size_t len;
+	int perlen;
+
+	len=fpfmtU64(buf,perPktData->seqNo);
+	buf[len++]=',';
+	len+=fpfmtFixed(buf+len,perPktData->signedTripTime,3,decimal_digits);
+	buf[len++]=',';
+
+	if(perPktData->followup_on_flag!=0) {
+		len+=fpfmtFixed(buf+len,(int64_t) perPktData->tripTimeProc,3,decimal_digits);
+		buf[len++]=',';
 	}
 
-	// Print extra data to CSV file, if requested with -X
+	len+=fpfmtI64(buf+len,(int64_t) perPktData->tx_timestamp.tv_sec);
+	buf[len++]='.';
+	len+=fpfmtU64Pad(buf+len,(uint64_t) perPktData->tx_timestamp.tv_usec,6);
+	buf[len++]=',';
+	buf[len++]=perPktData->signedTripTime<=0 ? '1' : '0';
+
+	// Print extra data, if requested with -X
 	// -X 'a' will set all the bits in "enabled_extra_data", thus making the program enter in all the if statements below
 	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_P)) {
-		perTillNow=compute_perTillNow(perPktData);
-		dprintf_ret_val+=dprintf(Tfiledescriptor,",%.2f",perTillNow);
+		perlen=snprintf(buf+len,MAX_W_LINE_SIZE-1-len,",%.2f",extraData->perTillNow);
+		if(perlen>0) {
+			len+=(size_t) perlen<MAX_W_LINE_SIZE-2-len ? (size_t) perlen : MAX_W_LINE_SIZE-2-len;
+		}
 	}
 
-	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_R)) {
-		reconstructedSeqNo=compute_reconstructedSeqNo(perPktData);
-		dprintf_ret_val+=dprintf(Tfiledescriptor,",%" PRIu64,reconstructedSeqNo);
+	// The remaining fields are written only when they surely fit inside 'buf' (this may not happen only when the "PER till now"
+	// value takes an unexpectedly large number of characters)
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_R) && len+1+FPFMT_MAX_LEN<=MAX_W_LINE_SIZE-2) {
+		buf[len++]=',';
+		len+=fpfmtU64(buf+len,extraData->reconstructedSeqNo);
 	}
 
-	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_M)) {
-		// perPktData->reportDataPointer->minLatency contains the current maximum measured latency (at the end of the test will contain the global test maximum)
-		dprintf_ret_val+=dprintf(Tfiledescriptor,",%.*f",decimal_digits,compute_minLatency(perPktData));
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_M) && len+1+FPFMT_MAX_LEN<=MAX_W_LINE_SIZE-2) {
+		buf[len++]=',';
+		len+=fpfmtFixed(buf+len,extraData->minLatency,3,decimal_digits);
 	}
 
-	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_N)) {
-		// perPktData->reportDataPointer->minLatency contains the current minimum measured latency (at the end of the test will contain the global test minimum)
-		dprintf_ret_val+=dprintf(Tfiledescriptor,",%.*f",decimal_digits,compute_maxLatency(perPktData));
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_N) && len+1+FPFMT_MAX_LEN<=MAX_W_LINE_SIZE-2) {
+		buf[len++]=',';
+		len+=fpfmtFixed(buf+len,extraData->maxLatency,3,decimal_digits);
+	}
+
+	return len;
+}
+
+// Format a full CSV line (including the final newline) for the current packet inside 'buf', which is 'bufsize' bytes long
+// The return value is the same as snprintf(), i.e. the number of characters which would have been written if enough space had been available
+int snprintTFileLine(char *buf,size_t bufsize,int decimal_digits,perPackerDataStructure *perPktData,perPacketExtraData *extraData) {
+	char linebuff[MAX_W_LINE_SIZE];
+	size_t len;
+
+	// Format the line directly inside 'buf' when it is surely large enough
+	if(bufsize>=MAX_W_LINE_SIZE) {
+		len=formatPerPacketFields(buf,decimal_digits,perPktData,extraData);
+		buf[len++]='\n';
+		buf[len]='\0';
+
+		return len;
 	}
 
-	dprintf_ret_val+=dprintf(Tfiledescriptor,"\n");
+	len=formatPerPacketFields(linebuff,decimal_digits,perPktData,extraData);
+	linebuff[len++]='\n';
+
+	if(bufsize>0) {
+		memcpy(buf,linebuff,len<bufsize ? len : bufsize-1);
+		buf[len<bufsize ? len : bufsize-1]='\0';
+	}
 
-	return dprintf_ret_val;
+	return len;
+}
+
+// Synchronously write the current packet data to the -W CSV file, with a single write() call
+// When printing additional data with -X, this function shall always be called after updating the report with "reportStructureUpdate()"
+// Receive loops should use instead the asynchronous writer defined in tfile_writer.h, which does not perform any system call
+// on the receive path
+int writeToTFile(int Tfiledescriptor,int decimal_digits,perPackerDataStructure *perPktData) {
+	char linebuff[MAX_W_LINE_SIZE];
+	perPacketExtraData extraData;
+	int str_char_count;
+
+	perPacketExtraDataGet(perPktData,&extraData);
+
+	str_char_count=snprintTFileLine(linebuff,MAX_W_LINE_SIZE,decimal_digits,perPktData,&extraData);
+	if(str_char_count<0 || str_char_count>=MAX_W_LINE_SIZE) {
+		return -1;
+	}
+
+	return write(Tfiledescriptor,linebuff,str_char_count);
+}
+
+// Send the current packet data inside a single binary '-w' datagram (see report_sock_binary.h)
+static int writeToReportSocketBinary(report_sock_data_t *sock_data,perPackerDataStructure *perPktData,uint16_t test_id) {
+	uint8_t sockbuff[REPORT_SOCK_BIN_HDR_SIZE+REPORT_SOCK_BIN_MAX_RECORD_SIZE];
+	perPacketExtraData extraData;
+	size_t recordlen;
+
+	perPacketExtraDataGet(perPktData,&extraData);
+
+	recordlen=reportSockBinaryRecordEncode(sockbuff+REPORT_SOCK_BIN_HDR_SIZE,perPktData,&extraData);
+	reportSockBinaryHeaderEncode(sockbuff,test_id,sock_data->dgram_seq,1,recordlen);
+	sock_data->dgram_seq++;
+
+	if(sendto(sock_data->descriptor_udp,sockbuff,REPORT_SOCK_BIN_HDR_SIZE+recordlen,0,(struct sockaddr *)&(sock_data->addrto),sizeof(struct sockaddr_in))!=REPORT_SOCK_BIN_HDR_SIZE+recordlen) {
+		fprintf(stderr,"%s() error: cannot send the current information via the specified UDP socket (-w).\n",__func__);
+		perror("UDP socket error:");
+		return -1;
+	}
+
+	return 0;
 }
 
 int writeToReportSocket(report_sock_data_t *sock_data,int decimal_digits,perPackerDataStructure *perPktData,uint16_t test_id,uint8_t *first_call) {
 	char sockbuff[MAX_w_UDP_SOCK_BUF_SIZE];
 	char sockbuff_tcp[MAX_w_TCP_SOCK_BUF_SIZE];
+	perPacketExtraData extraData;
 	int str_char_count=0;
 	int return_error_code=0;
 
@@ -913,6 +1451,16 @@ int writeToReportSocket(report_sock_data_t *sock_data,int decimal_digits,perPack
 	}
 
 	if(*first_call) {
+		// Batched '-w' mode: start a new writer thread for each test, as the datagram sequence number should restart from 0
+		if(sock_data!=NULL && sock_data->batched) {
+			reportSocketBatchFlush(sock_data);
+
+			sock_data->batch_writer=tfileWriterInitSocket(sock_data->descriptor_udp,&(sock_data->addrto),decimal_digits,test_id,sock_data->binary);
+			if(sock_data->batch_writer==NULL) {
+				fprintf(stderr,"%s() warning: cannot start the batched -w writer. One datagram per packet will be sent instead.\n",__func__);
+			}
+		}
+
 		str_char_count=snprintf(sockbuff_tcp,MAX_w_TCP_SOCK_BUF_SIZE,"LaTeINIT,%" PRIu16 ",fields=",test_id);
 
 		if(perPktData->followup_on_flag==0) {
@@ -938,6 +1486,17 @@ int writeToReportSocket(report_sock_data_t *sock_data,int decimal_digits,perPack
 			str_char_count+=snprintf(str_char_count+sockbuff_tcp,MAX_w_UDP_SOCK_BUF_SIZE-str_char_count,";currmax");
 		}
 
+		// Tell the receiving application that the per-packet data will be packed into multi-record datagrams, or that
+		// the binary framing will be used, describing the layout of each record
+		if(sock_data!=NULL && sock_data->binary) {
+			str_char_count+=snprintf(str_char_count+sockbuff_tcp,MAX_w_TCP_SOCK_BUF_SIZE-str_char_count,",framing=binary,binlayout=");
+			if(str_char_count<MAX_w_TCP_SOCK_BUF_SIZE) {
+				str_char_count+=reportSockBinaryLayoutPrint(str_char_count+sockbuff_tcp,MAX_w_TCP_SOCK_BUF_SIZE-str_char_count,perPktData->followup_on_flag,perPktData->enabled_extra_data);
+			}
+		} else if(sock_data!=NULL && sock_data->batch_writer!=NULL) {
+			str_char_count+=snprintf(str_char_count+sockbuff_tcp,MAX_w_TCP_SOCK_BUF_SIZE-str_char_count,",framing=batch");
+		}
+
 		// Send the current data via the TCP socket
 		if(sock_data!=NULL) {
 			if(send(sock_data->descriptor_tcp,sockbuff_tcp,strlen(sockbuff_tcp),0)!=strlen(sockbuff_tcp)) {
@@ -951,47 +1510,32 @@ int writeToReportSocket(report_sock_data_t *sock_data,int decimal_digits,perPack
 		}
 
 		str_char_count=0;
+		sock_data->dgram_seq=0;
 		*first_call=0;
 	}
 
-	// Prepare the full string (i.e. the UDP packet content) to be sent via the UDP socket
-	if(perPktData->followup_on_flag==0) {
-		str_char_count=snprintf(sockbuff,MAX_w_UDP_SOCK_BUF_SIZE,"LaTe,%" PRIu16 ",%" PRIu64 ",%.*f,%ld.%06ld,%d",
-			test_id,
-			perPktData->seqNo,
-			decimal_digits,(double)(perPktData->signedTripTime)/1000,
-			(long int)(perPktData->tx_timestamp.tv_sec),(long int)(perPktData->tx_timestamp.tv_usec),
-			perPktData->signedTripTime<=0 ? 1 : 0);
-	} else {
-		str_char_count=snprintf(sockbuff,MAX_w_UDP_SOCK_BUF_SIZE,"LaTe,%" PRIu16 "%" PRIu64 ",%.*f,%.*f,%ld.%06ld,%d",
-			test_id,
-			perPktData->seqNo,
-			decimal_digits,(double)(perPktData->signedTripTime)/1000,
-			decimal_digits,(double)(perPktData->tripTimeProc)/1000,
-			(long int)(perPktData->tx_timestamp.tv_sec),(long int)(perPktData->tx_timestamp.tv_usec),
-			perPktData->signedTripTime<=0 ? 1 : 0);
+	// In the batched mode, the per-packet data is just queued, and it is formatted and sent by the writer thread
+	if(sock_data!=NULL && sock_data->batch_writer!=NULL) {
+		return tfileWriterPush(sock_data->batch_writer,perPktData);
 	}
 
-	// Save the required extra (-X) data too
-	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_P)) {
-		str_char_count+=snprintf(str_char_count+sockbuff,MAX_w_UDP_SOCK_BUF_SIZE-str_char_count,",%.2f",compute_perTillNow(perPktData));
-	}
-
-	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_R)) {
-		str_char_count+=snprintf(str_char_count+sockbuff,MAX_w_UDP_SOCK_BUF_SIZE-str_char_count,",%" PRIu64,compute_reconstructedSeqNo(perPktData));
+	if(sock_data!=NULL && sock_data->binary) {
+		return writeToReportSocketBinary(sock_data,perPktData,test_id);
 	}
 
-	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_M)) {
-		str_char_count+=snprintf(str_char_count+sockbuff,MAX_w_UDP_SOCK_BUF_SIZE-str_char_count,",%.*f",decimal_digits,compute_minLatency(perPktData));
-	}
+	// Prepare the full string (i.e. the UDP packet content) to be sent via the UDP socket: 'LaTe,<LaMP ID>,', followed by
+	// the same fields written inside the -W CSV files
+	memcpy(sockbuff,"LaTe,",5);
+	str_char_count=5;
+	str_char_count+=fpfmtU64(sockbuff+str_char_count,test_id);
+	sockbuff[str_char_count++]=',';
 
-	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_N)) {
-		str_char_count+=snprintf(str_char_count+sockbuff,MAX_w_UDP_SOCK_BUF_SIZE-str_char_count,",%.*f",decimal_digits,compute_maxLatency(perPktData));
-	}
+	perPacketExtraDataGet(perPktData,&extraData);
+	str_char_count+=formatPerPacketFields(sockbuff+str_char_count,decimal_digits,perPktData,&extraData);
 
 	// Send the current data via a UDP socket
 	if(sock_data!=NULL) {
-		if(sendto(sock_data->descriptor_udp,sockbuff,strlen(sockbuff),0,(struct sockaddr *)&(sock_data->addrto),sizeof(struct sockaddr_in))!=strlen(sockbuff)) {
+		if(sendto(sock_data->descriptor_udp,sockbuff,str_char_count,0,(struct sockaddr *)&(sock_data->addrto),sizeof(struct sockaddr_in))!=str_char_count) {
 			fprintf(stderr,"%s() error: cannot send the current information via the specified UDP socket (-w).\n",__func__);
 			perror("UDP socket error:");
 			return_error_code=-1;
@@ -1015,6 +1559,8 @@ void closeReportSocket(report_sock_data_t *sock_data) {
 		return;
 	}
 
+	reportSocketBatchFlush(sock_data);
+
 	if(sock_data->descriptor_udp>0) {
 		close(sock_data->descriptor_udp);
 	}
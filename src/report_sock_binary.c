@@ -0,0 +1,129 @@
+#include "report_sock_binary.h"
+#include "options.h"
+#include "timer_man.h"
+#include <endian.h>
+#include <stdio.h>
+#include <string.h>
+
+static inline void putLE16(uint8_t *buf,uint16_t val) {
+	val=htole16(val);
+	memcpy(buf,&val,sizeof(val));
+}
+
+static inline void putLE32(uint8_t *buf,uint32_t val) {
+	val=htole32(val);
+	memcpy(buf,&val,sizeof(val));
+}
+
+static inline void putLE64(uint8_t *buf,uint64_t val) {
+	val=htole64(val);
+	memcpy(buf,&val,sizeof(val));
+}
+
+// Convert a current minimum/maximum value (in us, as stored inside perPacketExtraData) to ns
+// -1 ms (i.e. value not available) is converted to -1
+static inline int64_t usToNs(int64_t us) {
+	if(us<0) {
+		return -1;
+	}
+
+	return us*1000;
+}
+
+// Size (in bytes) of each record, depending on the follow-up mode and on the enabled -X fields
+size_t reportSockBinaryRecordSize(int followup_on_flag,uint16_t enabled_extra_data) {
+	size_t size=8+8+8+1; // seq, latency, tx timestamp, error
+
+	if(followup_on_flag) {
+		size+=8;
+	}
+
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(enabled_extra_data,CHAR_P)) {
+		size+=8;
+	}
+
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(enabled_extra_data,CHAR_R)) {
+		size+=8;
+	}
+
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(enabled_extra_data,CHAR_M)) {
+		size+=8;
+	}
+
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(enabled_extra_data,CHAR_N)) {
+		size+=8;
+	}
+
+	return size;
+}
+
+// Print the record layout, to be sent inside 'LaTeINIT' after 'binlayout=' (the order of the fields must be the same
+// used by reportSockBinaryRecordEncode())
+// The return value is the same as snprintf()
+int reportSockBinaryLayoutPrint(char *buf,size_t bufsize,int followup_on_flag,uint16_t enabled_extra_data) {
+	return snprintf(buf,bufsize,"seq:u64;latency_ns:i64%s;tx_timestamp_ns:i64;error:u8%s%s%s%s",
+		followup_on_flag ? ";est_proctime_ns:u64" : "",
+		CHECK_REPORT_EXTRA_DATA_BIT_SET(enabled_extra_data,CHAR_P) ? ";pertillnow:f64" : "",
+		CHECK_REPORT_EXTRA_DATA_BIT_SET(enabled_extra_data,CHAR_R) ? ";fullseq:u64" : "",
+		CHECK_REPORT_EXTRA_DATA_BIT_SET(enabled_extra_data,CHAR_M) ? ";currmin_ns:i64" : "",
+		CHECK_REPORT_EXTRA_DATA_BIT_SET(enabled_extra_data,CHAR_N) ? ";currmax_ns:i64" : "");
+}
+
+// Encode a datagram header inside 'buf', which should be at least REPORT_SOCK_BIN_HDR_SIZE bytes long
+size_t reportSockBinaryHeaderEncode(uint8_t *buf,uint16_t test_id,uint64_t dgram_seq,uint16_t nrecords,uint16_t record_size) {
+	putLE32(buf,REPORT_SOCK_BIN_MAGIC);
+	buf[4]=REPORT_SOCK_BIN_VERSION;
+	buf[5]=0; // Reserved
+	putLE16(buf+6,test_id);
+	putLE64(buf+8,dgram_seq);
+	putLE16(buf+16,nrecords);
+	putLE16(buf+18,record_size);
+
+	return REPORT_SOCK_BIN_HDR_SIZE;
+}
+
+// Encode a record inside 'buf', which should be at least REPORT_SOCK_BIN_MAX_RECORD_SIZE bytes long
+// The return value is the size of the encoded record, i.e. the same value returned by reportSockBinaryRecordSize()
+size_t reportSockBinaryRecordEncode(uint8_t *buf,perPackerDataStructure *perPktData,perPacketExtraData *extraData) {
+	int64_t txTime=((int64_t) perPktData->tx_timestamp.tv_sec*SEC_TO_MICROSEC+perPktData->tx_timestamp.tv_usec)*1000;
+	uint64_t perTillNow_bits;
+	size_t len=0;
+
+	putLE64(buf+len,perPktData->seqNo);
+	len+=8;
+	putLE64(buf+len,(uint64_t) (perPktData->signedTripTime*1000));
+	len+=8;
+
+	if(perPktData->followup_on_flag) {
+		putLE64(buf+len,perPktData->tripTimeProc*1000);
+		len+=8;
+	}
+
+	putLE64(buf+len,(uint64_t) txTime);
+	len+=8;
+	buf[len++]=perPktData->signedTripTime<=0 ? 1 : 0;
+
+	// Extra (-X) fields, in the same order in which they are sent in the text mode
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_P)) {
+		memcpy(&perTillNow_bits,&(extraData->perTillNow),sizeof(perTillNow_bits));
+		putLE64(buf+len,perTillNow_bits);
+		len+=8;
+	}
+
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_R)) {
+		putLE64(buf+len,extraData->reconstructedSeqNo);
+		len+=8;
+	}
+
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_M)) {
+		putLE64(buf+len,(uint64_t) usToNs(extraData->minLatency));
+		len+=8;
+	}
+
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(perPktData->enabled_extra_data,CHAR_N)) {
+		putLE64(buf+len,(uint64_t) usToNs(extraData->maxLatency));
+		len+=8;
+	}
+
+	return len;
+}
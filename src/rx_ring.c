@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <net/ethernet.h>
+#include "rx_ring.h"
+#include "timer_man.h"
+
+// Offset of the LaMP header from the beginning of the IPv4 header, as seen by the classic BPF filter, once the
+// length of the IPv4 header (including its options) has been loaded into X
+#define RX_RING_LAMP_OFFSET (sizeof(struct ether_header)+sizeof(struct udphdr))
+// Minimum length of a LaMP packet (IPv4 without options)
+#define RX_RING_LAMP_MINLEN (sizeof(struct ether_header)+sizeof(struct iphdr)+sizeof(struct udphdr)+LAMP_HDR_SIZE())
+
+// Index of the "no match" return instruction of the classic BPF filter, and relative offset to reach it from instruction 'i'
+#define RX_RING_FILTER_NOMATCH 26
+#define RX_RING_TO_NOMATCH(i) (RX_RING_FILTER_NOMATCH-(i)-1)
+
+struct _rxRing {
+	int fd; // AF_PACKET socket with the TPACKET_V3 rx ring
+	int ctl_fd;
+	uint8_t ctl_filter; // = 1 when the complementary filter has been attached to 'ctl_fd'
+
+	byte_t *map;
+	size_t map_len;
+
+	// Current block and next frame to be read inside it (the block is still owned by userspace while 'block_open' is 1)
+	unsigned int block_idx;
+	uint8_t block_open;
+	struct tpacket3_hdr *next_frame;
+	uint32_t frames_left;
+};
+
+// Attach to 'fd' a classic BPF filter returning 'match' for the non-outgoing IPv4/UDP packets directed to 'udp_port',
+// carrying a LaMP header with a control field selected by 'ctrl_mask' (see XDP_SOCK_CTRL_BIT()), and 'nomatch' for any other packet
+// The packets with IPv4 options, which are too short to contain a LaMP header after them, make the filter return 0
+static int rxRingAttachFilter(int fd, uint16_t udp_port, uint32_t ctrl_mask, uint32_t match, uint32_t nomatch) {
+	struct lamphdr lampHeader;
+
+	lampHeadPopulate(&lampHeader,CTRL_PINGLIKE_REQ,0,0);
+
+	struct sock_filter code[]={
+		/* 0 */ {BPF_LD | BPF_W | BPF_ABS,		0, 0, SKF_AD_OFF+SKF_AD_PKTTYPE},
+		/* 1 */ {BPF_JMP | BPF_JEQ | BPF_K,		RX_RING_TO_NOMATCH(1), 0, PACKET_OUTGOING},
+		/* 2 */ {BPF_LD | BPF_W | BPF_LEN,		0, 0, 0},
+		/* 3 */ {BPF_JMP | BPF_JGE | BPF_K,		0, RX_RING_TO_NOMATCH(3), RX_RING_LAMP_MINLEN},
+		/* 4 */ {BPF_LD | BPF_H | BPF_ABS,		0, 0, offsetof(struct ether_header,ether_type)},
+		/* 5 */ {BPF_JMP | BPF_JEQ | BPF_K,		0, RX_RING_TO_NOMATCH(5), ETHERTYPE_IP},
+		/* 6 */ {BPF_LD | BPF_B | BPF_ABS,		0, 0, sizeof(struct ether_header)+offsetof(struct iphdr,protocol)},
+		/* 7 */ {BPF_JMP | BPF_JEQ | BPF_K,		0, RX_RING_TO_NOMATCH(7), IPPROTO_UDP},
+		// Fragments are never accepted
+		/* 8 */ {BPF_LD | BPF_H | BPF_ABS,		0, 0, sizeof(struct ether_header)+offsetof(struct iphdr,frag_off)},
+		/* 9 */ {BPF_JMP | BPF_JSET | BPF_K,	RX_RING_TO_NOMATCH(9), 0, 0x3fff},
+		// X = length of the IPv4 header
+		/* 10 */ {BPF_LDX | BPF_B | BPF_MSH,	0, 0, sizeof(struct ether_header)},
+		/* 11 */ {BPF_LD | BPF_H | BPF_IND,		0, 0, sizeof(struct ether_header)+offsetof(struct udphdr,dest)},
+		/* 12 */ {BPF_JMP | BPF_JEQ | BPF_K,	0, RX_RING_TO_NOMATCH(12), udp_port},
+		/* 13 */ {BPF_LD | BPF_B | BPF_IND,		0, 0, RX_RING_LAMP_OFFSET+offsetof(struct lamphdr,reserved)},
+		/* 14 */ {BPF_JMP | BPF_JEQ | BPF_K,	0, RX_RING_TO_NOMATCH(14), lampHeader.reserved},
+		// LaMP control field: if((ctrl & 0xF0)!=(CTRL_PINGLIKE_REQ & 0xF0) || !((ctrl_mask>>(ctrl & 0x0F)) & 1)) goto nomatch
+		/* 15 */ {BPF_LD | BPF_B | BPF_IND,		0, 0, RX_RING_LAMP_OFFSET+offsetof(struct lamphdr,ctrl)},
+		/* 16 */ {BPF_ALU | BPF_AND | BPF_K,	0, 0, 0xF0},
+		/* 17 */ {BPF_JMP | BPF_JEQ | BPF_K,	0, RX_RING_TO_NOMATCH(17), CTRL_PINGLIKE_REQ & 0xF0},
+		/* 18 */ {BPF_LD | BPF_B | BPF_IND,		0, 0, RX_RING_LAMP_OFFSET+offsetof(struct lamphdr,ctrl)},
+		/* 19 */ {BPF_ALU | BPF_AND | BPF_K,	0, 0, 0x0F},
+		/* 20 */ {BPF_MISC | BPF_TAX,			0, 0, 0},
+		/* 21 */ {BPF_LD | BPF_IMM,				0, 0, ctrl_mask & 0xFFFF},
+		/* 22 */ {BPF_ALU | BPF_RSH | BPF_X,	0, 0, 0},
+		/* 23 */ {BPF_ALU | BPF_AND | BPF_K,	0, 0, 1},
+		/* 24 */ {BPF_JMP | BPF_JEQ | BPF_K,	RX_RING_TO_NOMATCH(24), 0, 0},
+		/* 25 */ {BPF_RET | BPF_K,				0, 0, match},
+		/* 26 */ {BPF_RET | BPF_K,				0, 0, nomatch}
+	};
+	struct sock_fprog prog={
+		.len=sizeof(code)/sizeof(code[0]),
+		.filter=code
+	};
+
+	return setsockopt(fd,SOL_SOCKET,SO_ATTACH_FILTER,&prog,sizeof(prog));
+}
+
+rxRing rxRingInit(const char *devname, int ifindex, uint16_t udp_port, uint32_t ctrl_mask, int ctl_fd, uint32_t blk_tov, uint8_t hw_timestamps) {
+	rxRing RR;
+	struct tpacket_req3 req;
+	struct sockaddr_ll addrll;
+	int version=TPACKET_V3;
+
+	RR=calloc(1,sizeof(struct _rxRing));
+	if(CHECK_RR_NULL(RR)) {
+		fprintf(stderr,"RX ring: cannot allocate memory.\n");
+		return NULL;
+	}
+
+	RR->ctl_fd=ctl_fd;
+
+	// Protocol 0: no packet is received until bind() is called, i.e. until the ring and the filter are ready
+	RR->fd=socket(AF_PACKET,SOCK_RAW,0);
+	if(RR->fd<0) {
+		fprintf(stderr,"RX ring: cannot open the AF_PACKET socket: %s.\n",strerror(errno));
+		free(RR);
+		return NULL;
+	}
+
+	if(setsockopt(RR->fd,SOL_PACKET,PACKET_VERSION,&version,sizeof(version))<0) {
+		fprintf(stderr,"RX ring: TPACKET_V3 is not supported: %s.\n",strerror(errno));
+		rxRingFree(RR);
+		return NULL;
+	}
+
+	if(rxRingAttachFilter(RR->fd,udp_port,ctrl_mask,UINT32_MAX,0)<0) {
+		fprintf(stderr,"RX ring: cannot attach the BPF filter: %s.\n",strerror(errno));
+		rxRingFree(RR);
+		return NULL;
+	}
+
+	if(rxRingSetTimestamping(RR,hw_timestamps)<0) {
+		fprintf(stderr,"RX ring: cannot select the %s timestamps: %s.\n",hw_timestamps ? "hardware" : "software",strerror(errno));
+		rxRingFree(RR);
+		return NULL;
+	}
+
+	memset(&req,0,sizeof(req));
+	req.tp_block_size=RX_RING_BLOCK_SIZE;
+	req.tp_block_nr=RX_RING_BLOCK_NR;
+	req.tp_frame_size=RX_RING_FRAME_SIZE;
+	req.tp_frame_nr=(RX_RING_BLOCK_SIZE/RX_RING_FRAME_SIZE)*RX_RING_BLOCK_NR;
+	req.tp_retire_blk_tov=blk_tov;
+
+	if(setsockopt(RR->fd,SOL_PACKET,PACKET_RX_RING,&req,sizeof(req))<0) {
+		fprintf(stderr,"RX ring: cannot set up the ring: %s.\n",strerror(errno));
+		rxRingFree(RR);
+		return NULL;
+	}
+
+	RR->map_len=(size_t) RX_RING_BLOCK_SIZE*RX_RING_BLOCK_NR;
+	RR->map=mmap(NULL,RR->map_len,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_LOCKED,RR->fd,0);
+	if(RR->map==MAP_FAILED) {
+		// MAP_LOCKED may fail because of RLIMIT_MEMLOCK: try again without it
+		RR->map=mmap(NULL,RR->map_len,PROT_READ | PROT_WRITE,MAP_SHARED,RR->fd,0);
+		if(RR->map==MAP_FAILED) {
+			fprintf(stderr,"RX ring: cannot map the ring: %s.\n",strerror(errno));
+			RR->map=NULL;
+			rxRingFree(RR);
+			return NULL;
+		}
+	}
+
+	memset(&addrll,0,sizeof(addrll));
+	addrll.sll_family=AF_PACKET;
+	addrll.sll_protocol=htons(ETH_P_ALL);
+	addrll.sll_ifindex=ifindex;
+
+	if(bind(RR->fd,(struct sockaddr *) &addrll,sizeof(addrll))<0) {
+		fprintf(stderr,"RX ring: cannot bind the socket to %s: %s.\n",devname,strerror(errno));
+		rxRingFree(RR);
+		return NULL;
+	}
+
+	// From now on, the LaMP data packets are received only through the ring
+	if(rxRingAttachFilter(ctl_fd,udp_port,ctrl_mask,0,UINT32_MAX)<0) {
+		fprintf(stderr,"RX ring: cannot attach the BPF filter to the control socket: %s.\n",strerror(errno));
+		rxRingFree(RR);
+		return NULL;
+	}
+	RR->ctl_filter=1;
+
+	return RR;
+}
+
+// Select the hardware (if 'hw_timestamps' is 1) or software timestamps for the frames received from now on
+// When no hardware timestamp is available for a packet, its software timestamp is reported instead (with 'ts_hw' set to 0)
+int rxRingSetTimestamping(rxRing RR, uint8_t hw_timestamps) {
+	int req=hw_timestamps ? SOF_TIMESTAMPING_RAW_HARDWARE : 0;
+
+	return setsockopt(RR->fd,SOL_PACKET,PACKET_TIMESTAMP,&req,sizeof(req));
+}
+
+// Get the reception timeout (in ms) from the SO_RCVTIMEO option of the companion AF_PACKET socket (-1: no timeout)
+static int rxRingTimeout(rxRing RR) {
+	struct timeval rx_timeout;
+	socklen_t optlen=sizeof(rx_timeout);
+
+	if(getsockopt(RR->ctl_fd,SOL_SOCKET,SO_RCVTIMEO,&rx_timeout,&optlen)<0 || (rx_timeout.tv_sec==0 && rx_timeout.tv_usec==0)) {
+		return -1;
+	}
+
+	return rx_timeout.tv_sec*1000+rx_timeout.tv_usec/1000;
+}
+
+static inline struct tpacket_block_desc *rxRingBlock(rxRing RR) {
+	return (struct tpacket_block_desc *) (RR->map+(size_t) RR->block_idx*RX_RING_BLOCK_SIZE);
+}
+
+// Receive one frame, without copying it: a block is given back to the kernel only when rxRingRecv() is called again
+// after its last frame has been read, so that 'frame' always points to valid data until the next call
+// Just like recvfrom() on a socket with SO_RCVTIMEO, -1 is returned with errno set to EAGAIN when the timeout expires
+ssize_t rxRingRecv(rxRing RR, rxRingFrame *frame) {
+	struct tpacket_block_desc *block;
+	struct tpacket3_hdr *hdr;
+	struct sockaddr_ll *addrll;
+	struct pollfd pfd;
+	int poll_ret;
+
+	pfd.fd=RR->fd;
+	pfd.events=POLLIN | POLLERR;
+
+	while(!RR->block_open || RR->frames_left==0) {
+		block=rxRingBlock(RR);
+
+		// The current block has been completely read: give it back to the kernel and move to the next one
+		if(RR->block_open) {
+			__atomic_store_n(&(block->hdr.bh1.block_status),TP_STATUS_KERNEL,__ATOMIC_RELEASE);
+			RR->block_open=0;
+			RR->block_idx=(RR->block_idx+1)%RX_RING_BLOCK_NR;
+			continue;
+		}
+
+		if(!(__atomic_load_n(&(block->hdr.bh1.block_status),__ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+			poll_ret=poll(&pfd,1,rxRingTimeout(RR));
+
+			if(poll_ret==0) {
+				errno=EAGAIN;
+				return -1;
+			} else if(poll_ret<0 && errno!=EINTR) {
+				return -1;
+			}
+
+			continue;
+		}
+
+		RR->block_open=1;
+		RR->next_frame=(struct tpacket3_hdr *) ((byte_t *) block+block->hdr.bh1.offset_to_first_pkt);
+		RR->frames_left=block->hdr.bh1.num_pkts;
+	}
+
+	hdr=RR->next_frame;
+	addrll=(struct sockaddr_ll *) ((byte_t *) hdr+TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+	frame->data=(byte_t *) hdr+hdr->tp_mac;
+	frame->len=hdr->tp_snaplen;
+	frame->ts.tv_sec=hdr->tp_sec;
+	frame->ts.tv_usec=hdr->tp_nsec/MICROSEC_TO_NANOSEC;
+	frame->ts_hw=(hdr->tp_status & TP_STATUS_TS_RAW_HARDWARE) ? 1 : 0;
+	frame->pkttype=addrll->sll_pkttype;
+
+	RR->next_frame=(struct tpacket3_hdr *) ((byte_t *) hdr+hdr->tp_next_offset);
+	RR->frames_left--;
+
+	return frame->len;
+}
+
+void rxRingFree(rxRing RR) {
+	int dummy=0;
+
+	if(CHECK_RR_NULL(RR)) {
+		return;
+	}
+
+	// Let the control socket receive again all the packets
+	if(RR->ctl_filter) {
+		setsockopt(RR->ctl_fd,SOL_SOCKET,SO_DETACH_FILTER,&dummy,sizeof(dummy));
+	}
+
+	if(RR->map) munmap(RR->map,RR->map_len);
+	if(RR->fd>=0) close(RR->fd);
+
+	free(RR);
+}
@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include "session_table.h"
+
+// The sessionTable is a hash table with separate chaining, storing a pointer to the state of each server session,
+// identified by its sessionKey
+// Lookups are performed for each received packet, while insertions and removals only happen when a session is admitted
+// or terminated: the table is grown (and the entries are rehashed) only when inserting a new session
+struct sessionTableNode {
+	sessionKey key;
+	void *session;
+	struct sessionTableNode *next;
+};
+
+struct _sessionTable {
+	struct sessionTableNode **buckets;
+	unsigned int bits; // The number of buckets is always 2^bits
+	unsigned int count; // Number of sessions currently stored inside the table
+};
+
+static inline int keyEqual(sessionKey a,sessionKey b) {
+	return a.ip==b.ip && a.port==b.port && a.lamp_id==b.lamp_id;
+}
+
+// Fibonacci (multiplicative) hashing of the whole key, taking the 'bits' most significant bits of the product
+static inline uint64_t keyHash(sessionKey key,unsigned int bits) {
+	uint64_t val=((uint64_t) key.ip<<32) | ((uint64_t) key.port<<16) | key.lamp_id;
+
+	return (val*0x9E3779B97F4A7C15ULL)>>(64-bits);
+}
+
+static int growTable(sessionTable ST) {
+	struct sessionTableNode **new_buckets;
+	struct sessionTableNode *node, *next;
+	uint64_t idx;
+
+	new_buckets=calloc((size_t) 1<<(ST->bits+1),sizeof(struct sessionTableNode *));
+	if(!new_buckets) {
+		return -1;
+	}
+
+	for(uint64_t i=0;i<((uint64_t) 1<<ST->bits);i++) {
+		for(node=ST->buckets[i];node!=NULL;node=next) {
+			next=node->next;
+			idx=keyHash(node->key,ST->bits+1);
+			node->next=new_buckets[idx];
+			new_buckets[idx]=node;
+		}
+	}
+
+	free(ST->buckets);
+	ST->buckets=new_buckets;
+	ST->bits++;
+
+	return 0;
+}
+
+// 'size' is the expected number of concurrent sessions (the table is anyway grown when needed)
+sessionTable sessionTableInit(unsigned int size) {
+	sessionTable ST;
+
+	ST=malloc(sizeof(struct _sessionTable));
+	if(!ST) {
+		return NULL;
+	}
+
+	ST->bits=0;
+	while(((unsigned int) 1<<ST->bits)<ST_MIN_BUCKETS || ((unsigned int) 1<<ST->bits)<size) {
+		ST->bits++;
+	}
+
+	ST->buckets=calloc((size_t) 1<<ST->bits,sizeof(struct sessionTableNode *));
+	if(!ST->buckets) {
+		free(ST);
+		return NULL;
+	}
+
+	ST->count=0;
+
+	return ST;
+}
+
+// Get the session associated to 'key', or NULL if no session with this key exists
+void *sessionTableLookup(sessionTable ST,sessionKey key) {
+	struct sessionTableNode *node;
+
+	for(node=ST->buckets[keyHash(key,ST->bits)];node!=NULL;node=node->next) {
+		if(keyEqual(node->key,key)) {
+			return node->session;
+		}
+	}
+
+	return NULL;
+}
+
+int sessionTableInsert(sessionTable ST,sessionKey key,void *session) {
+	struct sessionTableNode *node;
+	uint64_t idx;
+
+	if(sessionTableLookup(ST,key)!=NULL) {
+		return ST_EXISTS;
+	}
+
+	// Try to grow the table when the average chain length becomes larger than 2 (if this is not possible, the
+	// session is inserted anyway, with slightly longer chains)
+	if(ST->count>=((unsigned int) 2<<ST->bits) && ST->bits<31) {
+		growTable(ST);
+	}
+
+	node=malloc(sizeof(struct sessionTableNode));
+	if(!node) {
+		return ST_NOMEM;
+	}
+
+	idx=keyHash(key,ST->bits);
+
+	node->key=key;
+	node->session=session;
+	node->next=ST->buckets[idx];
+	ST->buckets[idx]=node;
+
+	ST->count++;
+
+	return ST_NOERR;
+}
+
+// Remove the session associated to 'key' from the table, returning it (or NULL, if no session with this key exists)
+void *sessionTableRemove(sessionTable ST,sessionKey key) {
+	struct sessionTableNode **nodeptr;
+	struct sessionTableNode *node;
+	void *session;
+
+	for(nodeptr=&(ST->buckets[keyHash(key,ST->bits)]);*nodeptr!=NULL;nodeptr=&((*nodeptr)->next)) {
+		if(keyEqual((*nodeptr)->key,key)) {
+			node=*nodeptr;
+			session=node->session;
+			*nodeptr=node->next;
+			free(node);
+			ST->count--;
+
+			return session;
+		}
+	}
+
+	return NULL;
+}
+
+// Call 'callback' for each session stored inside the table: the sessions for which 'callback' returns 1 are removed
+// The callback must not insert or remove any entry by itself
+void sessionTableForEach(sessionTable ST,sessionTableCallback callback,void *arg) {
+	struct sessionTableNode **nodeptr;
+	struct sessionTableNode *node;
+
+	for(uint64_t i=0;i<((uint64_t) 1<<ST->bits);i++) {
+		nodeptr=&(ST->buckets[i]);
+
+		while(*nodeptr!=NULL) {
+			node=*nodeptr;
+
+			if(callback(node->key,node->session,arg)==1) {
+				*nodeptr=node->next;
+				free(node);
+				ST->count--;
+			} else {
+				nodeptr=&(node->next);
+			}
+		}
+	}
+}
+
+unsigned int sessionTableCount(sessionTable ST) {
+	return ST->count;
+}
+
+// Free the table (the sessions which are still stored inside it are not freed)
+void sessionTableFree(sessionTable ST) {
+	struct sessionTableNode *node, *next;
+
+	if(ST==NULL) {
+		return;
+	}
+
+	for(uint64_t i=0;i<((uint64_t) 1<<ST->bits);i++) {
+		for(node=ST->buckets[i];node!=NULL;node=next) {
+			next=node->next;
+			free(node);
+		}
+	}
+
+	free(ST->buckets);
+	free(ST);
+}
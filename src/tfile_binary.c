@@ -0,0 +1,99 @@
+#include "tfile_binary.h"
+#include "options.h"
+#include "timer_man.h"
+#include <endian.h>
+#include <string.h>
+
+static inline size_t putVarint(uint8_t *buf,uint64_t val) {
+	size_t len=0;
+
+	while(val>=0x80) {
+		buf[len++]=(uint8_t) (val | 0x80);
+		val>>=7;
+	}
+
+	buf[len++]=(uint8_t) val;
+
+	return len;
+}
+
+static inline size_t putSignedVarint(uint8_t *buf,int64_t val) {
+	// Zigzag encoding: small negative values are mapped to small unsigned values
+	return putVarint(buf,((uint64_t) val<<1) ^ (uint64_t) (val>>63));
+}
+
+static inline void putU16(uint8_t *buf,uint16_t val) {
+	val=htobe16(val);
+	memcpy(buf,&val,sizeof(val));
+}
+
+static inline void putU32(uint8_t *buf,uint32_t val) {
+	val=htobe32(val);
+	memcpy(buf,&val,sizeof(val));
+}
+
+// Encode a header record inside 'buf', which should be at least TFILE_BIN_HDR_SIZE bytes long, and reset the delta
+// encoding state for the new section
+size_t tfileBinaryHeaderEncode(uint8_t *buf,tfileBinaryHeader *hdr,tfileBinaryState *state) {
+	buf[0]=TFILE_BIN_TAG_HEADER;
+	putU32(buf+1,TFILE_BIN_MAGIC);
+	buf[5]=TFILE_BIN_VERSION;
+	putU16(buf+6,hdr->lamp_id);
+	buf[8]=hdr->latency_type;
+	buf[9]=hdr->followup_on_flag;
+	putU16(buf+10,hdr->enabled_extra_data);
+	buf[12]=hdr->side;
+	buf[13]=hdr->decimal_digits;
+	putU32(buf+14,TFILE_BIN_TIME_UNIT_NS);
+
+	state->prevSeqNo=0;
+	state->prevTxTime=0;
+	state->followup_on_flag=hdr->followup_on_flag;
+	state->enabled_extra_data=hdr->enabled_extra_data;
+
+	return TFILE_BIN_HDR_SIZE;
+}
+
+// Encode a packet record inside 'buf', which should be at least TFILE_BIN_MAX_RECORD_SIZE bytes long
+// The return value is the size of the encoded record
+size_t tfileBinaryRecordEncode(uint8_t *buf,tfileBinaryState *state,perPackerDataStructure *perPktData,perPacketExtraData *extraData) {
+	int64_t txTime=(int64_t) perPktData->tx_timestamp.tv_sec*SEC_TO_MICROSEC+perPktData->tx_timestamp.tv_usec;
+	uint64_t perTillNow_bits;
+	size_t len=0;
+
+	buf[len++]=perPktData->signedTripTime<=0 ? TFILE_BIN_TAG_ERROR : 0;
+
+	len+=putSignedVarint(buf+len,(int64_t) (perPktData->seqNo-state->prevSeqNo));
+	len+=putSignedVarint(buf+len,perPktData->signedTripTime);
+
+	if(state->followup_on_flag) {
+		len+=putVarint(buf+len,perPktData->tripTimeProc);
+	}
+
+	len+=putSignedVarint(buf+len,txTime-state->prevTxTime);
+
+	state->prevSeqNo=perPktData->seqNo;
+	state->prevTxTime=txTime;
+
+	// Extra (-X) fields, in the same order in which they are written to CSV files
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(state->enabled_extra_data,CHAR_P)) {
+		memcpy(&perTillNow_bits,&(extraData->perTillNow),sizeof(perTillNow_bits));
+		perTillNow_bits=htobe64(perTillNow_bits);
+		memcpy(buf+len,&perTillNow_bits,sizeof(perTillNow_bits));
+		len+=sizeof(perTillNow_bits);
+	}
+
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(state->enabled_extra_data,CHAR_R)) {
+		len+=putVarint(buf+len,extraData->reconstructedSeqNo);
+	}
+
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(state->enabled_extra_data,CHAR_M)) {
+		len+=putSignedVarint(buf+len,extraData->minLatency);
+	}
+
+	if(CHECK_REPORT_EXTRA_DATA_BIT_SET(state->enabled_extra_data,CHAR_N)) {
+		len+=putSignedVarint(buf+len,extraData->maxLatency);
+	}
+
+	return len;
+}
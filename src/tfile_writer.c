@@ -0,0 +1,880 @@
+// Needed for sendmmsg() (and for 'environ')
+#define _GNU_SOURCE
+#include "tfile_writer.h"
+#include "report_manager.h"
+#include "report_sock_binary.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#if (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__))
+	#include <stdatomic.h>
+	#define TW_ATOMICS_SUPPORTED 1
+#else
+	#define TW_ATOMICS_SUPPORTED 0
+#endif
+
+// posix_spawn_file_actions_addclosefrom_np() is available since glibc 2.34: otherwise, the descriptors to be closed in the
+// hook process are listed from /proc/self/fd
+#if defined(__GLIBC__) && (__GLIBC__>2 || (__GLIBC__==2 && __GLIBC_MINOR__>=34))
+	#define TW_SPAWN_CLOSEFROM_SUPPORTED 1
+#else
+	#define TW_SPAWN_CLOSEFROM_SUPPORTED 0
+#endif
+
+#define TW_RING_MASK (TFILE_WRITER_RING_SIZE-1)
+// Maximum size of the records contained inside each batched '-w' datagram (text and binary framing)
+#define TW_SOCK_BODY_SIZE (MAX_w_UDP_SOCK_BUF_SIZE-TFILE_WRITER_SOCK_HDR_SIZE)
+#define TW_SOCK_BIN_BODY_SIZE (MAX_w_UDP_SOCK_BUF_SIZE-REPORT_SOCK_BIN_HDR_SIZE)
+
+// Fixed-size record stored in the ring buffer for each packet: as the report structure keeps changing while the
+// records are waiting to be written, the extra (-X) data is computed by the receive thread, when pushing each record
+struct tfileRecord {
+	perPackerDataStructure perPktData;
+	perPacketExtraData extraData;
+};
+
+struct _tfileWriter {
+	int fd;
+	int decimal_digits;
+	int poll_interval; // ms
+	const char *sinkname; // Used only when printing warnings
+
+	// Binary trace format (see tfile_binary.h), or binary '-w' framing (see report_sock_binary.h) when 'sock' is = 1
+	// When 'binary' is = 0, the records are written as CSV lines
+	uint8_t binary;
+	tfileBinaryState binState;
+
+	// Batched '-w' mode: when 'sock' is = 1, 'fd' is a UDP socket and the records are sent to 'addrto' inside
+	// multi-record datagrams
+	uint8_t sock;
+	struct sockaddr_in addrto;
+	uint16_t test_id;
+	uint64_t dgram_seq; // Datagram sequence number, to let the receiver detect lost datagrams
+	size_t bin_record_size;
+	struct mmsghdr msgs[TFILE_WRITER_SOCK_BATCH];
+	struct iovec msg_iov[TFILE_WRITER_SOCK_BATCH][2];
+	char msg_hdr[TFILE_WRITER_SOCK_BATCH][TFILE_WRITER_SOCK_HDR_SIZE];
+
+	// Rotation of the '-W' file (see tfileRotationParams): 'fd' is always the current segment, while 'next_fd' is the
+	// following one, which is opened in advance, as soon as the current one is started
+	// 'user_fd' is the first segment, opened by the caller, whose ownership is passed to the writer (see tfileWriterFree())
+	uint8_t rotate;
+	uint64_t rot_size;
+	uint32_t rot_interval;
+	uint8_t rot_overwrite;
+	int followup_on_flag;
+	char enabled_extra_data;
+	tfileBinaryHeader binHeader;
+	int user_fd;
+	char *seg_basename; // First segment name, without extension
+	char *seg_extension; // Extension of the first segment name (including the '.', if any)
+	char *seg_name; // Name of the current segment
+	uint64_t seg_bytes; // Bytes written to the current segment
+	uint8_t seg_has_records;
+	unsigned int segno; // Number of the last opened segment
+	int next_fd;
+	char *next_name;
+	tfileBinaryState next_binState;
+	time_t rot_deadline; // Next time-based rotation (wall-clock time)
+	char *hook_cmd; // Complete '/bin/sh -c' command, to run the hook in background (NULL if no hook was specified)
+	uint64_t rotate_errors; // Number of failed rotations, or of hooks which could not be started
+
+	struct tfileRecord *ring;
+
+	// 'head' is written only by the receive thread, 'tail' only by the writer thread
+	// If C11 atomic variables are not supported, they are protected by a mutex
+	#if TW_ATOMICS_SUPPORTED
+		_Atomic uint64_t head;
+		_Atomic uint64_t tail;
+	#else
+		uint64_t head;
+		uint64_t tail;
+		pthread_mutex_t ring_mut;
+	#endif
+
+	// Buffers used by the writer thread to format the records before calling writev()
+	char *blocks;
+
+	uint64_t dropped; // Records dropped because the ring buffer was full (written only by the receive thread)
+	uint64_t write_errors; // Number of failed writev() calls, or of datagrams which could not be sent (written only by the writer thread)
+
+	pthread_t tid;
+	// Pipe used to unblock and terminate the writer thread when calling tfileWriterFree()
+	int unlock_pd[2];
+};
+
+static inline uint64_t ringLoadHead(tfileWriter TW) {
+	#if TW_ATOMICS_SUPPORTED
+		return atomic_load_explicit(&(TW->head),memory_order_acquire);
+	#else
+		uint64_t head;
+		pthread_mutex_lock(&(TW->ring_mut));
+		head=TW->head;
+		pthread_mutex_unlock(&(TW->ring_mut));
+		return head;
+	#endif
+}
+
+static inline uint64_t ringLoadTail(tfileWriter TW) {
+	#if TW_ATOMICS_SUPPORTED
+		return atomic_load_explicit(&(TW->tail),memory_order_acquire);
+	#else
+		uint64_t tail;
+		pthread_mutex_lock(&(TW->ring_mut));
+		tail=TW->tail;
+		pthread_mutex_unlock(&(TW->ring_mut));
+		return tail;
+	#endif
+}
+
+static inline void ringStoreHead(tfileWriter TW,uint64_t head) {
+	#if TW_ATOMICS_SUPPORTED
+		atomic_store_explicit(&(TW->head),head,memory_order_release);
+	#else
+		pthread_mutex_lock(&(TW->ring_mut));
+		TW->head=head;
+		pthread_mutex_unlock(&(TW->ring_mut));
+	#endif
+}
+
+static inline void ringStoreTail(tfileWriter TW,uint64_t tail) {
+	#if TW_ATOMICS_SUPPORTED
+		atomic_store_explicit(&(TW->tail),tail,memory_order_release);
+	#else
+		pthread_mutex_lock(&(TW->ring_mut));
+		TW->tail=tail;
+		pthread_mutex_unlock(&(TW->ring_mut));
+	#endif
+}
+
+// Write all the given buffers, taking care of partial writes
+static int writevAll(int fd,struct iovec *iov,int iovcnt) {
+	ssize_t written;
+
+	while(iovcnt>0) {
+		written=writev(fd,iov,iovcnt);
+
+		if(written<0) {
+			if(errno==EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		while(iovcnt>0 && (size_t) written>=iov->iov_len) {
+			written-=iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+
+		if(iovcnt>0) {
+			iov->iov_base=(char *) iov->iov_base+written;
+			iov->iov_len-=written;
+		}
+	}
+
+	return 0;
+}
+
+// Open the segment following the last one which was opened, and write its header
+// Segments which already exist are skipped, unless the overwrite mode is enabled
+static int openNextSegment(tfileWriter TW) {
+	uint8_t binHdrBuf[TFILE_BIN_HDR_SIZE];
+	size_t namelen=strlen(TW->seg_basename)+strlen(TW->seg_extension)+4+W_MAX_FILE_NUMBER_DIGITS+12;
+	int attempts=0;
+	int fd=-1;
+
+	TW->next_name=malloc(namelen*sizeof(char));
+	if(!TW->next_name) {
+		return -1;
+	}
+
+	while(fd<0 && attempts<W_MAX_FILE_NUMBER) {
+		TW->segno++;
+		attempts++;
+
+		snprintf(TW->next_name,namelen,"%s_seg%0*u%s",TW->seg_basename,W_MAX_FILE_NUMBER_DIGITS,TW->segno,TW->seg_extension);
+
+		if(TW->rot_overwrite) {
+			fd=open(TW->next_name,O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC,S_IRUSR | S_IWUSR);
+		} else {
+			fd=open(TW->next_name,O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC,S_IRUSR | S_IWUSR);
+		}
+
+		if(fd<0 && errno!=EEXIST) {
+			break;
+		}
+	}
+
+	if(fd<0) {
+		free(TW->next_name);
+		TW->next_name=NULL;
+		return -1;
+	}
+
+	// The state of the binary trace is reset when the segment becomes the current one
+	if(TW->binary) {
+		tfileBinaryHeaderEncode(binHdrBuf,&(TW->binHeader),&(TW->next_binState));
+		if(write(fd,binHdrBuf,TFILE_BIN_HDR_SIZE)!=TFILE_BIN_HDR_SIZE) {
+			close(fd);
+			unlink(TW->next_name);
+			free(TW->next_name);
+			TW->next_name=NULL;
+			return -1;
+		}
+	} else {
+		writeTfileHeader(fd,TW->followup_on_flag,TW->enabled_extra_data);
+	}
+
+	TW->next_fd=fd;
+
+	return 0;
+}
+
+// Make the hook process close all the descriptors except stdin, stdout and stderr, so that it does not keep open the
+// sockets of LaTe, or the '-W' segments (which could still be written)
+static int hookCloseFdsActions(posix_spawn_file_actions_t *actions) {
+	#if TW_SPAWN_CLOSEFROM_SUPPORTED
+		return posix_spawn_file_actions_addclosefrom_np(actions,STDERR_FILENO+1);
+	#else
+		DIR *fddir;
+		struct dirent *entry;
+		int fd;
+		int rval=0;
+
+		fddir=opendir("/proc/self/fd");
+		if(fddir==NULL) {
+			return -1;
+		}
+
+		while((entry=readdir(fddir))!=NULL) {
+			fd=atoi(entry->d_name);
+
+			if(fd>STDERR_FILENO && fd!=dirfd(fddir) && posix_spawn_file_actions_addclose(actions,fd)!=0) {
+				rval=-1;
+				break;
+			}
+		}
+
+		closedir(fddir);
+
+		return rval;
+	#endif
+}
+
+// Run the hook command (if any) on a closed segment
+// The command is started in background by '/bin/sh', which immediately terminates, so that the writer thread never waits
+// for the command to complete, and no zombie process is left behind
+static void runRotateHook(tfileWriter TW,const char *segname) {
+	char *argv[]={"sh","-c",TW->hook_cmd,"sh",(char *) segname,NULL};
+	posix_spawn_file_actions_t actions;
+	pid_t pid;
+	int spawn_ret;
+
+	if(TW->hook_cmd==NULL) {
+		return;
+	}
+
+	if(posix_spawn_file_actions_init(&actions)!=0) {
+		TW->rotate_errors++;
+		return;
+	}
+
+	if(hookCloseFdsActions(&actions)!=0) {
+		posix_spawn_file_actions_destroy(&actions);
+		TW->rotate_errors++;
+		return;
+	}
+
+	spawn_ret=posix_spawn(&pid,"/bin/sh",&actions,NULL,argv,environ);
+	posix_spawn_file_actions_destroy(&actions);
+
+	if(spawn_ret!=0) {
+		TW->rotate_errors++;
+		return;
+	}
+
+	while(waitpid(pid,NULL,0)<0 && errno==EINTR);
+}
+
+// Close a segment (including the first one, which is owned by the writer) and pass it to the hook command
+static void closeSegment(tfileWriter TW,int fd,const char *segname) {
+	close(fd);
+
+	runRotateHook(TW,segname);
+}
+
+// Switch to the segment which was opened in advance, close the current one and open the following one
+// If no segment could be opened, the records keep being written to the current one
+static void tfileWriterRotate(tfileWriter TW) {
+	char *oldname;
+	int oldfd;
+
+	if(TW->next_fd<0 && openNextSegment(TW)<0) {
+		TW->rotate_errors++;
+		return;
+	}
+
+	oldfd=TW->fd;
+	oldname=TW->seg_name;
+
+	TW->fd=TW->next_fd;
+	TW->seg_name=TW->next_name;
+	TW->binState=TW->next_binState;
+	TW->seg_bytes=0;
+	TW->seg_has_records=0;
+	TW->next_fd=-1;
+	TW->next_name=NULL;
+
+	closeSegment(TW,oldfd,oldname);
+	free(oldname);
+
+	// A failure here is not fatal, as the segment will be opened again at the next rotation
+	openNextSegment(TW);
+}
+
+// Check if the current wall-clock rotation interval has elapsed
+// No new segment is started if no record was written to the current one
+static void tfileWriterCheckInterval(tfileWriter TW) {
+	time_t now=time(NULL);
+
+	if(now<TW->rot_deadline) {
+		return;
+	}
+
+	if(TW->seg_has_records) {
+		tfileWriterRotate(TW);
+	}
+
+	TW->rot_deadline=(now/TW->rot_interval+1)*TW->rot_interval;
+}
+
+// Format and write all the records currently stored in the ring buffer
+static void tfileWriterDrain(tfileWriter TW) {
+	struct iovec iov[TFILE_WRITER_IOV_NUM];
+	struct tfileRecord *record;
+	uint64_t head, tail;
+	size_t blocklen;
+	int iovcnt;
+	int linelen;
+
+	tail=ringLoadTail(TW);
+	head=ringLoadHead(TW);
+
+	while(tail!=head) {
+		iovcnt=0;
+
+		// Fill up to TFILE_WRITER_IOV_NUM blocks
+		while(iovcnt<TFILE_WRITER_IOV_NUM && tail!=head) {
+			char *block=TW->blocks+iovcnt*TFILE_WRITER_BLOCK_SIZE;
+			blocklen=0;
+
+			while(tail!=head && blocklen+MAX_W_LINE_SIZE<=TFILE_WRITER_BLOCK_SIZE) {
+				record=&(TW->ring[tail & TW_RING_MASK]);
+
+				if(TW->binary) {
+					linelen=tfileBinaryRecordEncode((uint8_t *) block+blocklen,&(TW->binState),&(record->perPktData),&(record->extraData));
+				} else {
+					linelen=snprintTFileLine(block+blocklen,MAX_W_LINE_SIZE,TW->decimal_digits,&(record->perPktData),&(record->extraData));
+				}
+
+				if(linelen>0 && linelen<MAX_W_LINE_SIZE) {
+					blocklen+=linelen;
+				}
+
+				tail++;
+			}
+
+			iov[iovcnt].iov_base=block;
+			iov[iovcnt].iov_len=blocklen;
+			iovcnt++;
+		}
+
+		// The records have already been formatted: their slots can be immediately released to the receive thread
+		ringStoreTail(TW,tail);
+
+		for(int i=0;i<iovcnt;i++) {
+			TW->seg_bytes+=iov[i].iov_len;
+		}
+		TW->seg_has_records=1;
+
+		if(writevAll(TW->fd,iov,iovcnt)<0) {
+			TW->write_errors++;
+		}
+
+		// The size of the segment is checked only between two writev() calls, so that the records of a binary trace,
+		// which depend on the previous ones, are never split between two segments
+		if(TW->rotate && TW->rot_size>0 && TW->seg_bytes>=TW->rot_size) {
+			tfileWriterRotate(TW);
+		}
+
+		head=ringLoadHead(TW);
+	}
+}
+
+// Send the first 'nmsg' datagrams prepared by tfileWriterDrainSocket(), taking care of partial sendmmsg() calls
+static void sendmmsgAll(tfileWriter TW,unsigned int nmsg) {
+	unsigned int sent=0;
+	int rval;
+
+	while(sent<nmsg) {
+		rval=sendmmsg(TW->fd,TW->msgs+sent,nmsg-sent,0);
+
+		if(rval<0) {
+			if(errno==EINTR) {
+				continue;
+			}
+			TW->write_errors+=nmsg-sent;
+			return;
+		}
+
+		sent+=rval;
+	}
+}
+
+// Fill the records of a text '-w' datagram, starting from the record in position 'tail'
+// The return value is the number of records which were written inside 'body'
+static unsigned int fillTextDatagram(tfileWriter TW,char *body,size_t *bodylen,uint64_t *tail,uint64_t head) {
+	struct tfileRecord *record;
+	unsigned int nrec=0;
+	int linelen;
+
+	while(*tail!=head) {
+		record=&(TW->ring[*tail & TW_RING_MASK]);
+
+		linelen=snprintTFileLine(body+*bodylen,TW_SOCK_BODY_SIZE-*bodylen,TW->decimal_digits,&(record->perPktData),&(record->extraData));
+
+		// The record does not fit in the current datagram: it will be formatted again inside the next one
+		// (a record which does not fit even inside an empty datagram is discarded)
+		if(linelen>=0 && (size_t) linelen>=TW_SOCK_BODY_SIZE-*bodylen && nrec>0) {
+			break;
+		}
+
+		if(linelen>0 && (size_t) linelen<TW_SOCK_BODY_SIZE-*bodylen) {
+			*bodylen+=linelen;
+			nrec++;
+		}
+
+		(*tail)++;
+	}
+
+	return nrec;
+}
+
+// Same as fillTextDatagram(), but for the binary framing defined in report_sock_binary.h
+static unsigned int fillBinaryDatagram(tfileWriter TW,char *body,size_t *bodylen,uint64_t *tail,uint64_t head) {
+	struct tfileRecord *record;
+	unsigned int nrec=0;
+
+	while(*tail!=head) {
+		record=&(TW->ring[*tail & TW_RING_MASK]);
+
+		// All the records of a test have the same size
+		TW->bin_record_size=reportSockBinaryRecordSize(record->perPktData.followup_on_flag,record->perPktData.enabled_extra_data);
+
+		if(*bodylen+TW->bin_record_size>TW_SOCK_BIN_BODY_SIZE) {
+			break;
+		}
+
+		*bodylen+=reportSockBinaryRecordEncode((uint8_t *) body+*bodylen,&(record->perPktData),&(record->extraData));
+		nrec++;
+
+		(*tail)++;
+	}
+
+	return nrec;
+}
+
+// Pack all the records currently stored in the ring buffer into '-w' datagrams, and send them
+// In the text mode, each datagram is made of a header line, 'LaTeB,<LaMP ID>,<datagram sequence number>,<number of records>',
+// followed by one line for each record, formatted exactly like a '-W' CSV line
+static void tfileWriterDrainSocket(tfileWriter TW) {
+	uint64_t head, tail;
+	unsigned int nmsg;
+	unsigned int nrec;
+	size_t bodylen;
+	int hdrlen;
+
+	tail=ringLoadTail(TW);
+	head=ringLoadHead(TW);
+
+	while(tail!=head) {
+		nmsg=0;
+
+		while(nmsg<TFILE_WRITER_SOCK_BATCH && tail!=head) {
+			char *body=TW->blocks+nmsg*MAX_w_UDP_SOCK_BUF_SIZE;
+			bodylen=0;
+
+			if(TW->binary) {
+				nrec=fillBinaryDatagram(TW,body,&bodylen,&tail,head);
+			} else {
+				nrec=fillTextDatagram(TW,body,&bodylen,&tail,head);
+			}
+
+			if(nrec==0) {
+				continue;
+			}
+
+			if(TW->binary) {
+				hdrlen=reportSockBinaryHeaderEncode((uint8_t *) TW->msg_hdr[nmsg],TW->test_id,TW->dgram_seq,nrec,TW->bin_record_size);
+			} else {
+				hdrlen=snprintf(TW->msg_hdr[nmsg],TFILE_WRITER_SOCK_HDR_SIZE,"LaTeB,%" PRIu16 ",%" PRIu64 ",%u\n",TW->test_id,TW->dgram_seq,nrec);
+			}
+
+			TW->msg_iov[nmsg][0].iov_len=hdrlen;
+			TW->msg_iov[nmsg][1].iov_base=body;
+			TW->msg_iov[nmsg][1].iov_len=bodylen;
+			TW->dgram_seq++;
+			nmsg++;
+		}
+
+		// The records have already been formatted: their slots can be immediately released to the receive thread
+		ringStoreTail(TW,tail);
+
+		sendmmsgAll(TW,nmsg);
+
+		head=ringLoadHead(TW);
+	}
+}
+
+static void *tfileWriterLoop(void *arg) {
+	tfileWriter TW=(tfileWriter) arg;
+	struct pollfd unlockMon;
+	int stop=0;
+
+	unlockMon.fd=TW->unlock_pd[0];
+	unlockMon.events=POLLIN;
+
+	while(!stop) {
+		unlockMon.revents=0;
+
+		// Wait for 'poll_interval' ms, or until tfileWriterFree() is called
+		if(poll(&unlockMon,1,TW->poll_interval)>0 && unlockMon.revents>0) {
+			stop=1;
+		}
+
+		// Write the records which were pushed in the meanwhile (including the last ones, when terminating the thread)
+		if(TW->sock) {
+			tfileWriterDrainSocket(TW);
+		} else {
+			tfileWriterDrain(TW);
+		}
+
+		if(!stop && TW->rotate && TW->rot_interval>0) {
+			tfileWriterCheckInterval(TW);
+		}
+	}
+
+	pthread_exit(NULL);
+}
+
+// Free the memory allocated by tfileWriterInit() (the writer thread should not be running anymore)
+static void tfileWriterMemFree(tfileWriter TW) {
+	free(TW->ring);
+	free(TW->blocks);
+	free(TW->seg_basename);
+	free(TW->seg_extension);
+	free(TW->seg_name);
+	free(TW->next_name);
+	free(TW->hook_cmd);
+	free(TW);
+}
+
+// Allocate the ring buffer and start the writer thread
+// In case of error, the memory pointed by 'TW' is freed
+static tfileWriter tfileWriterStart(tfileWriter TW) {
+	TW->dropped=0;
+	TW->write_errors=0;
+
+	TW->ring=malloc(TFILE_WRITER_RING_SIZE*sizeof(struct tfileRecord));
+	TW->blocks=malloc(TFILE_WRITER_IOV_NUM*TFILE_WRITER_BLOCK_SIZE*sizeof(char));
+
+	if(!TW->ring || !TW->blocks) {
+		tfileWriterMemFree(TW);
+		return NULL;
+	}
+
+	#if TW_ATOMICS_SUPPORTED
+		atomic_init(&(TW->head),0);
+		atomic_init(&(TW->tail),0);
+	#else
+		TW->head=0;
+		TW->tail=0;
+		if(pthread_mutex_init(&(TW->ring_mut),NULL)!=0) {
+			tfileWriterMemFree(TW);
+			return NULL;
+		}
+	#endif
+
+	if(pipe(TW->unlock_pd)<0) {
+		#if !TW_ATOMICS_SUPPORTED
+			pthread_mutex_destroy(&(TW->ring_mut));
+		#endif
+		tfileWriterMemFree(TW);
+		return NULL;
+	}
+
+	if(pthread_create(&(TW->tid),NULL,&tfileWriterLoop,(void *) TW)!=0) {
+		close(TW->unlock_pd[0]);
+		close(TW->unlock_pd[1]);
+		#if !TW_ATOMICS_SUPPORTED
+			pthread_mutex_destroy(&(TW->ring_mut));
+		#endif
+		tfileWriterMemFree(TW);
+		return NULL;
+	}
+
+	return TW;
+}
+
+// Prepare the rotation of the '-W' file, opening the second segment in advance
+// In case of error, the memory pointed by 'TW' is not freed
+static int tfileWriterRotationInit(tfileWriter TW,tfileRotationParams *rotation) {
+	const char *slash;
+	const char *dot;
+
+	TW->rotate=1;
+	TW->rot_size=rotation->size;
+	TW->rot_interval=rotation->interval;
+	TW->rot_overwrite=rotation->overwrite;
+	TW->followup_on_flag=rotation->followup_on_flag;
+	TW->enabled_extra_data=rotation->enabled_extra_data;
+	TW->user_fd=TW->fd;
+	TW->seg_bytes=0;
+	TW->seg_has_records=0;
+	TW->segno=0;
+	TW->next_fd=-1;
+
+	TW->seg_name=strdup(rotation->filename);
+	if(!TW->seg_name) {
+		return -1;
+	}
+
+	// Split the name of the first segment into <base name>.<extension>
+	slash=strrchr(TW->seg_name,'/');
+	dot=strrchr(TW->seg_name,'.');
+	if(dot==NULL || (slash!=NULL && dot<slash)) {
+		dot=TW->seg_name+strlen(TW->seg_name);
+	}
+
+	TW->seg_basename=strndup(TW->seg_name,dot-TW->seg_name);
+	TW->seg_extension=strdup(dot);
+	if(!TW->seg_basename || !TW->seg_extension) {
+		return -1;
+	}
+
+	if(rotation->hook!=NULL) {
+		size_t hooklen=strlen(rotation->hook)+32;
+
+		TW->hook_cmd=malloc(hooklen*sizeof(char));
+		if(!TW->hook_cmd) {
+			return -1;
+		}
+
+		// The newline allows the hook command to end with a comment
+		snprintf(TW->hook_cmd,hooklen,"(%s\n) </dev/null &",rotation->hook);
+	}
+
+	if(TW->rot_interval>0) {
+		TW->rot_deadline=(time(NULL)/TW->rot_interval+1)*TW->rot_interval;
+	}
+
+	if(openNextSegment(TW)<0) {
+		fprintf(stderr,"Warning: cannot open the next '-W' file segment. A new attempt will be performed at the next rotation.\n");
+	}
+
+	return 0;
+}
+
+// Start a writer thread which will write to the file 'Tfiledescriptor' (previously opened with openTfile(), or with
+// openTfileNamed() when 'rotation' is not NULL)
+// If the writer is successfully started, it owns 'Tfiledescriptor', which is closed by tfileWriterFree(); otherwise, the
+// caller should still close it
+// If 'binaryHeader' is not NULL, the binary trace format is used, and the header record is immediately written to the file
+// If 'rotation' is not NULL, the file is rotated as described in tfileRotationParams
+tfileWriter tfileWriterInit(int Tfiledescriptor,int decimal_digits,tfileBinaryHeader *binaryHeader,tfileRotationParams *rotation) {
+	uint8_t binHdrBuf[TFILE_BIN_HDR_SIZE];
+	tfileWriter TW;
+
+	if(Tfiledescriptor<=0) {
+		return NULL;
+	}
+
+	TW=calloc(1,sizeof(struct _tfileWriter));
+	if(CHECK_TW_NULL(TW)) {
+		return NULL;
+	}
+
+	TW->fd=Tfiledescriptor;
+	TW->decimal_digits=decimal_digits;
+	TW->poll_interval=TFILE_WRITER_POLL_INTERVAL;
+	TW->sinkname="'-W' file";
+	TW->binary=binaryHeader!=NULL;
+	TW->sock=0;
+	TW->next_fd=-1;
+
+	if(TW->binary) {
+		TW->binHeader=*binaryHeader;
+		tfileBinaryHeaderEncode(binHdrBuf,binaryHeader,&(TW->binState));
+		if(write(Tfiledescriptor,binHdrBuf,TFILE_BIN_HDR_SIZE)!=TFILE_BIN_HDR_SIZE) {
+			free(TW);
+			return NULL;
+		}
+	}
+
+	if(rotation!=NULL && rotation->filename!=NULL && tfileWriterRotationInit(TW,rotation)<0) {
+		if(TW->next_fd>=0) {
+			close(TW->next_fd);
+			unlink(TW->next_name);
+		}
+		tfileWriterMemFree(TW);
+		return NULL;
+	}
+
+	return tfileWriterStart(TW);
+}
+
+// Start a writer thread which will send the records, packed inside multi-record datagrams, through the '-w' UDP socket
+// 'sockfd', towards 'addrto' (batched '-w' mode)
+// If 'binary' is = 1, the binary framing defined in report_sock_binary.h is used instead of the text one
+// The datagram sequence number starts from 0 every time this function is called
+tfileWriter tfileWriterInitSocket(int sockfd,struct sockaddr_in *addrto,int decimal_digits,uint16_t test_id,uint8_t binary) {
+	tfileWriter TW;
+
+	if(sockfd<=0 || addrto==NULL) {
+		return NULL;
+	}
+
+	TW=calloc(1,sizeof(struct _tfileWriter));
+	if(CHECK_TW_NULL(TW)) {
+		return NULL;
+	}
+
+	TW->fd=sockfd;
+	TW->decimal_digits=decimal_digits;
+	TW->poll_interval=TFILE_WRITER_SOCK_DEADLINE;
+	TW->sinkname="'-w' socket";
+	TW->next_fd=-1;
+	TW->binary=binary;
+	TW->bin_record_size=0;
+	TW->sock=1;
+	TW->addrto=*addrto;
+	TW->test_id=test_id;
+	TW->dgram_seq=0;
+
+	// The destination address and the header buffers never change between different datagrams: they can be set once here
+	for(int i=0;i<TFILE_WRITER_SOCK_BATCH;i++) {
+		TW->msg_iov[i][0].iov_base=TW->msg_hdr[i];
+		TW->msgs[i].msg_hdr.msg_name=&(TW->addrto);
+		TW->msgs[i].msg_hdr.msg_namelen=sizeof(TW->addrto);
+		TW->msgs[i].msg_hdr.msg_iov=TW->msg_iov[i];
+		TW->msgs[i].msg_hdr.msg_iovlen=2;
+	}
+
+	return tfileWriterStart(TW);
+}
+
+// Push the data related to the current packet to the writer thread
+// This function never blocks: if the ring buffer is full, the record is dropped and -1 is returned
+// When printing additional data with -X, this function shall always be called after updating the report with "reportStructureUpdate()"
+int tfileWriterPush(tfileWriter TW,perPackerDataStructure *perPktData) {
+	struct tfileRecord *record;
+	uint64_t head, tail;
+
+	#if TW_ATOMICS_SUPPORTED
+		// Only this thread writes 'head'
+		head=atomic_load_explicit(&(TW->head),memory_order_relaxed);
+	#else
+		head=ringLoadHead(TW);
+	#endif
+	tail=ringLoadTail(TW);
+
+	if(head-tail>=TFILE_WRITER_RING_SIZE) {
+		TW->dropped++;
+		return -1;
+	}
+
+	record=&(TW->ring[head & TW_RING_MASK]);
+	record->perPktData=*perPktData;
+	perPacketExtraDataGet(perPktData,&(record->extraData));
+
+	ringStoreHead(TW,head+1);
+
+	return 0;
+}
+
+// Close the last segment and remove the one which was opened in advance
+// The last segment is removed as well if it does not contain any record (unless it is the first one); otherwise, the hook
+// command is run on it after it has been closed, as for all the other segments
+static void tfileWriterRotationEnd(tfileWriter TW) {
+	if(TW->next_fd>=0) {
+		close(TW->next_fd);
+		unlink(TW->next_name);
+	}
+
+	if(!TW->seg_has_records && TW->fd!=TW->user_fd) {
+		close(TW->fd);
+		unlink(TW->seg_name);
+	} else {
+		closeSegment(TW,TW->fd,TW->seg_name);
+	}
+
+	if(TW->rotate_errors>0) {
+		fprintf(stderr,"Warning: %" PRIu64 " errors occurred when rotating the %s, or when running the rotation command.\n",TW->rotate_errors,TW->sinkname);
+	}
+}
+
+// Write all the pending records, terminate the writer thread and close the '-W' file (or its last segment, when rotating
+// it), which should thus not be closed again by the caller
+// The '-w' socket of a writer started with tfileWriterInitSocket() is instead left open
+void tfileWriterFree(tfileWriter TW) {
+	if(CHECK_TW_NULL(TW)) {
+		return;
+	}
+
+	// Write a single byte to the unlock_pd pipe to unlock the thread, to gracefully terminate it
+	if(write(TW->unlock_pd[1],"\0",1)<0) {
+		fprintf(stderr,"Warning: could not gracefully terminate the per-packet data writer thread.\n"
+			"Its termination will be forced and some data may not be written to the %s.\n",TW->sinkname);
+		pthread_cancel(TW->tid);
+	}
+
+	pthread_join(TW->tid,NULL);
+
+	close(TW->unlock_pd[0]);
+	close(TW->unlock_pd[1]);
+
+	if(TW->dropped>0) {
+		fprintf(stderr,"Warning: %" PRIu64 " per-packet records were not written to the %s,\n"
+			"as the writer could not keep up with the received packets.\n",TW->dropped,TW->sinkname);
+	}
+
+	if(TW->write_errors>0) {
+		fprintf(stderr,"Warning: %" PRIu64 " errors occurred when writing to the %s.\n",TW->write_errors,TW->sinkname);
+	}
+
+	if(TW->rotate) {
+		tfileWriterRotationEnd(TW);
+	} else if(!TW->sock) {
+		close(TW->fd);
+	}
+
+	#if !TW_ATOMICS_SUPPORTED
+		pthread_mutex_destroy(&(TW->ring_mut));
+	#endif
+
+	tfileWriterMemFree(TW);
+}
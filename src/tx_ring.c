@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <net/ethernet.h>
+#include <linux/net_tstamp.h>
+#include "tx_ring.h"
+#include "common_udp.h"
+#include "ipcsum_alth.h"
+
+// Maximum time, in ms, txRingGetFrame() waits for a slot to be released by the kernel
+#define TX_RING_SLOT_WAIT_TIMEOUT 1000
+
+struct _txRing {
+	int fd; // AF_PACKET socket with the TPACKET_V2 tx ring (never bound, thus it does not receive any packet)
+	struct sockaddr_ll addrll;
+
+	byte_t *map;
+	size_t map_len;
+
+	unsigned int idx; // Next slot to be written
+	unsigned int pending; // Number of frames written in the ring since the last kick
+	unsigned int batch;
+};
+
+static inline struct tpacket2_hdr *txRingSlot(txRing TR, unsigned int idx) {
+	return (struct tpacket2_hdr *) (TR->map+(size_t) idx*TX_RING_FRAME_SIZE);
+}
+
+txRing txRingInit(const char *devname, int ctl_fd, struct sockaddr_ll addrll, unsigned int batch, uint8_t qdisc_bypass, uint8_t tx_timestamps) {
+	txRing TR;
+	struct tpacket_req req;
+	int version=TPACKET_V2;
+	int one=1;
+	int priority;
+	int tstamp_flags=0;
+	socklen_t optlen=sizeof(priority);
+
+	TR=calloc(1,sizeof(struct _txRing));
+	if(CHECK_TR_NULL(TR)) {
+		fprintf(stderr,"TX ring: cannot allocate memory.\n");
+		return NULL;
+	}
+
+	TR->addrll=addrll;
+	TR->batch=batch>0 ? batch : 1;
+
+	TR->fd=socket(AF_PACKET,SOCK_RAW,0);
+	if(TR->fd<0) {
+		fprintf(stderr,"TX ring: cannot open the AF_PACKET socket: %s.\n",strerror(errno));
+		free(TR);
+		return NULL;
+	}
+
+	if(setsockopt(TR->fd,SOL_PACKET,PACKET_VERSION,&version,sizeof(version))<0) {
+		fprintf(stderr,"TX ring: TPACKET_V2 is not supported: %s.\n",strerror(errno));
+		txRingFree(TR);
+		return NULL;
+	}
+
+	if(qdisc_bypass && setsockopt(TR->fd,SOL_PACKET,PACKET_QDISC_BYPASS,&one,sizeof(one))<0) {
+		fprintf(stderr,"TX ring: cannot bypass the qdisc layer: %s.\n",strerror(errno));
+		txRingFree(TR);
+		return NULL;
+	}
+
+	// Use the same user priority as the companion socket (-A)
+	if(getsockopt(ctl_fd,SOL_SOCKET,SO_PRIORITY,&priority,&optlen)==0 && priority!=0) {
+		setsockopt(TR->fd,SOL_SOCKET,SO_PRIORITY,&priority,sizeof(priority));
+	}
+
+	if(tx_timestamps==TX_RING_TSTAMP_HW) {
+		tstamp_flags=SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+	} else if(tx_timestamps==TX_RING_TSTAMP_SW) {
+		tstamp_flags=SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	}
+
+	if(tstamp_flags!=0 && setsockopt(TR->fd,SOL_SOCKET,SO_TIMESTAMPING,&tstamp_flags,sizeof(tstamp_flags))<0) {
+		fprintf(stderr,"TX ring: cannot enable the transmit timestamps: %s.\n",strerror(errno));
+		txRingFree(TR);
+		return NULL;
+	}
+
+	memset(&req,0,sizeof(req));
+	req.tp_block_size=TX_RING_FRAME_SIZE*TX_RING_FRAME_NR;
+	req.tp_block_nr=1;
+	req.tp_frame_size=TX_RING_FRAME_SIZE;
+	req.tp_frame_nr=TX_RING_FRAME_NR;
+
+	if(setsockopt(TR->fd,SOL_PACKET,PACKET_TX_RING,&req,sizeof(req))<0) {
+		fprintf(stderr,"TX ring: cannot set up the ring on %s: %s.\n",devname,strerror(errno));
+		txRingFree(TR);
+		return NULL;
+	}
+
+	TR->map_len=(size_t) TX_RING_FRAME_SIZE*TX_RING_FRAME_NR;
+	TR->map=mmap(NULL,TR->map_len,PROT_READ | PROT_WRITE,MAP_SHARED,TR->fd,0);
+	if(TR->map==MAP_FAILED) {
+		fprintf(stderr,"TX ring: cannot map the ring: %s.\n",strerror(errno));
+		TR->map=NULL;
+		txRingFree(TR);
+		return NULL;
+	}
+
+	return TR;
+}
+
+// Get the data area of the next slot of the ring, where the next frame (of at most TX_RING_MAX_FRAME_LEN bytes) should be
+// built before calling txRingLampSend(); NULL is returned (with errno set to ENOBUFS) if the kernel does not release the slot in time
+byte_t *txRingGetFrame(txRing TR) {
+	struct tpacket2_hdr *slot=txRingSlot(TR,TR->idx);
+	struct pollfd pfd;
+	int poll_ret;
+
+	pfd.fd=TR->fd;
+	pfd.events=POLLOUT;
+
+	// A slot with a malformed frame is just reused
+	while(__atomic_load_n(&(slot->tp_status),__ATOMIC_ACQUIRE) & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) {
+		poll_ret=poll(&pfd,1,TX_RING_SLOT_WAIT_TIMEOUT);
+
+		if(poll_ret==0) {
+			errno=ENOBUFS;
+			return NULL;
+		} else if(poll_ret<0 && errno!=EINTR) {
+			return NULL;
+		}
+	}
+
+	return (byte_t *) slot+TX_RING_DATA_OFFSET;
+}
+
+// Build a whole LaMP frame (Ethernet, IPv4, UDP and LaMP headers, followed by 'payloadlen' bytes of 'payload', if any) directly
+// inside 'frame', i.e. inside the slot returned by txRingGetFrame(), starting from the headers populated with the raw header builders
+// The UDP checksum and the LaMP timestamp are set later, by txRingFlush()
+// Return the size of the frame, or 0 (with errno set to EMSGSIZE) if it does not fit inside a slot
+size_t txRingLampFrameBuild(byte_t *frame, struct pktheaders_udp *headers, byte_t *payload, size_t payloadlen) {
+	struct iphdr *ipHeader=(struct iphdr *) (frame+sizeof(struct ether_header));
+	struct udphdr *udpHeader=(struct udphdr *) (frame+sizeof(struct ether_header)+sizeof(struct iphdr));
+	byte_t *lampPacket=frame+sizeof(struct ether_header)+sizeof(struct iphdr)+sizeof(struct udphdr);
+	size_t lampPacketSize=LAMP_HDR_PAYLOAD_SIZE(payloadlen);
+
+	if(ETH_IP_UDP_PACKET_SIZE_S(lampPacketSize)>TX_RING_MAX_FRAME_LEN) {
+		errno=EMSGSIZE;
+		return 0;
+	}
+
+	memcpy(frame,&(headers->etherHeader),sizeof(struct ether_header));
+
+	memcpy(ipHeader,&(headers->ipHeader),sizeof(struct iphdr));
+	ipHeader->tot_len=htons(IP_UDP_PACKET_SIZE_S(lampPacketSize));
+	ipHeader->check=0;
+	ipHeader->check=ip_fast_csum((__u8 *)ipHeader, ipHeader->ihl);
+
+	memcpy(udpHeader,&(headers->udpHeader),sizeof(struct udphdr));
+	udpHeader->len=htons(UDP_PACKET_SIZE_S(lampPacketSize));
+	udpHeader->check=0;
+
+	if(payloadlen!=0) {
+		lampEncapsulate(lampPacket, &(headers->lampHeader), payload, payloadlen);
+	} else {
+		memcpy(lampPacket,&(headers->lampHeader),LAMP_HDR_SIZE());
+	}
+
+	return ETH_IP_UDP_PACKET_SIZE_S(lampPacketSize);
+}
+
+// Set the timestamp of the LaMP packet inside a slot written by txRingLampSend() (for requests and unidirectional packets only,
+// as replies should carry the client timestamp) and recompute the UDP checksum
+static void txRingSlotStamp(struct tpacket2_hdr *slot) {
+	struct iphdr *ipHeader=(struct iphdr *) ((byte_t *) slot+TX_RING_DATA_OFFSET+sizeof(struct ether_header));
+	struct udphdr *udpHeader=(struct udphdr *) ((byte_t *) ipHeader+ipHeader->ihl*4);
+	struct lamphdr *inpacket_lamphdr=(struct lamphdr *) ((byte_t *) udpHeader+sizeof(struct udphdr));
+
+	if(inpacket_lamphdr->ctrl==CTRL_PINGLIKE_REQ || inpacket_lamphdr->ctrl==CTRL_PINGLIKE_ENDREQ ||
+		inpacket_lamphdr->ctrl==CTRL_UNIDIR_CONTINUE || inpacket_lamphdr->ctrl==CTRL_UNIDIR_STOP) {
+		lampHeadSetTimestamp(inpacket_lamphdr,NULL);
+	}
+
+	udpHeader->check=0;
+	udpHeader->check=rawUDPChecksum(ipHeader,udpHeader,ntohs(udpHeader->len));
+}
+
+// Hand all the frames written since the last kick to the kernel
+// Each frame is timestamped only now, just before the kick, so that the time spent in the ring waiting for the rest of the
+// batch is not included in the measured latency
+// Return the number of frames which have been handed to the kernel, or -1 if the kick failed
+int txRingFlush(txRing TR) {
+	int flushed=TR->pending;
+	struct tpacket2_hdr *slot;
+
+	if(TR->pending==0) {
+		return 0;
+	}
+
+	for(unsigned int i=TR->pending;i>0;i--) {
+		slot=txRingSlot(TR,(TR->idx+TX_RING_FRAME_NR-i)%TX_RING_FRAME_NR);
+
+		txRingSlotStamp(slot);
+		__atomic_store_n(&(slot->tp_status),TP_STATUS_SEND_REQUEST,__ATOMIC_RELEASE);
+	}
+
+	TR->pending=0;
+
+	if(sendto(TR->fd,NULL,0,MSG_DONTWAIT,(struct sockaddr *) &(TR->addrll),sizeof(TR->addrll))<0) {
+		return -1;
+	}
+
+	return flushed;
+}
+
+// Same as rawLampSend() (UDP only), but using the ring: 'frame' should be the slot returned by the last txRingGetFrame() call,
+// and 'inpacket_lamphdr' should point to the LaMP header inside it
+// The frame is handed to the kernel (and timestamped, see txRingFlush()) together with the other ones of its batch, or immediately
+// when 'flag' is FLG_STOP
+// Return the number of frames handed to the kernel by this call (0 if the batch is not complete yet), or -1 on error
+int txRingLampSend(txRing TR, struct lamphdr *inpacket_lamphdr, byte_t *frame, size_t len, endflag_t flag) {
+	struct tpacket2_hdr *slot=txRingSlot(TR,TR->idx);
+	struct iphdr *ipHeader=(struct iphdr *) (frame+sizeof(struct ether_header));
+	struct udphdr *udpHeader;
+	size_t udplen;
+
+	if(frame!=(byte_t *) slot+TX_RING_DATA_OFFSET || len>TX_RING_MAX_FRAME_LEN) {
+		errno=EMSGSIZE;
+		return -1;
+	}
+
+	if(len<sizeof(struct ether_header)+sizeof(struct iphdr)+sizeof(struct udphdr)) {
+		errno=EINVAL;
+		return -1;
+	}
+
+	udpHeader=(struct udphdr *) ((byte_t *) ipHeader+ipHeader->ihl*4);
+	udplen=ntohs(udpHeader->len);
+
+	if(udplen<sizeof(struct udphdr)+LAMP_HDR_SIZE() || (byte_t *) udpHeader+udplen>frame+len ||
+		(byte_t *) inpacket_lamphdr!=(byte_t *) udpHeader+sizeof(struct udphdr)) {
+		errno=EINVAL;
+		return -1;
+	}
+
+	// Mark the last packet of the session
+	if(flag==FLG_STOP) {
+		if(inpacket_lamphdr->ctrl==CTRL_UNIDIR_CONTINUE) {
+			lampSetUnidirStop(inpacket_lamphdr);
+		} else {
+			lampSetPinglikeEndreqAll(inpacket_lamphdr);
+		}
+	}
+
+	// The slot is left to user space (TP_STATUS_AVAILABLE) until the kick
+	slot->tp_len=len;
+
+	TR->idx=(TR->idx+1)%TX_RING_FRAME_NR;
+	TR->pending++;
+
+	if(TR->pending<TR->batch && flag!=FLG_STOP) {
+		return 0;
+	}
+
+	return txRingFlush(TR);
+}
+
+// Socket owning the ring: when transmit timestamps are enabled, they should be read from its error queue
+int txRingFd(txRing TR) {
+	return TR->fd;
+}
+
+void txRingFree(txRing TR) {
+	if(CHECK_TR_NULL(TR)) {
+		return;
+	}
+
+	// Do not leave any frame behind
+	if(TR->map) {
+		txRingFlush(TR);
+		munmap(TR->map,TR->map_len);
+	}
+
+	if(TR->fd>=0) close(TR->fd);
+
+	free(TR);
+}
@@ -7,6 +7,8 @@
 #include <pthread.h>
 #include "rawsock_lamp.h"
 #include "report_manager.h"
+#include "tfile_writer.h"
+#include "report_encoding.h"
 #include <inttypes.h>
 #include <errno.h>
 #include <linux/errqueue.h>
@@ -19,6 +21,7 @@
 // Local global variables
 static pthread_t txLoop_tid, rxLoop_tid, ackListenerInit_tid, initSender_tid, followupReplyListener_tid, followupRequestSender_tid;
 static uint16_t lamp_id_session;
+static uint16_t ext_flags_session=LAMP_EXT_FLAG_NONE; // LaMP extensions accepted by the server during the INIT procedure
 static reportStructure reportData;
 static carbonReportStructure carbonReportData;
 static int carbon_metrics_flush_first;
@@ -79,7 +82,9 @@ static void *ackListenerInit (void *arg) {
 	rcvData.session_id=lamp_id_session;
 
 	return_value=controlReceiverUDP(*sFd,&rcvData,ACK,&ack_init_received,&ack_init_received_mut);
-	if(return_value<0) {
+	if(return_value==0) {
+		ext_flags_session=rcvData.controlRCV.ext_flags;
+	} else if(return_value<0) {
 		if(return_value==-1) {
 			t_rx_error=ERR_INVALID_ARG_CMONUDP;
 		} else if(return_value==-2) {
@@ -124,7 +129,7 @@ static void *initSender (void *arg) {
 	arg_struct_udp *args=(arg_struct_udp *) arg;
 	int return_value;
 
-	return_value=controlSenderUDP(args,lamp_id_session,INIT_RETRY_MAX_ATTEMPTS,INIT,0,INIT_RETRY_INTERVAL_MS,&ack_init_received,&ack_init_received_mut);
+	return_value=controlSenderUDP(args,lamp_id_session,INIT_RETRY_MAX_ATTEMPTS,INIT,args->opts->ext_seq_enabled ? LAMP_EXT_FLAG_EXTSEQ : LAMP_EXT_FLAG_NONE,INIT_RETRY_INTERVAL_MS,&ack_init_received,&ack_init_received_mut);
 
 	if(return_value<0) {
 		if(return_value==-1) {
@@ -424,6 +429,11 @@ static void txLoop (arg_struct_udp *args) {
 
 			// Encapsulate LaMP payload only if it is available
 			if(args->opts->payloadlen!=0) {
+				// Write the extended sequence number in the first bytes of the payload, if its usage was accepted by the server
+				if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+					lampExtSeqWrite(payload_buff,counter);
+				}
+
 				lampEncapsulate(lampPacket, &lampHeader, payload_buff, args->opts->payloadlen);
 				// Set timestamp
 				lampHeadSetTimestamp((struct lamphdr *)lampPacket,NULL);
@@ -509,6 +519,10 @@ static void *rxLoop_t (void *arg) {
 	arg_struct_udp *args=(arg_struct_udp *) arg;
 
 	int Wfiledescriptor=-1;
+	tfileWriter Wwriter=NULL; // Asynchronous writer for the per-packet data, when '-W' is specified
+	tfileBinaryHeader Wbinheader;
+	tfileRotationParams Wrotation;
+	char *Wfilename_opened=NULL; // Name of the -W file which was actually opened (needed to name the next segments when rotating the file)
 
 	// Packet buffer with size = maximum LaMP packet length
 	byte_t lampPacket[MAX_LAMP_LEN + LAMP_HDR_SIZE()];
@@ -537,6 +551,7 @@ static void *rxLoop_t (void *arg) {
 	uint16_t lamp_id_rx;
 	uint16_t lamp_seq_rx=0; 
 	uint16_t lamp_payloadlen_rx;
+	uint64_t lamp_extseq_rx=INITIAL_SEQ_NO; // Full width sequence number (used only when extended sequence numbers are in use)
 
 	// SO_TIMESTAMP variables and structs (cmsg)
 	struct msghdr mhdr;
@@ -610,9 +625,45 @@ static void *rxLoop_t (void *arg) {
 
 	// Open CSV file when in "-W" mode (i.e. "write every packet measurement data to CSV file")
 	if(args->opts->Wfilename!=NULL) {
-		Wfiledescriptor=openTfile(args->opts->Wfilename,args->opts->overwrite_W,args->opts->followup_mode!=FOLLOWUP_OFF,args->opts->report_extra_data);
+		Wfiledescriptor=openTfileNamed(args->opts->Wfilename,args->opts->overwrite_W,args->opts->followup_mode!=FOLLOWUP_OFF,args->opts->report_extra_data,args->opts->W_binary,&Wfilename_opened);
 		if(Wfiledescriptor<0) {
 			fprintf(stderr,"Warning! Cannot open file for writing single packet latency data.\nThe '-W' option will be disabled.\n");
+		} else {
+			// Start the writer thread: from now on, no system call will be performed on the receive path to write the per-packet data
+			// Describe the current test in the header of the binary trace, when --report-perpacket-binary is specified
+			if(args->opts->W_binary) {
+				Wbinheader.lamp_id=lamp_id_session;
+				Wbinheader.latency_type=args->opts->latencyType;
+				Wbinheader.followup_on_flag=args->opts->followup_mode!=FOLLOWUP_OFF;
+				Wbinheader.enabled_extra_data=args->opts->report_extra_data;
+				Wbinheader.side=TFILE_BIN_SIDE_CLIENT;
+				Wbinheader.decimal_digits=W_DECIMAL_DIGITS;
+			}
+
+			// Rotate the file by size and/or by wall-clock interval, when --report-perpacket-rotate-size/interval are specified
+			if(args->opts->W_rotate_size>0 || args->opts->W_rotate_interval>0) {
+				Wrotation.size=args->opts->W_rotate_size;
+				Wrotation.interval=args->opts->W_rotate_interval;
+				Wrotation.hook=args->opts->W_rotate_hook;
+				Wrotation.filename=Wfilename_opened;
+				Wrotation.overwrite=args->opts->overwrite_W;
+				Wrotation.followup_on_flag=args->opts->followup_mode!=FOLLOWUP_OFF;
+				Wrotation.enabled_extra_data=args->opts->report_extra_data;
+			}
+
+			Wwriter=tfileWriterInit(Wfiledescriptor,W_DECIMAL_DIGITS,args->opts->W_binary ? &Wbinheader : NULL,
+				(args->opts->W_rotate_size>0 || args->opts->W_rotate_interval>0) && Wfilename_opened!=NULL ? &Wrotation : NULL);
+			if(CHECK_TW_NULL(Wwriter)) {
+				fprintf(stderr,"Warning! Cannot start the thread writing single packet latency data.\nThe '-W' option will be disabled.\n");
+				closeTfile(Wfiledescriptor);
+				Wfiledescriptor=-1;
+			}
+
+			// The writer keeps its own copy of the file name
+			if(Wfilename_opened!=NULL) {
+				free(Wfilename_opened);
+				Wfilename_opened=NULL;
+			}
 		}
 	}
 
@@ -661,6 +712,17 @@ static void *rxLoop_t (void *arg) {
 			continue;
 		}
 
+		// Get the full width sequence number, when extended sequence numbers are in use
+		// Follow-up data packets do not carry any payload: their extended sequence number is obtained by expanding
+		// the 16 bit one, starting from the last extended sequence number received in a reply
+		if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+			if(lamp_payloadlen_rx>=LAMP_EXTSEQ_SIZE && rcv_bytes>=LAMP_HDR_PAYLOAD_SIZE(LAMP_EXTSEQ_SIZE)) {
+				lamp_extseq_rx=lampExtSeqRead(lampPacket+LAMP_HDR_SIZE());
+			} else {
+				lamp_extseq_rx=lampExtSeqExpand(lamp_extseq_rx,lamp_seq_rx);
+			}
+		}
+
 		// The client is not expected to receive any FOLLOWUP_CTRL at this point!
 		if(lamp_type_rx==FOLLOWUP_CTRL) {
 			continue;
@@ -774,12 +836,16 @@ static void *rxLoop_t (void *arg) {
 				}
 			}
 
-			// Update the current report structure
-			reportStructureUpdate(&reportData,tripTime,lamp_seq_rx);
+			// Update the current report structure (using the full width sequence number, when available)
+			if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+				reportStructureUpdateExt(&reportData,tripTime,lamp_extseq_rx);
+			} else {
+				reportStructureUpdate(&reportData,tripTime,lamp_seq_rx);
+			}
 
 			// In "-W" mode, write the current measured value to the specified CSV file too (if a file was successfully opened)
 			if(Wfiledescriptor>0 || args->opts->udp_params.enabled) {
-				perPktData.seqNo=lamp_seq_rx;
+				perPktData.seqNo=(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) ? lamp_extseq_rx : lamp_seq_rx;
 				perPktData.signedTripTime=tripTime;
 				perPktData.tripTimeProc=tripTimeProc;
 
@@ -790,7 +856,7 @@ static void *rxLoop_t (void *arg) {
 				perPktData.tx_timestamp=tx_timestamp;
 
 				if(Wfiledescriptor>0) {
-					writeToTFile(Wfiledescriptor,W_DECIMAL_DIGITS,&perPktData);
+					tfileWriterPush(Wwriter,&perPktData);
 				}
 
 				if(args->opts->udp_params.enabled) {
@@ -809,9 +875,11 @@ static void *rxLoop_t (void *arg) {
 					}
 				}
 
-				carbon_pthread_mutex_lock(ctd);
-				carbonReportStructureUpdate(&carbonReportData,tripTime,lamp_seq_rx,args->opts->dup_detect_enabled);
-				carbon_pthread_mutex_unlock(ctd);
+				if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+					carbonReportStructureUpdateExt(&carbonReportData,tripTime,lamp_extseq_rx,args->opts->dup_detect_enabled);
+				} else {
+					carbonReportStructureUpdate(&carbonReportData,tripTime,lamp_seq_rx,args->opts->dup_detect_enabled);
+				}
 			}
 
 
@@ -826,7 +894,8 @@ static void *rxLoop_t (void *arg) {
 	} while(continueFlag || fu_flag);
 
 	if(Wfiledescriptor>0) {
-		closeTfile(Wfiledescriptor);
+		// The '-W' file is closed by the writer
+		tfileWriterFree(Wwriter);
 	}
 
 	if(!CHECK_SL_NULL(txstampslist)) {
@@ -854,6 +923,16 @@ static void unidirRxTxLoop (arg_struct_udp *args) {
 
 	ssize_t rcv_bytes;
 
+	// Reassembly structure for the (possibly fragmented) binary report
+	reportReasm reportRA;
+	int reasm_retval;
+
+	reportRA=reportReasm_init();
+	if(CHECK_REASM_NULL(reportRA)) {
+		t_rx_error=ERR_MALLOC;
+		return;
+	}
+
 	/* --------------------------- Rx part --------------------------- */
 
 	// There's no real loop now, just wait for a correct report and send ACK
@@ -881,21 +960,37 @@ static void unidirRxTxLoop (arg_struct_udp *args) {
 		lampHeadGetData(lampPacket, &lamp_type_rx, &lamp_id_rx, &lamp_seq_rx, &lamp_payloadlen_rx, NULL, NULL);
 
 		// Discard any LaMP packet which is not of interest
-		if(lamp_id_rx!=lamp_id_session || lamp_type_rx!=REPORT) {
+		if(lamp_id_rx!=lamp_id_session || lamp_type_rx!=REPORT || rcv_bytes<LAMP_HDR_PAYLOAD_SIZE(lamp_payloadlen_rx)) {
+			continue;
+		}
+
+		// Each REPORT packet carries a fragment of the binary encoded report: go on only when all the fragments have been received
+		reasm_retval=reportReasm_add(reportRA,lampPayloadPtr,lamp_payloadlen_rx);
+		if(reasm_retval==REPORT_REASM_INCOMPLETE) {
+			continue;
+		} else if(reasm_retval<0) {
+			fprintf(stderr,"Warning: discarded an invalid report fragment (%s).\n",reportEncErrStr(reasm_retval));
+			continue;
+		}
+
+		// If, finally, the full report has been received, parse it and send ACK
+		// Total packets is known to the client only, in this implementation, and it is already set thanks to reportStructureInit(), which
+		// is setting it to 'opts->number' (it is not overwritten by reportReasm_decode())
+		reasm_retval=reportReasm_decode(reportRA,&reportData);
+		if(reasm_retval!=REPORT_ENC_NOERR) {
+			// The server will retransmit the whole report until an ACK is received
+			fprintf(stderr,"Warning: the received report is not valid (%s). Waiting for a retransmission.\n",reportEncErrStr(reasm_retval));
+			reportReasm_reset(reportRA);
 			continue;
 		}
 
-		// If, finally, the packet is a report one, parse the report structure and send ACK
 		break;
 	}
 
-	if(timeoutFlag==0) {
-		/* --------------------------- Tx and report parsing part --------------------------- */
+	reportReasm_free(reportRA);
 
-		// Parse report structure (for now, it is encoded as a string for conveniency)
-		// Total packets is known to the client only, in this implementation, and it is already set thanks to reportStructureInit(), which
-		// is setting it to 'opts->number'
-		repscanf((const char *)lampPayloadPtr,&reportData);
+	if(timeoutFlag==0) {
+		/* --------------------------- Tx part --------------------------- */
 
 		if(controlSenderUDP(args,lamp_id_session,1,ACK,0,0,NULL,NULL)<0) {
 			fprintf(stderr,"Failed sending ACK.\n");
@@ -1018,6 +1113,15 @@ unsigned int runUDPclient(struct lampsock_data sData, struct options *opts) {
 	pthread_join(ackListenerInit_tid,NULL);
 
 	if(t_tx_error==NO_ERR && t_rx_error==NO_ERR) {
+		// Check whether the extended sequence numbers, if requested, were accepted by the server
+		if(opts->ext_seq_enabled) {
+			if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+				fprintf(stdout,"The server accepted the usage of extended (64 bit) sequence numbers.\n");
+			} else {
+				fprintf(stderr,"Warning: the server does not support extended sequence numbers.\n\tFalling back to 16 bit LaMP sequence numbers.\n");
+			}
+		}
+
 		if(opts->followup_mode!=FOLLOWUP_OFF) {
 			// If the user has requested the follow-up mode, start the FOLLOWUP request/reply procedure
 			// The client will send a request to the server, which will should "ACCEPT" if it supports
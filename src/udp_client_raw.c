@@ -8,6 +8,8 @@
 #include <pthread.h>
 #include "rawsock_lamp.h"
 #include "report_manager.h"
+#include "tfile_writer.h"
+#include "report_encoding.h"
 #include <inttypes.h>
 #include <errno.h>
 #include <linux/errqueue.h>
@@ -16,14 +18,21 @@
 #include "common_thread.h"
 #include "timer_man.h"
 #include "common_udp.h"
+#include "xdp_sock.h"
+#include "rx_ring.h"
+#include "tx_ring.h"
 
 // Local global variables
 static pthread_t txLoop_tid, rxLoop_tid, ackListenerInit_tid, initSender_tid, followupReplyListener_tid, followupRequestSender_tid;
 static uint16_t lamp_id_session;
+static uint16_t ext_flags_session=LAMP_EXT_FLAG_NONE; // LaMP extensions accepted by the server during the INIT procedure
 static reportStructure reportData;
 static carbonReportStructure carbonReportData;
 static int carbon_metrics_flush_first;
 static carbon_pthread_data_t ctd;
+static xdpSock xsk_session=NULL; // AF_XDP socket used to send the requests and to receive the replies, when --xdp is specified
+static rxRing rxring_session=NULL; // TPACKET_V3 ring used to receive the replies, when --rx-ring is specified
+static txRing txring_session=NULL; // PACKET_TX_RING used to send the requests, when --tx-ring is specified
 
 // Transmit error container
 static t_error_types t_tx_error=NO_ERR;
@@ -81,7 +90,9 @@ static void *ackListenerInit (void *arg) {
 	rcvData.session_id=lamp_id_session;
 
 	return_value=controlReceiverUDP_RAW(args->sData.descriptor,CLIENT_SRCPORT,args->srcIP.s_addr,&rcvData,ACK,&ack_init_received,&ack_init_received_mut);
-	if(return_value<0) {
+	if(return_value==0) {
+		ext_flags_session=rcvData.controlRCV.ext_flags;
+	} else if(return_value<0) {
 		if(return_value==-1) {
 			t_rx_error=ERR_INVALID_ARG_CMONUDP;
 		} else if(return_value==-2) {
@@ -106,7 +117,7 @@ static void *initSender (void *arg) {
 	initData.controlRCV.session_id=lamp_id_session;
 	memcpy(initData.controlRCV.mac,args->opts->destmacaddr,ETHER_ADDR_LEN);
 
-	return_value=controlSenderUDP_RAW(args,&initData,lamp_id_session,INIT_RETRY_MAX_ATTEMPTS, INIT, 0, INIT_RETRY_INTERVAL_MS, &ack_init_received, &ack_init_received_mut);
+	return_value=controlSenderUDP_RAW(args,&initData,lamp_id_session,INIT_RETRY_MAX_ATTEMPTS, INIT, args->opts->ext_seq_enabled ? LAMP_EXT_FLAG_EXTSEQ : LAMP_EXT_FLAG_NONE, INIT_RETRY_INTERVAL_MS, &ack_init_received, &ack_init_received_mut);
 	if(return_value<0) {
 		if(return_value==-1) {
 			t_tx_error=ERR_INVALID_ARG_CMONUDP;
@@ -220,6 +231,11 @@ static void txLoop (arg_struct *args) {
 	unsigned int id=START_ID;
 	// "in packet" LaMP header pointer
 	struct lamphdr *inpacket_lamphdr;
+	// Frame which is being sent: 'buffers.ethernetpacket', or the current slot of the ring, when --tx-ring is specified
+	byte_t *txframe;
+	int send_err;
+	// Number of frames handed to the kernel by the last send (with --tx-ring, 0 when the current batch is not complete yet)
+	int tx_flushed=1;
 
 	// Timer management variables
 	struct pollfd timerMon[2];
@@ -240,6 +256,7 @@ static void txLoop (arg_struct *args) {
 	// while loop counters
 	unsigned int counter=0;
 	unsigned int batch_counter=0;
+	unsigned int ts_seq;
 
 	// Final packet size
 	size_t finalpktsize;
@@ -269,6 +286,8 @@ static void txLoop (arg_struct *args) {
 
 	// recvfrom variable (for HARDWARE/SOFTWARE mode only)
 	ssize_t rcv_bytes;
+	// Socket whose error queue carries the tx timestamps (for HARDWARE/SOFTWARE mode only)
+	int ts_descriptor=CHECK_TR_NULL(txring_session) ? args->sData.descriptor : txRingFd(txring_session);
 
 	// struct scm_timestamping and struct timeval for the tx timestamp
 	struct scm_timestamping hw_ts;
@@ -468,17 +487,37 @@ static void txLoop (arg_struct *args) {
 			IP4headAddID(&(headers.ipHeader),(unsigned short) id);
 			id+=INCR_ID;
 
-			// Encapsulate LaMP payload only it is available
-			if(args->opts->payloadlen!=0) {
-				lampEncapsulate(buffers.lamppacket, &(headers.lampHeader), payload_buff, args->opts->payloadlen);
-				UDPencapsulate(buffers.udppacket,&(headers.udpHeader),buffers.lamppacket,(size_t) lampPacketSize,ipaddrs);
-			} else {
-				UDPencapsulate(buffers.udppacket,&(headers.udpHeader),(byte_t *)&(headers.lampHeader),(size_t) lampPacketSize,ipaddrs);
+			// Carry the full width sequence number, when extended sequence numbers have been accepted by the server
+			if(args->opts->payloadlen!=0 && (ext_flags_session & LAMP_EXT_FLAG_EXTSEQ)) {
+				lampExtSeqWrite(payload_buff,counter);
 			}
 
-			// 'IP4headAddTotLen' may also be skipped since IP4Encapsulate already takes care of filling the length field
-			IP4Encapsulate(buffers.ippacket, &(headers.ipHeader), buffers.udppacket, UDP_PACKET_SIZE_S(lampPacketSize));
-			finalpktsize=etherEncapsulate(buffers.ethernetpacket, &(headers.etherHeader), buffers.ippacket, IP_UDP_PACKET_SIZE_S(lampPacketSize));
+			if(!CHECK_TR_NULL(txring_session)) {
+				// With --tx-ring, the whole frame is built directly inside the next slot of the ring
+				txframe=txRingGetFrame(txring_session);
+				if(!txframe) {
+					fprintf(stderr,"Failed sending latency measurement packet with seq: %u (no free slot in the TX ring).\nThe execution will terminate now.\n",headers.lampHeader.seq);
+					t_tx_error=ERR_SEND;
+					break;
+				}
+
+				finalpktsize=txRingLampFrameBuild(txframe, &headers, payload_buff, args->opts->payloadlen);
+				inpacket_lamphdr=(struct lamphdr *) (txframe+sizeof(struct ether_header)+sizeof(struct iphdr)+sizeof(struct udphdr));
+			} else {
+				// Encapsulate LaMP payload only it is available
+				if(args->opts->payloadlen!=0) {
+					lampEncapsulate(buffers.lamppacket, &(headers.lampHeader), payload_buff, args->opts->payloadlen);
+					UDPencapsulate(buffers.udppacket,&(headers.udpHeader),buffers.lamppacket,(size_t) lampPacketSize,ipaddrs);
+				} else {
+					UDPencapsulate(buffers.udppacket,&(headers.udpHeader),(byte_t *)&(headers.lampHeader),(size_t) lampPacketSize,ipaddrs);
+				}
+
+				// 'IP4headAddTotLen' may also be skipped since IP4Encapsulate already takes care of filling the length field
+				IP4Encapsulate(buffers.ippacket, &(headers.ipHeader), buffers.udppacket, UDP_PACKET_SIZE_S(lampPacketSize));
+
+				txframe=buffers.ethernetpacket;
+				finalpktsize=etherEncapsulate(txframe, &(headers.etherHeader), buffers.ippacket, IP_UDP_PACKET_SIZE_S(lampPacketSize));
+			}
 
 			if(args->opts->mode_ub==UNIDIR) {
 				fprintf(stdout,"Sent unidirectional message with destination MAC: " PRI_MAC " (id=%u, seq=%u).\n",
@@ -494,45 +533,65 @@ static void txLoop (arg_struct *args) {
 				pthread_mutex_lock(&tslist_mut);
 			}
 
-			if(rawLampSend(args->sData.descriptor, args->sData.addru.addrll, inpacket_lamphdr, buffers.ethernetpacket, finalpktsize, end_flag, UDP)) {
+			if(!CHECK_TR_NULL(txring_session)) {
+				tx_flushed=txRingLampSend(txring_session, inpacket_lamphdr, txframe, finalpktsize, end_flag);
+				send_err=tx_flushed<0;
+			} else {
+				send_err=!CHECK_XS_NULL(xsk_session) ? xdpLampSend(xsk_session, inpacket_lamphdr, txframe, finalpktsize, end_flag) :
+					rawLampSend(args->sData.descriptor, args->sData.addru.addrll, inpacket_lamphdr, txframe, finalpktsize, end_flag, UDP);
+			}
+
+			if(send_err) {
 				if(errno==EMSGSIZE) {
 					fprintf(stderr,"Error: EMSGSIZE 90 Message too long.\n");
 				}
 				fprintf(stderr,"Failed sending latency measurement packet with seq: %u.\nThe execution will terminate now.\n",headers.lampHeader.seq);
+				if(args->opts->latencyType==SOFTWARE || args->opts->latencyType==HARDWARE) {
+					pthread_mutex_unlock(&tslist_mut);
+				}
 				break;
 			}
 
 			// Retrieve tx timestamp if mode is HARDWARE/SOFTWARE
 			// Extract ancillary data with the tx timestamp (if mode is HARDWARE/SOFTWARE)
+			// With --tx-ring, the tx timestamps of all the frames of the batch which has just been handed to the kernel are
+			// retrieved (none, if the batch is not complete yet), from the error queue of the ring socket
 			if(args->opts->latencyType==SOFTWARE || args->opts->latencyType==HARDWARE) {
-				do {
-					if(pollErrqueueWait(args->sData.descriptor,POLL_ERRQUEUE_WAIT_TIMEOUT)<=0) {
-						rcv_bytes=-1;
-						pthread_mutex_unlock(&tslist_mut);
+				rcv_bytes=0;
+
+				for(ts_seq=counter+1-tx_flushed;ts_seq<=counter;ts_seq++) {
+					do {
+						if(pollErrqueueWait(ts_descriptor,POLL_ERRQUEUE_WAIT_TIMEOUT)<=0) {
+							rcv_bytes=-1;
+							break;
+						}
+						saferecvmsg(rcv_bytes,ts_descriptor,&mhdr,MSG_ERRQUEUE);
+						lampPacketRxPtr=UDPgetpacketpointers(data_iov,NULL,NULL,NULL); // From Rawsock library
+						lampHeadGetData(lampPacketRxPtr,&lamp_type_rx_errqueue,NULL,&lamp_seq_rx_errqueue,NULL,NULL,NULL);
+					} while(lamp_seq_rx_errqueue!=ts_seq || (lamp_type_rx_errqueue!=PINGLIKE_REQ_TLESS && lamp_type_rx_errqueue!=PINGLIKE_ENDREQ_TLESS));
+
+					if(rcv_bytes==-1) {
 						break;
 					}
-					saferecvmsg(rcv_bytes,args->sData.descriptor,&mhdr,MSG_ERRQUEUE);
-					lampPacketRxPtr=UDPgetpacketpointers(data_iov,NULL,NULL,NULL); // From Rawsock library
-					lampHeadGetData(lampPacketRxPtr,&lamp_type_rx_errqueue,NULL,&lamp_seq_rx_errqueue,NULL,NULL,NULL);
-				} while(lamp_seq_rx_errqueue!=counter || (lamp_type_rx_errqueue!=PINGLIKE_REQ_TLESS && lamp_type_rx_errqueue!=PINGLIKE_ENDREQ_TLESS));
 
-				if(rcv_bytes==-1) {
-					t_rx_error=ERR_TXSTAMP;
-					pthread_mutex_unlock(&tslist_mut);
-					break;
-				}
+					for(cmsg=CMSG_FIRSTHDR(&mhdr);cmsg!=NULL;cmsg=CMSG_NXTHDR(&mhdr, cmsg)) {
+			           	if(cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SO_TIMESTAMPING) {
+			            	hw_ts=*((struct scm_timestamping *)CMSG_DATA(cmsg));
+			             	tx_timestamp.tv_sec=hw_ts.ts[args->opts->latencyType==HARDWARE ? 2 : 0].tv_sec;
+			       			tx_timestamp.tv_usec=hw_ts.ts[args->opts->latencyType==HARDWARE ? 2 : 0].tv_nsec/MICROSEC_TO_NANOSEC;
+			           	}
+					}
 
-				for(cmsg=CMSG_FIRSTHDR(&mhdr);cmsg!=NULL;cmsg=CMSG_NXTHDR(&mhdr, cmsg)) {
-		           	if(cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SO_TIMESTAMPING) {
-		            	hw_ts=*((struct scm_timestamping *)CMSG_DATA(cmsg));
-		             	tx_timestamp.tv_sec=hw_ts.ts[args->opts->latencyType==HARDWARE ? 2 : 0].tv_sec;
-		       			tx_timestamp.tv_usec=hw_ts.ts[args->opts->latencyType==HARDWARE ? 2 : 0].tv_nsec/MICROSEC_TO_NANOSEC;
-		           	}
+					// Save tx timestamp
+					timevalSL_insert(tslist,ts_seq,tx_timestamp);
 				}
 
-				// Save tx timestamp
-				timevalSL_insert(tslist,counter,tx_timestamp);
 				pthread_mutex_unlock(&tslist_mut);
+
+				if(rcv_bytes==-1) {
+					t_rx_error=ERR_TXSTAMP;
+					break;
+				}
 			}
 
 			// Increase sequence number for the next iteration
@@ -570,10 +629,18 @@ static void *rxLoop_t (void *arg) {
 	arg_struct *args=(arg_struct *) arg;
 
 	int Wfiledescriptor=-1;
+	tfileWriter Wwriter=NULL; // Asynchronous writer for the per-packet data, when '-W' is specified
+	tfileBinaryHeader Wbinheader;
+	tfileRotationParams Wrotation;
+	char *Wfilename_opened=NULL; // Name of the -W file which was actually opened (needed to name the next segments when rotating the file)
 
 	// Packet buffer with size = Ethernet MTU
 	byte_t packet[RAW_RX_PACKET_BUF_SIZE];
 
+	// Received frame: 'packet', or the current frame inside the ring, when --rx-ring is specified
+	byte_t *frame=packet;
+	rxRingFrame ringFrame;
+
 	// recvfrom variables
 	ssize_t rcv_bytes;
 	size_t UDPpayloadsize; // UDP payload size
@@ -595,6 +662,7 @@ static void *rxLoop_t (void *arg) {
 	uint16_t lamp_id_rx;
 	uint16_t lamp_seq_rx;
 	uint16_t lamp_payloadlen_rx;
+	uint64_t lamp_extseq_rx=INITIAL_SEQ_NO; // Full width sequence number (used only when extended sequence numbers are in use)
 
 	// struct sockaddr_ll filled by recvfrom() and used to filter out outgoing traffic
 	struct sockaddr_ll addrll;
@@ -676,9 +744,45 @@ static void *rxLoop_t (void *arg) {
 
 	// Open CSV file when in "-W" mode (i.e. "write every packet measurement data to CSV file")
 	if(args->opts->Wfilename!=NULL) {
-		Wfiledescriptor=openTfile(args->opts->Wfilename,args->opts->overwrite_W,args->opts->followup_mode!=FOLLOWUP_OFF,args->opts->report_extra_data);
+		Wfiledescriptor=openTfileNamed(args->opts->Wfilename,args->opts->overwrite_W,args->opts->followup_mode!=FOLLOWUP_OFF,args->opts->report_extra_data,args->opts->W_binary,&Wfilename_opened);
 		if(Wfiledescriptor<0) {
 			fprintf(stderr,"Warning! Cannot open file for writing single packet latency data.\nThe '-W' option will be disabled.\n");
+		} else {
+			// Start the writer thread: from now on, no system call will be performed on the receive path to write the per-packet data
+			// Describe the current test in the header of the binary trace, when --report-perpacket-binary is specified
+			if(args->opts->W_binary) {
+				Wbinheader.lamp_id=lamp_id_session;
+				Wbinheader.latency_type=args->opts->latencyType;
+				Wbinheader.followup_on_flag=args->opts->followup_mode!=FOLLOWUP_OFF;
+				Wbinheader.enabled_extra_data=args->opts->report_extra_data;
+				Wbinheader.side=TFILE_BIN_SIDE_CLIENT;
+				Wbinheader.decimal_digits=W_DECIMAL_DIGITS;
+			}
+
+			// Rotate the file by size and/or by wall-clock interval, when --report-perpacket-rotate-size/interval are specified
+			if(args->opts->W_rotate_size>0 || args->opts->W_rotate_interval>0) {
+				Wrotation.size=args->opts->W_rotate_size;
+				Wrotation.interval=args->opts->W_rotate_interval;
+				Wrotation.hook=args->opts->W_rotate_hook;
+				Wrotation.filename=Wfilename_opened;
+				Wrotation.overwrite=args->opts->overwrite_W;
+				Wrotation.followup_on_flag=args->opts->followup_mode!=FOLLOWUP_OFF;
+				Wrotation.enabled_extra_data=args->opts->report_extra_data;
+			}
+
+			Wwriter=tfileWriterInit(Wfiledescriptor,W_DECIMAL_DIGITS,args->opts->W_binary ? &Wbinheader : NULL,
+				(args->opts->W_rotate_size>0 || args->opts->W_rotate_interval>0) && Wfilename_opened!=NULL ? &Wrotation : NULL);
+			if(CHECK_TW_NULL(Wwriter)) {
+				fprintf(stderr,"Warning! Cannot start the thread writing single packet latency data.\nThe '-W' option will be disabled.\n");
+				closeTfile(Wfiledescriptor);
+				Wfiledescriptor=-1;
+			}
+
+			// The writer keeps its own copy of the file name
+			if(Wfilename_opened!=NULL) {
+				free(Wfilename_opened);
+				Wfilename_opened=NULL;
+			}
 		}
 	}
 
@@ -691,7 +795,21 @@ static void *rxLoop_t (void *arg) {
 	// Start receiving packets until an 'ENDREPLY' one is received (this is the ping-like loop)
 	do {
 		// If in KRT mode or HARDWARE/SOFTWARE mode, use (the safe version of) recvmsg(), otherwise, use recvfrom()
-		if(args->opts->latencyType==KRT || args->opts->latencyType==HARDWARE || args->opts->latencyType==SOFTWARE) {
+		// When the AF_XDP socket is used (user-to-user latency only), only the replies and follow-ups directed to this host are received
+		// When the TPACKET_V3 ring is used, the replies and follow-ups are read in place, together with their kernel timestamp
+		if(!CHECK_XS_NULL(xsk_session)) {
+			rcv_bytes=xdpSockRecv(xsk_session,packet,RAW_RX_PACKET_BUF_SIZE);
+			addrll.sll_pkttype=PACKET_HOST;
+		} else if(!CHECK_RR_NULL(rxring_session)) {
+			rcv_bytes=rxRingRecv(rxring_session,&ringFrame);
+
+			if(rcv_bytes!=-1) {
+				frame=ringFrame.data;
+				addrll.sll_pkttype=ringFrame.pkttype;
+				lampPacket=UDPgetpacketpointers(frame,&(headerptrs.etherHeader),&(headerptrs.ipHeader),&(headerptrs.udpHeader));
+				lampGetPacketPointers(lampPacket,&(headerptrs.lampHeader));
+			}
+		} else if(args->opts->latencyType==KRT || args->opts->latencyType==HARDWARE || args->opts->latencyType==SOFTWARE) {
 			saferecvmsg(rcv_bytes,args->sData.descriptor,&mhdr,NO_FLAGS);
 		} else {
 			saferecvfrom(rcv_bytes,args->sData.descriptor,packet,RAW_RX_PACKET_BUF_SIZE,NO_FLAGS,(struct sockaddr *)&addrll,&addrllLen);
@@ -736,7 +854,7 @@ static void *rxLoop_t (void *arg) {
 		// Verify checksums
 		// Validate checksum (combined mode: IP+UDP): if it is wrong, discard packet
 		UDPpayloadsize=UDPgetpayloadsize((headerptrs.udpHeader));
-		if(!validateEthCsum(packet, (headerptrs.udpHeader)->check, &((headerptrs.ipHeader)->check), CSUM_UDPIP, (void *) &UDPpayloadsize)) {
+		if(!validateEthCsum(frame, (headerptrs.udpHeader)->check, &((headerptrs.ipHeader)->check), CSUM_UDPIP, (void *) &UDPpayloadsize)) {
 			continue;
 		}
 
@@ -753,6 +871,17 @@ static void *rxLoop_t (void *arg) {
 			continue;
 		}
 
+		// Get the full width sequence number, when extended sequence numbers are in use
+		// Follow-up data packets do not carry any payload: their extended sequence number is obtained by expanding
+		// the 16 bit one, starting from the last extended sequence number received in a reply
+		if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+			if(lamp_payloadlen_rx>=LAMP_EXTSEQ_SIZE && UDPpayloadsize>=LAMP_HDR_PAYLOAD_SIZE(LAMP_EXTSEQ_SIZE)) {
+				lamp_extseq_rx=lampExtSeqRead(lampPacket+LAMP_HDR_SIZE());
+			} else {
+				lamp_extseq_rx=lampExtSeqExpand(lamp_extseq_rx,lamp_seq_rx);
+			}
+		}
+
 		if(lamp_type_rx!=PINGLIKE_REPLY && lamp_type_rx!=PINGLIKE_ENDREPLY && lamp_type_rx!=PINGLIKE_REPLY_TLESS && lamp_type_rx!=PINGLIKE_ENDREPLY_TLESS) {
 			if(args->opts->followup_mode!=FOLLOWUP_OFF && lamp_type_rx!=FOLLOWUP_DATA) {
 				continue;
@@ -760,8 +889,15 @@ static void *rxLoop_t (void *arg) {
 		}
 
 		if(lamp_type_rx==PINGLIKE_REPLY || lamp_type_rx==PINGLIKE_ENDREPLY || lamp_type_rx==PINGLIKE_REPLY_TLESS || lamp_type_rx==PINGLIKE_ENDREPLY_TLESS) {
-			// Extract ancillary data (if mode is KRT or if it is HARDWARE or SOFTWARE)
-			if(args->opts->latencyType==KRT || args->opts->latencyType==HARDWARE || args->opts->latencyType==SOFTWARE) {
+			// Extract ancillary data (if mode is KRT or if it is HARDWARE or SOFTWARE), or take the timestamp from the ring frame
+			if(!CHECK_RR_NULL(rxring_session) && args->opts->latencyType!=USERTOUSER) {
+				rx_timestamp=ringFrame.ts;
+
+				// No hardware timestamp was available for this packet: its software timestamp cannot be used in its place
+				if(args->opts->latencyType==HARDWARE && !ringFrame.ts_hw) {
+					errorTsFlag=1;
+				}
+			} else if(args->opts->latencyType==KRT || args->opts->latencyType==HARDWARE || args->opts->latencyType==SOFTWARE) {
 				for(cmsg=CMSG_FIRSTHDR(&mhdr);cmsg!=NULL;cmsg=CMSG_NXTHDR(&mhdr, cmsg)) {
 	                if(args->opts->latencyType==KRT && cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SO_TIMESTAMP) {
 	                    rx_timestamp=*((struct timeval *)CMSG_DATA(cmsg));
@@ -871,12 +1007,16 @@ static void *rxLoop_t (void *arg) {
 				}
 			}
 
-			// Update the current report structure
-			reportStructureUpdate(&reportData,tripTime,lamp_seq_rx);
+			// Update the current report structure (using the full width sequence number, when available)
+			if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+				reportStructureUpdateExt(&reportData,tripTime,lamp_extseq_rx);
+			} else {
+				reportStructureUpdate(&reportData,tripTime,lamp_seq_rx);
+			}
 
 			// In "-W" mode, write the current measured value to the specified CSV file too (if a file was successfully opened)
 			if(Wfiledescriptor>0 || args->opts->udp_params.enabled) {
-				perPktData.seqNo=lamp_seq_rx;
+				perPktData.seqNo=(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) ? lamp_extseq_rx : lamp_seq_rx;
 				perPktData.signedTripTime=tripTime;
 				perPktData.tripTimeProc=tripTimeProc;
 
@@ -887,7 +1027,7 @@ static void *rxLoop_t (void *arg) {
 				perPktData.tx_timestamp=tx_timestamp;
 
 				if(Wfiledescriptor>0) {
-					writeToTFile(Wfiledescriptor,W_DECIMAL_DIGITS,&perPktData);
+					tfileWriterPush(Wwriter,&perPktData);
 				}
 
 				if(args->opts->udp_params.enabled) {
@@ -906,9 +1046,11 @@ static void *rxLoop_t (void *arg) {
 					}
 				}
 
-				carbon_pthread_mutex_lock(ctd);
-				carbonReportStructureUpdate(&carbonReportData,tripTime,lamp_seq_rx,args->opts->dup_detect_enabled);
-				carbon_pthread_mutex_unlock(ctd);
+				if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+					carbonReportStructureUpdateExt(&carbonReportData,tripTime,lamp_extseq_rx,args->opts->dup_detect_enabled);
+				} else {
+					carbonReportStructureUpdate(&carbonReportData,tripTime,lamp_seq_rx,args->opts->dup_detect_enabled);
+				}
 			}
 
 			if(continueFlag==0) {
@@ -921,6 +1063,11 @@ static void *rxLoop_t (void *arg) {
 		}
 	} while(continueFlag || fu_flag);
 
+	if(Wfiledescriptor>0) {
+		// The '-W' file is closed by the writer
+		tfileWriterFree(Wwriter);
+	}
+
 	// Free source MAC address memory area
 	freeMacAddrT(srcmacaddr_pkt);
 
@@ -959,6 +1106,16 @@ static void unidirRxTxLoop (arg_struct *args) {
 	struct sockaddr_ll addrll;
 	socklen_t addrllLen=sizeof(addrll);
 
+	// Reassembly structure for the (possibly fragmented) binary report
+	reportReasm reportRA;
+	int reasm_retval;
+
+	reportRA=reportReasm_init();
+	if(CHECK_REASM_NULL(reportRA)) {
+		t_rx_error=ERR_MALLOC;
+		return;
+	}
+
 	/* --------------------------- Rx part --------------------------- */
 
 	// Already get all the packet pointers for Rx
@@ -1010,21 +1167,37 @@ static void unidirRxTxLoop (arg_struct *args) {
 		lampHeadGetData(lampPacket, &lamp_type_rx, &lamp_id_rx, &lamp_seq_rx, &lamp_payloadlen_rx, NULL, NULL);
 
 		// Discard any LaMP packet which is not of interest
-		if(lamp_id_rx!=lamp_id_session || lamp_type_rx!=REPORT) {
+		if(lamp_id_rx!=lamp_id_session || lamp_type_rx!=REPORT || UDPpayloadsize<LAMP_HDR_PAYLOAD_SIZE(lamp_payloadlen_rx)) {
+			continue;
+		}
+
+		// Each REPORT packet carries a fragment of the binary encoded report: go on only when all the fragments have been received
+		reasm_retval=reportReasm_add(reportRA,payload,lamp_payloadlen_rx);
+		if(reasm_retval==REPORT_REASM_INCOMPLETE) {
+			continue;
+		} else if(reasm_retval<0) {
+			fprintf(stderr,"Warning: discarded an invalid report fragment (%s).\n",reportEncErrStr(reasm_retval));
+			continue;
+		}
+
+		// If, finally, the full report has been received, parse it and send ACK
+		// Total packets is known to the client only, in this implementation, and it is already set thanks to reportStructureInit(), which
+		// is setting it to 'opts->number' (it is not overwritten by reportReasm_decode())
+		reasm_retval=reportReasm_decode(reportRA,&reportData);
+		if(reasm_retval!=REPORT_ENC_NOERR) {
+			// The server will retransmit the whole report until an ACK is received
+			fprintf(stderr,"Warning: the received report is not valid (%s). Waiting for a retransmission.\n",reportEncErrStr(reasm_retval));
+			reportReasm_reset(reportRA);
 			continue;
 		}
 
-		// If, finally, the packet is a report one, parse the report structure and send ACK
 		break;
 	}
 
-	if(timeoutFlag==0) {
-		/* --------------------------- Tx and report parsing part --------------------------- */
+	reportReasm_free(reportRA);
 
-		// Parse report structure (for now, it is encoded as a string for conveniency)
-		// Total packets is known to the client only, in this implementation, and it is already set thanks to reportStructureInit(), which
-		// is setting it to 'opts->number'
-		repscanf((const char *)payload,&reportData);
+	if(timeoutFlag==0) {
+		/* --------------------------- Tx part --------------------------- */
 
 		// Fill the ACKdata structure
 		ACKdata.controlRCV.ip=args->opts->dest_addr_u.destIPaddr;
@@ -1129,6 +1302,44 @@ unsigned int runUDPclient_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 	// LaMP ID is randomly generated between 0 and 65535 (the maximum over 16 bits)
 	lamp_id_session=(rand()+getpid())%UINT16_MAX;
 
+	// Open the AF_XDP socket before the INIT procedure, in order to be ready to receive the first reply
+	if(opts->xdp_enabled) {
+		xsk_session=xdpSockInit(sData.devname,sData.ifindex,opts->xdp_queue,CLIENT_SRCPORT,XDP_SOCK_CLIENT_CTRL_MASK,sData.descriptor,opts->xdp_generic);
+		if(CHECK_XS_NULL(xsk_session)) {
+			fprintf(stderr,"Error: cannot open the AF_XDP socket on %s.\n",sData.devname);
+			return 2;
+		}
+
+		fprintf(stdout,"\t[AF_XDP socket] = %s, queue %" PRIu32 "\n",xdpSockModeStr(xsk_session),opts->xdp_queue);
+	}
+
+	// Open the TPACKET_V3 ring, which is used only for the replies of the ping-like mode, before the INIT procedure too
+	if(opts->rx_ring && opts->mode_ub==PINGLIKE) {
+		rxring_session=rxRingInit(sData.devname,sData.ifindex,CLIENT_SRCPORT,XDP_SOCK_CLIENT_CTRL_MASK,sData.descriptor,opts->rx_ring_timeout,opts->latencyType==HARDWARE);
+		if(CHECK_RR_NULL(rxring_session)) {
+			fprintf(stderr,"Error: cannot open the TPACKET_V3 ring on %s.\n",sData.devname);
+			return 2;
+		}
+
+		fprintf(stdout,"\t[RX ring] = TPACKET_V3, %d blocks of %d kB, block timeout %" PRIu32 " ms\n",
+			RX_RING_BLOCK_NR,RX_RING_BLOCK_SIZE/1024,opts->rx_ring_timeout);
+	}
+
+	// Open the PACKET_TX_RING used to send the requests (and the unidirectional packets), when --tx-ring is specified
+	if(opts->tx_ring) {
+		txring_session=txRingInit(sData.devname,sData.descriptor,sData.addru.addrll,opts->tx_ring_batch,opts->qdisc_bypass,
+			opts->latencyType==HARDWARE ? TX_RING_TSTAMP_HW : (opts->latencyType==SOFTWARE ? TX_RING_TSTAMP_SW : TX_RING_TSTAMP_NONE));
+		if(CHECK_TR_NULL(txring_session)) {
+			fprintf(stderr,"Error: cannot open the PACKET_TX_RING on %s.\n",sData.devname);
+			rxRingFree(rxring_session);
+			rxring_session=NULL;
+			return 2;
+		}
+
+		fprintf(stdout,"\t[TX ring] = TPACKET_V2, %d slots, %" PRIu32 " packets per send()%s\n",
+			TX_RING_FRAME_NR,opts->tx_ring_batch,opts->qdisc_bypass ? ", qdisc bypass" : "");
+	}
+
 	// This fprintf() terminates the series of call to inform the user about current settings -> using \n\n instead of \n
 	fprintf(stdout,"\t[session LaMP ID] = %" PRIu16 "\n\n",lamp_id_session);
 
@@ -1165,6 +1376,15 @@ unsigned int runUDPclient_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 	pthread_join(ackListenerInit_tid,NULL);
 
 	if(t_tx_error==NO_ERR && t_rx_error==NO_ERR) {
+		// Check whether the extended sequence numbers, if requested, were accepted by the server
+		if(opts->ext_seq_enabled) {
+			if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+				fprintf(stdout,"The server accepted the usage of extended (64 bit) sequence numbers.\n");
+			} else {
+				fprintf(stderr,"Warning: the server does not support extended sequence numbers.\n\tFalling back to 16 bit LaMP sequence numbers.\n");
+			}
+		}
+
 		if(opts->followup_mode!=FOLLOWUP_OFF) {
 			pthread_create(&followupRequestSender_tid,NULL,&followupRequestSender,(void *) &args);
 			pthread_create(&followupReplyListener_tid,NULL,&followupReplyListener,(void *) &ful_raw_args);
@@ -1216,6 +1436,12 @@ unsigned int runUDPclient_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 			unidirRxTxLoop(&args);
 		} else {
 			fprintf(stderr,"Error: some unknown error caused the mode not be set when starting the UDP client.\n");
+			xdpSockFree(xsk_session);
+			xsk_session=NULL;
+			rxRingFree(rxring_session);
+			rxring_session=NULL;
+			txRingFree(txring_session);
+			txring_session=NULL;
 			return 1;
 		}
 
@@ -1227,6 +1453,14 @@ unsigned int runUDPclient_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 		fprintf(stderr,"Error: the init procedure could not be completed. No test will be performed.\n");
 	}
 
+	// Close the AF_XDP socket (and detach the XDP program) and the TPACKET_V3/PACKET_TX_RING rings as soon as the test is over
+	xdpSockFree(xsk_session);
+	xsk_session=NULL;
+	rxRingFree(rxring_session);
+	rxring_session=NULL;
+	txRingFree(txring_session);
+	txring_session=NULL;
+
 	// Print error messages, if errors have occurred (and, in case of error, return 1)
 	if(t_tx_error!=NO_ERR) {
 		thread_error_print("UDP Tx loop", t_tx_error);
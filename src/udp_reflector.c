@@ -0,0 +1,463 @@
+#define _GNU_SOURCE
+#include "udp_reflector.h"
+#include "latency_hist.h"
+#include "timer_man.h"
+#include "common_thread.h"
+#include "admission_ctrl.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <sys/time.h>
+
+#define REFLECTOR_PKT_SIZE (MAX_LAMP_LEN+LAMP_HDR_SIZE())
+
+// Buffers of a batch: each request is received inside its own packet buffer, which is then directly used to send the reply
+struct reflectorBatch {
+	byte_t *packets; // 'size' buffers of REFLECTOR_PKT_SIZE bytes each
+	struct mmsghdr *rx_msgs;
+	struct mmsghdr *tx_msgs;
+	struct iovec *rx_iovs;
+	struct iovec *tx_iovs;
+	char *ctrlBufs; // One SO_TIMESTAMP ancillary data buffer for each packet
+	struct sockaddr_in *rx_addrs; // Source address of each packet (needed only for the rate limit)
+	struct timeval *rx_timestamps;
+	unsigned int size;
+};
+
+// Statistics printed when the session ends
+struct reflectorStats {
+	uint64_t reflected;
+	uint64_t batches;
+	uint64_t discarded; // Packets not belonging to the session, or which are not ping-like requests
+	uint64_t rate_limited; // Packets discarded because of the rate limit (--rate-limit)
+	uint64_t residence_min;
+	uint64_t residence_max;
+	uint64_t residence_sum;
+	latencyHist residence; // Server residence time (us)
+};
+
+static void reflectorBatchFree(struct reflectorBatch *batch) {
+	free(batch->packets);
+	free(batch->rx_msgs);
+	free(batch->tx_msgs);
+	free(batch->rx_iovs);
+	free(batch->tx_iovs);
+	free(batch->ctrlBufs);
+	free(batch->rx_addrs);
+	free(batch->rx_timestamps);
+}
+
+static int reflectorBatchInit(struct reflectorBatch *batch,unsigned int size) {
+	batch->size=size;
+	batch->packets=malloc((size_t) size*REFLECTOR_PKT_SIZE);
+	batch->rx_msgs=calloc(size,sizeof(struct mmsghdr));
+	batch->tx_msgs=calloc(size,sizeof(struct mmsghdr));
+	batch->rx_iovs=calloc(size,sizeof(struct iovec));
+	batch->tx_iovs=calloc(size,sizeof(struct iovec));
+	batch->ctrlBufs=calloc(size,CMSG_SPACE(sizeof(struct timeval)));
+	batch->rx_addrs=calloc(size,sizeof(struct sockaddr_in));
+	batch->rx_timestamps=calloc(size,sizeof(struct timeval));
+
+	if(!batch->packets || !batch->rx_msgs || !batch->tx_msgs || !batch->rx_iovs || !batch->tx_iovs || !batch->ctrlBufs || !batch->rx_addrs || !batch->rx_timestamps) {
+		reflectorBatchFree(batch);
+		return -1;
+	}
+
+	for(unsigned int i=0;i<size;i++) {
+		batch->rx_iovs[i].iov_base=batch->packets+(size_t) i*REFLECTOR_PKT_SIZE;
+		batch->rx_iovs[i].iov_len=REFLECTOR_PKT_SIZE;
+		batch->rx_msgs[i].msg_hdr.msg_iov=&(batch->rx_iovs[i]);
+		batch->rx_msgs[i].msg_hdr.msg_iovlen=1;
+		batch->rx_msgs[i].msg_hdr.msg_name=&(batch->rx_addrs[i]);
+	}
+
+	return 0;
+}
+
+// Receive up to 'batch->size-first' packets, starting from slot 'first', and get their receive timestamps
+// When SO_TIMESTAMP is not available, all the packets received by the same recvmmsg() get the userspace timestamp taken
+// as soon as recvmmsg() returns
+static int reflectorReceive(int sFd,struct reflectorBatch *batch,unsigned int first,int flags,uint8_t krn_rx_timestamps) {
+	struct cmsghdr *cmsg;
+	struct timeval rx_app;
+	int rcv_msgs;
+
+	for(unsigned int i=first;i<batch->size;i++) {
+		batch->rx_msgs[i].msg_hdr.msg_control=krn_rx_timestamps ? batch->ctrlBufs+(size_t) i*CMSG_SPACE(sizeof(struct timeval)) : NULL;
+		batch->rx_msgs[i].msg_hdr.msg_controllen=krn_rx_timestamps ? CMSG_SPACE(sizeof(struct timeval)) : 0;
+		batch->rx_msgs[i].msg_hdr.msg_namelen=sizeof(struct sockaddr_in);
+		batch->rx_msgs[i].msg_hdr.msg_flags=NO_FLAGS;
+	}
+
+	while((rcv_msgs=recvmmsg(sFd,batch->rx_msgs+first,batch->size-first,flags,NULL))==-1 && errno==EINTR);
+
+	if(rcv_msgs<=0) {
+		return rcv_msgs;
+	}
+
+	gettimeofday(&rx_app,NULL);
+
+	for(unsigned int i=first;i<first+rcv_msgs;i++) {
+		batch->rx_timestamps[i]=rx_app;
+
+		if(krn_rx_timestamps) {
+			for(cmsg=CMSG_FIRSTHDR(&(batch->rx_msgs[i].msg_hdr));cmsg!=NULL;cmsg=CMSG_NXTHDR(&(batch->rx_msgs[i].msg_hdr),cmsg)) {
+				if(cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SO_TIMESTAMP) {
+					batch->rx_timestamps[i]=*((struct timeval *)CMSG_DATA(cmsg));
+				}
+			}
+		}
+	}
+
+	return rcv_msgs;
+}
+
+// Add to the batch the requests received before 'deadline' (or until the batch is full)
+static unsigned int reflectorFillBatch(int sFd,struct reflectorBatch *batch,unsigned int count,struct timeval *deadline,uint8_t krn_rx_timestamps) {
+	struct pollfd sockMon={.fd=sFd,.events=POLLIN};
+	struct timeval now, remaining;
+	struct timespec remaining_ts;
+	int rcv_msgs;
+
+	while(count<batch->size) {
+		gettimeofday(&now,NULL);
+
+		if(!timercmp(&now,deadline,<)) {
+			break;
+		}
+
+		timersub(deadline,&now,&remaining);
+		remaining_ts.tv_sec=remaining.tv_sec;
+		remaining_ts.tv_nsec=remaining.tv_usec*MICROSEC_TO_NANOSEC;
+
+		if(ppoll(&sockMon,1,&remaining_ts,NULL)<=0) {
+			break;
+		}
+
+		rcv_msgs=reflectorReceive(sFd,batch,count,MSG_DONTWAIT,krn_rx_timestamps);
+		if(rcv_msgs<=0) {
+			break;
+		}
+
+		count+=rcv_msgs;
+	}
+
+	return count;
+}
+
+// Rewrite in place the control field of a ping-like request of the session with id 'lamp_id', turning it into the
+// corresponding reply, and set '*endFlag' when the request is the last one of the session
+// Return -1 if the packet is not a ping-like request belonging to the session (the packet is left untouched), 0 otherwise
+static int reflectorRewriteRequest(struct lamphdr *lampHeaderPtr,size_t len,uint16_t lamp_id,uint8_t *endFlag) {
+	lamptype_t lamp_type_rx;
+	uint16_t lamp_id_rx;
+
+	if(len<LAMP_HDR_SIZE() || !IS_LAMP(lampHeaderPtr->reserved,lampHeaderPtr->ctrl)) {
+		return -1;
+	}
+
+	lampHeadGetData((byte_t *) lampHeaderPtr,&lamp_type_rx,&lamp_id_rx,NULL,NULL,NULL,NULL);
+
+	if(lamp_id_rx!=lamp_id) {
+		return -1;
+	}
+
+	switch(lamp_type_rx) {
+		case PINGLIKE_REQ:
+			lampHeaderPtr->ctrl=CTRL_PINGLIKE_REPLY;
+			break;
+		case PINGLIKE_REQ_TLESS:
+			lampHeaderPtr->ctrl=CTRL_PINGLIKE_REPLY_TLESS;
+			break;
+		case PINGLIKE_ENDREQ:
+			lampHeaderPtr->ctrl=CTRL_PINGLIKE_ENDREPLY;
+			*endFlag=1;
+			break;
+		case PINGLIKE_ENDREQ_TLESS:
+			lampHeaderPtr->ctrl=CTRL_PINGLIKE_ENDREPLY_TLESS;
+			*endFlag=1;
+			break;
+		default:
+			return -1;
+	}
+
+	return 0;
+}
+
+// The percentiles are the upper bounds of the histogram buckets: they are thus capped to the maximum measured value
+static inline uint64_t reflectorResidencePercentile(struct reflectorStats *stats,double percentile) {
+	uint64_t value=latencyHistPercentile(&(stats->residence),percentile);
+
+	return value>stats->residence_max ? stats->residence_max : value;
+}
+
+static void reflectorPrintStats(struct reflectorStats *stats) {
+	fprintf(stdout,"Reflected %" PRIu64 " ping-like requests in %" PRIu64 " batches (average batch size: %.2f). Discarded packets: %" PRIu64 ".\n",
+		stats->reflected,stats->batches,stats->batches>0 ? (double) stats->reflected/stats->batches : 0,stats->discarded);
+
+	if(stats->rate_limited>0) {
+		fprintf(stdout,"Rate limit: %" PRIu64 " packets discarded during the session.\n",stats->rate_limited);
+	}
+
+	if(stats->reflected>0) {
+		fprintf(stdout,"Server residence time: min = %" PRIu64 " us, avg = %.3f us, p50 = %" PRIu64 " us, p99 = %" PRIu64 " us, max = %" PRIu64 " us.\n",
+			stats->residence_min,(double) stats->residence_sum/stats->reflected,
+			reflectorResidencePercentile(stats,50),reflectorResidencePercentile(stats,99),stats->residence_max);
+	}
+}
+
+// Reflect the ping-like requests of the session with id 'lamp_id' to sData.addru.addrin[1], until the last request is
+// received or until the server timeout expires (the socket receive timeout applies to the first request of each batch)
+int udpReflectorRun(struct lampsock_data sData, struct options *opts, uint16_t lamp_id) {
+	struct reflectorBatch batch;
+	struct reflectorStats *stats;
+	struct lamphdr *lampHeaderPtr;
+	struct timeval deadline, tx_timestamp, residence_tv;
+
+	int rcv_msgs;
+	unsigned int count, tx_count, sent;
+	int snd_msgs;
+	int return_val=REFLECTOR_END;
+	uint8_t endFlag=0;
+	uint8_t krn_rx_timestamps=1;
+
+	uint64_t residence;
+
+	if(reflectorBatchInit(&batch,opts->reflector_batch)<0) {
+		fprintf(stderr,"Error: cannot allocate the buffers of the batched reflector.\n");
+		return REFLECTOR_ERROR;
+	}
+
+	stats=calloc(1,sizeof(struct reflectorStats));
+	if(!stats) {
+		fprintf(stderr,"Error: cannot allocate the statistics of the batched reflector.\n");
+		reflectorBatchFree(&batch);
+		return REFLECTOR_ERROR;
+	}
+
+	stats->residence_min=UINT64_MAX;
+	latencyHistInit(&(stats->residence));
+
+	// The residence time is measured starting from the kernel receive timestamp of each packet, in order to include the
+	// time spent inside the socket queue while the previous batch was being reflected
+	if(socketSetTimestamping(sData,SET_TIMESTAMPING_SW_RX)<0) {
+		fprintf(stderr,"Warning: SO_TIMESTAMP is probably not supported. The server residence time will not include\n"
+			"the time spent by the packets inside the socket receive queue.\n");
+		krn_rx_timestamps=0;
+	}
+
+	fprintf(stdout,"Reflecting the ping-like requests in batches of up to %u packets (maximum batch latency: %" PRIu32 " us)...\n",
+		batch.size,opts->reflector_batch_latency);
+
+	while(!endFlag) {
+		// Wait for the first request(s) of the next batch
+		rcv_msgs=reflectorReceive(sData.descriptor,&batch,0,MSG_WAITFORONE,krn_rx_timestamps);
+
+		if(rcv_msgs==-1) {
+			if(errno==EAGAIN || errno==EWOULDBLOCK) {
+				return_val=REFLECTOR_TIMEOUT;
+			} else {
+				fprintf(stderr,"Generic recvmmsg() error. errno = %d.\n",errno);
+				return_val=REFLECTOR_ERROR;
+			}
+			break;
+		}
+
+		count=rcv_msgs;
+
+		if(opts->reflector_batch_latency>0 && count<batch.size) {
+			gettimeofday(&deadline,NULL);
+			deadline.tv_sec+=opts->reflector_batch_latency/SEC_TO_MICROSEC;
+			deadline.tv_usec+=opts->reflector_batch_latency%SEC_TO_MICROSEC;
+			if(deadline.tv_usec>=SEC_TO_MICROSEC) {
+				deadline.tv_sec++;
+				deadline.tv_usec-=SEC_TO_MICROSEC;
+			}
+
+			count=reflectorFillBatch(sData.descriptor,&batch,count,&deadline,krn_rx_timestamps);
+		}
+
+		// Rewrite the control field of each request, in place, and queue it for transmission
+		// Anything received after the last request (ENDREQ) is ignored, as runUDPserver() would do
+		tx_count=0;
+		for(unsigned int i=0;i<count && !endFlag;i++) {
+			lampHeaderPtr=(struct lamphdr *) batch.rx_iovs[i].iov_base;
+
+			if(!CHECK_AC_NULL(sData.admission_ctrl) && admissionCtrlPacket(sData.admission_ctrl,batch.rx_addrs[i].sin_addr.s_addr)==AC_LIMITED) {
+				stats->rate_limited++;
+				continue;
+			}
+
+			if(reflectorRewriteRequest(lampHeaderPtr,batch.rx_msgs[i].msg_len,lamp_id,&endFlag)<0) {
+				stats->discarded++;
+				continue;
+			}
+
+			batch.tx_iovs[tx_count].iov_base=lampHeaderPtr;
+			batch.tx_iovs[tx_count].iov_len=batch.rx_msgs[i].msg_len;
+			batch.tx_msgs[tx_count].msg_hdr.msg_iov=&(batch.tx_iovs[tx_count]);
+			batch.tx_msgs[tx_count].msg_hdr.msg_iovlen=1;
+			batch.tx_msgs[tx_count].msg_hdr.msg_name=&(sData.addru.addrin[1]);
+			batch.tx_msgs[tx_count].msg_hdr.msg_namelen=sizeof(sData.addru.addrin[1]);
+			// The receive timestamp is moved to the transmission slot, to compute the residence time after sending the batch
+			batch.rx_timestamps[tx_count]=batch.rx_timestamps[i];
+			tx_count++;
+		}
+
+		if(tx_count==0) {
+			continue;
+		}
+
+		gettimeofday(&tx_timestamp,NULL);
+
+		// sendmmsg() may send less messages than the requested ones: in this case, send the remaining ones
+		for(sent=0;sent<tx_count;sent+=snd_msgs) {
+			snd_msgs=sendmmsg(sData.descriptor,batch.tx_msgs+sent,tx_count-sent,NO_FLAGS);
+
+			if(snd_msgs<=0) {
+				if(snd_msgs==-1 && errno==EINTR) {
+					snd_msgs=0;
+					continue;
+				}
+
+				perror("sendmmsg() for sending LaMP packets failed");
+				fprintf(stderr,"UDP server reported that it can't reply to the client with id=%u (%u replies not sent)\n",lamp_id,tx_count-sent);
+				break;
+			}
+		}
+
+		stats->batches++;
+
+		for(unsigned int i=0;i<sent;i++) {
+			if(timercmp(&tx_timestamp,&(batch.rx_timestamps[i]),<)) {
+				residence=0;
+			} else {
+				timersub(&tx_timestamp,&(batch.rx_timestamps[i]),&residence_tv);
+				residence=residence_tv.tv_sec*SEC_TO_MICROSEC+residence_tv.tv_usec;
+			}
+
+			latencyHistUpdate(&(stats->residence),residence);
+			stats->residence_sum+=residence;
+			if(residence<stats->residence_min) {
+				stats->residence_min=residence;
+			}
+			if(residence>stats->residence_max) {
+				stats->residence_max=residence;
+			}
+		}
+
+		stats->reflected+=sent;
+	}
+
+	reflectorPrintStats(stats);
+
+	free(stats);
+	reflectorBatchFree(&batch);
+
+	return return_val;
+}
+
+// Reflect the ping-like requests of the session with id 'lamp_id' in the kernel, with an XDP program, until the last
+// request is reflected or until no request is received for the whole server timeout (socket receive timeout)
+// The XDP program is attached only after the session has been initialized: any request received by the socket before
+// that (or not matched by the program) is reflected in userspace, as in udpReflectorRun()
+int udpXdpReflectorRun(struct lampsock_data sData, struct options *opts, uint16_t lamp_id) {
+	xdpReflector xr;
+	struct pollfd sockMon={.fd=sData.descriptor,.events=POLLIN};
+	struct timeval rx_timeout, last_activity, now, elapsed;
+	socklen_t rx_timeout_len=sizeof(rx_timeout);
+	byte_t *packet;
+
+	ssize_t rcv_bytes;
+	uint64_t reflected=0, reflected_prev=0, ended=0;
+	uint64_t reflected_user=0, discarded=0;
+	int return_val=REFLECTOR_END;
+	uint8_t endFlag=0;
+
+	if(sData.ifindex==0) {
+		fprintf(stderr,"Error: the XDP reflector requires the server to be bound to a specific interface.\n");
+		return REFLECTOR_ERROR;
+	}
+
+	packet=malloc(REFLECTOR_PKT_SIZE);
+	if(!packet) {
+		fprintf(stderr,"Error: cannot allocate the buffer of the XDP reflector.\n");
+		return REFLECTOR_ERROR;
+	}
+
+	// A zero timeout means that the server should wait forever, as for SO_RCVTIMEO
+	if(getsockopt(sData.descriptor,SOL_SOCKET,SO_RCVTIMEO,&rx_timeout,&rx_timeout_len)<0) {
+		timerclear(&rx_timeout);
+	}
+
+	xr=xdpReflectorInit(sData.devname,sData.ifindex,opts->port,lamp_id,opts->udp_forced_dst_port,opts->xdp_generic);
+	if(CHECK_XR_NULL(xr)) {
+		fprintf(stderr,"Error: cannot load the XDP reflector on %s.\n",sData.devname);
+		free(packet);
+		return REFLECTOR_ERROR;
+	}
+
+	fprintf(stdout,"Reflecting the ping-like requests in the kernel with an XDP program (%s)...\n",xdpReflectorModeStr(xr));
+
+	gettimeofday(&last_activity,NULL);
+
+	while(!endFlag) {
+		if(poll(&sockMon,1,XDP_REFLECTOR_POLL_INTERVAL)>0) {
+			// Reflect in userspace the requests which did not go through the XDP program
+			while((rcv_bytes=recvfrom(sData.descriptor,packet,REFLECTOR_PKT_SIZE,MSG_DONTWAIT,NULL,NULL))>=0 && !endFlag) {
+				if(reflectorRewriteRequest((struct lamphdr *) packet,rcv_bytes,lamp_id,&endFlag)<0) {
+					discarded++;
+					continue;
+				}
+
+				if(sendto(sData.descriptor,packet,rcv_bytes,NO_FLAGS,(struct sockaddr *) &(sData.addru.addrin[1]),sizeof(sData.addru.addrin[1]))!=rcv_bytes) {
+					perror("sendto() for sending LaMP packets failed");
+					fprintf(stderr,"UDP server reported that it can't reply to the client with id=%u\n",lamp_id);
+				}
+
+				reflected_user++;
+				gettimeofday(&last_activity,NULL);
+			}
+
+			if(rcv_bytes==-1 && errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR) {
+				fprintf(stderr,"Generic recvfrom() error. errno = %d.\n",errno);
+				return_val=REFLECTOR_ERROR;
+				break;
+			}
+		}
+
+		if(xdpReflectorGetCounters(xr,&reflected,&ended)<0) {
+			fprintf(stderr,"Error: cannot read the counters of the XDP reflector.\n");
+			return_val=REFLECTOR_ERROR;
+			break;
+		}
+
+		if(ended>0) {
+			endFlag=1;
+		}
+
+		gettimeofday(&now,NULL);
+
+		if(reflected!=reflected_prev) {
+			reflected_prev=reflected;
+			last_activity=now;
+		} else if(timerisset(&rx_timeout)) {
+			timersub(&now,&last_activity,&elapsed);
+			if(!timercmp(&elapsed,&rx_timeout,<)) {
+				return_val=REFLECTOR_TIMEOUT;
+				break;
+			}
+		}
+	}
+
+	fprintf(stdout,"Reflected %" PRIu64 " ping-like requests in the kernel and %" PRIu64 " in userspace. Discarded packets: %" PRIu64 ".\n",
+		reflected,reflected_user,discarded);
+
+	xdpReflectorFree(xr);
+	free(packet);
+
+	return return_val;
+}
@@ -1,7 +1,12 @@
 #include "udp_server_raw.h"
 #include "report_manager.h"
+#include "tfile_writer.h"
+#include "report_encoding.h"
 #include "packet_structs.h"
 #include "timeval_utils.h"
+#include "udp_reflector.h"
+#include "aggr_table.h"
+#include "admission_ctrl.h"
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -31,7 +36,14 @@ static reportStructure reportData;
 static uint16_t lamp_id_session;
 static modeub_t mode_session;
 static modefollowup_t followup_mode_session;
+static uint16_t ext_flags_session; // LaMP extensions requested by the client and accepted by the server during the INIT procedure
 static uint8_t ack_report_received; // Global flag set by the ackListener thread: = 1 when an ACK has been received, otherwise it is = 0
+static uint8_t reportData_allocated; // = 1 when reportData is kept allocated across the sessions (continuous daemon mode), = 0 otherwise
+
+// Session data merged in the aggregated statistics at the end of each session (--aggregate-stats, see aggr_table.h)
+static latencyHist latencyHistData; // Latency histogram of the current unidirectional session
+static struct in_addr client_ip_session;
+static uint8_t timedout_session; // = 1 if the current session has been terminated by the server timeout, = 0 otherwise
 
 static carbonReportStructure carbonReportData;
 static int carbon_metrics_flush_first;
@@ -80,7 +92,7 @@ static void *ackListenerUDP (void *arg) {
 static uint8_t ackSenderInit(arg_struct_udp *args) {
 	int controlSendRetValue;
 
-	controlSendRetValue=controlSenderUDP(args,lamp_id_session,1,ACK,0,0,NULL,NULL);
+	controlSendRetValue=controlSenderUDP(args,lamp_id_session,1,ACK,ext_flags_session,0,NULL,NULL);
 
 	if(controlSendRetValue<0) {
 		// Set error
@@ -105,7 +117,11 @@ static uint8_t initReceiver(struct lampsock_data *sData, uint64_t interval, int
 	// struct timeval to set the more reasonable timeout after the first LaMP packet (i.e. the INIT packet) is received
 	struct timeval rx_timeout_reasonable;
 
-	controlRcvRetValue=controlReceiverUDP(sData->descriptor,&rcvData,INIT,NULL,NULL);
+	// With --rate-limit, an INIT exceeding the rate of its client is ignored, as any other packet
+	do {
+		controlRcvRetValue=controlReceiverUDP(sData->descriptor,&rcvData,INIT,NULL,NULL);
+	} while(controlRcvRetValue==0 && !CHECK_AC_NULL(sData->admission_ctrl) &&
+		admissionCtrlPacket(sData->admission_ctrl,rcvData.controlRCV.ip.s_addr)==AC_LIMITED);
 
 	if(controlRcvRetValue<0) {
 		// Set error
@@ -121,6 +137,8 @@ static uint8_t initReceiver(struct lampsock_data *sData, uint64_t interval, int
 
 		return_val=1;
 	} else {
+		printInterSessionGap(&(sData->session_end));
+
 		// Set session data
 		fprintf(stdout,"Server will accept all packets coming from client %s, id: %u\n",
 			inet_ntoa(rcvData.controlRCV.ip),rcvData.controlRCV.session_id);
@@ -133,6 +151,13 @@ static uint8_t initReceiver(struct lampsock_data *sData, uint64_t interval, int
 		sData->addru.addrin[1].sin_port=udp_forced_dst_port == -1 ? rcvData.controlRCV.port : htons(udp_forced_dst_port);
 
 		lamp_id_session=rcvData.controlRCV.session_id;
+		client_ip_session=rcvData.controlRCV.ip;
+
+		// Accept all the requested extensions which are supported (the accepted ones will be notified to the client with the ACK)
+		ext_flags_session=rcvData.controlRCV.ext_flags & LAMP_EXT_SUPPORTED_FLAGS;
+		if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+			fprintf(stdout,"The client requested the usage of extended (64 bit) sequence numbers.\n");
+		}
 
 		if(rcvData.controlRCV.type_idx==INIT_UNIDIR_INDEX) {
 			mode_session=UNIDIR;
@@ -173,9 +198,13 @@ static int transmitReportUDP(struct lampsock_data sData, struct options *opts) {
 	// LaMP packet size container
 	uint32_t lampPacketSize=0;
 
-	// Report payload length and report buffer
-	size_t report_payloadlen;
-	char report_buff[REPORT_BUFF_SIZE]; // REPORT_BUFF_SIZE defined inside report_manager.h
+	// Binary encoded report, its length and the buffer which will contain each fragment to be sent
+	uint8_t *report_enc;
+	size_t report_enclen;
+	byte_t report_frag[REPORT_FRAG_MAX_SIZE]; // REPORT_FRAG_MAX_SIZE defined inside report_encoding.h
+	size_t report_fraglen;
+	unsigned int report_fragnum;
+	unsigned int fragidx;
 
 	// for loop counter
 	int counter=0;
@@ -191,20 +220,21 @@ static int transmitReportUDP(struct lampsock_data sData, struct options *opts) {
 	// Junk variable (needed to clear the timer event with read())
 	unsigned long long junk;
 
-	// Copying the report string inside the report buffer
-	repprintf(report_buff,reportData);
+	// Encode the report (it may be split into more than one fragment if it does not fit inside a single LaMP packet)
+	report_enc=reportEncode(&reportData,&report_enclen);
+	if(!report_enc) {
+		return 2;
+	}
 
-	// Compute report payload length
-	report_payloadlen=strlen(report_buff);
+	report_fragnum=reportFragmentsNumber(report_enclen);
 
 	// Allocating buffers
-	lampPacket=malloc(sizeof(struct lamphdr)+report_payloadlen);
+	lampPacket=malloc(sizeof(struct lamphdr)+REPORT_FRAG_MAX_SIZE);
 	if(!lampPacket) {
+		free(report_enc);
 		return 2;
 	}
 
-	lampPacketSize=LAMP_HDR_PAYLOAD_SIZE(report_payloadlen);
-
 	lampHeadPopulate(&lampHeader, CTRL_UNIDIR_REPORT, lamp_id_session, 0); // Starting back from sequence number equal to 0
 
 	// Create thread for receiving the ACK from the client
@@ -224,15 +254,26 @@ static int transmitReportUDP(struct lampsock_data sData, struct options *opts) {
 			}
 			pthread_mutex_unlock(&ack_report_received_mut);
 
-			// Prepare the LaMP packet
-			lampEncapsulate(lampPacket, &lampHeader, (byte_t *) report_buff, report_payloadlen);
+			// Send all the report fragments, each one inside a different LaMP packet
+			for(fragidx=0;fragidx<report_fragnum;fragidx++) {
+				report_fraglen=reportFragmentPrepare(report_frag,report_enc,report_enclen,fragidx);
+				lampPacketSize=LAMP_HDR_PAYLOAD_SIZE(report_fraglen);
 
-			// Set timestamp
-			lampHeadSetTimestamp((struct lamphdr *)lampPacket,NULL);
+				// Prepare the LaMP packet
+				lampEncapsulate(lampPacket, &lampHeader, report_frag, report_fraglen);
 
-			if(sendto(sData.descriptor,lampPacket,lampPacketSize,NO_FLAGS,(struct sockaddr *)&sData.addru.addrin[1],sizeof(sData.addru.addrin[1]))!=lampPacketSize) {
-				perror("sendto() for sending LaMP packet failed");
-				fprintf(stderr,"Failed sending report. Retrying in %d second(s).\n",REPORT_RETRY_INTERVAL_MS);
+				// Set timestamp
+				lampHeadSetTimestamp((struct lamphdr *)lampPacket,NULL);
+
+				if(sendto(sData.descriptor,lampPacket,lampPacketSize,NO_FLAGS,(struct sockaddr *)&sData.addru.addrin[1],sizeof(sData.addru.addrin[1]))!=lampPacketSize) {
+					perror("sendto() for sending LaMP packet failed");
+					fprintf(stderr,"Failed sending report. Retrying in %d second(s).\n",REPORT_RETRY_INTERVAL_MS);
+				}
+
+				// Each fragment will have its own sequence number
+				if(fragidx<report_fragnum-1) {
+					lampHeadIncreaseSeq(&lampHeader);
+				}
 			}
 		}
 
@@ -261,6 +302,7 @@ static int transmitReportUDP(struct lampsock_data sData, struct options *opts) {
 
 	// Free all buffers before returning
 	free(lampPacket);
+	free(report_enc);
 
 	return return_val;
 }
@@ -296,6 +338,7 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 	uint16_t lamp_id_rx;
 	uint16_t lamp_seq_rx=0; // Initilized to 0 in order to be sure to enter the while loop
 	uint16_t lamp_payloadlen_rx;
+	uint64_t lamp_extseq_rx=INITIAL_SEQ_NO; // Full width sequence number (used only when extended sequence numbers are in use)
 	lamptype_t lamp_type_tx; // Hardware tx timestamping only
 
 	// LaMP fields for packet retrieved from socket error queue (hardware tx timestamping only)
@@ -325,6 +368,10 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 
 	// File descriptor for -W option (write per-packet data to CSV file)
 	int Wfiledescriptor=-1;
+	tfileWriter Wwriter=NULL; // Asynchronous writer for the per-packet data, when '-W' is specified
+	tfileBinaryHeader Wbinheader;
+	tfileRotationParams Wrotation;
+	char *Wfilename_opened=NULL; // Name of the -W file which was actually opened (needed to name the next segments when rotating the file)
 
 	// Per-packet data structure (to be used when -W is selected)
 	// The followup_on_flag can be already set here, together with tripTimeProc,
@@ -343,8 +390,13 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 	// Flag managed internally by writeToReportSocket()
 	uint8_t first_call=1;
 
+	// Number of packets discarded because of the rate limit (--rate-limit) during the session
+	uint64_t rate_limited=0;
+
 	ack_report_received=0;
 	followup_mode_session=FOLLOWUP_OFF;
+	timedout_session=0;
+	latencyHistReset(&latencyHistData);
 	t_rx_error=NO_ERR;
 	t_tx_error=NO_ERR;
 	if(pthread_mutex_init(&ack_report_received_mut,NULL)!=0) {
@@ -363,6 +415,11 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 		opts->interval<=MIN_TIMEOUT_VAL_S ? MIN_TIMEOUT_VAL_S : opts->interval,
 		opts->refuseFollowup==1 ? "refused" : "accepted");
 
+	if(opts->rate_limit>0) {
+		fprintf(stdout,"\t[rate limit] = %" PRIu32 " packets/s for each client (bucket size: %" PRIu32 " packets)\n",
+			opts->rate_limit,opts->rate_limit_burst);
+	}
+
 	// Print current UP
 	if(opts->macUP==UINT8_MAX) {
 		fprintf(stdout,"\t[user priority] = unset or unpatched kernel.\n\n");
@@ -371,7 +428,14 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 	}
 
 	// Report structure inizialization
-	reportStructureInit(&reportData, 0, opts->number, opts->latencyType, opts->followup_mode, opts->dup_detect_enabled);
+	// In continuous daemon mode, the structure (and its duplicated packets detection list) is allocated only for the first
+	// session, and then just reset, in order to be ready to receive the next session as soon as possible
+	if(reportData_allocated) {
+		reportStructureReset(&reportData, opts->number, opts->latencyType, opts->followup_mode);
+	} else {
+		reportStructureInit(&reportData, 0, opts->number, opts->latencyType, opts->followup_mode, opts->dup_detect_enabled);
+		reportData_allocated=opts->dmode;
+	}
 
 	// Prepare sendto sockaddr_in structure (index 1) for the server ('sin_addr' and 'sin_port' will be set later on, as the server receives its first packet from a client)
 	memset(&sData.addru.addrin[1],0,sizeof(sData.addru.addrin[1]));
@@ -443,9 +507,45 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 
 	// Open CSV file when '-W' is specified (as this only applies to the unidirectional mode, no file is create when the mode is not unidirectional)
 	if(opts->Wfilename!=NULL && mode_session==UNIDIR) {
-		Wfiledescriptor=openTfile(opts->Wfilename,opts->overwrite_W,opts->followup_mode!=FOLLOWUP_OFF,opts->report_extra_data);
+		Wfiledescriptor=openTfileNamed(opts->Wfilename,opts->overwrite_W,opts->followup_mode!=FOLLOWUP_OFF,opts->report_extra_data,opts->W_binary,&Wfilename_opened);
 		if(Wfiledescriptor<0) {
 			fprintf(stderr,"Warning! Cannot open file for writing single packet latency data.\nThe '-W' option will be disabled.\n");
+		} else {
+			// Start the writer thread: from now on, no system call will be performed on the receive path to write the per-packet data
+			// Describe the current test in the header of the binary trace, when --report-perpacket-binary is specified
+			if(opts->W_binary) {
+				Wbinheader.lamp_id=lamp_id_session;
+				Wbinheader.latency_type=opts->latencyType;
+				Wbinheader.followup_on_flag=opts->followup_mode!=FOLLOWUP_OFF;
+				Wbinheader.enabled_extra_data=opts->report_extra_data;
+				Wbinheader.side=TFILE_BIN_SIDE_SERVER;
+				Wbinheader.decimal_digits=W_DECIMAL_DIGITS;
+			}
+
+			// Rotate the file by size and/or by wall-clock interval, when --report-perpacket-rotate-size/interval are specified
+			if(opts->W_rotate_size>0 || opts->W_rotate_interval>0) {
+				Wrotation.size=opts->W_rotate_size;
+				Wrotation.interval=opts->W_rotate_interval;
+				Wrotation.hook=opts->W_rotate_hook;
+				Wrotation.filename=Wfilename_opened;
+				Wrotation.overwrite=opts->overwrite_W;
+				Wrotation.followup_on_flag=opts->followup_mode!=FOLLOWUP_OFF;
+				Wrotation.enabled_extra_data=opts->report_extra_data;
+			}
+
+			Wwriter=tfileWriterInit(Wfiledescriptor,W_DECIMAL_DIGITS,opts->W_binary ? &Wbinheader : NULL,
+				(opts->W_rotate_size>0 || opts->W_rotate_interval>0) && Wfilename_opened!=NULL ? &Wrotation : NULL);
+			if(CHECK_TW_NULL(Wwriter)) {
+				fprintf(stderr,"Warning! Cannot start the thread writing single packet latency data.\nThe '-W' option will be disabled.\n");
+				closeTfile(Wfiledescriptor);
+				Wfiledescriptor=-1;
+			}
+
+			// The writer keeps its own copy of the file name
+			if(Wfilename_opened!=NULL) {
+				free(Wfilename_opened);
+				Wfilename_opened=NULL;
+			}
 		}
 	}
 	
@@ -491,6 +591,7 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 		if(rcv_bytes==-1) {
 			if(errno==EAGAIN) {
 				fprintf(stderr,"Timeout reached when receiving packets. Connection terminated.\n");
+				timedout_session=1;
 				if(mode_session==UNIDIR) {
 					reportSetTimeoutOccurred(&reportData);
 				}
@@ -501,6 +602,12 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 			}
 		}
 
+		// With --rate-limit, discard the packets exceeding the rate of their client, before doing anything else with them
+		if(!CHECK_AC_NULL(sData.admission_ctrl) && admissionCtrlPacket(sData.admission_ctrl,srcAddr.sin_addr.s_addr)==AC_LIMITED) {
+			rate_limited++;
+			continue;
+		}
+
 		// Check whether the packet is really encapsulating LaMP; if it is not, discard packet
 		// The packet is also discarded is the program receives less bytes, in the UDP payload, than
 		//  the number of bytes in a LaMP header
@@ -641,17 +748,34 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 						inet_ntoa(srcAddr.sin_addr),lamp_id_rx,lamp_seq_rx,(int)rcv_bytes,(double)tripTime/1000,latencyTypePrinter(opts->latencyType));
 				}
 
-				// Update the current report structure
-				reportStructureUpdate(&reportData,tripTime,lamp_seq_rx);
+				// Update the current report structure, using the full width sequence number carried in the payload, when available
+				// A packet not carrying it (which should never be sent by the client) is given the extended sequence number
+				// closest to the last received one
+				if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+					if(lamp_payloadlen_rx>=LAMP_EXTSEQ_SIZE && rcv_bytes>=LAMP_HDR_PAYLOAD_SIZE(LAMP_EXTSEQ_SIZE)) {
+						lamp_extseq_rx=lampExtSeqRead(lampPacket+LAMP_HDR_SIZE());
+					} else {
+						lamp_extseq_rx=lampExtSeqExpand(lamp_extseq_rx,lamp_seq_rx);
+					}
+
+					reportStructureUpdateExt(&reportData,tripTime,lamp_extseq_rx);
+				} else {
+					reportStructureUpdate(&reportData,tripTime,lamp_seq_rx);
+				}
+
+				// With --aggregate-stats, keep also the latency histogram of the session, which is merged at the end of the session
+				if(!CHECK_AT_NULL(sData.aggr_table) && tripTime!=0) {
+					latencyHistUpdate(&latencyHistData,tripTime);
+				}
 
 				// When '-W' is specified, write the current measured value to the specified CSV file too (if a file was successfully opened)
 				if(Wfiledescriptor>0 || opts->udp_params.enabled) {
-					perPktData.seqNo=lamp_seq_rx;
+					perPktData.seqNo=(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) ? lamp_extseq_rx : lamp_seq_rx;
 					perPktData.signedTripTime=timevalSub_retval==0 ? rx_timestamp.tv_sec*SEC_TO_MICROSEC+rx_timestamp.tv_usec : -(rx_timestamp.tv_sec*SEC_TO_MICROSEC+rx_timestamp.tv_usec);
 					perPktData.tx_timestamp=tx_timestamp;
 
 					if(Wfiledescriptor>0) {
-						writeToTFile(Wfiledescriptor,W_DECIMAL_DIGITS,&perPktData);
+						tfileWriterPush(Wwriter,&perPktData);
 					}
 
 					if(opts->udp_params.enabled) {
@@ -670,9 +794,11 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 						}
 					}
 
-					carbon_pthread_mutex_lock(ctd);
-					carbonReportStructureUpdate(&carbonReportData,tripTime,lamp_seq_rx,opts->dup_detect_enabled);
-					carbon_pthread_mutex_unlock(ctd);
+					if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+						carbonReportStructureUpdateExt(&carbonReportData,tripTime,lamp_extseq_rx,opts->dup_detect_enabled);
+					} else {
+						carbonReportStructureUpdate(&carbonReportData,tripTime,lamp_seq_rx,opts->dup_detect_enabled);
+					}
 				}
 			break;
 
@@ -760,6 +886,24 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 						fprintf(stderr,"UDP server reported that it can't reply to the client with id=%u and seq=%u (follow-up)\n",lamp_id_rx,lamp_seq_rx);
 					}
 				}
+
+				// When --reflector-batch or --xdp-reflector is specified, as soon as a normal request is received (i.e. the
+				// session will go on without follow-ups), reflect all the other requests in batches or in the kernel
+				if(continueFlag && followup_mode_session==FOLLOWUP_OFF && (opts->reflector_batch>1 || opts->xdp_reflector)) {
+					switch(opts->xdp_reflector ? udpXdpReflectorRun(sData,opts,lamp_id_session) : udpReflectorRun(sData,opts,lamp_id_session)) {
+						case REFLECTOR_TIMEOUT:
+							fprintf(stderr,"Timeout reached when receiving packets. Connection terminated.\n");
+							timedout_session=1;
+							break;
+						case REFLECTOR_ERROR:
+							fprintf(stderr,"UDP server reported an error in the reflector. Connection terminated.\n");
+							break;
+						default:
+							break;
+					}
+
+					continueFlag=0;
+				}
 			break;
 
 			default:
@@ -767,6 +911,15 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 		}
 	}
 
+	if(rate_limited>0) {
+		fprintf(stdout,"Rate limit: %" PRIu64 " packets discarded during the session.\n",rate_limited);
+	}
+
+	// Merge the session in the aggregated statistics (only its counters are updated, whatever the number of packets is)
+	if(!CHECK_AT_NULL(sData.aggr_table)) {
+		aggrTableAddSession(sData.aggr_table,client_ip_session,mode_session,&reportData,&latencyHistData,timedout_session);
+	}
+
 	if(mode_session==UNIDIR) {
 		// Terminate the carbon flush thread
 		// carbon_metrics_flush_first is checked in order to verify if the thread has been created or not
@@ -776,7 +929,8 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 		}
 
 		if(Wfiledescriptor>0) {
-			closeTfile(Wfiledescriptor);
+			// The '-W' file is closed by the writer
+			tfileWriterFree(Wwriter);
 		}
 
 		if(opts->udp_params.enabled) {
@@ -801,10 +955,20 @@ unsigned int runUDPserver(struct lampsock_data sData, struct options *opts) {
 		}
 	}
 
-	reportStructureFree(&reportData);
+	if(!reportData_allocated) {
+		reportStructureFree(&reportData);
+	}
 
 	// Destroy mutex (as it is no longer needed) and clear all the other data that should be clared (see the CLEAR_ALL() macro)
 	CLEAR_ALL();
 
 	return 0;
+}
+
+// Free the data kept allocated across the sessions in continuous daemon mode (to be called after the last session)
+void runUDPserverFree(void) {
+	if(reportData_allocated) {
+		reportStructureFree(&reportData);
+		reportData_allocated=0;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,1146 @@
+#define _GNU_SOURCE
+#include "udp_server_multi.h"
+#include "report_manager.h"
+#include "tfile_writer.h"
+#include "report_encoding.h"
+#include "packet_structs.h"
+#include "timeval_utils.h"
+#include "session_table.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include "common_thread.h"
+#include "timer_man.h"
+#include "common_udp.h"
+#include "aggr_table.h"
+#include "admission_ctrl.h"
+#include "carbon_report_manager.h"
+#include <arpa/inet.h>
+
+typedef enum {
+	SESSION_RUNNING,	// The session is receiving test packets
+	SESSION_REPORTING	// Unidirectional mode only: the test is over and the report is being sent, until an ACK is received
+} sessionstate_t;
+
+// State of each session: it contains everything which, in runUDPserver(), is either file-static or local to the receive loop
+typedef struct serverSession {
+	sessionKey key;
+	struct sockaddr_in dstAddr; // Destination of the replies, follow-up data and report of the session
+	sessionstate_t state;
+
+	modeub_t mode;
+	modefollowup_t followup_mode;
+	uint16_t ext_flags; // LaMP extensions requested by the client and accepted by the server during the INIT procedure
+	uint8_t isnotfirst_FU; // Used to discard any follow-up request after the first one (see runUDPserver())
+	uint64_t lamp_extseq_rx; // Full width sequence number (used only when extended sequence numbers are in use)
+	struct timeval last_rx; // Time at which the last packet of the session has been received (for the session timeout)
+
+	reportStructure reportData;
+	latencyHist *aggrHist; // Latency histogram merged in the aggregated statistics (unidirectional mode with --aggregate-stats only)
+	uint8_t timedout; // = 1 if the session has been terminated by the timeout
+
+	// Metrics sent to Carbon every -g interval, under <-g metric path>.sessions.<client IP>_<client port>_<LaMP id>
+	// (unidirectional mode with -g only, NULL otherwise)
+	carbonReportStructure *carbonData;
+	char *carbonPath;
+
+	// '-W' file of the session (unidirectional mode only)
+	int Wfiledescriptor;
+	tfileWriter Wwriter;
+	perPackerDataStructure perPktData;
+
+	// Report transmission (unidirectional mode only)
+	uint8_t *report_enc;
+	size_t report_enclen;
+	unsigned int report_attempts;
+	uint16_t report_seq;
+	struct timeval report_next_tx;
+} serverSession;
+
+// Statistics of each thread, merged when the server is terminated
+struct multiServerStats {
+	uint64_t rx_packets; // Number of received datagrams
+	uint64_t rx_limited; // Datagrams discarded because of the rate limit (--rate-limit)
+	uint64_t inits_refused; // INIT packets ignored because of the maximum number of sessions (--max-sessions)
+	uint64_t sessions_admitted;
+	uint64_t sessions_completed; // Sessions ended with the report acknowledged by the client, or with the last ping-like request
+	uint64_t sessions_timedout;
+	uint64_t reports_unacked; // Reports for which no ACK was received after REPORT_RETRY_MAX_ATTEMPTS attempts
+};
+
+// Data shared between the receive loop and the functions called on each session through sessionTableForEach()
+struct multiServerContext {
+	arg_struct_udp args;
+	sessionTable ST;
+	struct timeval now;
+	uint64_t timeout_ms;
+	uint8_t sw_rx_timestamping; // = 1 when SO_TIMESTAMP has been enabled on the socket (-L r or kernel rx follow-up)
+	struct multiServerStats stats;
+
+	// Carbon sink shared by all the threads (NULL if '-g' is not specified), and list of the sessions of the thread whose
+	// metrics are flushed at the next -g interval, with carbonReportStructureFlushMulti()
+	carbonSink carbon_sink;
+	struct timeval next_carbon_flush;
+	carbonReportStructure **carbon_reports;
+	const char **carbon_paths;
+	int carbon_nreports;
+	int carbon_size;
+};
+
+// Thread serving the sessions whose packets are received by its own socket (a single one, without --server-threads)
+struct multiServerThread {
+	struct multiServerContext ctx;
+	volatile sig_atomic_t *stop_flag;
+	unsigned int idx;
+	int cpu; // CPU to which the thread is pinned (-1: not pinned)
+	pthread_t tid;
+	unsigned int return_val;
+};
+
+static inline void timevalAddMs(struct timeval *tv,uint64_t ms) {
+	struct timeval add={.tv_sec=(time_t) (ms/MILLISEC_TO_SEC),.tv_usec=(suseconds_t) ((ms%MILLISEC_TO_SEC)*MILLISEC_TO_MICROSEC)};
+
+	timeradd(tv,&add,tv);
+}
+
+// Set the destination of the control packets and follow-up data sent with the functions defined in common_udp.c
+static inline void sessionSetDestination(struct multiServerContext *ctx,serverSession *sess) {
+	ctx->args.sData.addru.addrin[1]=sess->dstAddr;
+}
+
+// Get the name of the '-W' file of a session, i.e. <-W file name>_<client IP>_<client port>_<LaMP id>.csv (or .ltb)
+// The returned string should be freed by the caller
+static char *sessionWfilename(const char *Wfilename,sessionKey key) {
+	struct in_addr ip={.s_addr=key.ip};
+	char ipstr[INET_ADDRSTRLEN];
+	size_t namelen=strlen(Wfilename)+INET_ADDRSTRLEN+14; // '_', '_' and '_' + 5 digits port + 5 digits id + '\0'
+	char *name;
+
+	name=malloc(namelen*sizeof(char));
+	if(!name) {
+		return NULL;
+	}
+
+	inet_ntop(AF_INET,&ip,ipstr,sizeof(ipstr));
+
+	// All the -W file names end with a 4 characters extension (see parse_options())
+	snprintf(name,namelen,"%.*s_%s_%u_%u%s",(int) (strlen(Wfilename)-4),Wfilename,
+		ipstr,ntohs(key.port),key.lamp_id,Wfilename+strlen(Wfilename)-4);
+
+	return name;
+}
+
+static void sessionOpenWfile(struct options *opts,serverSession *sess) {
+	tfileBinaryHeader Wbinheader;
+	tfileRotationParams Wrotation;
+	char *Wfilename_session;
+	char *Wfilename_opened=NULL;
+
+	Wfilename_session=sessionWfilename(opts->Wfilename,sess->key);
+	if(!Wfilename_session) {
+		fprintf(stderr,"Warning! Cannot allocate the name of the file for writing single packet latency data (id=%u).\n"
+			"The '-W' option will be disabled for this session.\n",sess->key.lamp_id);
+		return;
+	}
+
+	sess->Wfiledescriptor=openTfileNamed(Wfilename_session,opts->overwrite_W,opts->followup_mode!=FOLLOWUP_OFF,opts->report_extra_data,opts->W_binary,&Wfilename_opened);
+	free(Wfilename_session);
+
+	if(sess->Wfiledescriptor<0) {
+		fprintf(stderr,"Warning! Cannot open file for writing single packet latency data (id=%u).\n"
+			"The '-W' option will be disabled for this session.\n",sess->key.lamp_id);
+		return;
+	}
+
+	if(opts->W_binary) {
+		Wbinheader.lamp_id=sess->key.lamp_id;
+		Wbinheader.latency_type=opts->latencyType;
+		Wbinheader.followup_on_flag=opts->followup_mode!=FOLLOWUP_OFF;
+		Wbinheader.enabled_extra_data=opts->report_extra_data;
+		Wbinheader.side=TFILE_BIN_SIDE_SERVER;
+		Wbinheader.decimal_digits=W_DECIMAL_DIGITS;
+	}
+
+	if(opts->W_rotate_size>0 || opts->W_rotate_interval>0) {
+		Wrotation.size=opts->W_rotate_size;
+		Wrotation.interval=opts->W_rotate_interval;
+		Wrotation.hook=opts->W_rotate_hook;
+		Wrotation.filename=Wfilename_opened;
+		Wrotation.overwrite=opts->overwrite_W;
+		Wrotation.followup_on_flag=opts->followup_mode!=FOLLOWUP_OFF;
+		Wrotation.enabled_extra_data=opts->report_extra_data;
+	}
+
+	sess->Wwriter=tfileWriterInit(sess->Wfiledescriptor,W_DECIMAL_DIGITS,opts->W_binary ? &Wbinheader : NULL,
+		(opts->W_rotate_size>0 || opts->W_rotate_interval>0) && Wfilename_opened!=NULL ? &Wrotation : NULL);
+	if(CHECK_TW_NULL(sess->Wwriter)) {
+		fprintf(stderr,"Warning! Cannot start the thread writing single packet latency data (id=%u).\n"
+			"The '-W' option will be disabled for this session.\n",sess->key.lamp_id);
+		closeTfile(sess->Wfiledescriptor);
+		sess->Wfiledescriptor=-1;
+	}
+
+	if(Wfilename_opened!=NULL) {
+		free(Wfilename_opened);
+	}
+}
+
+// Prepare the Carbon metrics of a new unidirectional session (if they cannot be allocated, they are not sent for this session)
+static void sessionOpenCarbon(struct multiServerContext *ctx,serverSession *sess) {
+	struct options *opts=ctx->args.opts;
+	struct in_addr ip={.s_addr=sess->key.ip};
+	char ipstr[INET_ADDRSTRLEN];
+	size_t pathlen=strlen(opts->carbon_metric_path)+INET_ADDRSTRLEN+24; // '.sessions.', '_' and '_' + 5 digits port + 5 digits id + '\0'
+
+	sess->carbonData=malloc(sizeof(carbonReportStructure));
+	sess->carbonPath=malloc(pathlen*sizeof(char));
+	if(!sess->carbonData || !sess->carbonPath) {
+		fprintf(stderr,"Warning: cannot allocate the Carbon/Graphite metrics of a new session (id=%u).\n"
+			"No metric will be sent for this session.\n",sess->key.lamp_id);
+		free(sess->carbonData);
+		free(sess->carbonPath);
+		sess->carbonData=NULL;
+		sess->carbonPath=NULL;
+		return;
+	}
+
+	// inet_ntop() is used instead of inet_ntoa(), as more than one thread may be running; the '.' inside the IP address
+	// would be interpreted as a path separator
+	inet_ntop(AF_INET,&ip,ipstr,sizeof(ipstr));
+	for(char *c=ipstr;*c!='\0';c++) {
+		if(*c=='.') {
+			*c='_';
+		}
+	}
+
+	snprintf(sess->carbonPath,pathlen,"%s.sessions.%s_%u_%u",opts->carbon_metric_path,ipstr,ntohs(sess->key.port),sess->key.lamp_id);
+
+	carbonReportStructureInit(sess->carbonData,opts);
+	sess->carbonData->sink=ctx->carbon_sink;
+}
+
+// Flush the metrics of the last (partial) -g interval of a session which is ending, and free them
+// As in carbon_thread_manager.c, '1' is added to the timestamp, to avoid overwriting the metrics of the last full interval
+static void sessionCloseCarbon(struct multiServerContext *ctx,serverSession *sess) {
+	if(sess->carbonData==NULL) {
+		return;
+	}
+
+	carbonReportStructureFlushMulti(&(sess->carbonData),(const char **) &(sess->carbonPath),1,ctx->carbon_sink,ctx->args.opts,g_DECIMAL_DIGITS,1);
+
+	carbonReportStructureFree(sess->carbonData,ctx->args.opts);
+	free(sess->carbonData);
+	free(sess->carbonPath);
+	sess->carbonData=NULL;
+	sess->carbonPath=NULL;
+}
+
+static void sessionCloseWfile(serverSession *sess) {
+	if(sess->Wfiledescriptor>0) {
+		// The '-W' file is closed by the writer
+		tfileWriterFree(sess->Wwriter);
+		sess->Wfiledescriptor=-1;
+	}
+}
+
+// Free a session (which should have already been removed from the session table, if it was inserted), releasing also its
+// place among the concurrent sessions (--max-sessions)
+static void sessionFree(struct multiServerContext *ctx,serverSession *sess) {
+	sessionCloseWfile(sess);
+	sessionCloseCarbon(ctx,sess);
+
+	if(sess->report_enc) {
+		free(sess->report_enc);
+	}
+
+	reportStructureFree(&(sess->reportData));
+
+	if(sess->aggrHist) {
+		free(sess->aggrHist);
+	}
+
+	free(sess);
+
+	if(!CHECK_AC_NULL(ctx->args.sData.admission_ctrl)) {
+		admissionCtrlSessionEnd(ctx->args.sData.admission_ctrl);
+	}
+}
+
+// Merge a session which is going to be freed in the aggregated statistics (--aggregate-stats), shared by all the threads
+static void sessionAggregate(struct multiServerContext *ctx,serverSession *sess) {
+	struct in_addr ip={.s_addr=sess->key.ip};
+
+	if(!CHECK_AT_NULL(ctx->args.sData.aggr_table)) {
+		aggrTableAddSession(ctx->args.sData.aggr_table,ip,sess->mode,&(sess->reportData),sess->aggrHist,sess->timedout);
+	}
+}
+
+// Send the ACK to the INIT of a session (it is sent again every time the same INIT is received, as the client retransmits
+// it until an ACK is received)
+static void sessionSendInitAck(struct multiServerContext *ctx,serverSession *sess) {
+	char ipstr[INET_ADDRSTRLEN];
+
+	sessionSetDestination(ctx,sess);
+
+	if(controlSenderUDP(&(ctx->args),sess->key.lamp_id,1,ACK,sess->ext_flags,0,NULL,NULL)<0) {
+		inet_ntop(AF_INET,&(sess->dstAddr.sin_addr),ipstr,sizeof(ipstr));
+		fprintf(stderr,"Error: cannot send the ACK to the INIT of the session with %s (id=%u).\n",
+			ipstr,sess->key.lamp_id);
+	}
+}
+
+// Admit a new session, after receiving its INIT packet
+static serverSession *sessionAdmit(struct multiServerContext *ctx,sessionKey key,uint16_t type_idx,uint16_t ext_flags_requested) {
+	struct options *opts=ctx->args.opts;
+	serverSession *sess;
+	modeub_t mode;
+	char ipstr[INET_ADDRSTRLEN];
+
+	if(type_idx==INIT_UNIDIR_INDEX) {
+		mode=UNIDIR;
+	} else if(type_idx==INIT_PINGLIKE_INDEX) {
+		mode=PINGLIKE;
+	} else {
+		return NULL;
+	}
+
+	// With --max-sessions, the INIT is ignored (without any message, as the client retransmits it) if there are already
+	// too many active sessions, over all the threads
+	if(!CHECK_AC_NULL(ctx->args.sData.admission_ctrl) && admissionCtrlSessionStart(ctx->args.sData.admission_ctrl)==AC_LIMITED) {
+		ctx->stats.inits_refused++;
+		return NULL;
+	}
+
+	sess=calloc(1,sizeof(serverSession));
+	if(!sess) {
+		fprintf(stderr,"Error: cannot allocate the state of a new session. The INIT will be ignored.\n");
+		if(!CHECK_AC_NULL(ctx->args.sData.admission_ctrl)) {
+			admissionCtrlSessionEnd(ctx->args.sData.admission_ctrl);
+		}
+		return NULL;
+	}
+
+	sess->key=key;
+	sess->state=SESSION_RUNNING;
+	sess->mode=mode;
+	sess->followup_mode=FOLLOWUP_OFF;
+	sess->ext_flags=ext_flags_requested & LAMP_EXT_SUPPORTED_FLAGS;
+	sess->lamp_extseq_rx=INITIAL_SEQ_NO;
+	sess->last_rx=ctx->now;
+	sess->Wfiledescriptor=-1;
+
+	// If the udp-force-dst-port option is specified, force a UDP destination port, otherwise use the client source port
+	sess->dstAddr.sin_family=AF_INET;
+	sess->dstAddr.sin_addr.s_addr=key.ip;
+	sess->dstAddr.sin_port=opts->udp_forced_dst_port==-1 ? key.port : htons(opts->udp_forced_dst_port);
+
+	reportStructureInit(&(sess->reportData), 0, opts->number, opts->latencyType, opts->followup_mode, opts->dup_detect_enabled);
+
+	sess->perPktData.followup_on_flag=0;
+	sess->perPktData.tripTimeProc=0;
+	sess->perPktData.enabled_extra_data=opts->report_extra_data;
+	sess->perPktData.reportDataPointer=&(sess->reportData);
+
+	if(!CHECK_AT_NULL(ctx->args.sData.aggr_table) && mode==UNIDIR) {
+		sess->aggrHist=malloc(sizeof(latencyHist));
+		if(!sess->aggrHist) {
+			fprintf(stderr,"Warning: cannot allocate the latency histogram of a new session (id=%u).\n"
+				"Its latency values will not be included in the aggregated percentiles.\n",key.lamp_id);
+		} else {
+			latencyHistInit(sess->aggrHist);
+		}
+	}
+
+	if(sessionTableInsert(ctx->ST,key,sess)!=ST_NOERR) {
+		fprintf(stderr,"Error: cannot store a new session. The INIT will be ignored.\n");
+		sessionFree(ctx,sess);
+		return NULL;
+	}
+
+	if(opts->Wfilename!=NULL && mode==UNIDIR) {
+		sessionOpenWfile(opts,sess);
+	}
+
+	if(!CHECK_CS_NULL(ctx->carbon_sink) && mode==UNIDIR) {
+		sessionOpenCarbon(ctx,sess);
+	}
+
+	ctx->stats.sessions_admitted++;
+
+	inet_ntop(AF_INET,&(sess->dstAddr.sin_addr),ipstr,sizeof(ipstr));
+	fprintf(stdout,"Server accepted a new session from client %s:%u, id: %u, in %s mode%s (active sessions: %u).\n",
+		ipstr,ntohs(key.port),key.lamp_id,mode==UNIDIR ? "unidirectional" : "ping-like",
+		(sess->ext_flags & LAMP_EXT_FLAG_EXTSEQ) ? " with extended sequence numbers" : "",sessionTableCount(ctx->ST));
+
+	return sess;
+}
+
+// Send all the fragments of the report of a session (each attempt uses new sequence numbers, as in transmitReportUDP())
+static void sessionSendReport(struct multiServerContext *ctx,serverSession *sess) {
+	struct lamphdr lampHeader;
+	byte_t lampPacket[sizeof(struct lamphdr)+REPORT_FRAG_MAX_SIZE];
+	byte_t report_frag[REPORT_FRAG_MAX_SIZE];
+	size_t report_fraglen;
+	uint32_t lampPacketSize;
+	unsigned int report_fragnum=reportFragmentsNumber(sess->report_enclen);
+
+	for(unsigned int fragidx=0;fragidx<report_fragnum;fragidx++) {
+		lampHeadPopulate(&lampHeader, CTRL_UNIDIR_REPORT, sess->key.lamp_id, sess->report_seq++);
+
+		report_fraglen=reportFragmentPrepare(report_frag,sess->report_enc,sess->report_enclen,fragidx);
+		lampPacketSize=LAMP_HDR_PAYLOAD_SIZE(report_fraglen);
+
+		lampEncapsulate(lampPacket, &lampHeader, report_frag, report_fraglen);
+		lampHeadSetTimestamp((struct lamphdr *)lampPacket,NULL);
+
+		if(sendto(ctx->args.sData.descriptor,lampPacket,lampPacketSize,NO_FLAGS,(struct sockaddr *)&(sess->dstAddr),sizeof(sess->dstAddr))!=lampPacketSize) {
+			perror("sendto() for sending LaMP packet failed");
+			fprintf(stderr,"Failed sending report (id=%u). Retrying in %d ms.\n",sess->key.lamp_id,REPORT_RETRY_INTERVAL_MS);
+		}
+	}
+
+	sess->report_attempts++;
+	sess->report_next_tx=ctx->now;
+	timevalAddMs(&(sess->report_next_tx),REPORT_RETRY_INTERVAL_MS);
+}
+
+// Terminate the test of a unidirectional session and start sending its report: the report is then sent again every
+// REPORT_RETRY_INTERVAL_MS ms by sessionHousekeeping(), until the ACK is received
+// It returns -1 if the report cannot be encoded (in this case, the session should be removed)
+static int sessionStartReport(struct multiServerContext *ctx,serverSession *sess) {
+	sessionCloseWfile(sess);
+	sessionCloseCarbon(ctx,sess);
+
+	sess->report_enc=reportEncode(&(sess->reportData),&(sess->report_enclen));
+	if(!sess->report_enc) {
+		fprintf(stderr,"UDP server reported an error while encoding the report (id=%u).\n"
+			"No report will be transmitted.\n",sess->key.lamp_id);
+		return -1;
+	}
+
+	sess->state=SESSION_REPORTING;
+	sess->report_attempts=0;
+	sess->report_seq=0; // Starting back from sequence number equal to 0
+
+	sessionSendReport(ctx,sess);
+
+	return 0;
+}
+
+// Called on each session every MULTI_SESSION_TICK_MS ms: check the session timeout and retransmit the pending reports
+static int sessionHousekeeping(sessionKey key,void *session,void *arg) {
+	struct multiServerContext *ctx=(struct multiServerContext *) arg;
+	serverSession *sess=(serverSession *) session;
+	struct timeval deadline;
+	char ipstr[INET_ADDRSTRLEN];
+
+	if(sess->state==SESSION_RUNNING) {
+		deadline=sess->last_rx;
+		timevalAddMs(&deadline,ctx->timeout_ms);
+
+		if(timercmp(&(ctx->now),&deadline,>=)) {
+			inet_ntop(AF_INET,&(sess->dstAddr.sin_addr),ipstr,sizeof(ipstr));
+			fprintf(stderr,"Timeout reached when receiving packets from %s (id=%u). Connection terminated.\n",
+				ipstr,key.lamp_id);
+
+			ctx->stats.sessions_timedout++;
+			sess->timedout=1;
+
+			if(sess->mode==UNIDIR) {
+				reportSetTimeoutOccurred(&(sess->reportData));
+
+				if(sessionStartReport(ctx,sess)==0) {
+					return 0;
+				}
+			}
+
+			sessionAggregate(ctx,sess);
+			sessionFree(ctx,sess);
+			return 1;
+		}
+	} else if(timercmp(&(ctx->now),&(sess->report_next_tx),>=)) {
+		if(sess->report_attempts>=REPORT_RETRY_MAX_ATTEMPTS) {
+			inet_ntop(AF_INET,&(sess->dstAddr.sin_addr),ipstr,sizeof(ipstr));
+			fprintf(stderr,"No ACK received from %s for the report (id=%u). Session terminated.\n",
+				ipstr,key.lamp_id);
+
+			ctx->stats.reports_unacked++;
+
+			sessionAggregate(ctx,sess);
+			sessionFree(ctx,sess);
+			return 1;
+		}
+
+		sessionSendReport(ctx,sess);
+	}
+
+	return 0;
+}
+
+// Add the Carbon metrics of a running session to the list of the ones flushed at the current -g interval
+static int sessionCarbonCollect(sessionKey key,void *session,void *arg) {
+	struct multiServerContext *ctx=(struct multiServerContext *) arg;
+	serverSession *sess=(serverSession *) session;
+	carbonReportStructure **reports;
+	const char **paths;
+
+	if(sess->carbonData==NULL) {
+		return 0;
+	}
+
+	if(ctx->carbon_nreports==ctx->carbon_size) {
+		int newsize=ctx->carbon_size>0 ? ctx->carbon_size*2 : MULTI_SESSION_CARBON_LIST_SIZE;
+
+		reports=realloc(ctx->carbon_reports,newsize*sizeof(carbonReportStructure *));
+		if(reports) {
+			ctx->carbon_reports=reports;
+		}
+
+		paths=realloc(ctx->carbon_paths,newsize*sizeof(const char *));
+		if(paths) {
+			ctx->carbon_paths=paths;
+		}
+
+		// The metrics of this session are flushed at the next interval, as the receive thread keeps updating them
+		if(!reports || !paths) {
+			return 0;
+		}
+
+		ctx->carbon_size=newsize;
+	}
+
+	ctx->carbon_reports[ctx->carbon_nreports]=sess->carbonData;
+	ctx->carbon_paths[ctx->carbon_nreports]=sess->carbonPath;
+	ctx->carbon_nreports++;
+
+	return 0;
+}
+
+// Flush the Carbon metrics of all the running unidirectional sessions of the thread, coalescing them in as few batches as
+// possible; the metrics are only queued to the sink, thus the receive loop is never blocked by the connection to Carbon
+static void multiServerCarbonFlush(struct multiServerContext *ctx) {
+	ctx->carbon_nreports=0;
+	sessionTableForEach(ctx->ST,sessionCarbonCollect,ctx);
+
+	if(ctx->carbon_nreports>0) {
+		carbonReportStructureFlushMulti(ctx->carbon_reports,ctx->carbon_paths,ctx->carbon_nreports,ctx->carbon_sink,ctx->args.opts,g_DECIMAL_DIGITS,0);
+	}
+}
+
+// Used to free all the sessions which are still active when the server is terminated
+static int sessionDiscard(sessionKey key,void *session,void *arg) {
+	sessionFree((struct multiServerContext *) arg,(serverSession *) session);
+
+	return 1;
+}
+
+static void sessionRemove(struct multiServerContext *ctx,serverSession *sess) {
+	char ipstr[INET_ADDRSTRLEN];
+
+	sessionTableRemove(ctx->ST,sess->key);
+
+	ctx->stats.sessions_completed++;
+
+	inet_ntop(AF_INET,&(sess->dstAddr.sin_addr),ipstr,sizeof(ipstr));
+	fprintf(stdout,"Session with %s (id=%u) terminated (active sessions: %u).\n",
+		ipstr,sess->key.lamp_id,sessionTableCount(ctx->ST));
+
+	sessionAggregate(ctx,sess);
+	sessionFree(ctx,sess);
+}
+
+// Manage a follow-up request received within a session (only the first one is considered, as in runUDPserver())
+// As the socket is shared by all the sessions, the kernel and hardware transmit timestamps cannot be gathered for
+// each session: the corresponding follow-up requests are always denied
+static void sessionFollowupRequest(struct multiServerContext *ctx,serverSession *sess,uint16_t followup_request_type) {
+	uint16_t followup_reply_type;
+
+	if(ctx->args.opts->refuseFollowup) {
+		followup_reply_type=FOLLOWUP_DENY;
+	} else {
+		switch(followup_request_type) {
+			case FOLLOWUP_REQUEST_T_APP:
+				followup_reply_type=FOLLOWUP_ACCEPT;
+				sess->followup_mode=FOLLOWUP_ON_APP;
+				break;
+
+			case FOLLOWUP_REQUEST_T_KRN_RX:
+				if(!ctx->sw_rx_timestamping && socketSetTimestamping(ctx->args.sData,SET_TIMESTAMPING_SW_RX)>=0) {
+					ctx->sw_rx_timestamping=1;
+				}
+
+				if(ctx->sw_rx_timestamping) {
+					followup_reply_type=FOLLOWUP_ACCEPT;
+					sess->followup_mode=FOLLOWUP_ON_KRN_RX;
+				} else {
+					followup_reply_type=FOLLOWUP_DENY;
+				}
+				break;
+
+			case FOLLOWUP_REQUEST_T_HW:
+			case FOLLOWUP_REQUEST_T_KRN:
+				followup_reply_type=FOLLOWUP_DENY;
+				break;
+
+			default:
+				followup_reply_type=FOLLOWUP_UNKNOWN;
+				break;
+		}
+	}
+
+	sessionSetDestination(ctx,sess);
+	controlSenderUDP(&(ctx->args),sess->key.lamp_id,1,FOLLOWUP_CTRL,followup_reply_type,0,NULL,NULL);
+
+	sess->isnotfirst_FU=1;
+}
+
+// Process a single received packet: 'rx_timestamp_app' is the userspace receive timestamp, while 'rx_timestamp_krn' is the
+// kernel receive timestamp (meaningful only when SO_TIMESTAMP is enabled on the socket)
+static void processPacket(struct multiServerContext *ctx,byte_t *lampPacket,ssize_t rcv_bytes,struct sockaddr_in *srcAddr,struct timeval *rx_timestamp_app,struct timeval *rx_timestamp_krn,uint8_t stopping) {
+	struct options *opts=ctx->args.opts;
+	struct lamphdr *lampHeaderPtr=(struct lamphdr *) lampPacket;
+	serverSession *sess;
+	sessionKey key;
+	char ipstr[INET_ADDRSTRLEN];
+
+	// RX and TX timestamp containers
+	struct timeval rx_timestamp, tx_timestamp={.tv_sec=0,.tv_usec=0};
+	uint64_t tripTime;
+	int timevalSub_retval=0;
+
+	// LaMP relevant fields
+	lamptype_t lamp_type_rx;
+	uint16_t lamp_id_rx;
+	uint16_t lamp_seq_rx;
+	uint16_t lamp_payloadlen_rx;
+
+	uint8_t last_packet=0;
+
+	// Check whether the packet is really encapsulating LaMP; if it is not, discard packet
+	if(rcv_bytes<LAMP_HDR_SIZE() || !IS_LAMP(lampHeaderPtr->reserved,lampHeaderPtr->ctrl)) {
+		return;
+	}
+
+	lampHeadGetData(lampPacket, &lamp_type_rx, &lamp_id_rx, &lamp_seq_rx, &lamp_payloadlen_rx, &tx_timestamp, NULL);
+
+	key.ip=srcAddr->sin_addr.s_addr;
+	key.port=srcAddr->sin_port;
+	key.lamp_id=lamp_id_rx;
+
+	sess=(serverSession *) sessionTableLookup(ctx->ST,key);
+
+	// INIT: admit a new session (unless the server is terminating), or send again the ACK if the session already exists
+	if(lamp_type_rx==INIT) {
+		if(sess==NULL && !stopping && IS_INIT_INDEX_VALID(lamp_payloadlen_rx)) {
+			sess=sessionAdmit(ctx,key,lamp_payloadlen_rx,lampExtRead(lampPacket+LAMP_HDR_SIZE(),rcv_bytes-LAMP_HDR_SIZE()));
+		}
+
+		if(sess!=NULL && sess->state==SESSION_RUNNING) {
+			sessionSendInitAck(ctx,sess);
+		}
+
+		return;
+	}
+
+	// Discard any packet not belonging to an active session
+	if(sess==NULL) {
+		return;
+	}
+
+	// When the report is being sent, only the ACK from the client is of interest
+	if(sess->state==SESSION_REPORTING) {
+		if(lamp_type_rx==ACK) {
+			sessionRemove(ctx,sess);
+		}
+
+		return;
+	}
+
+	// Discard any (end)reply, ack, report or follow-up data
+	if(lamp_type_rx==PINGLIKE_REPLY || lamp_type_rx==PINGLIKE_REPLY_TLESS || lamp_type_rx==PINGLIKE_ENDREPLY || lamp_type_rx==ACK || lamp_type_rx==REPORT || lamp_type_rx==FOLLOWUP_DATA) {
+		return;
+	}
+
+	sess->last_rx=*rx_timestamp_app;
+
+	if(lamp_type_rx==FOLLOWUP_CTRL) {
+		if(IS_FOLLOWUP_REQUEST(lamp_payloadlen_rx) && sess->isnotfirst_FU==0) {
+			sessionFollowupRequest(ctx,sess,lamp_payloadlen_rx);
+		} else {
+			inet_ntop(AF_INET,&(srcAddr->sin_addr),ipstr,sizeof(ipstr));
+			fprintf(stdout,"Ignoring a follow-up request from %s (id=%u)..\n",
+				ipstr,lamp_id_rx);
+		}
+
+		return;
+	}
+
+	sess->isnotfirst_FU=1;
+
+	if(lamp_type_rx==UNIDIR_STOP || lamp_type_rx==PINGLIKE_ENDREQ || lamp_type_rx==PINGLIKE_ENDREQ_TLESS) {
+		last_packet=1;
+	}
+
+	switch(sess->mode) {
+		case UNIDIR:
+			rx_timestamp=opts->latencyType==KRT ? *rx_timestamp_krn : *rx_timestamp_app;
+
+			timevalSub_retval=timevalSub(&tx_timestamp,&rx_timestamp);
+			if(timevalSub_retval) {
+				inet_ntop(AF_INET,&(srcAddr->sin_addr),ipstr,sizeof(ipstr));
+				fprintf(stderr,"Error: negative latency (-%.3f ms - %s) for packet from %s (id=%u, seq=%u, rx_bytes=%d)!\nThe clock synchronization is not sufficienty precise to allow unidirectional measurements.\n",
+					(double) (rx_timestamp.tv_sec*SEC_TO_MICROSEC+rx_timestamp.tv_usec)/1000,latencyTypePrinter(opts->latencyType),
+					ipstr,lamp_id_rx,lamp_seq_rx,(int)rcv_bytes);
+				tripTime=0;
+			} else {
+				tripTime=rx_timestamp.tv_sec*SEC_TO_MICROSEC+rx_timestamp.tv_usec;
+			}
+
+			if(tripTime!=0) {
+				inet_ntop(AF_INET,&(srcAddr->sin_addr),ipstr,sizeof(ipstr));
+				fprintf(stdout,"Received a unidirectional message from %s (id=%u, seq=%u, rx_bytes=%d). Time: %.3f ms (%s)\n",
+					ipstr,lamp_id_rx,lamp_seq_rx,(int)rcv_bytes,(double)tripTime/1000,latencyTypePrinter(opts->latencyType));
+			}
+
+			if(sess->ext_flags & LAMP_EXT_FLAG_EXTSEQ) {
+				if(lamp_payloadlen_rx>=LAMP_EXTSEQ_SIZE && rcv_bytes>=LAMP_HDR_PAYLOAD_SIZE(LAMP_EXTSEQ_SIZE)) {
+					sess->lamp_extseq_rx=lampExtSeqRead(lampPacket+LAMP_HDR_SIZE());
+				} else {
+					sess->lamp_extseq_rx=lampExtSeqExpand(sess->lamp_extseq_rx,lamp_seq_rx);
+				}
+
+				reportStructureUpdateExt(&(sess->reportData),tripTime,sess->lamp_extseq_rx);
+
+				if(sess->carbonData) {
+					carbonReportStructureUpdateExt(sess->carbonData,tripTime,sess->lamp_extseq_rx,opts->dup_detect_enabled);
+				}
+			} else {
+				reportStructureUpdate(&(sess->reportData),tripTime,lamp_seq_rx);
+
+				if(sess->carbonData) {
+					carbonReportStructureUpdate(sess->carbonData,tripTime,lamp_seq_rx,opts->dup_detect_enabled);
+				}
+			}
+
+			if(sess->aggrHist && tripTime!=0) {
+				latencyHistUpdate(sess->aggrHist,tripTime);
+			}
+
+			if(sess->Wfiledescriptor>0) {
+				sess->perPktData.seqNo=(sess->ext_flags & LAMP_EXT_FLAG_EXTSEQ) ? sess->lamp_extseq_rx : lamp_seq_rx;
+				sess->perPktData.signedTripTime=timevalSub_retval==0 ? rx_timestamp.tv_sec*SEC_TO_MICROSEC+rx_timestamp.tv_usec : -(rx_timestamp.tv_sec*SEC_TO_MICROSEC+rx_timestamp.tv_usec);
+				sess->perPktData.tx_timestamp=tx_timestamp;
+
+				tfileWriterPush(sess->Wwriter,&(sess->perPktData));
+			}
+
+			if(last_packet && sessionStartReport(ctx,sess)<0) {
+				sessionRemove(ctx,sess);
+			}
+		break;
+
+		case PINGLIKE:
+			rx_timestamp=sess->followup_mode==FOLLOWUP_ON_KRN_RX ? *rx_timestamp_krn : *rx_timestamp_app;
+
+			if(!opts->printAfter) {
+				inet_ntop(AF_INET,&(srcAddr->sin_addr),ipstr,sizeof(ipstr));
+				fprintf(stdout,"Received a ping-like message from %s (id=%u, seq=%u, rx_bytes=%d). Replying to client...\n",
+					ipstr,lamp_id_rx,lamp_seq_rx,(int)rcv_bytes);
+			}
+
+			// Change the reply type inside the received packet, and send it back, as in runUDPserver()
+			if(lamp_type_rx==PINGLIKE_REQ || lamp_type_rx==PINGLIKE_ENDREQ) {
+				lampHeaderPtr->ctrl = last_packet==0 ? CTRL_PINGLIKE_REPLY : CTRL_PINGLIKE_ENDREPLY;
+			} else if(lamp_type_rx==PINGLIKE_REQ_TLESS || lamp_type_rx==PINGLIKE_ENDREQ_TLESS) {
+				lampHeaderPtr->ctrl = last_packet==0 ? CTRL_PINGLIKE_REPLY_TLESS : CTRL_PINGLIKE_ENDREPLY_TLESS;
+			}
+
+			if(sess->followup_mode!=FOLLOWUP_OFF) {
+				gettimeofday(&tx_timestamp,NULL);
+			}
+
+			if(sendto(ctx->args.sData.descriptor,lampPacket,rcv_bytes,NO_FLAGS,(struct sockaddr *)&(sess->dstAddr),sizeof(sess->dstAddr))!=rcv_bytes) {
+				perror("sendto() for sending LaMP packet failed");
+				fprintf(stderr,"UDP server reported that it can't reply to the client with id=%u and seq=%u\n",lamp_id_rx,lamp_seq_rx);
+			}
+
+			if(opts->printAfter) {
+				inet_ntop(AF_INET,&(srcAddr->sin_addr),ipstr,sizeof(ipstr));
+				fprintf(stdout,"Received a ping-like message from %s (id=%u, seq=%u, rx_bytes=%d). Reply sent to client...\n",
+					ipstr,lamp_id_rx,lamp_seq_rx,(int)rcv_bytes);
+			}
+
+			if(sess->followup_mode!=FOLLOWUP_OFF) {
+				if(timevalSub(&rx_timestamp,&tx_timestamp)) {
+					fprintf(stderr,"Error: negative time!\nCannot compute follow-up processing time for the current packet (id=%u, seq=%u).\n",lamp_id_rx,lamp_seq_rx);
+					tx_timestamp.tv_sec=0;
+					tx_timestamp.tv_usec=0;
+				} else {
+					fprintf(stdout,"Sending follow-up data (id=%u, seq=%u). Processing delta: %.3f ms.\n",lamp_id_rx,lamp_seq_rx,((double) tx_timestamp.tv_sec)*SEC_TO_MILLISEC+((double) tx_timestamp.tv_usec)/MICROSEC_TO_MILLISEC);
+				}
+
+				sessionSetDestination(ctx,sess);
+				if(sendFollowUpData(ctx->args.sData,lamp_id_rx,lamp_seq_rx,tx_timestamp)) {
+					perror("sendto() for sending LaMP follow-up data failed");
+					fprintf(stderr,"UDP server reported that it can't reply to the client with id=%u and seq=%u (follow-up)\n",lamp_id_rx,lamp_seq_rx);
+				}
+			}
+
+			if(last_packet) {
+				sessionRemove(ctx,sess);
+			}
+		break;
+
+		default:
+		break;
+	}
+}
+
+// Receive loop of each thread, serving the sessions whose packets are received by its own socket
+static void *multiServerLoop(void *arg) {
+	struct multiServerThread *thr=(struct multiServerThread *) arg;
+	struct multiServerContext *ctx=&(thr->ctx);
+
+	// Packet buffer with size = maximum LaMP packet length
+	byte_t lampPacket[MAX_LAMP_LEN+LAMP_HDR_SIZE()];
+
+	ssize_t rcv_bytes;
+	struct sockaddr_in srcAddr;
+
+	// Userspace and kernel (SO_TIMESTAMP) receive timestamps
+	struct timeval rx_timestamp_app, rx_timestamp_krn;
+
+	// recvmsg() variables and structs (cmsg)
+	struct msghdr mhdr;
+	struct iovec iov;
+	struct cmsghdr *cmsg=NULL;
+	char ctrlBufSw[CMSG_SPACE(sizeof(struct timeval))];
+
+	struct pollfd sockMon;
+	int poll_retval;
+	struct timeval next_housekeeping;
+
+	uint8_t stopping=0;
+
+	cpu_set_t cpuset;
+
+	if(thr->cpu>=0) {
+		CPU_ZERO(&cpuset);
+		CPU_SET(thr->cpu,&cpuset);
+
+		if(pthread_setaffinity_np(pthread_self(),sizeof(cpuset),&cpuset)!=0) {
+			fprintf(stderr,"Warning: cannot pin the server thread %u to CPU %d.\n",thr->idx,thr->cpu);
+		}
+	}
+
+	ctx->ST=sessionTableInit(MULTI_SESSION_TABLE_SIZE);
+	if(CHECK_ST_NULL(ctx->ST)) {
+		fprintf(stderr,"Error: cannot allocate the session table.\n");
+		thr->return_val=1;
+		return NULL;
+	}
+
+	// recvmsg() is always used, in order to get the source address and, when enabled, the kernel receive timestamp
+	memset(&mhdr,0,sizeof(mhdr));
+	iov.iov_base=lampPacket;
+	iov.iov_len=sizeof(lampPacket);
+	mhdr.msg_name=&srcAddr;
+	mhdr.msg_iov=&iov;
+	mhdr.msg_iovlen=1;
+	mhdr.msg_control=ctrlBufSw;
+
+	sockMon.fd=ctx->args.sData.descriptor;
+	sockMon.events=POLLIN;
+
+	gettimeofday(&next_housekeeping,NULL);
+	ctx->next_carbon_flush=next_housekeeping;
+	timevalAddMs(&(ctx->next_carbon_flush),(uint64_t) ctx->args.opts->carbon_interval*MILLISEC_TO_SEC);
+
+	while(1) {
+		if(*(thr->stop_flag) && !stopping) {
+			stopping=1;
+			fprintf(stdout,"Termination requested: no new session will be accepted. Waiting for %u active session(s) to end...\n",
+				sessionTableCount(ctx->ST));
+		}
+
+		if(stopping && sessionTableCount(ctx->ST)==0) {
+			break;
+		}
+
+		poll_retval=poll(&sockMon,1,MULTI_SESSION_TICK_MS);
+
+		if(poll_retval<0 && errno!=EINTR) {
+			perror("poll() error in the multi-session UDP server");
+			thr->return_val=1;
+			break;
+		}
+
+		// Receive all the available packets (up to MULTI_SESSION_MAX_RX_BURST), without blocking
+		for(int burst=0;poll_retval>0 && burst<MULTI_SESSION_MAX_RX_BURST;burst++) {
+			mhdr.msg_namelen=sizeof(srcAddr);
+			mhdr.msg_controllen=sizeof(ctrlBufSw);
+			mhdr.msg_flags=NO_FLAGS;
+
+			saferecvmsg(rcv_bytes,ctx->args.sData.descriptor,&mhdr,MSG_DONTWAIT);
+
+			gettimeofday(&rx_timestamp_app,NULL);
+
+			if(rcv_bytes==-1) {
+				if(errno!=EAGAIN && errno!=EWOULDBLOCK) {
+					fprintf(stderr,"Generic recvmsg() error. errno = %d.\n",errno);
+				}
+				break;
+			}
+
+			ctx->stats.rx_packets++;
+
+			// With --rate-limit, discard the packets exceeding the rate of their client, before doing anything else with them
+			if(!CHECK_AC_NULL(ctx->args.sData.admission_ctrl) && admissionCtrlPacket(ctx->args.sData.admission_ctrl,srcAddr.sin_addr.s_addr)==AC_LIMITED) {
+				ctx->stats.rx_limited++;
+				continue;
+			}
+
+			rx_timestamp_krn=rx_timestamp_app;
+			if(ctx->sw_rx_timestamping) {
+				for(cmsg=CMSG_FIRSTHDR(&mhdr);cmsg!=NULL;cmsg=CMSG_NXTHDR(&mhdr,cmsg)) {
+					if(cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SO_TIMESTAMP) {
+						rx_timestamp_krn=*((struct timeval *)CMSG_DATA(cmsg));
+					}
+				}
+			}
+
+			ctx->now=rx_timestamp_app;
+			processPacket(ctx,lampPacket,rcv_bytes,&srcAddr,&rx_timestamp_app,&rx_timestamp_krn,stopping);
+		}
+
+		// Check the session timeouts and send again the reports which have not been acknowledged yet
+		gettimeofday(&(ctx->now),NULL);
+		if(timercmp(&(ctx->now),&next_housekeeping,>=)) {
+			sessionTableForEach(ctx->ST,sessionHousekeeping,ctx);
+
+			next_housekeeping=ctx->now;
+			timevalAddMs(&next_housekeeping,MULTI_SESSION_TICK_MS);
+		}
+
+		// Send the Carbon metrics of the running sessions every -g interval
+		if(!CHECK_CS_NULL(ctx->carbon_sink) && timercmp(&(ctx->now),&(ctx->next_carbon_flush),>=)) {
+			multiServerCarbonFlush(ctx);
+
+			timevalAddMs(&(ctx->next_carbon_flush),(uint64_t) ctx->args.opts->carbon_interval*MILLISEC_TO_SEC);
+		}
+	}
+
+	sessionTableForEach(ctx->ST,sessionDiscard,ctx);
+	sessionTableFree(ctx->ST);
+
+	free(ctx->carbon_reports);
+	free(ctx->carbon_paths);
+
+	return NULL;
+}
+
+static void printMultiServerStats(FILE *stream,const char *label,struct multiServerStats *stats) {
+	fprintf(stream,"\t[%s] received packets: %" PRIu64 " (rate limited: %" PRIu64 "), sessions admitted: %" PRIu64 ", completed: %" PRIu64
+		", timed out: %" PRIu64 ", reports not acknowledged: %" PRIu64 ", INIT packets refused: %" PRIu64 "\n",
+		label,stats->rx_packets,stats->rx_limited,stats->sessions_admitted,stats->sessions_completed,stats->sessions_timedout,
+		stats->reports_unacked,stats->inits_refused);
+}
+
+// Close the sockets opened by socketOpenShard() for the first 'nthreads' threads, and free their state
+static void multiServerThreadsFree(struct multiServerThread *threads,unsigned int nthreads) {
+	for(unsigned int i=1;i<nthreads;i++) {
+		close(threads[i].ctx.args.sData.descriptor);
+	}
+
+	free(threads);
+}
+
+// Get the CPU to which the thread with index 'idx' should be pinned, cycling over the CPUs on which LaTe is allowed to run
+// (-1 is returned if they cannot be retrieved)
+static int multiServerThreadCPU(cpu_set_t *allowed,unsigned int idx) {
+	int count=CPU_COUNT(allowed);
+	int seen=0;
+
+	if(count<=0) {
+		return -1;
+	}
+
+	idx%=count;
+
+	for(int cpu=0;cpu<CPU_SETSIZE;cpu++) {
+		if(CPU_ISSET(cpu,allowed)) {
+			if(seen==idx) {
+				return cpu;
+			}
+			seen++;
+		}
+	}
+
+	return -1;
+}
+
+// Run the multi-session UDP server, until 'stop_flag' is set (the server then waits for all the active sessions to end,
+// without accepting any new session)
+// With --server-threads, the sessions are served by opts->server_threads threads, each one with its own socket of the same
+// SO_REUSEPORT group: the first socket is the one opened by socketOpen() (sData.descriptor), which is not closed here
+unsigned int runUDPserverMulti(struct lampsock_data sData, struct options *opts, volatile sig_atomic_t *stop_flag) {
+	struct multiServerThread *threads;
+	struct multiServerStats total;
+	unsigned int nthreads=opts->server_threads>1 ? opts->server_threads : 1;
+	unsigned int started=0;
+	carbonSink carbon_sink=NULL;
+	unsigned int return_val=0;
+	uint64_t timeout_ms=opts->interval<=MIN_TIMEOUT_VAL_S ? MIN_TIMEOUT_VAL_S : opts->interval;
+	cpu_set_t allowed;
+	char label[32];
+
+	threads=calloc(nthreads,sizeof(struct multiServerThread));
+	if(!threads) {
+		fprintf(stderr,"Error: cannot allocate the state of the server threads.\n");
+		return 1;
+	}
+
+	if(sched_getaffinity(0,sizeof(allowed),&allowed)!=0) {
+		CPU_ZERO(&allowed);
+	}
+
+	// The per-session metrics of all the threads are sent through the same Carbon sink (which can be used by more than one
+	// thread at the same time), kept for the whole lifetime of the server
+	if(opts->carbon_sock_params.enabled) {
+		carbon_sink=carbonSinkInit(opts);
+		if(CHECK_CS_NULL(carbon_sink)) {
+			fprintf(stderr,"Warning: cannot open the sink for sending the per-session metrics to Carbon/Graphite.\n");
+		}
+	}
+
+	for(unsigned int i=0;i<nthreads;i++) {
+		threads[i].idx=i;
+		threads[i].stop_flag=stop_flag;
+		threads[i].cpu=nthreads>1 ? multiServerThreadCPU(&allowed,i) : -1;
+		threads[i].ctx.args.sData=sData;
+		threads[i].ctx.args.opts=opts;
+		threads[i].ctx.timeout_ms=timeout_ms;
+		threads[i].ctx.carbon_sink=carbon_sink;
+
+		memset(&threads[i].ctx.args.sData.addru.addrin[1],0,sizeof(threads[i].ctx.args.sData.addru.addrin[1]));
+		threads[i].ctx.args.sData.addru.addrin[1].sin_family=AF_INET;
+
+		if(i>0) {
+			threads[i].ctx.args.sData.descriptor=socketOpenShard(&sData,opts);
+
+			if(threads[i].ctx.args.sData.descriptor<0) {
+				fprintf(stderr,"Error: cannot open the socket of the server thread %u.\n",i);
+				multiServerThreadsFree(threads,i);
+				if(!CHECK_CS_NULL(carbon_sink)) {
+					carbonSinkFree(carbon_sink);
+				}
+				return 1;
+			}
+		}
+	}
+
+	if(opts->reuseport_cbpf && socketAttachReuseportCBPF(sData.descriptor,nthreads)!=0) {
+		perror("setsockopt() for SO_ATTACH_REUSEPORT_CBPF error");
+		fprintf(stderr,"Warning: cannot steer the packets by LaMP id. They will be distributed depending on the client IP address and port.\n");
+	}
+
+	// -L r (KRT) applies to all the unidirectional sessions (this is checked here, and not by each thread, as 'opts' is shared)
+	if(opts->latencyType==KRT) {
+		for(unsigned int i=0;i<nthreads;i++) {
+			if(socketSetTimestamping(threads[i].ctx.args.sData,SET_TIMESTAMPING_SW_RX)<0) {
+				perror("socketSetTimestamping() error");
+				fprintf(stderr,"Warning: SO_TIMESTAMP is probably not supported. Switching back to user-to-user latency.\n");
+				opts->latencyType=USERTOUSER;
+				break;
+			}
+
+			threads[i].ctx.sw_rx_timestamping=1;
+		}
+	}
+
+	fprintf(stdout,"UDP server started, with options:\n\t[socket type] = UDP\n"
+		"\t[listening on port] = %ld\n"
+		"\t[sessions] = multiple concurrent sessions\n"
+		"\t[threads] = %u%s\n"
+		"\t[timeout] = %" PRIu64 " ms (for each session)\n"
+		"\t[follow-up] = %s\n",
+		opts->port,
+		nthreads,nthreads==1 ? "" : (opts->reuseport_cbpf ? " (SO_REUSEPORT, steering by LaMP id)" : " (SO_REUSEPORT)"),
+		timeout_ms,
+		opts->refuseFollowup==1 ? "refused" : "accepted (application and kernel receive timestamps only)");
+
+	if(opts->rate_limit>0) {
+		fprintf(stdout,"\t[rate limit] = %" PRIu32 " packets/s for each client (bucket size: %" PRIu32 " packets)\n",
+			opts->rate_limit,opts->rate_limit_burst);
+	}
+
+	if(opts->max_sessions>0) {
+		fprintf(stdout,"\t[maximum concurrent sessions] = %" PRIu32 "\n",opts->max_sessions);
+	}
+
+	if(opts->macUP==UINT8_MAX) {
+		fprintf(stdout,"\t[user priority] = unset or unpatched kernel.\n\n");
+	} else {
+		fprintf(stdout,"\t[user priority] = %d\n\n",opts->macUP);
+	}
+
+	if(nthreads==1) {
+		multiServerLoop(&threads[0]);
+		started=1;
+	} else {
+		for(started=0;started<nthreads;started++) {
+			if(pthread_create(&threads[started].tid,NULL,&multiServerLoop,(void *) &threads[started])!=0) {
+				fprintf(stderr,"Error: cannot start the server thread %u. The server will be terminated as soon as the\n"
+					"active sessions end.\n",started);
+				*stop_flag=SIGUSR1;
+				return_val=1;
+				break;
+			}
+		}
+
+		for(unsigned int i=0;i<started;i++) {
+			pthread_join(threads[i].tid,NULL);
+		}
+	}
+
+	// Merge the statistics of all the threads
+	memset(&total,0,sizeof(total));
+
+	fprintf(stdout,"\nServer statistics:\n");
+
+	for(unsigned int i=0;i<started;i++) {
+		total.rx_packets+=threads[i].ctx.stats.rx_packets;
+		total.rx_limited+=threads[i].ctx.stats.rx_limited;
+		total.inits_refused+=threads[i].ctx.stats.inits_refused;
+		total.sessions_admitted+=threads[i].ctx.stats.sessions_admitted;
+		total.sessions_completed+=threads[i].ctx.stats.sessions_completed;
+		total.sessions_timedout+=threads[i].ctx.stats.sessions_timedout;
+		total.reports_unacked+=threads[i].ctx.stats.reports_unacked;
+
+		if(threads[i].return_val!=0) {
+			return_val=threads[i].return_val;
+		}
+
+		if(nthreads>1) {
+			snprintf(label,sizeof(label),"thread %u, CPU %d",i,threads[i].cpu);
+			printMultiServerStats(stdout,label,&(threads[i].ctx.stats));
+		}
+	}
+
+	printMultiServerStats(stdout,"total",&total);
+
+	multiServerThreadsFree(threads,nthreads);
+
+	// The metrics of the sessions which were still active have been flushed when discarding them
+	if(!CHECK_CS_NULL(carbon_sink)) {
+		carbonSinkFree(carbon_sink);
+	}
+
+	return return_val;
+}
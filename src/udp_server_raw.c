@@ -1,5 +1,7 @@
 #include "udp_server_raw.h"
 #include "report_manager.h"
+#include "tfile_writer.h"
+#include "report_encoding.h"
 #include "packet_structs.h"
 #include "timeval_utils.h"
 #include <sys/ioctl.h>
@@ -17,9 +19,19 @@
 #include "ipcsum_alth.h"
 #include "timer_man.h"
 #include "common_udp.h"
+#include "xdp_sock.h"
+#include "rx_ring.h"
+#include "aggr_table.h"
+#include "admission_ctrl.h"
 
 #define CLEAR_ALL() pthread_mutex_destroy(&ack_report_received_mut); \
-					freeMacAddrT(srcmacaddr_pkt);
+					freeMacAddrT(srcmacaddr_pkt); \
+					if(!opts->dmode) { \
+						xdpSockFree(xsk); \
+						xsk=NULL; \
+						rxRingFree(rxring); \
+						rxring=NULL; \
+					}
 	
 typedef enum {
 	FLAG_UNSET,
@@ -33,10 +45,25 @@ static t_error_types t_tx_error;
 // Local global variables
 static reportStructure reportData;
 static uint16_t lamp_id_session;
+static uint16_t ext_flags_session; // LaMP extensions requested by the client and accepted by the server during the INIT procedure
 static modeub_t mode_session;
 static modefollowup_t followup_mode_session;
 static uint16_t client_port_session; // Stored in host byte order
 static uint8_t ack_report_received; // Global flag set by the ackListener thread: = 1 when an ACK has been received, otherwise it is = 0
+static uint8_t reportData_allocated; // = 1 when reportData is kept allocated across the sessions (continuous daemon mode), = 0 otherwise
+
+// Session data merged in the aggregated statistics at the end of each session (--aggregate-stats, see aggr_table.h)
+static latencyHist latencyHistData; // Latency histogram of the current unidirectional session
+static struct in_addr client_ip_session;
+static uint8_t timedout_session; // = 1 if the current session has been terminated by the server timeout, = 0 otherwise
+
+// AF_XDP socket used to receive the requests and to send the replies, when --xdp is specified (NULL otherwise)
+// In continuous daemon mode, it is kept open across the sessions
+static xdpSock xsk=NULL;
+
+// TPACKET_V3 ring used to receive the requests, when --rx-ring is specified (NULL otherwise)
+// In continuous daemon mode, it is kept open across the sessions, like the AF_XDP socket
+static rxRing rxring=NULL;
 
 static carbonReportStructure carbonReportData;
 static int carbon_metrics_flush_first;
@@ -90,7 +117,11 @@ static uint8_t initReceiverACKsender(arg_struct *args, uint64_t interval, in_por
 	// struct timeval to set the more reasonable timeout after the first LaMP packet (i.e. the INIT packet) is received
 	struct timeval rx_timeout_reasonable;
 
-	controlRcvRetValue=controlReceiverUDP_RAW(args->sData.descriptor,port,args->srcIP.s_addr,&rcvData,INIT,NULL,NULL);
+	// With --rate-limit, an INIT exceeding the rate of its client is ignored, as any other packet
+	do {
+		controlRcvRetValue=controlReceiverUDP_RAW(args->sData.descriptor,port,args->srcIP.s_addr,&rcvData,INIT,NULL,NULL);
+	} while(controlRcvRetValue==0 && !CHECK_AC_NULL(args->sData.admission_ctrl) &&
+		admissionCtrlPacket(args->sData.admission_ctrl,rcvData.controlRCV.ip.s_addr)==AC_LIMITED);
 
 	if(controlRcvRetValue<0) {
 		// Set error
@@ -109,11 +140,20 @@ static uint8_t initReceiverACKsender(arg_struct *args, uint64_t interval, in_por
 		// Set the destination port inside the sendto sockaddr_in structure
 		client_port_session=rcvData.controlRCV.port;
 
+		printInterSessionGap(&(args->sData.session_end));
+
 		// Set session data
 		fprintf(stdout,"Server will accept all packets coming from client %s, port: %d, id: %u\n",
 			inet_ntoa(rcvData.controlRCV.ip),client_port_session,rcvData.controlRCV.session_id);
 
 		lamp_id_session=rcvData.controlRCV.session_id;
+		client_ip_session=rcvData.controlRCV.ip;
+
+		// Accept all the requested extensions which are supported (the accepted ones will be notified to the client with the ACK)
+		ext_flags_session=rcvData.controlRCV.ext_flags & LAMP_EXT_SUPPORTED_FLAGS;
+		if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+			fprintf(stdout,"The client requested the usage of extended (64 bit) sequence numbers.\n");
+		}
 
 		if(rcvData.controlRCV.type_idx==INIT_UNIDIR_INDEX) {
 			mode_session=UNIDIR;
@@ -140,7 +180,7 @@ static uint8_t initReceiverACKsender(arg_struct *args, uint64_t interval, in_por
 			}
 
 			// Send ACK
-			controlSendRetValue=controlSenderUDP_RAW(args,&rcvData,lamp_id_session,1,ACK,0,0,NULL,NULL);
+			controlSendRetValue=controlSenderUDP_RAW(args,&rcvData,lamp_id_session,1,ACK,ext_flags_session,0,NULL,NULL);
 			if(controlSendRetValue<0) {
 				// Set error
 				if(controlSendRetValue==-1) {
@@ -174,9 +214,13 @@ static int transmitReport(struct lampsock_data sData, struct options *opts, stru
 	// LaMP packet size container
 	uint32_t lampPacketSize=0;
 
-	// Report payload length and report buffer
-	size_t report_payloadlen;
-	char report_buff[REPORT_BUFF_SIZE]; // REPORT_BUFF_SIZE defined inside report_manager.h
+	// Binary encoded report, its length and the buffer which will contain each fragment to be sent
+	uint8_t *report_enc;
+	size_t report_enclen;
+	byte_t report_frag[REPORT_FRAG_MAX_SIZE]; // REPORT_FRAG_MAX_SIZE defined inside report_encoding.h
+	size_t report_fraglen;
+	unsigned int report_fragnum;
+	unsigned int fragidx;
 
 	// Final packet size
 	size_t finalpktsize;
@@ -210,23 +254,27 @@ static int transmitReport(struct lampsock_data sData, struct options *opts, stru
 	IP4headPopulateS(&(headers.ipHeader), sData.devname, destIP, 0, 0, BASIC_UDP_TTL, IPPROTO_UDP, FLAG_NOFRAG_MASK, &ipaddrs);
 	UDPheadPopulate(&(headers.udpHeader), opts->port, client_port_session);
 
-	// Copying the report string inside the report buffer
-	repprintf(report_buff,reportData);
+	// Encode the report (it may be split into more than one fragment if it does not fit inside a single LaMP packet)
+	report_enc=reportEncode(&reportData,&report_enclen);
+	if(!report_enc) {
+		return 2;
+	}
 
-	// Compute report payload length
-	report_payloadlen=strlen(report_buff);
+	report_fragnum=reportFragmentsNumber(report_enclen);
 
-	// Allocating buffers
-	buffers.lamppacket=malloc(sizeof(struct lamphdr)+report_payloadlen);
+	// Allocating buffers (they are sized to contain the biggest possible fragment)
+	buffers.lamppacket=malloc(sizeof(struct lamphdr)+REPORT_FRAG_MAX_SIZE);
 	if(!buffers.lamppacket) {
+		free(report_enc);
 		return 2;
 	}
 
-	lampPacketSize=LAMP_HDR_PAYLOAD_SIZE(report_payloadlen);
+	lampPacketSize=LAMP_HDR_PAYLOAD_SIZE(REPORT_FRAG_MAX_SIZE);
 
 	buffers.udppacket=malloc(UDP_PACKET_SIZE_S(lampPacketSize));
 	if(!buffers.udppacket) {
 		free(buffers.lamppacket);
+		free(report_enc);
 		return 2;
 	}
 
@@ -234,6 +282,7 @@ static int transmitReport(struct lampsock_data sData, struct options *opts, stru
 	if(!buffers.ippacket) {
 		free(buffers.lamppacket);
 		free(buffers.udppacket);
+		free(report_enc);
 		return 2;
 	}
 
@@ -242,6 +291,7 @@ static int transmitReport(struct lampsock_data sData, struct options *opts, stru
 		free(buffers.lamppacket);
 		free(buffers.ippacket);
 		free(buffers.udppacket);
+		free(report_enc);
 		return 2;
 	}
 
@@ -267,18 +317,29 @@ static int transmitReport(struct lampsock_data sData, struct options *opts, stru
 			}
 			pthread_mutex_unlock(&ack_report_received_mut);
 
-			// Prepare datagram
-			IP4headAddID(&(headers.ipHeader),(unsigned short) id); // random ID could be okay?
+			// Send all the report fragments, each one inside a different LaMP packet
+			for(fragidx=0;fragidx<report_fragnum;fragidx++) {
+				report_fraglen=reportFragmentPrepare(report_frag,report_enc,report_enclen,fragidx);
+				lampPacketSize=LAMP_HDR_PAYLOAD_SIZE(report_fraglen);
 
-			lampEncapsulate(buffers.lamppacket, &(headers.lampHeader), (byte_t *) report_buff, report_payloadlen);
-			UDPencapsulate(buffers.udppacket,&(headers.udpHeader),buffers.lamppacket,lampPacketSize,ipaddrs);
+				// Prepare datagram
+				IP4headAddID(&(headers.ipHeader),(unsigned short) id); // random ID could be okay?
 
-			// 'IP4headAddTotLen' may also be skipped since IP4Encapsulate already takes care of filling the length field
-			IP4Encapsulate(buffers.ippacket, &(headers.ipHeader), buffers.udppacket, UDP_PACKET_SIZE_S(lampPacketSize));
-			finalpktsize=etherEncapsulate(buffers.ethernetpacket, &(headers.etherHeader), buffers.ippacket, IP_UDP_PACKET_SIZE_S(lampPacketSize));
+				lampEncapsulate(buffers.lamppacket, &(headers.lampHeader), report_frag, report_fraglen);
+				UDPencapsulate(buffers.udppacket,&(headers.udpHeader),buffers.lamppacket,lampPacketSize,ipaddrs);
 
-			if(rawLampSend(sData.descriptor, sData.addru.addrll, inpacket_lamphdr, buffers.ethernetpacket, finalpktsize, FLG_NONE, UDP)) {
-				fprintf(stderr,"Failed sending report. Retrying in %d millisecond(s).\n",REPORT_RETRY_INTERVAL_MS);
+				// 'IP4headAddTotLen' may also be skipped since IP4Encapsulate already takes care of filling the length field
+				IP4Encapsulate(buffers.ippacket, &(headers.ipHeader), buffers.udppacket, UDP_PACKET_SIZE_S(lampPacketSize));
+				finalpktsize=etherEncapsulate(buffers.ethernetpacket, &(headers.etherHeader), buffers.ippacket, IP_UDP_PACKET_SIZE_S(lampPacketSize));
+
+				if(rawLampSend(sData.descriptor, sData.addru.addrll, inpacket_lamphdr, buffers.ethernetpacket, finalpktsize, FLG_NONE, UDP)) {
+					fprintf(stderr,"Failed sending report. Retrying in %d millisecond(s).\n",REPORT_RETRY_INTERVAL_MS);
+				}
+
+				// Each fragment will have its own sequence number
+				if(fragidx<report_fragnum-1) {
+					lampHeadIncreaseSeq(&(headers.lampHeader));
+				}
 			}
 		}
 	
@@ -310,6 +371,7 @@ static int transmitReport(struct lampsock_data sData, struct options *opts, stru
 	free(buffers.udppacket);
 	free(buffers.ippacket);
 	free(buffers.ethernetpacket);
+	free(report_enc);
 
 	return return_val;
 }
@@ -324,12 +386,18 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 	// Packet buffer with size = Ethernet MTU
 	byte_t packet[RAW_RX_PACKET_BUF_SIZE];
 
+	// Received frame: 'packet', or the current frame inside the ring, when --rx-ring is specified
+	// The reply is built in place inside this frame
+	byte_t *frame=packet;
+	rxRingFrame ringFrame;
+
 	// recvfrom variables
 	ssize_t rcv_bytes;
 	size_t UDPpayloadsize; // UDP payload size
 
 	struct pktheadersptr_udp headerptrs;
 	byte_t *lampPacket=NULL;
+	byte_t *lampPacketErrqueue=NULL; // LaMP header of the packets read from the error queue (always inside 'packet')
 
 	// RX and TX timestamp containers
 	struct timeval rx_timestamp={.tv_sec=0,.tv_usec=0}, tx_timestamp={.tv_sec=0,.tv_usec=0};
@@ -342,6 +410,7 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 	uint16_t lamp_id_rx;
 	uint16_t lamp_seq_rx=0; // Initilized to 0 in order to be sure to enter the while loop
 	uint16_t lamp_payloadlen_rx;
+	uint64_t lamp_extseq_rx=INITIAL_SEQ_NO; // Full width sequence number (used only when extended sequence numbers are in use)
 	lamptype_t lamp_type_tx; // Hardware tx timestamping only
 
 	// LaMP fields for packet retrieved from socket error queue (hardware tx timestamping only)
@@ -386,6 +455,10 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 
 	// File descriptor for -W option (write per-packet data to CSV file)
 	int Wfiledescriptor=-1;
+	tfileWriter Wwriter=NULL; // Asynchronous writer for the per-packet data, when '-W' is specified
+	tfileBinaryHeader Wbinheader;
+	tfileRotationParams Wrotation;
+	char *Wfilename_opened=NULL; // Name of the -W file which was actually opened (needed to name the next segments when rotating the file)
 
 	// Per-packet data structure (to be used when -W is selected)
 	// The followup_on_flag can be already set here, together with tripTimeProc,
@@ -404,9 +477,14 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 	// Flag managed internally by writeToReportSocket()
 	uint8_t first_call=1;
 
+	// Number of packets discarded because of the rate limit (--rate-limit) during the session
+	uint64_t rate_limited=0;
+
 	// Very important: initialize to 0 any flag that is used inside threads
 	ack_report_received=0;
 	followup_mode_session=FOLLOWUP_OFF;
+	timedout_session=0;
+	latencyHistReset(&latencyHistData);
 	t_rx_error=NO_ERR;
 	t_tx_error=NO_ERR;
 	if(pthread_mutex_init(&ack_report_received_mut,NULL)!=0) {
@@ -414,6 +492,32 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 		return 2;
 	}
 
+	// Open the AF_XDP socket before the INIT procedure, in order to be ready to receive the first request
+	// (unless it is still open from the previous session, in continuous daemon mode)
+	if(opts->xdp_enabled && CHECK_XS_NULL(xsk)) {
+		xsk=xdpSockInit(sData.devname,sData.ifindex,opts->xdp_queue,opts->port,XDP_SOCK_SERVER_CTRL_MASK,sData.descriptor,opts->xdp_generic);
+		if(CHECK_XS_NULL(xsk)) {
+			fprintf(stderr,"Error: cannot open the AF_XDP socket on %s.\n",sData.devname);
+			CLEAR_ALL();
+			return 2;
+		}
+	}
+
+	// Open the TPACKET_V3 ring before the INIT procedure too
+	if(opts->rx_ring) {
+		if(CHECK_RR_NULL(rxring)) {
+			rxring=rxRingInit(sData.devname,sData.ifindex,opts->port,XDP_SOCK_SERVER_CTRL_MASK,sData.descriptor,opts->rx_ring_timeout,0);
+			if(CHECK_RR_NULL(rxring)) {
+				fprintf(stderr,"Error: cannot open the TPACKET_V3 ring on %s.\n",sData.devname);
+				CLEAR_ALL();
+				return 2;
+			}
+		} else {
+			// Kept open from the previous session: use the software timestamps, until the hardware ones are requested again
+			rxRingSetTimestamping(rxring,0);
+		}
+	}
+
 	// Inform the user about the current options
 	fprintf(stdout,"UDP server started, with options:\n\t[socket type] = RAW\n"
 		"\t[listening on port] = %ld\n"
@@ -421,6 +525,20 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 		opts->port,
 		opts->interval<=MIN_TIMEOUT_VAL_S ? MIN_TIMEOUT_VAL_S : opts->interval);
 
+	if(!CHECK_XS_NULL(xsk)) {
+		fprintf(stdout,"\t[AF_XDP socket] = %s, queue %" PRIu32 "\n",xdpSockModeStr(xsk),opts->xdp_queue);
+	}
+
+	if(!CHECK_RR_NULL(rxring)) {
+		fprintf(stdout,"\t[RX ring] = TPACKET_V3, %d blocks of %d kB, block timeout %" PRIu32 " ms\n",
+			RX_RING_BLOCK_NR,RX_RING_BLOCK_SIZE/1024,opts->rx_ring_timeout);
+	}
+
+	if(opts->rate_limit>0) {
+		fprintf(stdout,"\t[rate limit] = %" PRIu32 " packets/s for each client (bucket size: %" PRIu32 " packets)\n",
+			opts->rate_limit,opts->rate_limit_burst);
+	}
+
 	// Print current UP
 	if(opts->macUP==UINT8_MAX) {
 		fprintf(stdout,"\t[user priority] = unset or unpatched kernel.\n\n");
@@ -429,7 +547,14 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 	}
 
 	// Report structure inizialization
-	reportStructureInit(&reportData, 0, opts->number, opts->latencyType, opts->followup_mode, opts->dup_detect_enabled);
+	// In continuous daemon mode, the structure (and its duplicated packets detection list) is allocated only for the first
+	// session, and then just reset, in order to be ready to receive the next session as soon as possible
+	if(reportData_allocated) {
+		reportStructureReset(&reportData, opts->number, opts->latencyType, opts->followup_mode);
+	} else {
+		reportStructureInit(&reportData, 0, opts->number, opts->latencyType, opts->followup_mode, opts->dup_detect_enabled);
+		reportData_allocated=opts->dmode;
+	}
 
 	// Populate the 'args' struct
 	args.sData=sData;
@@ -505,35 +630,93 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 
 	// Open CSV file when '-W' is specified (as this only applies to the unidirectional mode, no file is create when the mode is not unidirectional)
 	if(opts->Wfilename!=NULL && mode_session==UNIDIR) {
-		Wfiledescriptor=openTfile(opts->Wfilename,opts->overwrite_W,opts->followup_mode!=FOLLOWUP_OFF,opts->report_extra_data);
+		Wfiledescriptor=openTfileNamed(opts->Wfilename,opts->overwrite_W,opts->followup_mode!=FOLLOWUP_OFF,opts->report_extra_data,opts->W_binary,&Wfilename_opened);
 		if(Wfiledescriptor<0) {
 			fprintf(stderr,"Warning! Cannot open file for writing single packet latency data.\nThe '-W' option will be disabled.\n");
+		} else {
+			// Start the writer thread: from now on, no system call will be performed on the receive path to write the per-packet data
+			// Describe the current test in the header of the binary trace, when --report-perpacket-binary is specified
+			if(opts->W_binary) {
+				Wbinheader.lamp_id=lamp_id_session;
+				Wbinheader.latency_type=opts->latencyType;
+				Wbinheader.followup_on_flag=opts->followup_mode!=FOLLOWUP_OFF;
+				Wbinheader.enabled_extra_data=opts->report_extra_data;
+				Wbinheader.side=TFILE_BIN_SIDE_SERVER;
+				Wbinheader.decimal_digits=W_DECIMAL_DIGITS;
+			}
+
+			// Rotate the file by size and/or by wall-clock interval, when --report-perpacket-rotate-size/interval are specified
+			if(opts->W_rotate_size>0 || opts->W_rotate_interval>0) {
+				Wrotation.size=opts->W_rotate_size;
+				Wrotation.interval=opts->W_rotate_interval;
+				Wrotation.hook=opts->W_rotate_hook;
+				Wrotation.filename=Wfilename_opened;
+				Wrotation.overwrite=opts->overwrite_W;
+				Wrotation.followup_on_flag=opts->followup_mode!=FOLLOWUP_OFF;
+				Wrotation.enabled_extra_data=opts->report_extra_data;
+			}
+
+			Wwriter=tfileWriterInit(Wfiledescriptor,W_DECIMAL_DIGITS,opts->W_binary ? &Wbinheader : NULL,
+				(opts->W_rotate_size>0 || opts->W_rotate_interval>0) && Wfilename_opened!=NULL ? &Wrotation : NULL);
+			if(CHECK_TW_NULL(Wwriter)) {
+				fprintf(stderr,"Warning! Cannot start the thread writing single packet latency data.\nThe '-W' option will be disabled.\n");
+				closeTfile(Wfiledescriptor);
+				Wfiledescriptor=-1;
+			}
+
+			// The writer keeps its own copy of the file name
+			if(Wfilename_opened!=NULL) {
+				free(Wfilename_opened);
+				Wfilename_opened=NULL;
+			}
 		}
 	}
 
 	// Already get all the packet pointers
 	lampPacket=UDPgetpacketpointers(packet,&(headerptrs.etherHeader),&(headerptrs.ipHeader),&(headerptrs.udpHeader));
 	lampGetPacketPointers(lampPacket,&(headerptrs.lampHeader));
+	lampPacketErrqueue=lampPacket;
 
 	// From now on, 'payload' should -never- be used if (headerptrs.lampHeader)->payloadLen is 0
 
 	// Start receiving packets
 	while(continueFlag) {
 		// If in KRT unidirectional mode or in HARDWARE/SOFTWARE mode (requested by the client through a follow-up control message, use recvmsg(), otherwise, use recvfrom())
-		if((mode_session==UNIDIR && opts->latencyType==KRT) || followup_mode_session==FOLLOWUP_ON_HW || followup_mode_session==FOLLOWUP_ON_KRN || followup_mode_session==FOLLOWUP_ON_KRN_RX) {
+		// When the AF_XDP socket is used, only the LaMP data packets directed to this host are received (and no kernel timestamp is available)
+		// When the TPACKET_V3 ring is used, the LaMP data packets are read in place, together with their kernel (or hardware) timestamp
+		if(!CHECK_XS_NULL(xsk)) {
+			rcv_bytes=xdpSockRecv(xsk,packet,RAW_RX_PACKET_BUF_SIZE);
+			addrll.sll_pkttype=PACKET_HOST;
+		} else if(!CHECK_RR_NULL(rxring)) {
+			rcv_bytes=rxRingRecv(rxring,&ringFrame);
+
+			if(rcv_bytes!=-1) {
+				frame=ringFrame.data;
+				addrll.sll_pkttype=ringFrame.pkttype;
+				lampPacket=UDPgetpacketpointers(frame,&(headerptrs.etherHeader),&(headerptrs.ipHeader),&(headerptrs.udpHeader));
+				lampGetPacketPointers(lampPacket,&(headerptrs.lampHeader));
+			}
+		} else if((mode_session==UNIDIR && opts->latencyType==KRT) || followup_mode_session==FOLLOWUP_ON_HW || followup_mode_session==FOLLOWUP_ON_KRN || followup_mode_session==FOLLOWUP_ON_KRN_RX) {
 			saferecvmsg(rcv_bytes,sData.descriptor,&mhdr,NO_FLAGS);
 		} else {
 			saferecvfrom(rcv_bytes,sData.descriptor,packet,RAW_RX_PACKET_BUF_SIZE,NO_FLAGS,(struct sockaddr *)&addrll,&addrllLen);
 		}
 
+		// With the TPACKET_V3 ring, the request may have waited in its block for up to --rx-ring-timeout: its kernel receive
+		// timestamp is used instead, so that the follow-up processing time includes this wait
 		if(followup_mode_session==FOLLOWUP_ON_APP) {
-			gettimeofday(&rx_timestamp,NULL);
+			if(!CHECK_RR_NULL(rxring) && rcv_bytes!=-1) {
+				rx_timestamp=ringFrame.ts;
+			} else {
+				gettimeofday(&rx_timestamp,NULL);
+			}
 		}
 
 		// Timeout or other recvfrom() error occurred
 		if(rcv_bytes==-1) {
 			if(errno==EAGAIN) {
 				fprintf(stderr,"Timeout reached when receiving packets. Connection terminated.\n");
+				timedout_session=1;
 
 				if(mode_session==UNIDIR) {
 					reportSetTimeoutOccurred(&reportData);
@@ -559,10 +742,16 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 			continue;
 		}
 
+		// With --rate-limit, discard the packets exceeding the rate of their client, before validating their checksum
+		if(!CHECK_AC_NULL(sData.admission_ctrl) && admissionCtrlPacket(sData.admission_ctrl,(headerptrs.ipHeader)->saddr)==AC_LIMITED) {
+			rate_limited++;
+			continue;
+		}
+
 		// Verify checksums
 		// Validate checksum (combined mode: IP+UDP): if it is wrong, discard packet
 		UDPpayloadsize=UDPgetpayloadsize((headerptrs.udpHeader));
-		if(!validateEthCsum(packet, (headerptrs.udpHeader)->check, &((headerptrs.ipHeader)->check), CSUM_UDPIP, (void *) &UDPpayloadsize)) {
+		if(!validateEthCsum(frame, (headerptrs.udpHeader)->check, &((headerptrs.ipHeader)->check), CSUM_UDPIP, (void *) &UDPpayloadsize)) {
 			continue;
 		}
 
@@ -588,7 +777,15 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 			continue;
 		}
 		
-		if((mode_session==UNIDIR && opts->latencyType==KRT) || followup_mode_session==FOLLOWUP_ON_HW || followup_mode_session==FOLLOWUP_ON_KRN || followup_mode_session==FOLLOWUP_ON_KRN_RX) {
+		if(!CHECK_RR_NULL(rxring) && ((mode_session==UNIDIR && opts->latencyType==KRT) || followup_mode_session==FOLLOWUP_ON_HW || followup_mode_session==FOLLOWUP_ON_KRN || followup_mode_session==FOLLOWUP_ON_KRN_RX)) {
+			rx_timestamp=ringFrame.ts;
+
+			// Just like when the hardware timestamp is missing from the ancillary data, report a null timestamp
+			if(followup_mode_session==FOLLOWUP_ON_HW && !ringFrame.ts_hw) {
+				rx_timestamp.tv_sec=0;
+				rx_timestamp.tv_usec=0;
+			}
+		} else if((mode_session==UNIDIR && opts->latencyType==KRT) || followup_mode_session==FOLLOWUP_ON_HW || followup_mode_session==FOLLOWUP_ON_KRN || followup_mode_session==FOLLOWUP_ON_KRN_RX) {
 			for(cmsg=CMSG_FIRSTHDR(&mhdr);cmsg!=NULL;cmsg=CMSG_NXTHDR(&mhdr, cmsg)) {
 				// KRT (unidirectional) mode
                 if((opts->latencyType==KRT || followup_mode_session==FOLLOWUP_ON_KRN_RX) && cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SO_TIMESTAMP) {
@@ -619,8 +816,9 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 						followup_mode_session=FOLLOWUP_ON_APP;
 						break;
 
+					// The kernel follow-up modes are always denied when using the AF_XDP socket, as the requests bypass the kernel
 					case FOLLOWUP_REQUEST_T_KRN_RX:
-						if(socketSetTimestamping(sData,SET_TIMESTAMPING_SW_RX)<0) {
+						if(!CHECK_XS_NULL(xsk) || socketSetTimestamping(sData,SET_TIMESTAMPING_SW_RX)<0) {
 							followup_reply_type=FOLLOWUP_DENY;
 						} else {
 							// Prepare ancillary data structure
@@ -647,7 +845,9 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 
 					case FOLLOWUP_REQUEST_T_HW:
 					case FOLLOWUP_REQUEST_T_KRN:
-						if(socketSetTimestamping(sData,lamp_payloadlen_rx==FOLLOWUP_REQUEST_T_HW ? SET_TIMESTAMPING_HW : SET_TIMESTAMPING_SW_RXTX)<0) {
+						// With the TPACKET_V3 ring, the ring frames should carry the same kind of timestamps
+						if(!CHECK_XS_NULL(xsk) || socketSetTimestamping(sData,lamp_payloadlen_rx==FOLLOWUP_REQUEST_T_HW ? SET_TIMESTAMPING_HW : SET_TIMESTAMPING_SW_RXTX)<0 ||
+							(!CHECK_RR_NULL(rxring) && rxRingSetTimestamping(rxring,lamp_payloadlen_rx==FOLLOWUP_REQUEST_T_HW)<0)) {
 							followup_reply_type=FOLLOWUP_DENY;
 						} else {
 							// Prepare ancillary data structure
@@ -693,6 +893,12 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 
 		if(isnotfirst_FU==0) {
 			isnotfirst_FU=1;
+
+			// Without any follow-up mode, the client cannot subtract the time spent by the requests inside the ring blocks
+			if(!CHECK_RR_NULL(rxring) && mode_session==PINGLIKE && followup_mode_session==FOLLOWUP_OFF) {
+				fprintf(stderr,"Warning: the client did not request any follow-up mode (-F): the RTT values it measures will include\n"
+					"up to %" PRIu32 " ms spent by each request inside the TPACKET_V3 ring (--rx-ring-timeout).\n",opts->rx_ring_timeout);
+			}
 		}
 
 		if(lamp_type_rx==FOLLOWUP_CTRL) {
@@ -729,17 +935,34 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 						MAC_PRINTER(srcmacaddr_pkt),lamp_id_rx,lamp_seq_rx,(int)rcv_bytes,(double)tripTime/1000,latencyTypePrinter(opts->latencyType));
 				}
 
-				// Update the current report structure
-				reportStructureUpdate(&reportData,tripTime,lamp_seq_rx);
+				// Update the current report structure, using the full width sequence number carried in the payload, when available
+				// A packet not carrying it (which should never be sent by the client) is given the extended sequence number
+				// closest to the last received one
+				if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+					if(lamp_payloadlen_rx>=LAMP_EXTSEQ_SIZE && UDPpayloadsize>=LAMP_HDR_PAYLOAD_SIZE(LAMP_EXTSEQ_SIZE)) {
+						lamp_extseq_rx=lampExtSeqRead(lampPacket+LAMP_HDR_SIZE());
+					} else {
+						lamp_extseq_rx=lampExtSeqExpand(lamp_extseq_rx,lamp_seq_rx);
+					}
+
+					reportStructureUpdateExt(&reportData,tripTime,lamp_extseq_rx);
+				} else {
+					reportStructureUpdate(&reportData,tripTime,lamp_seq_rx);
+				}
+
+				// With --aggregate-stats, keep also the latency histogram of the session, which is merged at the end of the session
+				if(!CHECK_AT_NULL(sData.aggr_table) && tripTime!=0) {
+					latencyHistUpdate(&latencyHistData,tripTime);
+				}
 
 				// When '-W' is specified, write the current measured value to the specified CSV file too (if a file was successfully opened)
 				if(Wfiledescriptor>0 || opts->udp_params.enabled) {
-					perPktData.seqNo=lamp_seq_rx;
+					perPktData.seqNo=(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) ? lamp_extseq_rx : lamp_seq_rx;
 					perPktData.signedTripTime=timevalSub_retval==0 ? rx_timestamp.tv_sec*SEC_TO_MICROSEC+rx_timestamp.tv_usec : -(rx_timestamp.tv_sec*SEC_TO_MICROSEC+rx_timestamp.tv_usec);
 					perPktData.tx_timestamp=tx_timestamp;
 
 					if(Wfiledescriptor>0) {
-						writeToTFile(Wfiledescriptor,W_DECIMAL_DIGITS,&perPktData);
+						tfileWriterPush(Wwriter,&perPktData);
 					}
 
 					if(opts->udp_params.enabled) {
@@ -758,9 +981,11 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 						}
 					}
 
-					carbon_pthread_mutex_lock(ctd);
-					carbonReportStructureUpdate(&carbonReportData,tripTime,lamp_seq_rx,opts->dup_detect_enabled);
-					carbon_pthread_mutex_unlock(ctd);
+					if(ext_flags_session & LAMP_EXT_FLAG_EXTSEQ) {
+						carbonReportStructureUpdateExt(&carbonReportData,tripTime,lamp_extseq_rx,opts->dup_detect_enabled);
+					} else {
+						carbonReportStructureUpdate(&carbonReportData,tripTime,lamp_seq_rx,opts->dup_detect_enabled);
+					}
 				}
 			break;
 
@@ -810,7 +1035,8 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 				// Send packet (as the reply does require to carry the client timestamp, the control field should now correspond to CTRL_PINGLIKE_REPLY)
 				// 'rcv_bytes' still stores the packet size, thus it can be used as packet size to be passed to rawLampSend(), wich will in turn call sendto() with that size
 				// rawLampSend should also take care of re-computing the checksum, which is changed due to the different fields in the reply packet.
-				if(rawLampSend(sData.descriptor, sData.addru.addrll, headerptrs.lampHeader, packet, rcv_bytes, FLG_NONE, UDP)) {
+				if(!CHECK_XS_NULL(xsk) ? xdpLampSend(xsk, headerptrs.lampHeader, packet, rcv_bytes, FLG_NONE) :
+					rawLampSend(sData.descriptor, sData.addru.addrll, headerptrs.lampHeader, frame, rcv_bytes, FLG_NONE, UDP)) {
 					fprintf(stderr,"UDP server reported that it can't reply to the client with id=%u and seq=%u\n",lamp_id_rx,lamp_seq_rx);
 				}
 
@@ -830,7 +1056,7 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 							break;
 						}
 						saferecvmsg(rcv_bytes,sData.descriptor,&mhdr,MSG_ERRQUEUE);
-						lampHeadGetData(lampPacket,&lamp_type_rx_errqueue,NULL,&lamp_seq_rx_errqueue,NULL,NULL,NULL);
+						lampHeadGetData(lampPacketErrqueue,&lamp_type_rx_errqueue,NULL,&lamp_seq_rx_errqueue,NULL,NULL,NULL);
 					} while(lamp_seq_rx_errqueue!=lamp_seq_rx || lamp_type_rx_errqueue!=lamp_type_tx);
 
 					if(rcv_bytes==-1) {
@@ -872,6 +1098,15 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 		}
 	}
 
+	if(rate_limited>0) {
+		fprintf(stdout,"Rate limit: %" PRIu64 " packets discarded during the session.\n",rate_limited);
+	}
+
+	// Merge the session in the aggregated statistics (only its counters are updated, whatever the number of packets is)
+	if(!CHECK_AT_NULL(sData.aggr_table)) {
+		aggrTableAddSession(sData.aggr_table,client_ip_session,mode_session,&reportData,&latencyHistData,timedout_session);
+	}
+
 	if(mode_session==UNIDIR) {
 		// Terminate the carbon flush thread
 		// carbon_metrics_flush_first is checked in order to verify if the thread has been created or not
@@ -881,12 +1116,15 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 		}
 
 		if(Wfiledescriptor>0) {
+			tfileWriterFree(Wwriter);
 			closeTfile(Wfiledescriptor);
 		}
 
-		destIP_inaddr.s_addr=headerptrs.ipHeader->saddr;
 		// If the mode is the unidirectional one, get the destination IP/MAC from the last packet
 		// Use as destination IP (destIP), the source IP of the last received packet (headerptrs.ipHeader->saddr)
+		// With the TPACKET_V3 ring, the last frame may have already been given back to the kernel (e.g. after a timeout):
+		// the client IP address received with the INIT packet is used instead
+		destIP_inaddr.s_addr=CHECK_RR_NULL(rxring) ? headerptrs.ipHeader->saddr : client_ip_session.s_addr;
 		if(transmitReport(sData, opts, destIP_inaddr, srcIP, srcMAC, srcmacaddr_pkt)) {
 			fprintf(stderr,"UDP server reported an error while transmitting the report.\n"
 				"No report will be transmitted.\n");
@@ -909,10 +1147,25 @@ unsigned int runUDPserver_raw(struct lampsock_data sData, macaddr_t srcMAC, stru
 		}
 	}
 
-	reportStructureFree(&reportData);
+	if(!reportData_allocated) {
+		reportStructureFree(&reportData);
+	}
 
 	// Destroy mutex (as it is no longer needed) and clear all the other data that should be clared (see the CLEAR_ALL() macro)
 	CLEAR_ALL();
 
 	return 0;
+}
+
+// Free the data kept allocated across the sessions in continuous daemon mode (to be called after the last session)
+void runUDPserverFree_raw(void) {
+	if(reportData_allocated) {
+		reportStructureFree(&reportData);
+		reportData_allocated=0;
+	}
+
+	xdpSockFree(xsk);
+	xsk=NULL;
+	rxRingFree(rxring);
+	rxring=NULL;
 }
\ No newline at end of file
@@ -0,0 +1,806 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <net/ethernet.h>
+#include "xdp_sock.h"
+#include "common_udp.h"
+
+// Maximum number of instructions and of jump targets of the XDP programs
+#define XDP_PROG_MAX_INSNS 192
+#define XDP_PROG_MAX_LABELS 8
+// Offset of the LaMP header inside the frames inspected by the XDP programs (IPv4 without options)
+#define XDP_PROG_LAMP_OFFSET (sizeof(struct ether_header)+sizeof(struct iphdr)+sizeof(struct udphdr))
+#define XDP_PROG_UDP_CSUM_OFFSET (sizeof(struct ether_header)+sizeof(struct iphdr)+offsetof(struct udphdr,check))
+
+// Jump targets of the XDP programs
+#define XDP_LABEL_PASS 0
+#define XDP_LABEL_TX 1
+#define XDP_LABEL_COUNT_END 2
+#define XDP_LABEL_CSUM_SKIP 3 // One label for each checksum update (see xdpProgEmitCsumUpdate())
+
+// Indices of the counters updated by the in-kernel reflector
+#define XDP_REFLECTOR_CNT_REFLECTED 0
+#define XDP_REFLECTOR_CNT_END 1
+#define XDP_REFLECTOR_CNT_NUM 2
+
+#define XDP_INSN(CODE,DST,SRC,OFF,IMM) ((struct bpf_insn) {.code=(CODE),.dst_reg=(DST),.src_reg=(SRC),.off=(OFF),.imm=(IMM)})
+
+typedef enum {
+	XDP_SOCK_MODE_ZEROCOPY,
+	XDP_SOCK_MODE_COPY_NATIVE,
+	XDP_SOCK_MODE_COPY_GENERIC
+} xdpSockMode;
+
+// Single-producer/single-consumer ring shared with the kernel
+struct xdpSockRing {
+	uint32_t *producer;
+	uint32_t *consumer;
+	uint32_t *flags;
+	void *descs; // struct xdp_desc (rx/tx rings) or uint64_t UMEM addresses (fill/completion rings)
+	void *map;
+	size_t map_len;
+};
+
+struct _xdpSock {
+	int fd; // AF_XDP socket
+	int map_fd; // XSKMAP, containing 'fd' at the index of the bound queue
+	int prog_fd;
+	int link_fd; // The XDP program is detached from the interface as soon as this bpf_link is closed
+	int ctl_fd;
+
+	byte_t *umem;
+	struct xdpSockRing fill;
+	struct xdpSockRing comp;
+	struct xdpSockRing rx;
+	struct xdpSockRing tx;
+
+	// Stack of the UMEM addresses which are currently available for the transmission
+	uint64_t txFree[XDP_SOCK_NUM_FRAMES/2];
+	uint32_t txFreeNum;
+
+	xdpSockMode mode;
+};
+
+struct _xdpReflector {
+	int map_fd; // Array with the XDP_REFLECTOR_CNT_NUM counters
+	int prog_fd;
+	int link_fd;
+	uint8_t generic;
+};
+
+// XDP program being assembled: the jumps are emitted towards a label, and their offsets are set by xdpProgLoad()
+struct xdpProg {
+	struct bpf_insn insns[XDP_PROG_MAX_INSNS];
+	int n;
+	int jumps[XDP_PROG_MAX_INSNS];
+	int jumpLabels[XDP_PROG_MAX_INSNS];
+	int nj;
+	int labels[XDP_PROG_MAX_LABELS];
+};
+
+static inline long bpfSyscall(int cmd, union bpf_attr *attr) {
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static inline uint32_t ringLoadAcquire(uint32_t *idx) {
+	return __atomic_load_n(idx,__ATOMIC_ACQUIRE);
+}
+
+static inline void ringStoreRelease(uint32_t *idx, uint32_t value) {
+	__atomic_store_n(idx,value,__ATOMIC_RELEASE);
+}
+
+static inline void xdpProgEmit(struct xdpProg *p, struct bpf_insn insn) {
+	p->insns[p->n++]=insn;
+}
+
+static inline void xdpProgEmitJump(struct xdpProg *p, struct bpf_insn insn, int label) {
+	p->jumps[p->nj]=p->n;
+	p->jumpLabels[p->nj++]=label;
+	p->insns[p->n++]=insn;
+}
+
+static inline void xdpProgLabel(struct xdpProg *p, int label) {
+	p->labels[label]=p->n;
+}
+
+// r1 = address of the map with file descriptor 'map_fd' (64 bit immediate load, taking two instructions)
+static inline void xdpProgEmitLoadMap(struct xdpProg *p, int map_fd) {
+	xdpProgEmit(p,XDP_INSN(BPF_LD | BPF_DW | BPF_IMM,BPF_REG_1,BPF_PSEUDO_MAP_FD,0,map_fd));
+	xdpProgEmit(p,XDP_INSN(0,0,0,0,0));
+}
+
+// Emit the checks shared by all the XDP programs: the program jumps to XDP_LABEL_PASS unless the packet is an IPv4 (without
+// options, not fragmented) UDP packet directed to 'udp_port', carrying a LaMP header with a control field selected by 'ctrl_mask'
+// The packet fields are compared with constants in network byte order; the LaMP 'reserved' field and the upper bits of the control
+// field are compared with the ones written by lampHeadPopulate(), i.e. with what IS_LAMP() checks in userspace
+// After the checks, r6 contains the context, r2 the packet data pointer and r7 the LaMP control field
+static void xdpProgEmitLampMatch(struct xdpProg *p, uint16_t udp_port, uint32_t ctrl_mask) {
+	struct lamphdr lampHeader;
+
+	lampHeadPopulate(&lampHeader,CTRL_PINGLIKE_REQ,0,0);
+
+	// r6 = ctx, r2 = data, r3 = data_end
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X,BPF_REG_6,BPF_REG_1,0,0));
+	xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_W | BPF_MEM,BPF_REG_2,BPF_REG_1,offsetof(struct xdp_md,data),0));
+	xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_W | BPF_MEM,BPF_REG_3,BPF_REG_1,offsetof(struct xdp_md,data_end),0));
+
+	// if(data+XDP_PROG_LAMP_OFFSET+LAMP_HDR_SIZE() > data_end) goto pass
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X,BPF_REG_4,BPF_REG_2,0,0));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_K,BPF_REG_4,0,0,XDP_PROG_LAMP_OFFSET+LAMP_HDR_SIZE()));
+	xdpProgEmitJump(p,XDP_INSN(BPF_JMP | BPF_JGT | BPF_X,BPF_REG_4,BPF_REG_3,0,0),XDP_LABEL_PASS);
+
+	// EtherType: IPv4
+	xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_H | BPF_MEM,BPF_REG_5,BPF_REG_2,offsetof(struct ether_header,ether_type),0));
+	xdpProgEmitJump(p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_5,0,0,htons(ETHERTYPE_IP)),XDP_LABEL_PASS);
+
+	// IPv4 without options, UDP, not fragmented
+	xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_B | BPF_MEM,BPF_REG_5,BPF_REG_2,sizeof(struct ether_header),0));
+	xdpProgEmitJump(p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_5,0,0,0x45),XDP_LABEL_PASS);
+	xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_B | BPF_MEM,BPF_REG_5,BPF_REG_2,sizeof(struct ether_header)+offsetof(struct iphdr,protocol),0));
+	xdpProgEmitJump(p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_5,0,0,IPPROTO_UDP),XDP_LABEL_PASS);
+	xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_H | BPF_MEM,BPF_REG_5,BPF_REG_2,sizeof(struct ether_header)+offsetof(struct iphdr,frag_off),0));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_AND | BPF_K,BPF_REG_5,0,0,htons(0x3fff)));
+	xdpProgEmitJump(p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_5,0,0,0),XDP_LABEL_PASS);
+
+	// UDP destination port
+	xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_H | BPF_MEM,BPF_REG_5,BPF_REG_2,sizeof(struct ether_header)+sizeof(struct iphdr)+offsetof(struct udphdr,dest),0));
+	xdpProgEmitJump(p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_5,0,0,htons(udp_port)),XDP_LABEL_PASS);
+
+	// LaMP 'reserved' field
+	xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_B | BPF_MEM,BPF_REG_5,BPF_REG_2,XDP_PROG_LAMP_OFFSET+offsetof(struct lamphdr,reserved),0));
+	xdpProgEmitJump(p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_5,0,0,lampHeader.reserved),XDP_LABEL_PASS);
+
+	// LaMP control field: if((ctrl & 0xF0)!=(CTRL_PINGLIKE_REQ & 0xF0) || !((ctrl_mask>>(ctrl & 0x0F)) & 1)) goto pass
+	xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_B | BPF_MEM,BPF_REG_7,BPF_REG_2,XDP_PROG_LAMP_OFFSET+offsetof(struct lamphdr,ctrl),0));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X,BPF_REG_5,BPF_REG_7,0,0));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_AND | BPF_K,BPF_REG_5,0,0,0xF0));
+	xdpProgEmitJump(p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_5,0,0,CTRL_PINGLIKE_REQ & 0xF0),XDP_LABEL_PASS);
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X,BPF_REG_5,BPF_REG_7,0,0));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_AND | BPF_K,BPF_REG_5,0,0,0x0F));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K,BPF_REG_4,0,0,ctrl_mask & 0xFFFF));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_RSH | BPF_X,BPF_REG_4,BPF_REG_5,0,0));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_AND | BPF_K,BPF_REG_4,0,0,1));
+	xdpProgEmitJump(p,XDP_INSN(BPF_JMP | BPF_JEQ | BPF_K,BPF_REG_4,0,0,0),XDP_LABEL_PASS);
+}
+
+// Incrementally update the UDP checksum (RFC 1624: HC' = ~(~HC + ~m + m')), after changing a 16 bit word of the datagram
+// from the value in r0 to the value in r1 (both loaded from the packet, just like the checksum), with r2 pointing to the packet data
+// A zero checksum (i.e. no checksum) is left untouched, while a result equal to zero is transmitted as 0xFFFF
+static void xdpProgEmitCsumUpdate(struct xdpProg *p, int label) {
+	xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_H | BPF_MEM,BPF_REG_4,BPF_REG_2,XDP_PROG_UDP_CSUM_OFFSET,0));
+	xdpProgEmitJump(p,XDP_INSN(BPF_JMP | BPF_JEQ | BPF_K,BPF_REG_4,0,0,0),label);
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_XOR | BPF_K,BPF_REG_4,0,0,0xFFFF));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_XOR | BPF_K,BPF_REG_0,0,0,0xFFFF));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_X,BPF_REG_4,BPF_REG_0,0,0));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_X,BPF_REG_4,BPF_REG_1,0,0));
+	// Fold the carries twice
+	for(int i=0;i<2;i++) {
+		xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X,BPF_REG_5,BPF_REG_4,0,0));
+		xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_RSH | BPF_K,BPF_REG_5,0,0,16));
+		xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_AND | BPF_K,BPF_REG_4,0,0,0xFFFF));
+		xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_X,BPF_REG_4,BPF_REG_5,0,0));
+	}
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_XOR | BPF_K,BPF_REG_4,0,0,0xFFFF));
+	xdpProgEmit(p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_4,0,1,0));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K,BPF_REG_4,0,0,0xFFFF));
+	xdpProgEmit(p,XDP_INSN(BPF_STX | BPF_H | BPF_MEM,BPF_REG_2,BPF_REG_4,XDP_PROG_UDP_CSUM_OFFSET,0));
+	xdpProgLabel(p,label);
+}
+
+// Swap two fields of 'len' bytes (multiple of 2) of the packet, at offsets 'a' and 'b'
+static void xdpProgEmitSwap(struct xdpProg *p, int a, int b, int len) {
+	for(int i=0;i<len;i+=2) {
+		xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_H | BPF_MEM,BPF_REG_4,BPF_REG_2,a+i,0));
+		xdpProgEmit(p,XDP_INSN(BPF_LDX | BPF_H | BPF_MEM,BPF_REG_5,BPF_REG_2,b+i,0));
+		xdpProgEmit(p,XDP_INSN(BPF_STX | BPF_H | BPF_MEM,BPF_REG_2,BPF_REG_5,a+i,0));
+		xdpProgEmit(p,XDP_INSN(BPF_STX | BPF_H | BPF_MEM,BPF_REG_2,BPF_REG_4,b+i,0));
+	}
+}
+
+// Atomically increase by one the counter with index 'idx' of the array map 'map_fd' (the packet pointers are not preserved)
+static void xdpProgEmitCounterInc(struct xdpProg *p, int map_fd, int idx) {
+	xdpProgEmit(p,XDP_INSN(BPF_ST | BPF_W | BPF_MEM,BPF_REG_10,0,-4,idx));
+	xdpProgEmitLoadMap(p,map_fd);
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X,BPF_REG_2,BPF_REG_10,0,0));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_K,BPF_REG_2,0,0,-4));
+	xdpProgEmit(p,XDP_INSN(BPF_JMP | BPF_CALL,0,0,0,BPF_FUNC_map_lookup_elem));
+	xdpProgEmit(p,XDP_INSN(BPF_JMP | BPF_JEQ | BPF_K,BPF_REG_0,0,2,0));
+	xdpProgEmit(p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K,BPF_REG_1,0,0,1));
+	xdpProgEmit(p,XDP_INSN(BPF_STX | BPF_DW | BPF_XADD,BPF_REG_0,BPF_REG_1,0,0));
+}
+
+// Resolve the jumps and load the program, returning its file descriptor (or -1 in case of error)
+static int xdpProgLoad(struct xdpProg *p) {
+	union bpf_attr attr;
+
+	for(int i=0;i<p->nj;i++) {
+		p->insns[p->jumps[i]].off=p->labels[p->jumpLabels[i]]-(p->jumps[i]+1);
+	}
+
+	memset(&attr,0,sizeof(attr));
+	attr.prog_type=BPF_PROG_TYPE_XDP;
+	attr.insn_cnt=p->n;
+	attr.insns=(uint64_t) (uintptr_t) p->insns;
+	attr.license=(uint64_t) (uintptr_t) "GPL";
+
+	return bpfSyscall(BPF_PROG_LOAD,&attr);
+}
+
+// Load the XDP program of the AF_XDP socket, which redirects to the XSKMAP (on the receiving queue) only the LaMP packets directed
+// to 'udp_port' and with a control field in 'ctrl_mask', and lets any other packet go through the network stack
+// In case the XSKMAP does not contain any socket for the receiving queue, bpf_redirect_map() falls back to XDP_PASS
+static int xdpSockProgLoad(int map_fd, uint16_t udp_port, uint32_t ctrl_mask) {
+	struct xdpProg p={.n=0,.nj=0};
+
+	xdpProgEmitLampMatch(&p,udp_port,ctrl_mask);
+
+	// return bpf_redirect_map(map,ctx->rx_queue_index,XDP_PASS)
+	xdpProgEmit(&p,XDP_INSN(BPF_LDX | BPF_W | BPF_MEM,BPF_REG_2,BPF_REG_6,offsetof(struct xdp_md,rx_queue_index),0));
+	xdpProgEmitLoadMap(&p,map_fd);
+	xdpProgEmit(&p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K,BPF_REG_3,0,0,XDP_PASS));
+	xdpProgEmit(&p,XDP_INSN(BPF_JMP | BPF_CALL,0,0,0,BPF_FUNC_redirect_map));
+	xdpProgEmit(&p,XDP_INSN(BPF_JMP | BPF_EXIT,0,0,0,0));
+
+	xdpProgLabel(&p,XDP_LABEL_PASS);
+	xdpProgEmit(&p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K,BPF_REG_0,0,0,XDP_PASS));
+	xdpProgEmit(&p,XDP_INSN(BPF_JMP | BPF_EXIT,0,0,0,0));
+
+	return xdpProgLoad(&p);
+}
+
+// Load the XDP program of the in-kernel reflector, which replies to the ping-like requests of the session 'lamp_id' with XDP_TX,
+// after swapping the MAC addresses, the IP addresses and the UDP ports (using 'dst_port', if >0, as destination port) and after
+// rewriting the control field (REQ->REPLY, ENDREQ->ENDREPLY, and the same for the TLESS types)
+// The IP checksum does not change, while the UDP checksum is updated incrementally
+static int xdpReflectorProgLoad(int map_fd, uint16_t udp_port, uint16_t lamp_id, int dst_port) {
+	struct xdpProg p={.n=0,.nj=0};
+	struct lamphdr lampHeader;
+	uint16_t lamp_id_pkt;
+	const uint8_t ctrlMap[][2]={
+		{CTRL_PINGLIKE_REQ,CTRL_PINGLIKE_REPLY},
+		{CTRL_PINGLIKE_ENDREQ,CTRL_PINGLIKE_ENDREPLY},
+		{CTRL_PINGLIKE_REQ_TLESS,CTRL_PINGLIKE_REPLY_TLESS},
+		{CTRL_PINGLIKE_ENDREQ_TLESS,CTRL_PINGLIKE_ENDREPLY_TLESS}
+	};
+	const int ctrlMapLen=sizeof(ctrlMap)/sizeof(ctrlMap[0]);
+	const int ipOffset=sizeof(struct ether_header);
+	const int udpOffset=sizeof(struct ether_header)+sizeof(struct iphdr);
+
+	// Get the LaMP id as written inside the packets
+	lampHeadPopulate(&lampHeader,CTRL_PINGLIKE_REQ,lamp_id,0);
+	memcpy(&lamp_id_pkt,&(lampHeader.id),sizeof(lamp_id_pkt));
+
+	xdpProgEmitLampMatch(&p,udp_port,XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_REQ) | XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_ENDREQ) |
+		XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_REQ_TLESS) | XDP_SOCK_CTRL_BIT(CTRL_PINGLIKE_ENDREQ_TLESS));
+
+	// LaMP id
+	xdpProgEmit(&p,XDP_INSN(BPF_LDX | BPF_H | BPF_MEM,BPF_REG_5,BPF_REG_2,XDP_PROG_LAMP_OFFSET+offsetof(struct lamphdr,id),0));
+	xdpProgEmitJump(&p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_5,0,0,lamp_id_pkt),XDP_LABEL_PASS);
+
+	// Swap the addresses and the ports
+	xdpProgEmitSwap(&p,offsetof(struct ether_header,ether_dhost),offsetof(struct ether_header,ether_shost),ETHER_ADDR_LEN);
+	xdpProgEmitSwap(&p,ipOffset+offsetof(struct iphdr,saddr),ipOffset+offsetof(struct iphdr,daddr),sizeof(uint32_t));
+	xdpProgEmitSwap(&p,udpOffset+offsetof(struct udphdr,source),udpOffset+offsetof(struct udphdr,dest),sizeof(uint16_t));
+
+	// Forced destination port (--udp-force-dst-port)
+	if(dst_port>0) {
+		xdpProgEmit(&p,XDP_INSN(BPF_LDX | BPF_H | BPF_MEM,BPF_REG_0,BPF_REG_2,udpOffset+offsetof(struct udphdr,dest),0));
+		xdpProgEmit(&p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K,BPF_REG_1,0,0,htons(dst_port)));
+		xdpProgEmit(&p,XDP_INSN(BPF_STX | BPF_H | BPF_MEM,BPF_REG_2,BPF_REG_1,udpOffset+offsetof(struct udphdr,dest),0));
+		xdpProgEmitCsumUpdate(&p,XDP_LABEL_CSUM_SKIP);
+	}
+
+	// Control field: r0 = 16 bit word containing the control field, before and (r1) after the rewrite
+	xdpProgEmit(&p,XDP_INSN(BPF_LDX | BPF_H | BPF_MEM,BPF_REG_0,BPF_REG_2,XDP_PROG_LAMP_OFFSET+(offsetof(struct lamphdr,ctrl) & ~1),0));
+	for(int i=0;i<ctrlMapLen;i++) {
+		xdpProgEmit(&p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_7,0,2,ctrlMap[i][0]));
+		xdpProgEmit(&p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K,BPF_REG_7,0,0,ctrlMap[i][1]));
+		xdpProgEmit(&p,XDP_INSN(BPF_JMP | BPF_JA,0,0,3*(ctrlMapLen-1-i),0));
+	}
+	xdpProgEmit(&p,XDP_INSN(BPF_STX | BPF_B | BPF_MEM,BPF_REG_2,BPF_REG_7,XDP_PROG_LAMP_OFFSET+offsetof(struct lamphdr,ctrl),0));
+	xdpProgEmit(&p,XDP_INSN(BPF_LDX | BPF_H | BPF_MEM,BPF_REG_1,BPF_REG_2,XDP_PROG_LAMP_OFFSET+(offsetof(struct lamphdr,ctrl) & ~1),0));
+	xdpProgEmitCsumUpdate(&p,XDP_LABEL_CSUM_SKIP+1);
+
+	// Update the counters: the userspace server polls them to detect the end of the session
+	xdpProgEmitCounterInc(&p,map_fd,XDP_REFLECTOR_CNT_REFLECTED);
+	xdpProgEmitJump(&p,XDP_INSN(BPF_JMP | BPF_JEQ | BPF_K,BPF_REG_7,0,0,CTRL_PINGLIKE_ENDREPLY),XDP_LABEL_COUNT_END);
+	xdpProgEmitJump(&p,XDP_INSN(BPF_JMP | BPF_JNE | BPF_K,BPF_REG_7,0,0,CTRL_PINGLIKE_ENDREPLY_TLESS),XDP_LABEL_TX);
+	xdpProgLabel(&p,XDP_LABEL_COUNT_END);
+	xdpProgEmitCounterInc(&p,map_fd,XDP_REFLECTOR_CNT_END);
+
+	xdpProgLabel(&p,XDP_LABEL_TX);
+	xdpProgEmit(&p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K,BPF_REG_0,0,0,XDP_TX));
+	xdpProgEmit(&p,XDP_INSN(BPF_JMP | BPF_EXIT,0,0,0,0));
+
+	xdpProgLabel(&p,XDP_LABEL_PASS);
+	xdpProgEmit(&p,XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K,BPF_REG_0,0,0,XDP_PASS));
+	xdpProgEmit(&p,XDP_INSN(BPF_JMP | BPF_EXIT,0,0,0,0));
+
+	return xdpProgLoad(&p);
+}
+
+// Attach the XDP program to the interface, in native mode if supported by the driver (and if 'force_generic' is 0), otherwise in
+// generic mode; return the bpf_link file descriptor, or -1 if the program cannot be attached in any mode
+static int xdpProgAttach(int prog_fd, int ifindex, uint8_t force_generic, uint8_t *generic) {
+	union bpf_attr attr;
+	int link_fd=-1;
+
+	memset(&attr,0,sizeof(attr));
+	attr.link_create.prog_fd=prog_fd;
+	attr.link_create.target_ifindex=ifindex;
+	attr.link_create.attach_type=BPF_XDP;
+
+	*generic=0;
+
+	if(!force_generic) {
+		attr.link_create.flags=XDP_FLAGS_DRV_MODE;
+		link_fd=bpfSyscall(BPF_LINK_CREATE,&attr);
+	}
+
+	if(link_fd<0 && (force_generic || (errno!=EBUSY && errno!=EEXIST))) {
+		attr.link_create.flags=XDP_FLAGS_SKB_MODE;
+		*generic=1;
+		link_fd=bpfSyscall(BPF_LINK_CREATE,&attr);
+	}
+
+	return link_fd;
+}
+
+static int xdpSockRingMap(int fd, struct xdpSockRing *ring, struct xdp_ring_offset *off, size_t desc_size, off_t pgoff) {
+	ring->map_len=off->desc+XDP_SOCK_RING_SIZE*desc_size;
+	ring->map=mmap(NULL,ring->map_len,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,pgoff);
+
+	if(ring->map==MAP_FAILED) {
+		ring->map=NULL;
+		return -1;
+	}
+
+	ring->producer=(uint32_t *) ((byte_t *) ring->map+off->producer);
+	ring->consumer=(uint32_t *) ((byte_t *) ring->map+off->consumer);
+	ring->flags=(uint32_t *) ((byte_t *) ring->map+off->flags);
+	ring->descs=(byte_t *) ring->map+off->desc;
+
+	return 0;
+}
+
+// Create the AF_XDP socket, register the UMEM and map the four rings
+static int xdpSockUmemSetup(xdpSock XS) {
+	struct xdp_umem_reg umemReg;
+	struct xdp_mmap_offsets offsets;
+	socklen_t optlen=sizeof(offsets);
+	int ringSize=XDP_SOCK_RING_SIZE;
+
+	XS->fd=socket(AF_XDP,SOCK_RAW,0);
+	if(XS->fd<0) {
+		return -1;
+	}
+
+	XS->umem=mmap(NULL,XDP_SOCK_NUM_FRAMES*XDP_SOCK_FRAME_SIZE,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,-1,0);
+	if(XS->umem==MAP_FAILED) {
+		XS->umem=NULL;
+		return -1;
+	}
+
+	memset(&umemReg,0,sizeof(umemReg));
+	umemReg.addr=(uint64_t) (uintptr_t) XS->umem;
+	umemReg.len=XDP_SOCK_NUM_FRAMES*XDP_SOCK_FRAME_SIZE;
+	umemReg.chunk_size=XDP_SOCK_FRAME_SIZE;
+	umemReg.headroom=0;
+
+	if(setsockopt(XS->fd,SOL_XDP,XDP_UMEM_REG,&umemReg,sizeof(umemReg))<0 ||
+		setsockopt(XS->fd,SOL_XDP,XDP_UMEM_FILL_RING,&ringSize,sizeof(ringSize))<0 ||
+		setsockopt(XS->fd,SOL_XDP,XDP_UMEM_COMPLETION_RING,&ringSize,sizeof(ringSize))<0 ||
+		setsockopt(XS->fd,SOL_XDP,XDP_RX_RING,&ringSize,sizeof(ringSize))<0 ||
+		setsockopt(XS->fd,SOL_XDP,XDP_TX_RING,&ringSize,sizeof(ringSize))<0) {
+		return -1;
+	}
+
+	if(getsockopt(XS->fd,SOL_XDP,XDP_MMAP_OFFSETS,&offsets,&optlen)<0) {
+		return -1;
+	}
+
+	if(xdpSockRingMap(XS->fd,&XS->fill,&offsets.fr,sizeof(uint64_t),XDP_UMEM_PGOFF_FILL_RING)<0 ||
+		xdpSockRingMap(XS->fd,&XS->comp,&offsets.cr,sizeof(uint64_t),XDP_UMEM_PGOFF_COMPLETION_RING)<0 ||
+		xdpSockRingMap(XS->fd,&XS->rx,&offsets.rx,sizeof(struct xdp_desc),XDP_PGOFF_RX_RING)<0 ||
+		xdpSockRingMap(XS->fd,&XS->tx,&offsets.tx,sizeof(struct xdp_desc),XDP_PGOFF_TX_RING)<0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+// Bind the socket to the given queue, trying the zero-copy mode first, when the XDP program is running in native mode
+static int xdpSockBind(xdpSock XS, int ifindex, uint32_t queue, uint8_t generic) {
+	struct sockaddr_xdp addrxdp;
+
+	memset(&addrxdp,0,sizeof(addrxdp));
+	addrxdp.sxdp_family=AF_XDP;
+	addrxdp.sxdp_ifindex=ifindex;
+	addrxdp.sxdp_queue_id=queue;
+
+	if(!generic) {
+		addrxdp.sxdp_flags=XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+		if(bind(XS->fd,(struct sockaddr *) &addrxdp,sizeof(addrxdp))==0) {
+			XS->mode=XDP_SOCK_MODE_ZEROCOPY;
+			return 0;
+		}
+	}
+
+	addrxdp.sxdp_flags=XDP_COPY | XDP_USE_NEED_WAKEUP;
+	if(bind(XS->fd,(struct sockaddr *) &addrxdp,sizeof(addrxdp))<0) {
+		return -1;
+	}
+
+	XS->mode=generic ? XDP_SOCK_MODE_COPY_GENERIC : XDP_SOCK_MODE_COPY_NATIVE;
+
+	return 0;
+}
+
+xdpSock xdpSockInit(const char *devname, int ifindex, uint32_t queue, uint16_t udp_port, uint32_t ctrl_mask, int ctl_fd, uint8_t force_generic) {
+	xdpSock XS;
+	union bpf_attr attr;
+	struct rlimit memlock={RLIM_INFINITY,RLIM_INFINITY};
+	uint32_t fillIdx;
+	uint8_t generic;
+	int mapKey=(int) queue;
+
+	XS=calloc(1,sizeof(struct _xdpSock));
+	if(CHECK_XS_NULL(XS)) {
+		fprintf(stderr,"AF_XDP socket: cannot allocate memory.\n");
+		return NULL;
+	}
+
+	XS->fd=-1;
+	XS->map_fd=-1;
+	XS->prog_fd=-1;
+	XS->link_fd=-1;
+	XS->ctl_fd=ctl_fd;
+
+	// Older kernels account both the BPF objects and the UMEM to RLIMIT_MEMLOCK: just try to remove the limit
+	setrlimit(RLIMIT_MEMLOCK,&memlock);
+
+	// XSKMAP, with one entry for each queue up to the selected one
+	memset(&attr,0,sizeof(attr));
+	attr.map_type=BPF_MAP_TYPE_XSKMAP;
+	attr.key_size=sizeof(int);
+	attr.value_size=sizeof(int);
+	attr.max_entries=queue+1;
+
+	XS->map_fd=bpfSyscall(BPF_MAP_CREATE,&attr);
+	if(XS->map_fd<0) {
+		fprintf(stderr,"AF_XDP socket: cannot create the XSKMAP: %s.\n",strerror(errno));
+		xdpSockFree(XS);
+		return NULL;
+	}
+
+	XS->prog_fd=xdpSockProgLoad(XS->map_fd,udp_port,ctrl_mask);
+	if(XS->prog_fd<0) {
+		fprintf(stderr,"AF_XDP socket: cannot load the XDP program: %s.\n",strerror(errno));
+		xdpSockFree(XS);
+		return NULL;
+	}
+
+	XS->link_fd=xdpProgAttach(XS->prog_fd,ifindex,force_generic,&generic);
+	if(XS->link_fd<0) {
+		fprintf(stderr,"AF_XDP socket: cannot attach the XDP program to %s: %s.\n"
+			"A Linux kernel >= 5.9 is required and no other XDP program should be attached to the same interface.\n",
+			devname,strerror(errno));
+		xdpSockFree(XS);
+		return NULL;
+	}
+
+	if(xdpSockUmemSetup(XS)<0 || xdpSockBind(XS,ifindex,queue,generic)<0) {
+		fprintf(stderr,"AF_XDP socket: cannot set up the socket on %s (queue %" PRIu32 "): %s.\n",devname,queue,strerror(errno));
+		xdpSockFree(XS);
+		return NULL;
+	}
+
+	// Give the first half of the UMEM frames to the kernel for the reception, and keep the second half for the transmission
+	for(fillIdx=0;fillIdx<XDP_SOCK_NUM_FRAMES/2;fillIdx++) {
+		((uint64_t *) XS->fill.descs)[fillIdx & (XDP_SOCK_RING_SIZE-1)]=(uint64_t) fillIdx*XDP_SOCK_FRAME_SIZE;
+	}
+	ringStoreRelease(XS->fill.producer,*XS->fill.producer+XDP_SOCK_NUM_FRAMES/2);
+
+	for(XS->txFreeNum=0;XS->txFreeNum<XDP_SOCK_NUM_FRAMES/2;XS->txFreeNum++) {
+		XS->txFree[XS->txFreeNum]=(uint64_t) (XDP_SOCK_NUM_FRAMES/2+XS->txFreeNum)*XDP_SOCK_FRAME_SIZE;
+	}
+
+	// Only now the packets can be redirected to the socket
+	memset(&attr,0,sizeof(attr));
+	attr.map_fd=XS->map_fd;
+	attr.key=(uint64_t) (uintptr_t) &mapKey;
+	attr.value=(uint64_t) (uintptr_t) &XS->fd;
+	attr.flags=BPF_ANY;
+
+	if(bpfSyscall(BPF_MAP_UPDATE_ELEM,&attr)<0) {
+		fprintf(stderr,"AF_XDP socket: cannot insert the socket into the XSKMAP: %s.\n",strerror(errno));
+		xdpSockFree(XS);
+		return NULL;
+	}
+
+	return XS;
+}
+
+// Get the reception timeout (in ms) from the SO_RCVTIMEO option of the companion AF_PACKET socket (-1: no timeout)
+static int xdpSockTimeout(xdpSock XS) {
+	struct timeval rx_timeout;
+	socklen_t optlen=sizeof(rx_timeout);
+
+	if(getsockopt(XS->ctl_fd,SOL_SOCKET,SO_RCVTIMEO,&rx_timeout,&optlen)<0 || (rx_timeout.tv_sec==0 && rx_timeout.tv_usec==0)) {
+		return -1;
+	}
+
+	return rx_timeout.tv_sec*1000+rx_timeout.tv_usec/1000;
+}
+
+// Receive one frame, copying it to 'buf'
+// Just like recvfrom() on a socket with SO_RCVTIMEO, -1 is returned with errno set to EAGAIN when the timeout expires
+ssize_t xdpSockRecv(xdpSock XS, byte_t *buf, size_t len) {
+	struct xdp_desc *desc;
+	struct pollfd pfd;
+	uint32_t rxIdx, fillIdx;
+	size_t rcv_bytes;
+	int poll_ret;
+
+	pfd.fd=XS->fd;
+	pfd.events=POLLIN;
+
+	rxIdx=*XS->rx.consumer;
+
+	while(ringLoadAcquire(XS->rx.producer)==rxIdx) {
+		poll_ret=poll(&pfd,1,xdpSockTimeout(XS));
+
+		if(poll_ret==0) {
+			errno=EAGAIN;
+			return -1;
+		} else if(poll_ret<0 && errno!=EINTR) {
+			return -1;
+		}
+	}
+
+	desc=&((struct xdp_desc *) XS->rx.descs)[rxIdx & (XDP_SOCK_RING_SIZE-1)];
+	rcv_bytes=desc->len<len ? desc->len : len;
+	memcpy(buf,XS->umem+desc->addr,rcv_bytes);
+
+	// Give the frame back to the kernel: at most XDP_SOCK_NUM_FRAMES/2 frames are owned by the kernel, thus there is always space in the fill ring
+	fillIdx=*XS->fill.producer;
+	((uint64_t *) XS->fill.descs)[fillIdx & (XDP_SOCK_RING_SIZE-1)]=desc->addr & ~((uint64_t) XDP_SOCK_FRAME_SIZE-1);
+	ringStoreRelease(XS->fill.producer,fillIdx+1);
+	ringStoreRelease(XS->rx.consumer,rxIdx+1);
+
+	if(__atomic_load_n(XS->fill.flags,__ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) {
+		recvfrom(XS->fd,NULL,0,MSG_DONTWAIT,NULL,NULL);
+	}
+
+	return rcv_bytes;
+}
+
+// Get back the UMEM frames of the already transmitted packets
+static void xdpSockTxReclaim(xdpSock XS) {
+	uint32_t compIdx=*XS->comp.consumer;
+	uint32_t compProd=ringLoadAcquire(XS->comp.producer);
+
+	for(;compIdx!=compProd;compIdx++) {
+		XS->txFree[XS->txFreeNum++]=((uint64_t *) XS->comp.descs)[compIdx & (XDP_SOCK_RING_SIZE-1)];
+	}
+
+	ringStoreRelease(XS->comp.consumer,compIdx);
+}
+
+static inline void xdpSockTxKick(xdpSock XS) {
+	if(__atomic_load_n(XS->tx.flags,__ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) {
+		sendto(XS->fd,NULL,0,MSG_DONTWAIT,NULL,0);
+	}
+}
+
+// Transmit one frame, copying it to a UMEM frame
+// Return 0 on success, -1 otherwise (with errno set to EMSGSIZE when the frame is too big, or to ENOBUFS when the tx ring is full)
+int xdpSockSend(xdpSock XS, byte_t *frame, size_t len) {
+	struct xdp_desc *desc;
+	uint32_t txIdx;
+
+	if(len>XDP_SOCK_FRAME_SIZE) {
+		errno=EMSGSIZE;
+		return -1;
+	}
+
+	xdpSockTxReclaim(XS);
+
+	if(XS->txFreeNum==0) {
+		xdpSockTxKick(XS);
+		xdpSockTxReclaim(XS);
+
+		if(XS->txFreeNum==0) {
+			errno=ENOBUFS;
+			return -1;
+		}
+	}
+
+	// At most XDP_SOCK_NUM_FRAMES/2 frames can be in flight, thus there is always space in the tx ring
+	txIdx=*XS->tx.producer;
+	desc=&((struct xdp_desc *) XS->tx.descs)[txIdx & (XDP_SOCK_RING_SIZE-1)];
+	desc->addr=XS->txFree[--XS->txFreeNum];
+	desc->len=len;
+	desc->options=0;
+	memcpy(XS->umem+desc->addr,frame,len);
+	ringStoreRelease(XS->tx.producer,txIdx+1);
+
+	xdpSockTxKick(XS);
+
+	return 0;
+}
+
+// Same as rawLampSend() (UDP only), but using the AF_XDP socket
+// 'inpacket_lamphdr' should point to the LaMP header inside 'frame': when 'flag' is FLG_STOP, the packet is marked as the last one
+// of the session; the timestamp is then set just before the transmission (for requests and unidirectional packets only, as replies
+// should carry the client timestamp) and the UDP checksum is recomputed
+int xdpLampSend(xdpSock XS, struct lamphdr *inpacket_lamphdr, byte_t *frame, size_t len, endflag_t flag) {
+	struct iphdr *ipHeader=(struct iphdr *) (frame+sizeof(struct ether_header));
+	struct udphdr *udpHeader;
+	size_t udplen;
+
+	if(len<sizeof(struct ether_header)+sizeof(struct iphdr)+sizeof(struct udphdr)) {
+		errno=EINVAL;
+		return -1;
+	}
+
+	udpHeader=(struct udphdr *) ((byte_t *) ipHeader+ipHeader->ihl*4);
+	udplen=ntohs(udpHeader->len);
+
+	if((byte_t *) udpHeader+udplen>frame+len) {
+		errno=EINVAL;
+		return -1;
+	}
+
+	if(flag==FLG_STOP) {
+		if(inpacket_lamphdr->ctrl==CTRL_UNIDIR_CONTINUE) {
+			lampSetUnidirStop(inpacket_lamphdr);
+		} else {
+			lampSetPinglikeEndreqAll(inpacket_lamphdr);
+		}
+	}
+
+	if(inpacket_lamphdr->ctrl==CTRL_PINGLIKE_REQ || inpacket_lamphdr->ctrl==CTRL_PINGLIKE_ENDREQ ||
+		inpacket_lamphdr->ctrl==CTRL_UNIDIR_CONTINUE || inpacket_lamphdr->ctrl==CTRL_UNIDIR_STOP) {
+		lampHeadSetTimestamp(inpacket_lamphdr,NULL);
+	}
+
+	udpHeader->check=0;
+	udpHeader->check=rawUDPChecksum(ipHeader,udpHeader,udplen);
+
+	return xdpSockSend(XS,frame,len);
+}
+
+const char *xdpSockModeStr(xdpSock XS) {
+	switch(XS->mode) {
+		case XDP_SOCK_MODE_ZEROCOPY:
+			return "zero-copy";
+		case XDP_SOCK_MODE_COPY_NATIVE:
+			return "copy (native XDP)";
+		case XDP_SOCK_MODE_COPY_GENERIC:
+			return "copy (generic XDP)";
+	}
+
+	return "unknown";
+}
+
+void xdpSockFree(xdpSock XS) {
+	if(CHECK_XS_NULL(XS)) {
+		return;
+	}
+
+	struct xdpSockRing *rings[]={&XS->fill,&XS->comp,&XS->rx,&XS->tx};
+
+	// Closing the bpf_link detaches the XDP program from the interface
+	if(XS->link_fd>=0) close(XS->link_fd);
+	if(XS->prog_fd>=0) close(XS->prog_fd);
+	if(XS->map_fd>=0) close(XS->map_fd);
+
+	for(unsigned int i=0;i<sizeof(rings)/sizeof(rings[0]);i++) {
+		if(rings[i]->map) munmap(rings[i]->map,rings[i]->map_len);
+	}
+
+	if(XS->fd>=0) close(XS->fd);
+	if(XS->umem) munmap(XS->umem,XDP_SOCK_NUM_FRAMES*XDP_SOCK_FRAME_SIZE);
+
+	free(XS);
+}
+
+xdpReflector xdpReflectorInit(const char *devname, int ifindex, uint16_t udp_port, uint16_t lamp_id, int dst_port, uint8_t force_generic) {
+	xdpReflector XR;
+	union bpf_attr attr;
+	struct rlimit memlock={RLIM_INFINITY,RLIM_INFINITY};
+
+	XR=calloc(1,sizeof(struct _xdpReflector));
+	if(CHECK_XR_NULL(XR)) {
+		fprintf(stderr,"XDP reflector: cannot allocate memory.\n");
+		return NULL;
+	}
+
+	XR->prog_fd=-1;
+	XR->link_fd=-1;
+
+	setrlimit(RLIMIT_MEMLOCK,&memlock);
+
+	memset(&attr,0,sizeof(attr));
+	attr.map_type=BPF_MAP_TYPE_ARRAY;
+	attr.key_size=sizeof(uint32_t);
+	attr.value_size=sizeof(uint64_t);
+	attr.max_entries=XDP_REFLECTOR_CNT_NUM;
+
+	XR->map_fd=bpfSyscall(BPF_MAP_CREATE,&attr);
+	if(XR->map_fd<0) {
+		fprintf(stderr,"XDP reflector: cannot create the counters map: %s.\n",strerror(errno));
+		xdpReflectorFree(XR);
+		return NULL;
+	}
+
+	XR->prog_fd=xdpReflectorProgLoad(XR->map_fd,udp_port,lamp_id,dst_port);
+	if(XR->prog_fd<0) {
+		fprintf(stderr,"XDP reflector: cannot load the XDP program: %s.\n",strerror(errno));
+		xdpReflectorFree(XR);
+		return NULL;
+	}
+
+	XR->link_fd=xdpProgAttach(XR->prog_fd,ifindex,force_generic,&(XR->generic));
+	if(XR->link_fd<0) {
+		fprintf(stderr,"XDP reflector: cannot attach the XDP program to %s: %s.\n"
+			"A Linux kernel >= 5.9 is required and no other XDP program should be attached to the same interface.\n",
+			devname,strerror(errno));
+		xdpReflectorFree(XR);
+		return NULL;
+	}
+
+	return XR;
+}
+
+// Get the number of requests reflected so far, and the number of last requests (ENDREQ/ENDREQ_TLESS) among them
+int xdpReflectorGetCounters(xdpReflector XR, uint64_t *reflected, uint64_t *ended) {
+	union bpf_attr attr;
+	uint64_t *counters[XDP_REFLECTOR_CNT_NUM]={reflected,ended};
+
+	for(uint32_t key=0;key<XDP_REFLECTOR_CNT_NUM;key++) {
+		memset(&attr,0,sizeof(attr));
+		attr.map_fd=XR->map_fd;
+		attr.key=(uint64_t) (uintptr_t) &key;
+		attr.value=(uint64_t) (uintptr_t) counters[key];
+
+		if(bpfSyscall(BPF_MAP_LOOKUP_ELEM,&attr)<0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+const char *xdpReflectorModeStr(xdpReflector XR) {
+	return XR->generic ? "generic XDP" : "native XDP";
+}
+
+void xdpReflectorFree(xdpReflector XR) {
+	if(CHECK_XR_NULL(XR)) {
+		return;
+	}
+
+	// Closing the bpf_link detaches the XDP program from the interface
+	if(XR->link_fd>=0) close(XR->link_fd);
+	if(XR->prog_fd>=0) close(XR->prog_fd);
+	if(XR->map_fd>=0) close(XR->map_fd);
+
+	free(XR);
+}